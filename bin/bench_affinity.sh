@@ -0,0 +1,48 @@
+#!/bin/bash
+# Compare the p99 latency of httpd with and without CPU pinning.
+# Require wrk(https://github.com/wg/wrk).
+#
+# Usage: ./bench_affinity.sh thread_num cpu_list [url_path]
+# e.g.   ./bench_affinity.sh 4 1-4 /html/index.html
+if [ $# -lt 2 ];
+then
+  echo "Usage: ./bench_affinity.sh thread_num cpu_list [url_path]"
+  exit 1
+fi
+
+thread_num="$1"
+cpus="$2"
+url_path="${3:-/html/index.html}"
+port=8080
+duration=30s
+connections=256
+
+# --cpus accepts a list of CPU numbers
+cpu_args=$(echo "$cpus" | awk -F, '{
+  for (i = 1; i <= NF; ++i) {
+    n = split($i, range, "-")
+    if (n == 1) printf("%s ", range[1])
+    else for (c = range[1]; c <= range[2]; ++c) printf("%d ", c)
+  }
+}')
+
+run() {
+  local name="$1"
+  shift
+
+  ./httpd -p $port -t "$thread_num" "$@" > /dev/null 2>&1 &
+  local pid=$!
+  sleep 1
+
+  # Warm up the file cache and connections
+  wrk -t 2 -c $connections -d 5s "http://127.0.0.1:$port$url_path" > /dev/null
+  local p99=$(wrk -t 2 -c $connections -d $duration --latency "http://127.0.0.1:$port$url_path" \
+              | awk '$1 == "99%" { print $2 }')
+
+  kill $pid
+  wait $pid 2> /dev/null
+  printf "%-10s p99 = %s\n" "$name" "$p99"
+}
+
+run "unpinned"
+run "pinned" --acceptor_cpu 0 --cpus $cpu_args
@@ -9,43 +9,31 @@
 #include "common/http_response.h"
 
 #include "util/cgi_parse.h"
+#include "util/cgi_worker.h"
 
 using namespace std;
 using namespace cgi;
 using namespace http;
 using namespace kanon;
 
-int main()
+/**
+ * \param query The query string or form body starts with '?'
+ */
+static void Add(StringView query, std::string& output)
 {
-  auto method = ::getenv("REQUEST_METHOD");
   int num1 = 0, num2 = 0;
 
-  if (method != NULL) {
-    if (::strcmp(method, "GET") == 0) {
-      auto query = ::getenv("QUERY_STRING");
-      auto args_map = ParseQueryString(query);     
-
-
-      auto iter = args_map.find("num1");
-      if (iter != args_map.end()) {
-        num1 = ::atoi(iter->second.c_str());
-      }
+  if (query.size() > 1) {
+    auto args_map = ParseQueryString(query);
 
-      iter = args_map.find("num2");
-      if (iter != args_map.end()) {
-        num2 = ::atoi(iter->second.c_str());
-      }
+    auto iter = args_map.find("num1");
+    if (iter != args_map.end()) {
+      num1 = ::atoi(iter->second.c_str());
     }
-    else if (::strcmp(method, "POST") == 0) {
-      size_t len = ::atoll(::getenv("CONTENT_LENGTH"));
 
-      std::string content;
-      content.reserve(len);
-      size_t n = ::fread(&content[0], 1, len, stdin);
-      KANON_UNUSED(n);
-      assert(n == len);
-
-      ::fwrite(content.data(), 1, len, stdout);
+    iter = args_map.find("num2");
+    if (iter != args_map.end()) {
+      num2 = ::atoi(iter->second.c_str());
     }
   }
 
@@ -59,12 +47,58 @@ int main()
           .AddBody("<title>adder</title>")
           .AddBody("<body bgcolor=\"#ffffff\">")
           .AddBody("Welcome to add.com\r\n")
-          .AddBody(buf, "<p>The answer is: %d + %d = %d</p>\r\n", num1, num2, num1+num2)
+          .AddBody(buf, sizeof buf, "<p>The answer is: %d + %d = %d</p>\r\n", num1, num2, num1+num2)
           .AddBody("<p>Thanks for visiting!</p>\r\n")
           .AddBody("</body>")
           .AddBody("</html>\r\n");
 
   auto buffer = response.GetBuffer().ToStringView();
-  ::fwrite(buffer.begin(), 1, buffer.size(), stdout);
+  output.append(buffer.data(), buffer.size());
+}
+
+static void ServeRequest(StringView method, StringView query, StringView input, std::string& output)
+{
+  if (method == "POST") {
+    std::string body = "?";
+    body.append(input.data(), input.size());
+    Add(body, output);
+  }
+  else {
+    Add(query, output);
+  }
+}
+
+int main()
+{
+  // Spawned by the worker pool, serve the requests until it is stopped
+  if (IsPersistentWorker()) {
+    return RunPersistentWorker([](CgiRequest const& request, std::string& output) {
+      ServeRequest(request.GetParam("REQUEST_METHOD"),
+                   request.GetParam("QUERY_STRING"),
+                   request.input, output);
+    });
+  }
+
+  auto method = ::getenv("REQUEST_METHOD");
+
+  if (method == NULL) {
+    return 1;
+  }
+
+  std::string input;
+  std::string output;
+  auto query = ::getenv("QUERY_STRING");
+
+  if (::strcmp(method, "POST") == 0) {
+    size_t len = ::atoll(::getenv("CONTENT_LENGTH"));
+
+    input.resize(len);
+    size_t n = ::fread(&input[0], 1, len, stdin);
+    input.resize(n);
+  }
+
+  ServeRequest(method, query ? query : "", input, output);
+
+  ::fwrite(output.data(), 1, output.size(), stdout);
   ::fflush(stdout);
 }
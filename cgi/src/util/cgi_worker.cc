@@ -0,0 +1,112 @@
+#include "cgi_worker.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/cgi_codec.h"
+
+using namespace kanon;
+using namespace http;
+
+namespace cgi {
+
+StringView CgiRequest::GetParam(StringView name) const noexcept
+{
+  StringView value;
+  CgiCodec::GetParam(params, name, value);
+  return value;
+}
+
+bool IsPersistentWorker() noexcept
+{
+  auto persistent = ::getenv("KANON_CGI_PERSISTENT");
+  return persistent && ::strcmp(persistent, "1") == 0;
+}
+
+static bool WriteAll(int fd, char const* data, size_t len)
+{
+  while (len > 0) {
+    auto writen = ::write(fd, data, len);
+
+    if (writen < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    data += writen;
+    len -= writen;
+  }
+
+  return true;
+}
+
+int RunPersistentWorker(CgiHandler handler)
+{
+  std::string buffer;
+  std::string output;
+  std::string records;
+  CgiRequest request;
+  char buf[1 << 16];
+
+  for (;;) {
+    auto readn = ::read(STDIN_FILENO, buf, sizeof buf);
+
+    if (readn < 0) {
+      if (errno == EINTR) continue;
+      return EXIT_FAILURE;
+    }
+
+    // The server closes the pipe to stop the worker
+    if (readn == 0) {
+      return EXIT_SUCCESS;
+    }
+
+    buffer.append(buf, readn);
+
+    StringView data(buffer);
+    CgiCodec::RecordType type;
+    StringView content;
+    size_t consumed = 0;
+    CgiCodec::Result result;
+
+    while ((result = CgiCodec::Parse(data, type, content, consumed)) == CgiCodec::kGood) {
+      data.remove_prefix(consumed);
+
+      switch (type) {
+        case CgiCodec::kParams:
+          request.params.append(content.data(), content.size());
+          break;
+        case CgiCodec::kStdin:
+          request.input.append(content.data(), content.size());
+          break;
+        case CgiCodec::kEnd:
+          output.clear();
+          handler(request, output);
+
+          records.clear();
+          CgiCodec::Append(records, CgiCodec::kStdout, output);
+          CgiCodec::Append(records, CgiCodec::kEnd, StringView());
+
+          if (!WriteAll(STDOUT_FILENO, records.data(), records.size())) {
+            return EXIT_FAILURE;
+          }
+
+          request.params.clear();
+          request.input.clear();
+          break;
+        default:
+          return EXIT_FAILURE;
+      }
+    }
+
+    if (result == CgiCodec::kBad) {
+      return EXIT_FAILURE;
+    }
+
+    buffer.erase(0, buffer.size() - data.size());
+  }
+}
+
+} // namespace cgi
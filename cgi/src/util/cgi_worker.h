@@ -0,0 +1,42 @@
+#ifndef KANON_CGI_WORKER_H
+#define KANON_CGI_WORKER_H
+
+#include <functional>
+#include <string>
+
+#include "kanon/string/string_view.h"
+
+namespace cgi {
+
+/**
+ * The request received by the persistent worker
+ */
+struct CgiRequest {
+  /** \see http::CgiCodec */
+  std::string params;
+  std::string input;
+
+  /** \return The value of \p name, e.g. REQUEST_METHOD, empty if not found */
+  kanon::StringView GetParam(kanon::StringView name) const noexcept;
+};
+
+/**
+ * \param output The response written to stdout in the legacy mode
+ */
+using CgiHandler = std::function<void(CgiRequest const& request, std::string& output)>;
+
+/**
+ * \return true if the server runs it as a persistent worker,
+ *         otherwise it serves one request by the environment variables
+ */
+bool IsPersistentWorker() noexcept;
+
+/**
+ * Serve the framed requests from stdin until the server closes it.
+ * \return The exit status
+ */
+int RunPersistentWorker(CgiHandler handler);
+
+} // namespace cgi
+
+#endif // KANON_CGI_WORKER_H
@@ -1,6 +1,5 @@
 #include "common/http_response.h"
-#include "common/parse_args.h"
-#include "plugin/http_dynamic_response_interface.h"
+#include "plugin/static_plugin.h"
 
 using namespace http;
 
@@ -9,8 +8,10 @@ class Adder : public HttpDynamicResponseInterface {
   Adder() = default;
   ~Adder() = default;
 
-  void GenResponseForGet(const ArgsMap &args, HttpResponse& response) override
+  // The arguments of query and form body are parsed by the server
+  void GenResponse(RequestView const& request, HttpResponse& response) override
   {
+    auto const& args = request.GetArgs();
     int a = 0;
     int b = 0;
 
@@ -36,20 +37,20 @@ class Adder : public HttpDynamicResponseInterface {
             .AddBody("</body>")
             .AddBody("</html>\r\n");
 
-    conn_->Send(response.GetBuffer());
+    // Sent by the server since it is cacheable
   }
 
-  void GenResponseForPost(const std::string &body, HttpResponse& response) override
-  {
-    auto args = ParseArgs(body);
+  // No state, the instance can be reused
+  bool IsReusable() const override { return true; }
 
-    return GenResponseForGet(args, response);    
+  // The answer never changes
+  CachePolicy GetCachePolicy() const override
+  {
+    CachePolicy policy;
+    policy.ttl_ms = 60 * 1000;
+    policy.stale_ms = 10 * 1000;
+    return policy;
   }
 };
 
-extern "C" {
-  HttpDynamicResponseInterface* CreateObject()
-  {
-    return new Adder();
-  }
-}
+KANON_PLUGIN(adder, Adder)
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/parse_args.h"
+#include "plugin/static_plugin.h"
+
+using namespace http;
+
+/**
+ * Stream a large report in constant memory,
+ * e.g. /contents/report?rows=1000000
+ */
+class Report : public HttpDynamicResponseInterface {
+ public:
+  Report() = default;
+  ~Report() = default;
+
+  bool IsStreaming() const override { return true; }
+
+  void GenResponseForGet(const ArgsMap &args, HttpResponse& response) override
+  {
+    KANON_UNUSED(args);
+    KANON_UNUSED(response);
+  }
+
+  void GenResponseForPost(const std::string &body, HttpResponse& response) override
+  {
+    KANON_UNUSED(body);
+    KANON_UNUSED(response);
+  }
+
+  void StreamResponseForGet(const ArgsMap &args, ResponseWriter& writer) override
+  {
+    auto iter = args.find("rows");
+    rows_ = iter != args.end() ? ::atol(iter->second.c_str()) : 1000;
+    writer_ = &writer;
+
+    writer.AddHeader("Content-Type", "text/csv");
+    writer.WriteHead(HttpStatusCode::k200OK);
+    writer.SetDrainCallback([this]() { WriteRows(); });
+    WriteRows();
+  }
+
+  void StreamResponseForPost(const std::string &body, ResponseWriter& writer) override
+  {
+    StreamResponseForGet(ParseArgs(body), writer);
+  }
+
+ private:
+  // Write until the output buffer is congested
+  void WriteRows()
+  {
+    char line[128];
+
+    while (cur_ < rows_) {
+      const int n = ::snprintf(line, sizeof line, "%ld,%ld\n", cur_, cur_ * cur_);
+      ++cur_;
+
+      if (!writer_->Write(kanon::StringView(line, n))) {
+        return;
+      }
+    }
+
+    writer_->End();
+  }
+
+  ResponseWriter* writer_ = nullptr;
+  long rows_ = 0;
+  long cur_ = 0;
+};
+
+KANON_PLUGIN(report, Report)
@@ -0,0 +1,99 @@
+#include "common/cgi_codec.h"
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+constexpr uint8_t CgiCodec::kVersion;
+constexpr size_t CgiCodec::kHeaderSize;
+constexpr size_t CgiCodec::kMaxContentSize;
+
+static void AppendRecord(std::string& out, CgiCodec::RecordType type, StringView content)
+{
+  const auto len = static_cast<uint32_t>(content.size());
+
+  char header[CgiCodec::kHeaderSize] = {
+    static_cast<char>(CgiCodec::kVersion),
+    static_cast<char>(type),
+    0, 0,
+    static_cast<char>(len >> 24),
+    static_cast<char>(len >> 16),
+    static_cast<char>(len >> 8),
+    static_cast<char>(len),
+  };
+
+  out.append(header, sizeof header);
+  out.append(content.data(), content.size());
+}
+
+void CgiCodec::Append(std::string& out, RecordType type, StringView content)
+{
+  // The empty record is meaningful, e.g. kEnd
+  do {
+    const auto len = std::min(content.size(), kMaxContentSize);
+    AppendRecord(out, type, content.substr(0, len));
+    content.remove_prefix(len);
+  } while (!content.empty());
+}
+
+void CgiCodec::AppendParam(std::string& params, StringView name, StringView value)
+{
+  params.append(name.data(), name.size());
+  params += '=';
+  params.append(value.data(), value.size());
+  params += '\0';
+}
+
+auto CgiCodec::Parse(StringView data, RecordType& type,
+                     StringView& content, size_t& consumed) noexcept -> Result
+{
+  if (data.size() < kHeaderSize) {
+    return kShort;
+  }
+
+  auto header = reinterpret_cast<unsigned char const*>(data.data());
+
+  if (header[0] != kVersion || header[1] < kParams || header[1] > kEnd) {
+    return kBad;
+  }
+
+  const uint32_t len = (uint32_t(header[4]) << 24) | (uint32_t(header[5]) << 16) |
+                       (uint32_t(header[6]) << 8) | uint32_t(header[7]);
+
+  if (len > kMaxContentSize) {
+    return kBad;
+  }
+
+  if (data.size() < kHeaderSize + len) {
+    return kShort;
+  }
+
+  type = static_cast<RecordType>(header[1]);
+  content = data.substr(kHeaderSize, len);
+  consumed = kHeaderSize + len;
+  return kGood;
+}
+
+bool CgiCodec::GetParam(StringView params, StringView name, StringView& value) noexcept
+{
+  while (!params.empty()) {
+    auto end_pos = params.find('\0');
+    auto param = params.substr(0, end_pos);
+
+    if (param.size() > name.size() && param[name.size()] == '=' &&
+        param.starts_with(name)) {
+      value = param.substr(name.size() + 1);
+      return true;
+    }
+
+    if (end_pos == StringView::npos) break;
+
+    params.remove_prefix(end_pos + 1);
+  }
+
+  return false;
+}
+
+} // namespace http
@@ -0,0 +1,66 @@
+#ifndef KANON_HTTP_CGI_CODEC_H
+#define KANON_HTTP_CGI_CODEC_H
+
+#include <stdint.h>
+#include <string>
+
+#include <kanon/string/string_view.h>
+
+namespace http {
+
+/**
+ * The framing between the server and the persistent CGI workers.
+ *
+ * It is a simplified FastCGI: a worker serves one request at a time
+ * over its stdin and stdout, so the request id and padding are dropped.
+ * Each record is a 8 bytes header followed by the content:
+ *
+ * | version(1) | type(1) | reserved(2) | content length(4, big endian) |
+ *
+ * The server sends kParams, kStdin..., kEnd per request and the
+ * worker replies kStdout..., kEnd. The params are name=value pairs
+ * terminated by '\0', e.g. REQUEST_METHOD=GET.
+ */
+class CgiCodec {
+ public:
+  enum RecordType : uint8_t {
+    kParams = 1,
+    kStdin,
+    kStdout,
+    kEnd,
+  };
+
+  enum Result {
+    kGood = 0,
+    kShort, /** Need more data */
+    kBad, /** Invalid version or type */
+  };
+
+  static constexpr uint8_t kVersion = 1;
+  static constexpr size_t kHeaderSize = 8;
+  /** The larger content is split into multiple records */
+  static constexpr size_t kMaxContentSize = 1 << 16;
+
+  /** Append the records of \p content to \p out */
+  static void Append(std::string& out, RecordType type, kanon::StringView content);
+
+  /** Append name=value to the content of params */
+  static void AppendParam(std::string& params, kanon::StringView name, kanon::StringView value);
+
+  /**
+   * Parse a record at the beginning of \p data
+   * \param consumed The size of the record if kGood
+   */
+  static Result Parse(kanon::StringView data, RecordType& type,
+                      kanon::StringView& content, size_t& consumed) noexcept;
+
+  /**
+   * \return true if \p name is found in \p params
+   */
+  static bool GetParam(kanon::StringView params, kanon::StringView name,
+                       kanon::StringView& value) noexcept;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_CGI_CODEC_H
@@ -46,6 +46,7 @@ http_status_code[] = {
   415,
   500,
   501,
+  502,
   503,
   505
 };
@@ -70,6 +71,7 @@ http_status_code_strings[] = {
   "Unsupported MediaType",
   "Internal ServerError",
   "Not Implemeted",
+  "Bad Gateway",
   "Server Unavailable",
   "Http Version Not Supported",
 };
@@ -50,6 +50,7 @@ enum class HttpStatusCode {
   k415UnsupportedMediaType,
   k500InternalServerError,
   k501NotImplemeted,
+  k502BadGateway,
   k503ServerUnavailable,
   k505HttpVersionNotSupported,
   kNum,
@@ -9,7 +9,9 @@ namespace http {
 
 Buffer& HttpResponse::GetBuffer() 
 {
-  if (!known_length_) {
+  if (!known_length_ && !rendered_) {
+    rendered_ = true;
+
     if (body_.size() != 0) {
       char buf[128];
       MemoryZero(buf);
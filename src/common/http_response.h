@@ -43,6 +43,20 @@ public:
     return AddHeaderLine(code, HttpVersion::kHttp11);    
   }
 
+  /**
+   * The status not in HttpStatusCode, e.g. forwarded from
+   * the FastCGI application.
+   */
+  Self& AddHeaderLine(int code, kanon::StringView reason, HttpVersion ver) {
+    char buf[32];
+    AddVersion(ver);
+    ::snprintf(buf, sizeof buf, " %d ", code);
+    buffer_.Append(static_cast<char const*>(buf));
+    buffer_.Append(reason.data(), reason.size());
+    buffer_.Append("\r\n");
+    return *this;
+  }
+
   /**
    * Add header in response line
    * including its field and content.
@@ -139,7 +153,28 @@ public:
     return AddChunk(data.data(), data.size());
   }
 
+  /**
+   * Clear the contents to construct another response.
+   * The capacity of buffers is kept, used by the object pool.
+   */
+  void Reset(const bool known_length = false) noexcept {
+    buffer_.AdvanceAll();
+    body_.clear();
+    known_length_ = known_length;
+    chunked = false;
+    rendered_ = false;
+  }
+
   size_t GetBodySize() const noexcept { return body_.size(); }
+
+  /** The Content-Type of the file extension */
+  static char const* GetFileType(kanon::StringView filename);
+
+  /**
+   * Get the whole response.
+   * If the length is unknown, the Content-Length and body are
+   * appended in the first call.
+   */
   kanon::Buffer& GetBuffer();
 
 private:
@@ -168,12 +203,13 @@ private:
   }
 
   static std::string Dec2Hex(size_t num);
-  static char const* GetFileType(kanon::StringView filename);
 
   kanon::Buffer buffer_;
   std::vector<char> body_;
   bool known_length_ = false;
   bool chunked = false;
+  /** The body of unknown length is appended to the buffer once */
+  bool rendered_ = false;
 };
 
 HttpResponse GetClientError(
@@ -7,7 +7,13 @@
 
 namespace http {
 
-ArgsMap ParseArgs(kanon::StringView query);
+/**
+ * Parse the query string or form body(application/x-www-form-urlencoded)
+ * to key-value pairs, the keys and values are percent-decoded.
+ * \param arena The arguments are allocated from it if not null
+ * \see QueryArgs
+ */
+ArgsMap ParseArgs(kanon::StringView query, Arena* arena = nullptr);
 
 }
 #endif
\ No newline at end of file
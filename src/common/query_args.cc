@@ -0,0 +1,137 @@
+#include "common/query_args.h"
+
+#include <string.h>
+
+using namespace kanon;
+
+namespace http {
+
+// The own arena only serves a query or body
+static constexpr size_t kOwnArenaBlockSize = 512;
+
+static inline int HexToInt(char c) noexcept
+{
+  if (c >= '0' && c <= '9') return c - '0';
+
+  c |= 0x20; // to lower case letter
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+
+  return -1;
+}
+
+QueryArgs::QueryArgs(Arena* arena)
+  : arena_(arena)
+  , args_(ArenaAllocator<value_type>(arena))
+{
+}
+
+QueryArgs::~QueryArgs() noexcept = default;
+
+char* QueryArgs::Allocate(size_t size)
+{
+  if (!arena_) {
+    own_arena_.reset(new Arena(kOwnArenaBlockSize));
+    arena_ = own_arena_.get();
+  }
+
+  return static_cast<char*>(arena_->Allocate(size, 1));
+}
+
+size_t QueryArgs::Decode(char* data, size_t len) noexcept
+{
+  char* out = data;
+
+  for (size_t i = 0; i < len; ++i) {
+    const char c = data[i];
+
+    if (c == '+') {
+      *out++ = ' ';
+    }
+    else if (c == '%' && i + 2 < len && HexToInt(data[i+1]) >= 0 && HexToInt(data[i+2]) >= 0) {
+      *out++ = static_cast<char>((HexToInt(data[i+1]) << 4) | HexToInt(data[i+2]));
+      i += 2;
+    }
+    else {
+      *out++ = c;
+    }
+  }
+
+  return out - data;
+}
+
+void QueryArgs::Parse(StringView query)
+{
+  if (query.empty()) return;
+
+  // One more byte for the NUL of the last value
+  char* buf = Allocate(query.size() + 1);
+  ::memcpy(buf, query.data(), query.size());
+  buf[query.size()] = '&';
+
+  size_t num = 1;
+  for (auto c : query) {
+    if (c == '&') ++num;
+  }
+
+  args_.reserve(args_.size() + num);
+
+  char* const end = buf + query.size() + 1;
+  char* arg = buf;
+
+  while (arg < end) {
+    auto and_pos = static_cast<char*>(::memchr(arg, '&', end - arg));
+
+    if (and_pos != arg) {
+      auto equal_pos = static_cast<char*>(::memchr(arg, '=', and_pos - arg));
+      char* key_end = equal_pos ? equal_pos : and_pos;
+      char* val = equal_pos ? equal_pos + 1 : and_pos;
+
+      // The separators are replaced by NUL
+      const auto key_len = Decode(arg, key_end - arg);
+      arg[key_len] = 0;
+
+      const auto val_len = Decode(val, and_pos - val);
+      val[val_len] = 0;
+
+      args_.emplace_back(ArgView(arg, key_len), ArgView(val, val_len));
+    }
+
+    arg = and_pos + 1;
+  }
+}
+
+void QueryArgs::Set(StringView key, StringView value)
+{
+  char* buf = Allocate(key.size() + value.size() + 2);
+
+  ::memcpy(buf, key.data(), key.size());
+  buf[key.size()] = 0;
+
+  char* val = buf + key.size() + 1;
+  ::memcpy(val, value.data(), value.size());
+  val[value.size()] = 0;
+
+  ArgView new_val(val, value.size());
+
+  for (auto& arg : args_) {
+    if (arg.first == key) {
+      arg.second = new_val;
+      return;
+    }
+  }
+
+  args_.emplace_back(ArgView(buf, key.size()), new_val);
+}
+
+auto QueryArgs::find(StringView key) const noexcept -> const_iterator
+{
+  for (auto iter = args_.begin(); iter != args_.end(); ++iter) {
+    if (iter->first == key) {
+      return iter;
+    }
+  }
+
+  return args_.end();
+}
+
+} // namespace http
@@ -0,0 +1,109 @@
+#ifndef KANON_HTTP_QUERY_ARGS_H
+#define KANON_HTTP_QUERY_ARGS_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+
+#include "util/arena.h"
+
+namespace http {
+
+/**
+ * The key or value of argument.
+ * It is decoded in the buffer of QueryArgs and NUL-terminated,
+ * so it can be passed to the C functions, e.g. atoi(arg.c_str()).
+ */
+class ArgView : public kanon::StringView {
+ public:
+  ArgView() = default;
+
+  ArgView(char const* data, size_t len) noexcept
+    : kanon::StringView(data, len)
+  {
+  }
+
+  char const* c_str() const noexcept { return data(); }
+  std::string ToString() const { return std::string(data(), size()); }
+};
+
+/**
+ * The arguments of query string or form body
+ * (application/x-www-form-urlencoded).
+ *
+ * The source is copied once to the arena, then the keys and values
+ * are decoded(%XX and +) and split in place. The arguments are views
+ * stored in a flat vector, so parsing doesn't allocate per argument
+ * and a lookup is a linear scan which beats hashing for the usual
+ * handful of arguments.
+ *
+ * It is movable but not copyable, the views refer to its buffer.
+ */
+class QueryArgs {
+ public:
+  using value_type = std::pair<ArgView, ArgView>;
+  using Container = std::vector<value_type, ArenaAllocator<value_type>>;
+  using const_iterator = Container::const_iterator;
+  using iterator = const_iterator;
+
+  /**
+   * \param arena The buffer and views are allocated from it,
+   *              use the own one if null
+   */
+  explicit QueryArgs(Arena* arena = nullptr);
+  ~QueryArgs() noexcept;
+
+  QueryArgs(QueryArgs&& other) noexcept = default;
+  QueryArgs& operator=(QueryArgs&& other) noexcept = default;
+
+  /**
+   * Append the arguments of \p query, e.g. a=1&b=hello+world%21
+   * The empty arguments are skipped and the invalid percent-encoding
+   * is kept as is.
+   */
+  void Parse(kanon::StringView query);
+
+  /**
+   * Set the value of \p key which is not encoded,
+   * e.g. the parameters of route
+   */
+  void Set(kanon::StringView key, kanon::StringView value);
+
+  /** \return The first argument of \p key */
+  const_iterator find(kanon::StringView key) const noexcept;
+
+  /** \return The value of \p key, \p default_val if not found */
+  ArgView Get(kanon::StringView key, ArgView default_val = ArgView()) const noexcept
+  {
+    auto iter = find(key);
+    return iter != end() ? iter->second : default_val;
+  }
+
+  const_iterator begin() const noexcept { return args_.begin(); }
+  const_iterator end() const noexcept { return args_.end(); }
+  size_t size() const noexcept { return args_.size(); }
+  bool empty() const noexcept { return args_.empty(); }
+
+  Arena* GetArena() const noexcept { return arena_; }
+
+  /**
+   * Decode %XX and + in place.
+   * \return The size of decoded string
+   */
+  static size_t Decode(char* data, size_t len) noexcept;
+
+ private:
+  char* Allocate(size_t size);
+
+  Arena* arena_;
+  /** Used if no arena is given, e.g. the arguments parsed by plugins */
+  std::unique_ptr<Arena> own_arena_;
+  Container args_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_QUERY_ARGS_H
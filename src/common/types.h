@@ -1,13 +1,60 @@
 #ifndef KANON_HTTP_TYPES_H
 #define KANON_HTTP_TYPES_H
 
+#include <functional>
+#include <string>
 #include <unordered_map>
 
+#include <kanon/string/string_view.h>
+
+#include "common/query_args.h"
+#include "util/arena.h"
+
 namespace http {
 
 using HeaderMap = std::unordered_map<std::string, std::string>;
 using HeaderType = HeaderMap::value_type;
-using ArgsMap = std::unordered_map<std::string, std::string>;
+
+/**
+ * The string allocated from the arena of session.
+ * If the arena is null, it is same as std::string.
+ */
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+/**
+ * FNV-1a hash, std::hash is only specialized for std::string
+ */
+struct ArenaStringHash {
+  size_t operator()(ArenaString const& str) const noexcept
+  {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (auto c : str) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ULL;
+    }
+
+    return static_cast<size_t>(hash);
+  }
+};
+
+template<typename V>
+using ArenaStringMap = std::unordered_map<
+  ArenaString, V, ArenaStringHash, std::equal_to<ArenaString>,
+  ArenaAllocator<std::pair<ArenaString const, V>>>;
+
+/** Header fields of the request, allocated from the arena */
+using ArenaHeaderMap = ArenaStringMap<ArenaString>;
+
+/**
+ * The query arguments passed to plugins.
+ * Plugins can also construct it without arena, e.g. ParseArgs(body).
+ * The name is kept for the existing plugins, it isn't a hash map.
+ */
+using ArgsMap = QueryArgs;
+
+inline kanon::StringView ToStringView(ArenaString const& str) noexcept
+{ return kanon::StringView(str.data(), str.size()); }
 
 } // namespace http
 
@@ -36,15 +36,15 @@ void ConfigDescriptor::Read()
     }
 
     if (colon_pos != std::string::npos) {
-      // Read config field
-      auto space_pos = line.find(' ', colon_pos+2);
-
-      if (space_pos != std::string::npos) {
-        paras_.emplace(line.substr(0, colon_pos), line.substr(colon_pos+2, space_pos));
-      }
-      else {
-        paras_.emplace(line.substr(0, colon_pos), line.substr(colon_pos+2));
-      }
+      // Read config field, the value may contain spaces, e.g. Route
+      auto key = line.substr(0, colon_pos);
+      auto value = colon_pos+2 < line.size() ? line.substr(colon_pos+2) : std::string();
+
+      auto last = value.find_last_not_of(" \t\r");
+      value.erase(last == std::string::npos ? 0 : last+1);
+
+      para_lists_[key].push_back(value);
+      paras_.emplace(std::move(key), std::move(value));
     }
   }
 
@@ -65,4 +65,16 @@ ConfigDescriptor::GetParameter(std::string const& key)
   return kanon::make_optional(std::move(iter->second));
 }
 
+std::vector<std::string>
+ConfigDescriptor::GetParameterList(std::string const& key)
+{
+  auto iter = para_lists_.find(key);
+
+  if (iter == std::end(para_lists_)) {
+    return {};
+  }
+
+  return std::move(iter->second);
+}
+
 } // namespace config
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define KANON_CONFIG_DESCRIPTOR_H
 
 #include <unordered_map>
+#include <vector>
 
 #include <kanon/util/noncopyable.h>
 #include <kanon/string/string_view.h>
@@ -13,6 +14,7 @@ namespace config {
 
 class ConfigDescriptor : kanon::noncopyable {
   using ParameterMap = std::unordered_map<std::string, std::string>;
+  using ParameterListMap = std::unordered_map<std::string, std::vector<std::string>>;
 public:
   explicit ConfigDescriptor(kanon::StringView const& filename);
   ~ConfigDescriptor() noexcept;
@@ -20,6 +22,12 @@ public:
   void Read();
   kanon::optional<std::string> GetParameter(std::string const& key);
 
+  /**
+   * Get all values of the \p key which can be repeated, e.g. Route.
+   * GetParameter() only returns the first one.
+   */
+  std::vector<std::string> GetParameterList(std::string const& key);
+
   // For debugging
   ParameterMap const& GetParameters() const noexcept
   { return paras_; }
@@ -28,6 +36,7 @@ private:
   http::File file_;
   std::string filename_;
   ParameterMap paras_;
+  ParameterListMap para_lists_;
 };
 
 } // namespace config
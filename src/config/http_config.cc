@@ -1,8 +1,11 @@
 #include "http_config.h"
 
+#include <stdlib.h>
+
 #include <kanon/log/logger.h>
 
 #include "config/config_descriptor.h"
+#include "unix/affinity.h"
 
 using namespace config;
 
@@ -26,6 +29,24 @@ static void SetBoolParameter(kanon::optional<std::string> const& val, bool& para
   }
 }
 
+static void SetIntParameter(kanon::optional<std::string> const& val, int& para)
+{
+  if (val) {
+    para = ::atoi(val->c_str());
+  }
+}
+
+static void SetCpuListParameter(kanon::optional<std::string> const& val, std::vector<int>& para)
+{
+  if (val) {
+    para.clear();
+    if (!unix::ParseCpuList(val->c_str(), para)) {
+      LOG_ERROR << "Invalid CPU list: " << *val;
+      para.clear();
+    }
+  }
+}
+
 void SetConfigParameters(const std::string &config_name)
 {
   ConfigDescriptor cd(config_name);
@@ -37,12 +58,79 @@ void SetConfigParameters(const std::string &config_name)
   SetStringParameter(cd.GetParameter("Host"), g_config.hostname);
   SetStringParameter(cd.GetParameter("RootPath"), g_config.root_path);
   SetBoolParameter(cd.GetParameter("UseMmap"), g_config.use_mmap);
+  SetIntParameter(cd.GetParameter("MaxConnections"), g_config.max_connections);
+  SetIntParameter(cd.GetParameter("MaxConnectionsPerLoop"), g_config.max_connections_per_loop);
+  SetIntParameter(cd.GetParameter("ShedInflightRequests"), g_config.shed_inflight_requests);
+  SetIntParameter(cd.GetParameter("ShedLoopLagMs"), g_config.shed_loop_lag_ms);
+  SetIntParameter(cd.GetParameter("RetryAfter"), g_config.retry_after);
+  SetIntParameter(cd.GetParameter("HighWaterMark"), g_config.high_water_mark);
+  SetIntParameter(cd.GetParameter("MaxConnectionBuffer"), g_config.max_connection_buffer);
+  SetIntParameter(cd.GetParameter("DrainTimeout"), g_config.drain_timeout);
+  SetIntParameter(cd.GetParameter("IdleBufferSize"), g_config.idle_buffer_size);
+  SetStringParameter(cd.GetParameter("StatusPath"), g_config.status_path);
+  SetCpuListParameter(cd.GetParameter("CpuAffinity"), g_config.cpu_affinity);
+  SetIntParameter(cd.GetParameter("AcceptorCpu"), g_config.acceptor_cpu);
+  SetBoolParameter(cd.GetParameter("PluginHotReload"), g_config.plugin_hot_reload);
+  SetIntParameter(cd.GetParameter("PluginWorkerThreads"), g_config.plugin_worker_threads);
+  SetIntParameter(cd.GetParameter("PluginQueueSize"), g_config.plugin_queue_size);
+  SetIntParameter(cd.GetParameter("PluginCacheSize"), g_config.plugin_cache_size);
+  SetIntParameter(cd.GetParameter("FastCgiMaxConnections"), g_config.fastcgi_max_connections);
+  SetIntParameter(cd.GetParameter("FastCgiMaxRequests"), g_config.fastcgi_max_requests);
+  SetIntParameter(cd.GetParameter("FastCgiQueueSize"), g_config.fastcgi_queue_size);
+  SetStringParameter(cd.GetParameter("ProxyBalance"), g_config.proxy_balance);
+  SetIntParameter(cd.GetParameter("ProxyMaxIdleConnections"), g_config.proxy_max_idle_connections);
+  SetIntParameter(cd.GetParameter("ProxyMaxFails"), g_config.proxy_max_fails);
+  SetIntParameter(cd.GetParameter("ProxyFailTimeout"), g_config.proxy_fail_timeout);
+  SetIntParameter(cd.GetParameter("ProxyMaxBuffer"), g_config.proxy_max_buffer);
+  SetBoolParameter(cd.GetParameter("EnableHttp2"), g_config.enable_http2);
+  SetIntParameter(cd.GetParameter("Http2MaxConcurrentStreams"), g_config.http2_max_concurrent_streams);
+  SetStringParameter(cd.GetParameter("TlsCertificate"), g_config.tls_certificate);
+  SetStringParameter(cd.GetParameter("TlsPrivateKey"), g_config.tls_private_key);
+  SetIntParameter(cd.GetParameter("TlsSessionTimeout"), g_config.tls_session_timeout);
+  SetBoolParameter(cd.GetParameter("TlsKernelOffload"), g_config.tls_kernel_offload);
+  SetIntParameter(cd.GetParameter("WebSocketMaxMessageSize"), g_config.websocket_max_message_size);
+  g_config.routes = cd.GetParameterList("Route");
 
   LOG_INFO << "The configuration file has been parsed";
   LOG_INFO << "[HomePagePath: " << g_config.homepage_path << "]";
   LOG_INFO << "[Host: " << g_config.hostname << "]";
   LOG_INFO << "[RootPath: " << g_config.root_path << "]";
   LOG_INFO << "[UseMmap: " << g_config.use_mmap << "]";
+  LOG_INFO << "[MaxConnections: " << g_config.max_connections << "]";
+  LOG_INFO << "[MaxConnectionsPerLoop: " << g_config.max_connections_per_loop << "]";
+  LOG_INFO << "[ShedInflightRequests: " << g_config.shed_inflight_requests << "]";
+  LOG_INFO << "[ShedLoopLagMs: " << g_config.shed_loop_lag_ms << "]";
+  LOG_INFO << "[RetryAfter: " << g_config.retry_after << "]";
+  LOG_INFO << "[HighWaterMark: " << g_config.high_water_mark << "]";
+  LOG_INFO << "[MaxConnectionBuffer: " << g_config.max_connection_buffer << "]";
+  LOG_INFO << "[DrainTimeout: " << g_config.drain_timeout << "]";
+  LOG_INFO << "[IdleBufferSize: " << g_config.idle_buffer_size << "]";
+  LOG_INFO << "[StatusPath: " << g_config.status_path << "]";
+  LOG_INFO << "[CpuAffinity: " << g_config.cpu_affinity.size() << " CPUs]";
+  LOG_INFO << "[AcceptorCpu: " << g_config.acceptor_cpu << "]";
+  LOG_INFO << "[PluginHotReload: " << g_config.plugin_hot_reload << "]";
+  LOG_INFO << "[PluginWorkerThreads: " << g_config.plugin_worker_threads << "]";
+  LOG_INFO << "[PluginQueueSize: " << g_config.plugin_queue_size << "]";
+  LOG_INFO << "[PluginCacheSize: " << g_config.plugin_cache_size << "]";
+  LOG_INFO << "[FastCgiMaxConnections: " << g_config.fastcgi_max_connections << "]";
+  LOG_INFO << "[FastCgiMaxRequests: " << g_config.fastcgi_max_requests << "]";
+  LOG_INFO << "[FastCgiQueueSize: " << g_config.fastcgi_queue_size << "]";
+  LOG_INFO << "[ProxyBalance: " << g_config.proxy_balance << "]";
+  LOG_INFO << "[ProxyMaxIdleConnections: " << g_config.proxy_max_idle_connections << "]";
+  LOG_INFO << "[ProxyMaxFails: " << g_config.proxy_max_fails << "]";
+  LOG_INFO << "[ProxyFailTimeout: " << g_config.proxy_fail_timeout << "]";
+  LOG_INFO << "[ProxyMaxBuffer: " << g_config.proxy_max_buffer << "]";
+  LOG_INFO << "[EnableHttp2: " << g_config.enable_http2 << "]";
+  LOG_INFO << "[Http2MaxConcurrentStreams: " << g_config.http2_max_concurrent_streams << "]";
+  LOG_INFO << "[TlsCertificate: " << g_config.tls_certificate << "]";
+  LOG_INFO << "[TlsPrivateKey: " << g_config.tls_private_key << "]";
+  LOG_INFO << "[TlsSessionTimeout: " << g_config.tls_session_timeout << "]";
+  LOG_INFO << "[TlsKernelOffload: " << g_config.tls_kernel_offload << "]";
+  LOG_INFO << "[WebSocketMaxMessageSize: " << g_config.websocket_max_message_size << "]";
+
+  for (auto const& route : g_config.routes) {
+    LOG_INFO << "[Route: " << route << "]";
+  }
 }
 
 } // namespace http
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define KANON_HTTP_CONFIG_H
 
 #include <string>
+#include <vector>
 
 namespace http {
 
@@ -11,6 +12,131 @@ struct HttpConfig {
   std::string hostname;
   std::string homepage_name;
   bool use_mmap;
+
+  /**
+   * Admission control, 0 means unlimited.
+   * In pre-fork mode, MaxConnections is divided among the workers
+   */
+  int max_connections = 0;
+  int max_connections_per_loop = 0;
+  /** Shed new connections if the IO loop has so many requests in progress */
+  int shed_inflight_requests = 0;
+  /** Shed new connections if the IO loop lags behind its timers so long */
+  int shed_loop_lag_ms = 0;
+  /** The value of Retry-After header in the 503 response */
+  int retry_after = 5;
+
+  /**
+   * Stop serving the pipelined requests if the output buffer of
+   * connection reaches it, resume when drained. 0 means disabled
+   */
+  int high_water_mark = 4 << 20;
+  /**
+   * Close the connection if its input or output buffer exceeds it,
+   * e.g. the slow reader. 0 means unlimited
+   */
+  int max_connection_buffer = 64 << 20;
+  /**
+   * Close the connection if the response written by the blocking
+   * plugin is not drained in the seconds. 0 means never
+   */
+  int drain_timeout = 30;
+  /**
+   * Shrink the buffers of connection to it when the response is
+   * complete if they are much larger. 0 means disabled
+   */
+  int idle_buffer_size = 4096;
+
+  /** The URL of the status page, empty means disabled */
+  std::string status_path;
+
+  /** The CPUs which the IO threads are pinned to, e.g. 0-3,8 */
+  std::vector<int> cpu_affinity;
+  /** The CPU which the acceptor(main thread) is pinned to, -1 means not pinned */
+  int acceptor_cpu = -1;
+
+  /**
+   * Watch the directories of loaded plugins and reload the
+   * plugin when its shared object is replaced
+   */
+  bool plugin_hot_reload = false;
+
+  /**
+   * The worker threads running the blocking plugins,
+   * 0 means the blocking plugins run in the IO loop
+   */
+  int plugin_worker_threads = 4;
+  /** The requests exceed it are rejected with 503 */
+  int plugin_queue_size = 1024;
+
+  /**
+   * The bytes of the responses cached for the plugins which opt in
+   * (see CachePolicy), 0 means disabled
+   */
+  int plugin_cache_size = 64 << 20;
+
+  /** The connections to each FastCGI application per IO loop */
+  int fastcgi_max_connections = 8;
+  /**
+   * The requests multiplexed on a FastCGI connection, 1 for the
+   * applications which don't support it(e.g. php-fpm)
+   */
+  int fastcgi_max_requests = 1;
+  /** The requests waiting for a FastCGI connection, the others are rejected with 503 */
+  int fastcgi_queue_size = 1024;
+
+  /** The balancing of proxy routes: round_robin or least_conn */
+  std::string proxy_balance = "round_robin";
+  /** The idle keep-alive connections to each upstream server per IO loop */
+  int proxy_max_idle_connections = 32;
+  /** The upstream server failed so many times in a row is taken out of rotation */
+  int proxy_max_fails = 3;
+  /** The interval(in seconds) of health check when the upstream server is down */
+  int proxy_fail_timeout = 10;
+  /**
+   * The upstream response buffered for a slow client. The upstream keeps
+   * sending when the client is congested, the request is aborted if the
+   * buffered bytes exceed it. 0 means unlimited
+   */
+  int proxy_max_buffer = 16 << 20;
+
+  /**
+   * Accept HTTP/2 over cleartext, i.e. the h2c upgrade and the
+   * prior knowledge(the connection starts with the preface)
+   */
+  bool enable_http2 = false;
+  /** The streams opened by the client at a time, the excess ones are refused */
+  int http2_max_concurrent_streams = 100;
+
+  /**
+   * The certificate chain and private key(PEM), TLS is terminated if set.
+   * The connection starting with a TLS handshake record is encrypted,
+   * the plaintext requests on the same port are still served.
+   * Only available if built with ENABLE_TLS.
+   */
+  std::string tls_certificate;
+  std::string tls_private_key;
+  /** The lifetime(in seconds) of session tickets for resumption */
+  int tls_session_timeout = 300;
+  /**
+   * Hand the encryption of the sending side to the kernel(kTLS) when the
+   * kernel and cipher support it, the responses are written in plaintext
+   * as before and the kernel builds the records
+   */
+  bool tls_kernel_offload = false;
+
+  /**
+   * The limit of a WebSocket message(the fragments are joined),
+   * the connection is closed with 1009 if exceeded
+   */
+  int websocket_max_message_size = 1 << 20;
+
+  /**
+   * The lines of Route, compiled to the routing table at startup.
+   * The URLs not matched are served as before.
+   * \see Router::AddRoute()
+   */
+  std::vector<std::string> routes;
 };
 
 extern HttpConfig g_config;
@@ -0,0 +1,362 @@
+#include "http/cgi_worker_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "kanon/log/logger.h"
+#include "kanon/net/tcp_connection.h"
+
+#include "common/cgi_codec.h"
+#include "common/http_response.h"
+#include "unix/process.h"
+
+using namespace kanon;
+using namespace unix;
+
+extern char** environ;
+
+namespace http {
+
+static char const kStatusLine[] = "HTTP/1.0 200 OK\r\n";
+
+static void SendError(TcpConnectionPtr const& conn, HttpStatusCode code, StringView msg)
+{
+  conn->Send(GetClientError(code, msg).GetBuffer());
+  conn->ShutdownWrite();
+}
+
+CgiWorkerPool::CgiWorkerPool(EventLoop* loop, size_t max_workers, size_t max_pendings)
+  : loop_(loop)
+  , max_workers_(max_workers)
+  , max_pendings_(max_pendings)
+{
+}
+
+CgiWorkerPool::~CgiWorkerPool() noexcept
+{
+  for (auto& program : programs_) {
+    for (auto& worker : program.second.workers) {
+      Destroy(*worker);
+    }
+  }
+}
+
+void CgiWorkerPool::Submit(Request request)
+{
+  auto& program = programs_[request.path];
+
+  for (auto const& worker : program.workers) {
+    if (!worker->request) {
+      Dispatch(worker, std::move(request));
+      return;
+    }
+  }
+
+  if (program.workers.size() < max_workers_) {
+    auto worker = Spawn(request.path);
+
+    if (!worker) {
+      SendError(request.conn, HttpStatusCode::k500InternalServerError,
+                "Failed to spawn the CGI worker");
+      return;
+    }
+
+    program.workers.push_back(worker);
+    Dispatch(worker, std::move(request));
+    return;
+  }
+
+  if (program.pendings.size() >= max_pendings_) {
+    LOG_WARN << "The CGI workers of " << request.path << " are busy";
+    SendError(request.conn, HttpStatusCode::k503ServerUnavailable,
+              "The CGI workers are busy");
+    return;
+  }
+
+  program.pendings.push_back(std::move(request));
+}
+
+auto CgiWorkerPool::Spawn(std::string const& path) -> WorkerPtr
+{
+  int to_worker[2];
+  int from_worker[2];
+
+  if (::pipe2(to_worker, O_CLOEXEC) < 0) {
+    LOG_SYSERROR << "Failed to create the stdin pipe of CGI worker";
+    return nullptr;
+  }
+
+  if (::pipe2(from_worker, O_CLOEXEC) < 0) {
+    LOG_SYSERROR << "Failed to create the stdout pipe of CGI worker";
+    ::close(to_worker[0]);
+    ::close(to_worker[1]);
+    return nullptr;
+  }
+
+  // The descriptors are close-on-exec, only the duplicated ones are inherited
+  FileActions actions;
+  actions.Dup2(to_worker[0], STDIN_FILENO);
+  actions.Dup2(from_worker[1], STDOUT_FILENO);
+
+  std::vector<char*> envp;
+  for (char** env = environ; *env; ++env) {
+    envp.push_back(*env);
+  }
+
+  char persistent[] = "KANON_CGI_PERSISTENT=1";
+  envp.push_back(persistent);
+  envp.push_back(nullptr);
+
+  char* argv[] = { const_cast<char*>(path.c_str()), nullptr };
+
+  Process process;
+
+  // Only spawn when the pool grows, the worker is reused then.
+  // posix_spawn() doesn't copy the page tables of server as fork().
+  const bool spawned = process.Spawn(path.c_str(), argv, envp.data(), &actions);
+
+  ::close(to_worker[0]);
+  ::close(from_worker[1]);
+
+  if (!spawned) {
+    LOG_SYSERROR << "Failed to spawn the CGI worker of " << path;
+    ::close(to_worker[1]);
+    ::close(from_worker[0]);
+    return nullptr;
+  }
+
+  auto worker = std::make_shared<Worker>();
+  worker->path = path;
+  worker->pid = process.GetPid();
+  worker->in_fd = to_worker[1];
+  worker->out_fd = from_worker[0];
+
+  ::fcntl(worker->in_fd, F_SETFL, ::fcntl(worker->in_fd, F_GETFL) | O_NONBLOCK);
+  ::fcntl(worker->out_fd, F_SETFL, ::fcntl(worker->out_fd, F_GETFL) | O_NONBLOCK);
+
+  std::weak_ptr<Worker> wp(worker);
+
+  worker->out_channel.reset(new Channel(loop_, worker->out_fd));
+  worker->out_channel->SetReadCallback([this, wp](TimeStamp) {
+    auto worker = wp.lock();
+    if (worker) OnReadable(worker);
+  });
+  worker->out_channel->EnableReading();
+
+  worker->in_channel.reset(new Channel(loop_, worker->in_fd));
+  worker->in_channel->SetWriteCallback([this, wp]() {
+    auto worker = wp.lock();
+    if (worker) OnWritable(worker);
+  });
+
+  LOG_INFO << "The CGI worker of " << path << "(pid = " << worker->pid << ") is spawned";
+  return worker;
+}
+
+void CgiWorkerPool::Dispatch(WorkerPtr const& worker, Request request)
+{
+  std::string records;
+  CgiCodec::Append(records, CgiCodec::kParams, request.params);
+
+  if (!request.input.empty()) {
+    CgiCodec::Append(records, CgiCodec::kStdin, request.input);
+  }
+
+  CgiCodec::Append(records, CgiCodec::kEnd, StringView());
+
+  worker->request.reset(new Request(std::move(request)));
+  worker->output_started = false;
+
+  WriteToWorker(worker, records);
+}
+
+void CgiWorkerPool::WriteToWorker(WorkerPtr const& worker, std::string const& records)
+{
+  size_t writen = 0;
+
+  // Queued after the pending ones to keep the order
+  if (worker->output.empty()) {
+    auto n = ::write(worker->in_fd, records.data(), records.size());
+
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      LOG_SYSERROR << "Failed to write to the CGI worker of " << worker->path;
+      OnError(worker);
+      return;
+    }
+
+    writen = n < 0 ? 0 : n;
+  }
+
+  if (writen < records.size()) {
+    const bool was_empty = worker->output.empty();
+    worker->output.append(records, writen, std::string::npos);
+
+    if (was_empty) {
+      worker->in_channel->EnableWriting();
+    }
+  }
+}
+
+void CgiWorkerPool::OnWritable(WorkerPtr const& worker)
+{
+  auto& output = worker->output;
+  auto n = ::write(worker->in_fd, output.data(), output.size());
+
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR) return;
+
+    LOG_SYSERROR << "Failed to write to the CGI worker of " << worker->path;
+    OnError(worker);
+    return;
+  }
+
+  output.erase(0, n);
+
+  if (output.empty()) {
+    worker->in_channel->DisableWriting();
+  }
+}
+
+void CgiWorkerPool::OnReadable(WorkerPtr const& worker)
+{
+  char buf[1 << 16];
+  bool closed = false;
+
+  for (;;) {
+    auto n = ::read(worker->out_fd, buf, sizeof buf);
+
+    if (n > 0) {
+      worker->input.append(buf, n);
+      continue;
+    }
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno == EAGAIN) break;
+
+    closed = true;
+    break;
+  }
+
+  StringView data(worker->input);
+  CgiCodec::RecordType type;
+  StringView content;
+  size_t consumed = 0;
+  CgiCodec::Result result = CgiCodec::kShort;
+
+  while (!worker->closed &&
+         (result = CgiCodec::Parse(data, type, content, consumed)) == CgiCodec::kGood) {
+    data.remove_prefix(consumed);
+
+    if (!worker->request || (type != CgiCodec::kStdout && type != CgiCodec::kEnd)) {
+      result = CgiCodec::kBad;
+      break;
+    }
+
+    auto const& conn = worker->request->conn;
+
+    if (!worker->output_started) {
+      worker->output_started = true;
+      conn->Send(StringView(kStatusLine, sizeof kStatusLine - 1));
+    }
+
+    if (type == CgiCodec::kStdout) {
+      conn->Send(content);
+    }
+    else {
+      OnComplete(worker);
+    }
+  }
+
+  worker->input.erase(0, worker->input.size() - data.size());
+
+  if (result == CgiCodec::kBad) {
+    LOG_ERROR << "The CGI worker of " << worker->path << " replies an invalid record";
+    OnError(worker);
+  }
+  else if (closed) {
+    LOG_ERROR << "The CGI worker of " << worker->path << "(pid = " << worker->pid << ") exits";
+    OnError(worker);
+  }
+}
+
+void CgiWorkerPool::OnComplete(WorkerPtr const& worker)
+{
+  // The response is ended by closing the connection
+  // since it has no Content-Length
+  worker->request->conn->ShutdownWrite();
+  worker->request.reset();
+
+  auto& pendings = programs_[worker->path].pendings;
+
+  if (!pendings.empty()) {
+    auto request = std::move(pendings.front());
+    pendings.pop_front();
+    Dispatch(worker, std::move(request));
+  }
+}
+
+void CgiWorkerPool::OnError(WorkerPtr const& worker)
+{
+  if (worker->closed) return;
+  worker->closed = true;
+
+  if (worker->request) {
+    auto const& conn = worker->request->conn;
+
+    if (worker->output_started) {
+      conn->ShutdownWrite();
+    }
+    else {
+      SendError(conn, HttpStatusCode::k502BadGateway, "The CGI program failed");
+    }
+
+    worker->request.reset();
+  }
+
+  auto& program = programs_[worker->path];
+  auto& workers = program.workers;
+
+  for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+    if (*iter == worker) {
+      workers.erase(iter);
+      break;
+    }
+  }
+
+  // The channel can't be destroyed in its callback
+  worker->in_channel->DisableAll();
+  worker->out_channel->DisableAll();
+  loop_->QueueToLoop([worker]() { Destroy(*worker); });
+
+  // Replace the worker for the waiting requests
+  if (!program.pendings.empty()) {
+    auto request = std::move(program.pendings.front());
+    program.pendings.pop_front();
+    Submit(std::move(request));
+  }
+}
+
+void CgiWorkerPool::Destroy(Worker& worker)
+{
+  worker.in_channel->DisableAll();
+  worker.in_channel->Remove();
+  worker.out_channel->DisableAll();
+  worker.out_channel->Remove();
+
+  // The worker exits when its stdin is closed
+  ::close(worker.in_fd);
+  ::close(worker.out_fd);
+
+  if (::waitpid(worker.pid, NULL, WNOHANG) == 0) {
+    ::kill(worker.pid, SIGKILL);
+    ::waitpid(worker.pid, NULL, 0);
+  }
+}
+
+} // namespace http
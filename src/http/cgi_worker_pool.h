@@ -0,0 +1,103 @@
+#ifndef KANON_HTTP_CGI_WORKER_POOL_H
+#define KANON_HTTP_CGI_WORKER_POOL_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "kanon/net/callback.h"
+#include "kanon/net/channel.h"
+#include "kanon/net/event_loop.h"
+#include "kanon/util/noncopyable.h"
+
+namespace http {
+
+/**
+ * Run the CGI programs as persistent workers.
+ *
+ * The worker of a program is spawned when all of its workers are busy
+ * and the limit is not reached, then it is kept to serve the following
+ * requests, so no fork on the hot path. The requests and responses are
+ * framed by CgiCodec over the stdin and stdout of worker, which are
+ * non-blocking and handled by the loop.
+ *
+ * The program must support the persistent mode, see cgi/src/util/cgi_worker.h
+ *
+ * \note Not thread-safe, must be used in the loop
+ */
+class CgiWorkerPool : kanon::noncopyable {
+ public:
+  struct Request {
+    /** The path of CGI program */
+    std::string path;
+    /** \see CgiCodec::AppendParam() */
+    std::string params;
+    /** The body of POST */
+    std::string input;
+    kanon::TcpConnectionPtr conn;
+  };
+
+  /**
+   * \param max_workers The max number of workers per program
+   * \param max_pendings The max number of requests waiting for a worker per program
+   */
+  CgiWorkerPool(kanon::EventLoop* loop, size_t max_workers, size_t max_pendings);
+  ~CgiWorkerPool() noexcept;
+
+  /**
+   * The output of worker is sent to the connection,
+   * the connection is shut down when complete.
+   */
+  void Submit(Request request);
+
+ private:
+  struct Worker {
+    std::string path;
+    pid_t pid = -1;
+    /** The stdin of worker */
+    int in_fd = -1;
+    /** The stdout of worker */
+    int out_fd = -1;
+    std::unique_ptr<kanon::Channel> in_channel;
+    std::unique_ptr<kanon::Channel> out_channel;
+    /** The records are not written since the pipe is full */
+    std::string output;
+    /** The records are not complete */
+    std::string input;
+    std::unique_ptr<Request> request;
+    bool output_started = false;
+    /** Removed from the pool, waiting to be destroyed */
+    bool closed = false;
+  };
+
+  using WorkerPtr = std::shared_ptr<Worker>;
+
+  struct Program {
+    std::vector<WorkerPtr> workers;
+    std::deque<Request> pendings;
+  };
+
+  WorkerPtr Spawn(std::string const& path);
+  void Dispatch(WorkerPtr const& worker, Request request);
+  void WriteToWorker(WorkerPtr const& worker, std::string const& records);
+
+  void OnReadable(WorkerPtr const& worker);
+  void OnWritable(WorkerPtr const& worker);
+  void OnComplete(WorkerPtr const& worker);
+  void OnError(WorkerPtr const& worker);
+
+  /** Close the pipes and reap the worker */
+  static void Destroy(Worker& worker);
+
+  kanon::EventLoop* loop_;
+  size_t max_workers_;
+  size_t max_pendings_;
+
+  std::unordered_map<std::string, Program> programs_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_CGI_WORKER_POOL_H
@@ -10,17 +10,15 @@
 #include "kanon/util/mem.h"
 
 #include "http/http_request_parser.h"
+#include "common/cgi_codec.h"
 #include "common/http_constant.h"
 #include "common/http_response.h"
-#include "unix/pipe.h"
-#include "unix/process.h"
 #include "util/file.h"
 #include "util/macro.h"
 
 using namespace kanon;
 using namespace http;
 using namespace std;
-using namespace unix;
 
 // FIXME These should be setted in config file
 char const HttpServer::kRootPath_[] = "/root/kanon_http/";
@@ -28,8 +26,10 @@ char const HttpServer::kHtmlPath_[] = "/root/kanon_http/html";
 char const HttpServer::kHomePage_[] = "index.html";
 char const HttpServer::kHost_[] = "47.99.92.230";
 
-HttpServer::HttpServer(EventLoop* loop, InetAddr const& listen_addr)
+HttpServer::HttpServer(EventLoop* loop, InetAddr const& listen_addr,
+                       size_t cgi_worker_num, size_t cgi_pending_num)
   : TcpServer(loop, listen_addr, "HttpServer")
+  , cgi_workers_(loop, cgi_worker_num, cgi_pending_num)
 {
   SetMessageCallback(std::bind(&HttpServer::OnMessage, this, _1, _2, _3));
   SetConnectionCallback(std::bind(&HttpServer::OnConnection, this, _1));
@@ -215,89 +215,37 @@ void HttpServer::ExecuteCgi(
 {
   LOG_TRACE << "Handle cgi request";
 
-  // Child process(cgi) write to parent
-  Pipe output;
-  // Parent process write to child(cgi)
-  Pipe input;
+  CgiWorkerPool::Request request;
+  request.path = kRootPath_;
+  request.conn = conn;
 
-  Process process;
+  const auto method = parser.GetMethod();
+  CgiCodec::AppendParam(request.params, "REQUEST_METHOD", GetMethodString(method));
 
-  conn->Send("HTTP/1.0 200 OK\r\n");
+  if (method == HttpMethod::kGet) {
+    auto query_url = StringView(parser.GetUrl());
+    const auto delimter = query_url.find('?');
+    auto path = query_url.substr(0, delimter);
+    request.path.append(path.data(), path.size());
 
-  process.Fork(
-    [&conn, &parser, &input, &output]
-    {
-      input.CloseReadEnd();
-      output.CloseWriteEnd();
-
-      auto input_buffer = conn->GetInputBuffer();
-      if (parser.GetMethod() == HttpMethod::kPost) {
-        input.Write(
-          input_buffer->ToStringView().substr(0, parser.GetCacheContentLength()).data(),
-          parser.GetCacheContentLength());
-      }
-
-      char buf[4096];MemoryZero(buf);
-      size_t readn = 0; 
-      while ((readn = output.Read(buf)) > 0) {
-        LOG_DEBUG << StringView(buf, readn);
-        conn->Send(buf, readn);
-      }
-
-      CloseConnection(conn, parser);
-    },
-    [&input, &parser, &output]()
-    {
-      char method_env[4096];
-      char query_env[4096];
-      char length_env[4096];
-
-      const auto method = parser.GetMethod();
-      const auto content_length = parser.GetCacheContentLength();
-
-      std::string path = kRootPath_;
-
-      ::snprintf(method_env, sizeof method_env, "REQUEST_METHOD=%s", GetMethodString(method));
-      ::putenv(method_env);
-
-      LOG_DEBUG << "method_env = " << method_env;
-
-      if (parser.GetMethod() == HttpMethod::kGet) {
-        auto query_url = StringView(parser.GetUrl());
-        const auto delimter = query_url.find('?');
-        auto args = query_url.substr(delimter).ToString();
-        path += query_url.substr(0, delimter).ToString();
-
-        LOG_DEBUG << "query_url = " << query_url;
-        LOG_DEBUG << "path = " << path;
-        LOG_DEBUG << "args = " << args;
-
-        ::snprintf(query_env, sizeof query_env, "QUERY_STRING=%s", args.data());
-        ::putenv(query_env);
-
-        LOG_DEBUG << "query_env = " << query_env;
-      }
-      else if (method == HttpMethod::kPost) {
-        path += parser.GetUrl();
-        
-        LOG_DEBUG << path;
-        assert(path.find('?') == StringView::npos);
-        ::snprintf(length_env, sizeof length_env, "CONTENT_LENGTH=%lu", content_length);
-        ::putenv(length_env);
-      }
+    // The query string starts with ?
+    if (delimter != StringView::npos) {
+      CgiCodec::AppendParam(request.params, "QUERY_STRING", query_url.substr(delimter));
+    }
 
+    LOG_DEBUG << "query_url = " << query_url;
+  }
+  else if (method == HttpMethod::kPost) {
+    request.path += parser.GetUrl();
 
-      input.RedirectReadEnd(STDIN_FILENO);
-      output.RedirectWriteEnd(STDOUT_FILENO);
+    const auto content_length = parser.GetCacheContentLength();
+    request.input = conn->GetInputBuffer()->ToStringView().substr(0, content_length).ToString();
+    CgiCodec::AppendParam(request.params, "CONTENT_LENGTH", std::to_string(content_length));
+  }
 
-      input.CloseWriteEnd();
-      output.CloseReadEnd();
+  LOG_DEBUG << "path = " << request.path;
 
-      if (::execl(path.c_str(), "", NULL) == -1) {
-        ::perror("execl() error occurred");
-      }
-      ::exit(0);
-    });
+  cgi_workers_.Submit(std::move(request));
 }
 
 void HttpServer::SendErrorResponse(
@@ -10,6 +10,7 @@
 
 #include "common/http_response.h"
 #include "common/http_constant.h"
+#include "http/cgi_worker_pool.h"
 #include "http/http_request_parser.h"
 #include "util/file.h"
 
@@ -26,7 +27,12 @@ public:
   { 
   }
 
-  HttpServer(EventLoop* loop, InetAddr const& listen_addr);
+  /**
+   * \param cgi_worker_num The max number of persistent workers per CGI program
+   * \param cgi_pending_num The max number of requests waiting for a worker per program
+   */
+  HttpServer(EventLoop* loop, InetAddr const& listen_addr,
+             size_t cgi_worker_num = 4, size_t cgi_pending_num = 1024);
 
 private:
   void OnMessage(TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp recv);
@@ -67,6 +73,9 @@ private:
     HttpRequestParser const& parser)
   { SendErrorResponse(conn, code, kanon::MakeStringView(""), parser); }
 
+  /** The requests of CGI are run by the persistent workers */
+  CgiWorkerPool cgi_workers_;
+
   static char const kHomePage_[];
   static char const kRootPath_[];
   static char const kHtmlPath_[];
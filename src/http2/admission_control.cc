@@ -0,0 +1,134 @@
+#include "http2/admission_control.h"
+
+#include <chrono>
+
+#include <kanon/log/logger.h>
+
+#include "common/http_response.h"
+#include "config/http_config.h"
+
+using namespace kanon;
+
+namespace http {
+
+// The interval of the timer which measures the lag of IO loop(in seconds)
+static constexpr double kLagProbeInterval = 0.1;
+
+AdmissionControl::AdmissionControl(ServerStats& stats)
+  : stats_(&stats)
+{
+  HttpResponse response(true);
+
+  response.AddHeaderLine(HttpStatusCode::k503ServerUnavailable)
+          .AddHeader("Retry-After", std::to_string(g_config.retry_after))
+          .AddHeader("Content-Length", "0")
+          .AddHeader("Connection", "close")
+          .AddBlackLine();
+
+  unavailable_response_ = response.GetBuffer().RetrieveAllAsString();
+}
+
+AdmissionControl::~AdmissionControl() noexcept
+{
+}
+
+auto AdmissionControl::GetLoopState(EventLoop* loop) -> LoopState*
+{
+  LoopStatePtr state;
+
+  {
+    MutexGuard guard(mutex_);
+    auto& entry = loop_states_[loop];
+
+    if (entry) {
+      return entry.get();
+    }
+
+    entry = std::make_shared<LoopState>();
+    state = entry;
+  }
+
+  if (g_config.shed_loop_lag_ms > 0) {
+    StartLagProbe(loop, state);
+  }
+
+  return state.get();
+}
+
+void AdmissionControl::StartLagProbe(EventLoop* loop, LoopStatePtr const& state)
+{
+  using Clock = std::chrono::steady_clock;
+
+  // The timer holds the state, so the state is alive
+  // even though the server is destroyed before the loop.
+  loop->RunEvery([state, last = Clock::now()]() mutable {
+    const auto now = Clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - last).count();
+    last = now;
+
+    int64_t sample = elapsed - static_cast<int64_t>(kLagProbeInterval * 1000000);
+    if (sample < 0) sample = 0;
+
+    // Exponentially weighted moving average(alpha = 1/8)
+    const auto lag = state->lag_us.load(std::memory_order_relaxed);
+    state->lag_us.store(lag + (sample - lag) / 8, std::memory_order_relaxed);
+  }, kLagProbeInterval);
+}
+
+bool AdmissionControl::TryAdmit(LoopState* state)
+{
+  if (g_config.max_connections > 0) {
+    const auto active = stats_->active_connections.fetch_add(1, std::memory_order_relaxed);
+
+    if (active >= g_config.max_connections) {
+      stats_->active_connections.fetch_sub(1, std::memory_order_relaxed);
+      Increment(stats_->shed_global_cap);
+      return false;
+    }
+  } else {
+    stats_->active_connections.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const char* reason = nullptr;
+  ServerStats::Counter* counter = nullptr;
+
+  if (g_config.max_connections_per_loop > 0 &&
+      state->connections.load(std::memory_order_relaxed) >= g_config.max_connections_per_loop) {
+    reason = "loop connection cap";
+    counter = &stats_->shed_loop_cap;
+  } else if (g_config.shed_inflight_requests > 0 &&
+             state->inflight_requests.load(std::memory_order_relaxed) >= g_config.shed_inflight_requests) {
+    reason = "inflight requests";
+    counter = &stats_->shed_overload;
+  } else if (g_config.shed_loop_lag_ms > 0 &&
+             state->lag_us.load(std::memory_order_relaxed) >= g_config.shed_loop_lag_ms * 1000) {
+    reason = "loop lag";
+    counter = &stats_->shed_overload;
+  }
+
+  if (counter) {
+    LOG_DEBUG << "The connection is shed due to " << reason;
+    stats_->active_connections.fetch_sub(1, std::memory_order_relaxed);
+    Increment(*counter);
+    return false;
+  }
+
+  state->connections.fetch_add(1, std::memory_order_relaxed);
+  Increment(stats_->accepted_connections);
+  return true;
+}
+
+void AdmissionControl::Release(LoopState* state) noexcept
+{
+  state->connections.fetch_sub(1, std::memory_order_relaxed);
+  stats_->active_connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AdmissionControl::Reject(TcpConnectionPtr const& conn)
+{
+  conn->Send(unavailable_response_.data(), unavailable_response_.size());
+  conn->ShutdownWrite();
+}
+
+} // namespace http
@@ -0,0 +1,87 @@
+#ifndef KANON_HTTP_ADMISSION_CONTROL_H
+#define KANON_HTTP_ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <kanon/net/user_server.h>
+#include <kanon/thread/mutex_lock.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/server_stats.h"
+
+namespace http {
+
+/**
+ * Decide if a new connection can be served.
+ *
+ * The connection is rejected with a pre-rendered 503 response if
+ * one of the following conditions is satisfied:
+ * 1. The number of connections of the server reaches MaxConnections
+ * 2. The number of connections of the IO loop reaches MaxConnectionsPerLoop
+ * 3. The IO loop has ShedInflightRequests requests in progress
+ * 4. The IO loop lags behind its timers more than ShedLoopLagMs
+ *
+ * Rejecting the excess is much cheaper than degrading all clients.
+ */
+class AdmissionControl : kanon::noncopyable {
+ public:
+  /**
+   * The state of an IO loop.
+   * Only modified in the loop thread, but may be read by others.
+   */
+  struct LoopState {
+    std::atomic<int> connections{0};
+    std::atomic<int> inflight_requests{0};
+    /** Smoothed lag of the loop in microseconds */
+    std::atomic<int64_t> lag_us{0};
+  };
+
+  using LoopStatePtr = std::shared_ptr<LoopState>;
+
+  explicit AdmissionControl(ServerStats& stats);
+  ~AdmissionControl() noexcept;
+
+  void SetStats(ServerStats& stats) noexcept { stats_ = &stats; }
+
+  /**
+   * Get the state of the loop, create it if this is the first call.
+   * Must be called in the loop thread.
+   */
+  LoopState* GetLoopState(EventLoop* loop);
+
+  /**
+   * Account the connection if it can be admitted.
+   * \return false if the connection should be rejected
+   */
+  bool TryAdmit(LoopState* state);
+  void Release(LoopState* state) noexcept;
+
+  /**
+   * Send the 503 response with Retry-After and close the connection.
+   * \note The response is plaintext, the session of TLS connection
+   *       sends GetUnavailableResponse() by itself
+   */
+  void Reject(TcpConnectionPtr const& conn);
+
+  /** The 503 response with Retry-After and Connection: close */
+  kanon::StringView GetUnavailableResponse() const noexcept
+  { return unavailable_response_; }
+
+ private:
+  void StartLagProbe(EventLoop* loop, LoopStatePtr const& state);
+
+  ServerStats* stats_;
+
+  /** Rendered once, sent to every rejected connection */
+  std::string unavailable_response_;
+
+  kanon::MutexLock mutex_;
+  std::unordered_map<EventLoop*, LoopStatePtr> loop_states_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_ADMISSION_CONTROL_H
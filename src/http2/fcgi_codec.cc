@@ -0,0 +1,270 @@
+#include "http2/fcgi_codec.h"
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+constexpr uint8_t FcgiCodec::kVersion;
+constexpr size_t FcgiCodec::kHeaderSize;
+constexpr size_t FcgiCodec::kMaxContentSize;
+constexpr uint16_t FcgiCodec::kResponder;
+
+static void AppendHeader(std::string& out, FcgiCodec::RecordType type, uint16_t request_id,
+                         size_t content_length, size_t padding_length)
+{
+  char header[FcgiCodec::kHeaderSize] = {
+    static_cast<char>(FcgiCodec::kVersion),
+    static_cast<char>(type),
+    static_cast<char>(request_id >> 8),
+    static_cast<char>(request_id),
+    static_cast<char>(content_length >> 8),
+    static_cast<char>(content_length),
+    static_cast<char>(padding_length),
+    0,
+  };
+
+  out.append(header, sizeof header);
+}
+
+static void AppendRecord(std::string& out, FcgiCodec::RecordType type,
+                         uint16_t request_id, StringView content)
+{
+  // Align the record to 8 bytes as recommended
+  const size_t padding = (8 - content.size() % 8) % 8;
+
+  AppendHeader(out, type, request_id, content.size(), padding);
+  out.append(content.data(), content.size());
+  out.append(padding, '\0');
+}
+
+void FcgiCodec::AppendBeginRequest(std::string& out, uint16_t request_id, bool keep_conn)
+{
+  char body[8] = {
+    static_cast<char>(kResponder >> 8),
+    static_cast<char>(kResponder),
+    static_cast<char>(keep_conn ? 1 : 0),
+  };
+
+  AppendRecord(out, kBeginRequest, request_id, StringView(body, sizeof body));
+}
+
+void FcgiCodec::AppendAbortRequest(std::string& out, uint16_t request_id)
+{
+  AppendRecord(out, kAbortRequest, request_id, StringView());
+}
+
+void FcgiCodec::AppendEndRequest(std::string& out, uint16_t request_id,
+                                 uint32_t app_status, ProtocolStatus status)
+{
+  char body[8] = {
+    static_cast<char>(app_status >> 24),
+    static_cast<char>(app_status >> 16),
+    static_cast<char>(app_status >> 8),
+    static_cast<char>(app_status),
+    static_cast<char>(status),
+  };
+
+  AppendRecord(out, kEndRequest, request_id, StringView(body, sizeof body));
+}
+
+void FcgiCodec::AppendStream(std::string& out, RecordType type, uint16_t request_id,
+                             StringView content)
+{
+  do {
+    const auto len = std::min(content.size(), kMaxContentSize);
+    AppendRecord(out, type, request_id, content.substr(0, len));
+    content.remove_prefix(len);
+  } while (!content.empty());
+}
+
+static void AppendLength(std::string& out, size_t len)
+{
+  if (len < 128) {
+    out += static_cast<char>(len);
+    return;
+  }
+
+  out += static_cast<char>((len >> 24) | 0x80);
+  out += static_cast<char>(len >> 16);
+  out += static_cast<char>(len >> 8);
+  out += static_cast<char>(len);
+}
+
+void FcgiCodec::AppendParam(std::string& params, StringView name, StringView value)
+{
+  AppendLength(params, name.size());
+  AppendLength(params, value.size());
+  params.append(name.data(), name.size());
+  params.append(value.data(), value.size());
+}
+
+auto FcgiCodec::Parse(StringView data, Record& record, size_t& consumed) noexcept -> Result
+{
+  if (data.size() < kHeaderSize) {
+    return kShort;
+  }
+
+  auto header = reinterpret_cast<unsigned char const*>(data.data());
+
+  if (header[0] != kVersion || header[1] < kBeginRequest || header[1] > kUnknownType) {
+    return kBad;
+  }
+
+  const size_t content_length = (size_t(header[4]) << 8) | header[5];
+  const size_t total = kHeaderSize + content_length + header[6];
+
+  if (data.size() < total) {
+    return kShort;
+  }
+
+  record.type = static_cast<RecordType>(header[1]);
+  record.request_id = static_cast<uint16_t>((header[2] << 8) | header[3]);
+  record.content = data.substr(kHeaderSize, content_length);
+  consumed = total;
+  return kGood;
+}
+
+static bool ParseLength(StringView& content, size_t& len) noexcept
+{
+  if (content.empty()) return false;
+
+  auto p = reinterpret_cast<unsigned char const*>(content.data());
+
+  if (p[0] < 128) {
+    len = p[0];
+    content.remove_prefix(1);
+    return true;
+  }
+
+  if (content.size() < 4) return false;
+
+  len = (size_t(p[0] & 0x7f) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | p[3];
+  content.remove_prefix(4);
+  return true;
+}
+
+bool FcgiCodec::ParseParams(StringView content, std::vector<Pair>& params)
+{
+  while (!content.empty()) {
+    size_t name_len = 0;
+    size_t value_len = 0;
+
+    if (!ParseLength(content, name_len) || !ParseLength(content, value_len) ||
+        content.size() < name_len + value_len) {
+      return false;
+    }
+
+    params.emplace_back(content.substr(0, name_len), content.substr(name_len, value_len));
+    content.remove_prefix(name_len + value_len);
+  }
+
+  return true;
+}
+
+bool FcgiCodec::ParseBeginRequest(StringView content, uint16_t& role, bool& keep_conn) noexcept
+{
+  if (content.size() != 8) return false;
+
+  auto p = reinterpret_cast<unsigned char const*>(content.data());
+  role = static_cast<uint16_t>((p[0] << 8) | p[1]);
+  keep_conn = p[2] & 1;
+  return true;
+}
+
+bool FcgiCodec::ParseEndRequest(StringView content, uint32_t& app_status,
+                                ProtocolStatus& status) noexcept
+{
+  if (content.size() != 8) return false;
+
+  auto p = reinterpret_cast<unsigned char const*>(content.data());
+  app_status = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+  status = static_cast<ProtocolStatus>(p[4]);
+  return true;
+}
+
+static StringView Trim(StringView str) noexcept
+{
+  while (!str.empty() && (str[0] == ' ' || str[0] == '\t')) {
+    str.remove_prefix(1);
+  }
+
+  while (!str.empty() && (str[str.size()-1] == ' ' || str[str.size()-1] == '\t' ||
+                          str[str.size()-1] == '\r')) {
+    str = str.substr(0, str.size()-1);
+  }
+
+  return str;
+}
+
+auto FcgiCodec::ParseResponseHead(StringView data, int& status, StringView& reason,
+                                  std::vector<Pair>& headers, size_t& consumed) -> Result
+{
+  status = 200;
+  reason = "OK";
+  headers.clear();
+
+  bool has_status = false;
+  bool has_location = false;
+  StringView rest = data;
+
+  for (;;) {
+    auto lf_pos = rest.find('\n');
+
+    if (lf_pos == StringView::npos) {
+      return kShort;
+    }
+
+    auto line = rest.substr(0, lf_pos);
+    rest.remove_prefix(lf_pos + 1);
+
+    if (!line.empty() && line[line.size()-1] == '\r') {
+      line = line.substr(0, line.size()-1);
+    }
+
+    // The blank line ends the header
+    if (line.empty()) break;
+
+    auto colon_pos = line.find(':');
+
+    if (colon_pos == StringView::npos || colon_pos == 0) {
+      return kBad;
+    }
+
+    auto name = line.substr(0, colon_pos);
+    auto value = Trim(line.substr(colon_pos + 1));
+
+    if (name.size() == 6 && ::strncasecmp(name.data(), "Status", 6) == 0) {
+      // e.g. 404 Not Found
+      if (value.size() < 3) return kBad;
+
+      status = ::atoi(value.ToString().c_str());
+
+      if (status < 100 || status > 999) return kBad;
+
+      reason = value.size() > 4 ? Trim(value.substr(4)) : StringView();
+      has_status = true;
+      continue;
+    }
+
+    if (name.size() == 8 && ::strncasecmp(name.data(), "Location", 8) == 0) {
+      has_location = true;
+    }
+
+    headers.emplace_back(name, value);
+  }
+
+  if (!has_status && has_location) {
+    status = 302;
+    reason = "Found";
+  }
+
+  consumed = data.size() - rest.size();
+  return kGood;
+}
+
+} // namespace http
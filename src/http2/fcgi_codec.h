@@ -0,0 +1,114 @@
+#ifndef KANON_HTTP_FCGI_CODEC_H
+#define KANON_HTTP_FCGI_CODEC_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+
+namespace http {
+
+/**
+ * The records of FastCGI 1.0.
+ *
+ * Each record is a 8 bytes header followed by the content and padding:
+ *
+ * | version(1) | type(1) | request id(2) | content length(2) | padding length(1) | reserved(1) |
+ *
+ * The integers are big endian. The records of different requests can
+ * be interleaved in a connection(multiplexing).
+ * Both sides are provided, the server side is used by the tests.
+ */
+class FcgiCodec {
+ public:
+  enum RecordType : uint8_t {
+    kBeginRequest = 1,
+    kAbortRequest,
+    kEndRequest,
+    kParams,
+    kStdin,
+    kStdout,
+    kStderr,
+    kData,
+    kGetValues,
+    kGetValuesResult,
+    kUnknownType,
+  };
+
+  enum ProtocolStatus : uint8_t {
+    kRequestComplete = 0,
+    kCantMpxConn,
+    kOverloaded,
+    kUnknownRole,
+  };
+
+  enum Result {
+    kGood = 0,
+    kShort, /** Need more data */
+    kBad,
+  };
+
+  struct Record {
+    RecordType type;
+    uint16_t request_id;
+    kanon::StringView content;
+  };
+
+  using Pair = std::pair<kanon::StringView, kanon::StringView>;
+
+  static constexpr uint8_t kVersion = 1;
+  static constexpr size_t kHeaderSize = 8;
+  static constexpr size_t kMaxContentSize = 65535;
+  static constexpr uint16_t kResponder = 1;
+
+  /**
+   * \param keep_conn If false, the application closes the connection
+   *                  after the request
+   */
+  static void AppendBeginRequest(std::string& out, uint16_t request_id, bool keep_conn);
+  static void AppendAbortRequest(std::string& out, uint16_t request_id);
+  static void AppendEndRequest(std::string& out, uint16_t request_id,
+                               uint32_t app_status, ProtocolStatus status);
+
+  /**
+   * Append the records of stream(kParams, kStdin, kStdout, ...),
+   * the empty \p content appends the empty record which ends the stream.
+   */
+  static void AppendStream(std::string& out, RecordType type, uint16_t request_id,
+                           kanon::StringView content);
+
+  /** Append the name-value pair to the content of kParams */
+  static void AppendParam(std::string& params, kanon::StringView name, kanon::StringView value);
+
+  /**
+   * Parse a record at the beginning of \p data
+   * \param consumed The size of the record(including padding) if kGood
+   */
+  static Result Parse(kanon::StringView data, Record& record, size_t& consumed) noexcept;
+
+  /** \return false if the content is invalid */
+  static bool ParseParams(kanon::StringView content, std::vector<Pair>& params);
+  static bool ParseBeginRequest(kanon::StringView content, uint16_t& role, bool& keep_conn) noexcept;
+  static bool ParseEndRequest(kanon::StringView content, uint32_t& app_status,
+                              ProtocolStatus& status) noexcept;
+
+  /**
+   * Parse the CGI header of response(kStdout), e.g.
+   *   Status: 404 Not Found\r\n
+   *   Content-Type: text/html\r\n
+   *   \r\n
+   * The status is 302 if only Location is given, otherwise 200.
+   * The Status field is not included in \p headers.
+   *
+   * \param consumed The size of header including the blank line if kGood
+   */
+  static Result ParseResponseHead(kanon::StringView data, int& status,
+                                  kanon::StringView& reason,
+                                  std::vector<Pair>& headers, size_t& consumed);
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_FCGI_CODEC_H
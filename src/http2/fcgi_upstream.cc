@@ -0,0 +1,425 @@
+#include "http2/fcgi_upstream.h"
+
+#include <stdlib.h>
+
+#include <kanon/log/logger.h>
+
+using namespace kanon;
+
+namespace http {
+
+// The application is treated as down if not connected in time
+static constexpr double kConnectTimeout = 3;
+
+// The CGI header larger than it is invalid
+static constexpr size_t kMaxHeadSize = 64 << 10;
+
+FcgiUpstream::FcgiUpstream(EventLoop* loop, InetAddr const& addr,
+                           size_t max_conns, size_t max_requests, size_t max_pendings)
+  : loop_(loop)
+  , addr_(addr)
+  , max_conns_(max_conns > 0 ? max_conns : 1)
+  , max_requests_(max_requests > 0 ? max_requests : 1)
+  , max_pendings_(max_pendings)
+{
+}
+
+FcgiUpstream::~FcgiUpstream() noexcept
+{
+  for (auto const& c : conns_) {
+    c->closed = true;
+    c->client->Stop();
+  }
+}
+
+bool FcgiUpstream::ParseAddress(StringView address, std::string& ip, uint16_t& port,
+                                std::string& error)
+{
+  if (address.starts_with("unix:")) {
+    error = "The Unix socket is not supported: " + address.ToString();
+    return false;
+  }
+
+  auto colon_pos = address.rfind(':');
+
+  if (colon_pos == StringView::npos || colon_pos == 0) {
+    error = "The address must be ip:port: " + address.ToString();
+    return false;
+  }
+
+  const int value = ::atoi(address.substr(colon_pos + 1).ToString().c_str());
+
+  if (value <= 0 || value > 65535) {
+    error = "Invalid port: " + address.ToString();
+    return false;
+  }
+
+  ip = address.substr(0, colon_pos).ToString();
+  port = static_cast<uint16_t>(value);
+  return true;
+}
+
+auto FcgiUpstream::Submit(std::string const& params, StringView body,
+                          Callbacks callbacks) -> RequestId
+{
+  auto c = GetConnection();
+
+  if (!c) {
+    if (pendings_.size() >= max_pendings_) {
+      LOG_WARN << "The FastCGI application " << addr_.ToIpPort() << " is busy";
+      return 0;
+    }
+
+    const auto id = next_id_++;
+    pendings_.push_back(Pending{id, params, body.ToString(), std::move(callbacks)});
+    return id;
+  }
+
+  const auto id = next_id_++;
+  Start(c, id, params, body, std::move(callbacks));
+  return id;
+}
+
+void FcgiUpstream::Abort(RequestId id)
+{
+  auto iter = locations_.find(id);
+
+  if (iter == locations_.end()) {
+    for (auto pending = pendings_.begin(); pending != pendings_.end(); ++pending) {
+      if (pending->id == id) {
+        pendings_.erase(pending);
+        return;
+      }
+    }
+
+    return;
+  }
+
+  auto& c = *iter->second.conn;
+  auto& stream = c.streams.find(iter->second.request_id)->second;
+
+  if (stream.aborted) return;
+
+  // The request id is reused after FCGI_END_REQUEST
+  stream.aborted = true;
+  stream.callbacks = Callbacks();
+
+  std::string records;
+  FcgiCodec::AppendAbortRequest(records, iter->second.request_id);
+  Send(c, records);
+}
+
+auto FcgiUpstream::GetConnection() -> ConnectionPtr
+{
+  ConnectionPtr best;
+
+  // The least loaded one, the idle connections are reused first
+  for (auto const& c : conns_) {
+    if (!c->free_ids.empty() && (!best || c->free_ids.size() > best->free_ids.size())) {
+      best = c;
+    }
+  }
+
+  if (best && best->free_ids.size() == max_requests_) {
+    return best;
+  }
+
+  if (conns_.size() < max_conns_) {
+    return NewConnection();
+  }
+
+  return best;
+}
+
+auto FcgiUpstream::NewConnection() -> ConnectionPtr
+{
+  auto c = std::make_shared<Connection>();
+  c->client = std::make_shared<TcpClient>(loop_, addr_, "FcgiUpstream");
+
+  // Allocated from the end, so 1 is used first
+  for (size_t i = max_requests_; i > 0; --i) {
+    c->free_ids.push_back(static_cast<uint16_t>(i));
+  }
+
+  std::weak_ptr<Connection> wp(c);
+
+  c->client->SetConnectionCallback([this, wp](TcpConnectionPtr const& conn) {
+    auto c = wp.lock();
+    if (c) OnConnection(c, conn);
+  });
+
+  c->client->SetMessageCallback([this, wp](TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp) {
+    auto c = wp.lock();
+    if (c) OnMessage(c, buffer);
+  });
+
+  loop_->RunAfter([this, wp]() {
+    auto c = wp.lock();
+
+    if (c && !c->conn && !c->closed) {
+      LOG_ERROR << "Failed to connect to the FastCGI application " << addr_.ToIpPort();
+      Close(c);
+    }
+  }, kConnectTimeout);
+
+  conns_.push_back(c);
+  c->client->Connect();
+  return c;
+}
+
+void FcgiUpstream::Start(ConnectionPtr const& c, RequestId id, std::string const& params,
+                         StringView body, Callbacks callbacks)
+{
+  const auto request_id = c->free_ids.back();
+  c->free_ids.pop_back();
+
+  auto& stream = c->streams[request_id];
+  stream.id = id;
+  stream.callbacks = std::move(callbacks);
+
+  locations_[id] = Location{c.get(), request_id};
+
+  std::string records;
+  records.reserve(params.size() + body.size() + 64);
+
+  FcgiCodec::AppendBeginRequest(records, request_id, true);
+
+  if (!params.empty()) {
+    FcgiCodec::AppendStream(records, FcgiCodec::kParams, request_id, params);
+  }
+
+  FcgiCodec::AppendStream(records, FcgiCodec::kParams, request_id, StringView());
+
+  if (!body.empty()) {
+    FcgiCodec::AppendStream(records, FcgiCodec::kStdin, request_id, body);
+  }
+
+  FcgiCodec::AppendStream(records, FcgiCodec::kStdin, request_id, StringView());
+
+  Send(*c, records);
+}
+
+void FcgiUpstream::Send(Connection& c, std::string const& records)
+{
+  if (c.conn) {
+    c.conn->Send(records);
+  }
+  else {
+    c.output += records;
+  }
+}
+
+void FcgiUpstream::OnConnection(ConnectionPtr const& c, TcpConnectionPtr const& conn)
+{
+  if (conn->IsConnected()) {
+    if (c->closed) {
+      conn->ShutdownWrite();
+      return;
+    }
+
+    c->conn = conn;
+
+    if (!c->output.empty()) {
+      conn->Send(c->output);
+      std::string().swap(c->output);
+    }
+
+    return;
+  }
+
+  if (!c->closed) {
+    LOG_WARN << "The connection to the FastCGI application " << addr_.ToIpPort() << " is closed";
+    Close(c);
+  }
+}
+
+void FcgiUpstream::OnMessage(ConnectionPtr const& c, Buffer& buffer)
+{
+  auto data = buffer.ToStringView();
+  FcgiCodec::Record record;
+  size_t consumed = 0;
+  size_t total = 0;
+  FcgiCodec::Result result;
+
+  while ((result = FcgiCodec::Parse(data, record, consumed)) == FcgiCodec::kGood) {
+    data.remove_prefix(consumed);
+    total += consumed;
+
+    if (!OnRecord(c, record)) {
+      result = FcgiCodec::kBad;
+      break;
+    }
+  }
+
+  buffer.AdvanceRead(total);
+
+  if (result == FcgiCodec::kBad) {
+    LOG_ERROR << "The FastCGI application " << addr_.ToIpPort() << " sends an invalid record";
+    Close(c);
+    return;
+  }
+
+  DispatchPendings();
+}
+
+bool FcgiUpstream::OnRecord(ConnectionPtr const& c, FcgiCodec::Record const& record)
+{
+  auto iter = c->streams.find(record.request_id);
+
+  if (iter == c->streams.end()) {
+    LOG_WARN << "The FastCGI request " << record.request_id << " is unknown, ignore it";
+    return true;
+  }
+
+  auto& stream = iter->second;
+
+  switch (record.type) {
+    case FcgiCodec::kStdout:
+      if (!stream.aborted) {
+        OnStdout(*c, record.request_id, stream, record.content);
+      }
+      break;
+    case FcgiCodec::kStderr:
+      if (!record.content.empty()) {
+        LOG_WARN << "FastCGI stderr: " << record.content;
+      }
+      break;
+    case FcgiCodec::kEndRequest: {
+      uint32_t app_status = 0;
+      FcgiCodec::ProtocolStatus status;
+
+      if (!FcgiCodec::ParseEndRequest(record.content, app_status, status)) {
+        return false;
+      }
+
+      if (status != FcgiCodec::kRequestComplete) {
+        LOG_WARN << "The FastCGI request is rejected, protocol status: " << status;
+      }
+
+      auto callbacks = std::move(stream.callbacks);
+      const bool ok = stream.head_done && status == FcgiCodec::kRequestComplete;
+      Release(*c, record.request_id);
+
+      if (callbacks.on_end) {
+        callbacks.on_end(ok);
+      }
+    }
+      break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+void FcgiUpstream::OnStdout(Connection& c, uint16_t request_id, Stream& stream,
+                            StringView content)
+{
+  if (stream.head_done) {
+    if (!content.empty()) {
+      stream.callbacks.on_body(content);
+    }
+
+    return;
+  }
+
+  stream.head.append(content.data(), content.size());
+
+  int status = 0;
+  StringView reason;
+  std::vector<Pair> headers;
+  size_t consumed = 0;
+
+  auto result = FcgiCodec::ParseResponseHead(stream.head, status, reason, headers, consumed);
+
+  if (result == FcgiCodec::kShort && stream.head.size() <= kMaxHeadSize) {
+    return;
+  }
+
+  if (result != FcgiCodec::kGood) {
+    LOG_ERROR << "The FastCGI application " << addr_.ToIpPort() << " sends an invalid header";
+
+    auto callbacks = std::move(stream.callbacks);
+    stream.aborted = true;
+
+    std::string records;
+    FcgiCodec::AppendAbortRequest(records, request_id);
+    Send(c, records);
+
+    if (callbacks.on_end) {
+      callbacks.on_end(false);
+    }
+
+    return;
+  }
+
+  stream.head_done = true;
+  stream.callbacks.on_head(status, reason, headers);
+
+  if (consumed < stream.head.size()) {
+    stream.callbacks.on_body(StringView(stream.head).substr(consumed));
+  }
+
+  std::string().swap(stream.head);
+}
+
+void FcgiUpstream::Release(Connection& c, uint16_t request_id)
+{
+  auto iter = c.streams.find(request_id);
+  locations_.erase(iter->second.id);
+  c.streams.erase(iter);
+  c.free_ids.push_back(request_id);
+}
+
+void FcgiUpstream::Close(ConnectionPtr const& c)
+{
+  if (c->closed) return;
+  c->closed = true;
+
+  for (auto iter = conns_.begin(); iter != conns_.end(); ++iter) {
+    if (*iter == c) {
+      conns_.erase(iter);
+      break;
+    }
+  }
+
+  auto streams = std::move(c->streams);
+  c->streams.clear();
+
+  for (auto& stream : streams) {
+    locations_.erase(stream.second.id);
+  }
+
+  if (c->conn && c->conn->IsConnected()) {
+    c->client->Disconnect();
+  }
+  else {
+    c->client->Stop();
+  }
+
+  // The client can't be destroyed in its callback
+  loop_->QueueToLoop([c]() {});
+
+  for (auto& stream : streams) {
+    if (!stream.second.aborted && stream.second.callbacks.on_end) {
+      stream.second.callbacks.on_end(false);
+    }
+  }
+
+  DispatchPendings();
+}
+
+void FcgiUpstream::DispatchPendings()
+{
+  while (!pendings_.empty()) {
+    auto c = GetConnection();
+
+    if (!c) return;
+
+    auto pending = std::move(pendings_.front());
+    pendings_.pop_front();
+    Start(c, pending.id, pending.params, pending.body, std::move(pending.callbacks));
+  }
+}
+
+} // namespace http
@@ -0,0 +1,155 @@
+#ifndef KANON_HTTP_FCGI_UPSTREAM_H
+#define KANON_HTTP_FCGI_UPSTREAM_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <kanon/net/user_client.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/fcgi_codec.h"
+
+namespace http {
+
+/**
+ * The connections to a FastCGI application owned by an IO loop.
+ *
+ * The connections are persistent(FCGI_KEEP_CONN) and each one carries
+ * up to max_requests requests at the same time by request id, so the
+ * applications supporting multiplexing share a few connections, and
+ * the others(e.g. php-fpm) get one request per connection with
+ * max_requests = 1. The requests exceeding the capacity wait in the
+ * queue until a request id is released.
+ *
+ * The request body is split into records when submitted, and the
+ * records of response are passed to the callbacks once received,
+ * so neither of them is buffered as a whole.
+ *
+ * \note Not thread-safe, must be used in the loop
+ */
+class FcgiUpstream : kanon::noncopyable {
+ public:
+  using Pair = FcgiCodec::Pair;
+
+  struct Callbacks {
+    /** The CGI header of response is received */
+    std::function<void(int status, kanon::StringView reason,
+                       std::vector<Pair> const& headers)> on_head;
+
+    /** A piece of the response body */
+    std::function<void(kanon::StringView data)> on_body;
+
+    /**
+     * The request is complete.
+     * \param ok false if the application failed or the connection is
+     *           lost, the response may be partially received
+     */
+    std::function<void(bool ok)> on_end;
+  };
+
+  /** Unique in the upstream, 0 is invalid */
+  using RequestId = uint64_t;
+
+  /**
+   * \param max_conns The max number of connections
+   * \param max_requests The max number of requests per connection
+   * \param max_pendings The max number of requests waiting for a connection
+   */
+  FcgiUpstream(kanon::EventLoop* loop, kanon::InetAddr const& addr,
+               size_t max_conns, size_t max_requests, size_t max_pendings);
+  ~FcgiUpstream() noexcept;
+
+  /**
+   * \param params The content of FCGI_PARAMS, see FcgiCodec::AppendParam()
+   * \param body The request body, copied only if the request waits in the queue
+   * \return 0 if the queue is full
+   */
+  RequestId Submit(std::string const& params, kanon::StringView body, Callbacks callbacks);
+
+  /**
+   * Abort the request, e.g. the client is disconnected.
+   * The callbacks are not called after it.
+   */
+  void Abort(RequestId id);
+
+  size_t GetConnectionNum() const noexcept { return conns_.size(); }
+  size_t GetPendingNum() const noexcept { return pendings_.size(); }
+
+  /**
+   * Parse ip:port, the Unix socket is not supported
+   * \param error Set the error message if failed
+   */
+  static bool ParseAddress(kanon::StringView address, std::string& ip, uint16_t& port,
+                           std::string& error);
+
+ private:
+  struct Stream {
+    RequestId id = 0;
+    Callbacks callbacks;
+    /** The CGI header received, it may be split to records */
+    std::string head;
+    bool head_done = false;
+    bool aborted = false;
+  };
+
+  struct Connection {
+    kanon::TcpClientPtr client;
+    kanon::TcpConnectionPtr conn;
+    bool closed = false;
+    /** The records are sent when connected */
+    std::string output;
+    std::unordered_map<uint16_t, Stream> streams;
+    std::vector<uint16_t> free_ids;
+  };
+
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  struct Pending {
+    RequestId id;
+    std::string params;
+    std::string body;
+    Callbacks callbacks;
+  };
+
+  ConnectionPtr GetConnection();
+  ConnectionPtr NewConnection();
+  void Start(ConnectionPtr const& c, RequestId id, std::string const& params,
+             kanon::StringView body, Callbacks callbacks);
+  void Send(Connection& c, std::string const& records);
+
+  void OnConnection(ConnectionPtr const& c, kanon::TcpConnectionPtr const& conn);
+  void OnMessage(ConnectionPtr const& c, kanon::Buffer& buffer);
+  /** \return false if the connection must be closed */
+  bool OnRecord(ConnectionPtr const& c, FcgiCodec::Record const& record);
+  void OnStdout(Connection& c, uint16_t request_id, Stream& stream, kanon::StringView content);
+  void Release(Connection& c, uint16_t request_id);
+
+  /** Fail the requests of \p c and remove it */
+  void Close(ConnectionPtr const& c);
+  /** Start the waiting requests if there are free request ids */
+  void DispatchPendings();
+
+  struct Location {
+    Connection* conn;
+    uint16_t request_id;
+  };
+
+  kanon::EventLoop* loop_;
+  kanon::InetAddr addr_;
+  size_t max_conns_;
+  size_t max_requests_;
+  size_t max_pendings_;
+
+  RequestId next_id_ = 1;
+  std::vector<ConnectionPtr> conns_;
+  std::unordered_map<RequestId, Location> locations_;
+  std::deque<Pending> pendings_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_FCGI_UPSTREAM_H
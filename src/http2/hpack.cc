@@ -0,0 +1,517 @@
+#include "http2/hpack.h"
+
+using namespace kanon;
+
+namespace http {
+
+constexpr size_t Hpack::kEntryOverhead;
+constexpr size_t Hpack::kDefaultTableSize;
+constexpr size_t Hpack::kStaticTableSize;
+
+namespace {
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+/** The static Huffman code of RFC 7541 Appendix B, the last one is EOS */
+constexpr HuffmanCode kHuffmanCodes[257] = {
+  { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+  { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+  { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+  { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+  { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+  { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+  { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+  { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+  { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+  { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+  { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+  { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+  { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+  { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+  { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+  { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+  { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+  { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+  { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+  { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+  { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+  { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+  { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+  { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+  { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+  { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+  { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+  { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+  { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+  { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+  { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+  { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+  { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+  { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+  { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+  { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+  { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+  { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+  { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+  { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+  { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+  { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+  { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+  { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+  { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+  { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+  { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+  { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+  { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+  { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+  { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+  { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+  { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+  { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+  { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+  { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+  { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+  { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+  { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+  { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+  { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+  { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+  { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+  { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+  { 0x3fffffff, 30 },
+};
+
+constexpr int kEos = 256;
+
+/** The static table of RFC 7541 Appendix A */
+Hpack::Header const kStaticTable[Hpack::kStaticTableSize] = {
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" },
+};
+
+/**
+ * The binary tree of Huffman code, the leaves are symbols.
+ * Built once, the decoding walks it bit by bit.
+ */
+class HuffmanTree {
+ public:
+  struct Node {
+    int16_t children[2] = { -1, -1 };
+    int16_t symbol = -1;
+  };
+
+  HuffmanTree()
+  {
+    nodes_.reserve(2 * 257);
+    nodes_.emplace_back();
+
+    for (int sym = 0; sym < 257; ++sym) {
+      auto const& code = kHuffmanCodes[sym];
+      int16_t cur = 0;
+
+      for (int i = code.bits - 1; i >= 0; --i) {
+        const int bit = (code.code >> i) & 1;
+
+        if (nodes_[cur].children[bit] < 0) {
+          nodes_[cur].children[bit] = static_cast<int16_t>(nodes_.size());
+          nodes_.emplace_back();
+        }
+
+        cur = nodes_[cur].children[bit];
+      }
+
+      nodes_[cur].symbol = static_cast<int16_t>(sym);
+    }
+  }
+
+  Node const& operator[](int16_t index) const noexcept { return nodes_[index]; }
+
+  static HuffmanTree const& Get()
+  {
+    static HuffmanTree tree;
+    return tree;
+  }
+
+ private:
+  std::vector<Node> nodes_;
+};
+
+} // namespace
+
+void Hpack::AppendInteger(std::string& out, uint64_t value, int prefix, uint8_t first)
+{
+  const uint64_t max_prefix = (1u << prefix) - 1;
+
+  if (value < max_prefix) {
+    out += static_cast<char>(first | value);
+    return;
+  }
+
+  out += static_cast<char>(first | max_prefix);
+  value -= max_prefix;
+
+  while (value >= 128) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+
+  out += static_cast<char>(value);
+}
+
+bool Hpack::ParseInteger(StringView& data, int prefix, uint64_t& value) noexcept
+{
+  if (data.empty()) return false;
+
+  const uint64_t max_prefix = (1u << prefix) - 1;
+  value = static_cast<uint8_t>(data[0]) & max_prefix;
+  size_t i = 1;
+
+  if (value == max_prefix) {
+    int shift = 0;
+
+    for (;;) {
+      // The integers used are far less than 2^56
+      if (i >= data.size() || shift > 56) return false;
+
+      const uint8_t b = data[i++];
+      value += static_cast<uint64_t>(b & 0x7f) << shift;
+      shift += 7;
+
+      if ((b & 0x80) == 0) break;
+    }
+  }
+
+  data.remove_prefix(i);
+  return true;
+}
+
+void Hpack::AppendString(std::string& out, StringView str)
+{
+  const size_t huffman_length = GetHuffmanLength(str);
+
+  if (huffman_length < str.size()) {
+    AppendInteger(out, huffman_length, 7, 0x80);
+    HuffmanEncode(out, str);
+  }
+  else {
+    AppendInteger(out, str.size(), 7, 0);
+    out.append(str.data(), str.size());
+  }
+}
+
+bool Hpack::ParseString(StringView& data, std::string& str)
+{
+  if (data.empty()) return false;
+
+  const bool huffman = (data[0] & 0x80) != 0;
+  uint64_t length = 0;
+
+  if (!ParseInteger(data, 7, length) || length > data.size()) {
+    return false;
+  }
+
+  auto octets = data.substr(0, length);
+  data.remove_prefix(length);
+
+  str.clear();
+
+  if (huffman) {
+    return HuffmanDecode(str, octets);
+  }
+
+  str.assign(octets.data(), octets.size());
+  return true;
+}
+
+size_t Hpack::GetHuffmanLength(StringView str) noexcept
+{
+  uint64_t bits = 0;
+
+  for (auto c : str) {
+    bits += kHuffmanCodes[static_cast<uint8_t>(c)].bits;
+  }
+
+  return (bits + 7) / 8;
+}
+
+void Hpack::HuffmanEncode(std::string& out, StringView str)
+{
+  // The codes are at most 30 bits, so the pending bits(< 8) fit in
+  uint64_t pending = 0;
+  int pending_bits = 0;
+
+  for (auto c : str) {
+    auto const& code = kHuffmanCodes[static_cast<uint8_t>(c)];
+    pending = (pending << code.bits) | code.code;
+    pending_bits += code.bits;
+
+    while (pending_bits >= 8) {
+      pending_bits -= 8;
+      out += static_cast<char>(pending >> pending_bits);
+    }
+  }
+
+  // Padded by the prefix of EOS(all ones)
+  if (pending_bits > 0) {
+    out += static_cast<char>((pending << (8 - pending_bits)) | (0xff >> pending_bits));
+  }
+}
+
+bool Hpack::HuffmanDecode(std::string& out, StringView str)
+{
+  auto const& tree = HuffmanTree::Get();
+  int16_t cur = 0;
+
+  // The bits since the last symbol, they must be the padding at last
+  int pending_bits = 0;
+  bool all_ones = true;
+
+  for (auto c : str) {
+    const uint8_t b = c;
+
+    for (int i = 7; i >= 0; --i) {
+      const int bit = (b >> i) & 1;
+      cur = tree[cur].children[bit];
+
+      if (cur < 0) return false;
+
+      ++pending_bits;
+      all_ones = all_ones && bit == 1;
+
+      const int16_t sym = tree[cur].symbol;
+
+      if (sym >= 0) {
+        if (sym == kEos) return false;
+
+        out += static_cast<char>(sym);
+        cur = 0;
+        pending_bits = 0;
+        all_ones = true;
+      }
+    }
+  }
+
+  return pending_bits < 8 && all_ones;
+}
+
+auto Hpack::GetStaticEntry(size_t index) noexcept -> Header const&
+{
+  return kStaticTable[index - 1];
+}
+
+bool HpackDecoder::Decode(StringView block, std::vector<Header>& headers)
+{
+  headers.clear();
+  size_t list_size = 0;
+
+  // The size update is only allowed at the beginning of block
+  bool update_allowed = true;
+
+  while (!block.empty()) {
+    const uint8_t b = block[0];
+
+    if (b & 0x80) {
+      // Indexed header field
+      uint64_t index = 0;
+      Header const* entry = nullptr;
+
+      if (!Hpack::ParseInteger(block, 7, index) || !GetEntry(index, entry)) {
+        return false;
+      }
+
+      headers.push_back(*entry);
+    }
+    else if ((b & 0xe0) == 0x20) {
+      // Dynamic table size update
+      uint64_t size = 0;
+
+      if (!update_allowed || !Hpack::ParseInteger(block, 5, size) || size > max_table_size_) {
+        return false;
+      }
+
+      capacity_ = size;
+      Evict(capacity_);
+      continue;
+    }
+    else {
+      // Literal with incremental indexing(01), without indexing(0000)
+      // or never indexed(0001)
+      const bool indexing = (b & 0xc0) == 0x40;
+      uint64_t index = 0;
+
+      if (!Hpack::ParseInteger(block, indexing ? 6 : 4, index)) {
+        return false;
+      }
+
+      Header header;
+
+      if (index != 0) {
+        Header const* entry = nullptr;
+        if (!GetEntry(index, entry)) return false;
+        header.first = entry->first;
+      }
+      else if (!Hpack::ParseString(block, header.first)) {
+        return false;
+      }
+
+      if (!Hpack::ParseString(block, header.second)) {
+        return false;
+      }
+
+      if (indexing) {
+        Insert(header);
+      }
+
+      headers.push_back(std::move(header));
+    }
+
+    update_allowed = false;
+
+    auto const& header = headers.back();
+    list_size += header.first.size() + header.second.size() + Hpack::kEntryOverhead;
+
+    if (list_size > max_list_size_) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool HpackDecoder::GetEntry(uint64_t index, Header const*& entry) const noexcept
+{
+  if (index == 0) return false;
+
+  if (index <= Hpack::kStaticTableSize) {
+    entry = &Hpack::GetStaticEntry(index);
+    return true;
+  }
+
+  index -= Hpack::kStaticTableSize + 1;
+
+  if (index >= table_.size()) return false;
+
+  entry = &table_[index];
+  return true;
+}
+
+void HpackDecoder::Insert(Header header)
+{
+  const size_t size = header.first.size() + header.second.size() + Hpack::kEntryOverhead;
+
+  // The entry larger than the table empties it
+  if (size > capacity_) {
+    table_.clear();
+    table_size_ = 0;
+    return;
+  }
+
+  Evict(capacity_ - size);
+
+  table_size_ += size;
+  table_.push_front(std::move(header));
+}
+
+void HpackDecoder::Evict(size_t capacity)
+{
+  while (table_size_ > capacity) {
+    auto const& oldest = table_.back();
+    table_size_ -= oldest.first.size() + oldest.second.size() + Hpack::kEntryOverhead;
+    table_.pop_back();
+  }
+}
+
+void HpackEncoder::Append(std::string& out, StringView name, StringView value)
+{
+  if (!size_update_sent_) {
+    Hpack::AppendInteger(out, 0, 5, 0x20);
+    size_update_sent_ = true;
+  }
+
+  size_t name_index = 0;
+
+  for (size_t i = 1; i <= Hpack::kStaticTableSize; ++i) {
+    auto const& entry = Hpack::GetStaticEntry(i);
+
+    if (name != entry.first) continue;
+
+    if (value == entry.second) {
+      Hpack::AppendInteger(out, i, 7, 0x80);
+      return;
+    }
+
+    if (name_index == 0) name_index = i;
+  }
+
+  Hpack::AppendInteger(out, name_index, 4, 0);
+
+  if (name_index == 0) {
+    Hpack::AppendString(out, name);
+  }
+
+  Hpack::AppendString(out, value);
+}
+
+} // namespace http
@@ -0,0 +1,132 @@
+#ifndef KANON_HTTP_HPACK_H
+#define KANON_HTTP_HPACK_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+/**
+ * The primitives of HPACK(RFC 7541), the header compression of HTTP/2.
+ *
+ * The integer is encoded with a N-bit prefix in the first byte, the
+ * rest is continued by 7 bits per byte(little endian). The string is
+ * a length(7-bit prefix, the high bit is the Huffman flag) followed by
+ * the octets, which are Huffman-encoded with the static code if flagged.
+ */
+class Hpack {
+ public:
+  using Header = std::pair<std::string, std::string>;
+
+  /** The size of an entry is the length of name and value plus 32 */
+  static constexpr size_t kEntryOverhead = 32;
+  static constexpr size_t kDefaultTableSize = 4096;
+  static constexpr size_t kStaticTableSize = 61;
+
+  /**
+   * \param prefix The bits of integer in the first byte(1~8)
+   * \param first The bits of the first byte above the prefix, e.g. the representation
+   */
+  static void AppendInteger(std::string& out, uint64_t value, int prefix, uint8_t first);
+
+  /** Huffman-encoded if it is shorter */
+  static void AppendString(std::string& out, kanon::StringView str);
+
+  /**
+   * Decode the integer at the beginning of \p data, the decoded bytes
+   * are removed from it.
+   * \return false if incomplete or overflow
+   */
+  static bool ParseInteger(kanon::StringView& data, int prefix, uint64_t& value) noexcept;
+  static bool ParseString(kanon::StringView& data, std::string& str);
+
+  static void HuffmanEncode(std::string& out, kanon::StringView str);
+  static size_t GetHuffmanLength(kanon::StringView str) noexcept;
+
+  /**
+   * \return false if the code is invalid, i.e. EOS is decoded or the
+   *         padding is longer than 7 bits or not the prefix of EOS
+   */
+  static bool HuffmanDecode(std::string& out, kanon::StringView str);
+
+  /** \param index 1-based */
+  static Header const& GetStaticEntry(size_t index) noexcept;
+};
+
+/**
+ * Decode the header blocks of a connection.
+ *
+ * The dynamic table is shared by all header blocks sent by the peer,
+ * so the blocks must be decoded in the order they are received.
+ */
+class HpackDecoder : kanon::noncopyable {
+ public:
+  using Header = Hpack::Header;
+
+  /**
+   * The SETTINGS_HEADER_TABLE_SIZE sent to the peer,
+   * the size update of encoder can't exceed it.
+   */
+  void SetMaxTableSize(size_t size) noexcept { max_table_size_ = size; }
+
+  /**
+   * The header list larger than it(decoded size of RFC 7540 6.5.2)
+   * is rejected, i.e. SETTINGS_MAX_HEADER_LIST_SIZE.
+   */
+  void SetMaxHeaderListSize(size_t size) noexcept { max_list_size_ = size; }
+
+  /**
+   * Decode a complete header block(the fragments of HEADERS and
+   * CONTINUATION are concatenated).
+   * \return false if it is malformed or the list is too large, the
+   *         connection must be closed with COMPRESSION_ERROR since
+   *         the rest of block is not decoded and the table is inconsistent
+   */
+  bool Decode(kanon::StringView block, std::vector<Header>& headers);
+
+  size_t GetTableSize() const noexcept { return table_size_; }
+  size_t GetEntryNum() const noexcept { return table_.size(); }
+
+ private:
+  bool GetEntry(uint64_t index, Header const*& entry) const noexcept;
+  void Insert(Header header);
+  void Evict(size_t capacity);
+
+  /** The newest entry is at the front */
+  std::deque<Header> table_;
+  size_t table_size_ = 0;
+
+  /** The size set by the size update of peer */
+  size_t capacity_ = Hpack::kDefaultTableSize;
+  size_t max_table_size_ = Hpack::kDefaultTableSize;
+  size_t max_list_size_ = static_cast<size_t>(-1);
+};
+
+/**
+ * Encode the header blocks sent to the peer.
+ *
+ * The dynamic table is not used, the encoder announces the table size
+ * is 0 in the first block. The fields are encoded as the literal without
+ * indexing(the name is indexed if it is in the static table) or the
+ * indexed field if both name and value match the static entry.
+ * The responses only share a few fields, it is cheaper than keeping a
+ * table per connection.
+ */
+class HpackEncoder : kanon::noncopyable {
+ public:
+  /** Append a field to the header block \p out, the \p name must be lowercase */
+  void Append(std::string& out, kanon::StringView name, kanon::StringView value);
+
+ private:
+  bool size_update_sent_ = false;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_HPACK_H
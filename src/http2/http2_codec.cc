@@ -0,0 +1,225 @@
+#include "http2/http2_codec.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+constexpr size_t Http2Codec::kHeaderSize;
+constexpr size_t Http2Codec::kDefaultMaxFrameSize;
+constexpr size_t Http2Codec::kMaxFrameSize;
+constexpr int64_t Http2Codec::kDefaultWindowSize;
+constexpr int64_t Http2Codec::kMaxWindowSize;
+constexpr char const Http2Codec::kPreface[];
+constexpr size_t Http2Codec::kPrefaceSize;
+
+static void AppendUint32(std::string& out, uint32_t value)
+{
+  char bytes[4] = {
+    static_cast<char>(value >> 24),
+    static_cast<char>(value >> 16),
+    static_cast<char>(value >> 8),
+    static_cast<char>(value),
+  };
+
+  out.append(bytes, sizeof bytes);
+}
+
+int Http2Codec::MatchPreface(StringView data) noexcept
+{
+  const size_t n = std::min(data.size(), kPrefaceSize);
+
+  if (::memcmp(data.data(), kPreface, n) != 0) {
+    return -1;
+  }
+
+  return n == kPrefaceSize ? 1 : 0;
+}
+
+void Http2Codec::AppendFrameHeader(std::string& out, size_t length, FrameType type,
+                                   uint8_t flags, uint32_t stream_id)
+{
+  char header[kHeaderSize] = {
+    static_cast<char>(length >> 16),
+    static_cast<char>(length >> 8),
+    static_cast<char>(length),
+    static_cast<char>(type),
+    static_cast<char>(flags),
+    static_cast<char>((stream_id >> 24) & 0x7f),
+    static_cast<char>(stream_id >> 16),
+    static_cast<char>(stream_id >> 8),
+    static_cast<char>(stream_id),
+  };
+
+  out.append(header, sizeof header);
+}
+
+void Http2Codec::AppendSettings(std::string& out, std::vector<Setting> const& settings)
+{
+  AppendFrameHeader(out, settings.size() * 6, kSettings, 0, 0);
+
+  for (auto const& setting : settings) {
+    out += static_cast<char>(setting.first >> 8);
+    out += static_cast<char>(setting.first);
+    AppendUint32(out, setting.second);
+  }
+}
+
+void Http2Codec::AppendSettingsAck(std::string& out)
+{
+  AppendFrameHeader(out, 0, kSettings, kAck, 0);
+}
+
+void Http2Codec::AppendPing(std::string& out, StringView opaque, bool ack)
+{
+  AppendFrameHeader(out, opaque.size(), kPing, ack ? kAck : 0, 0);
+  out.append(opaque.data(), opaque.size());
+}
+
+void Http2Codec::AppendWindowUpdate(std::string& out, uint32_t stream_id, uint32_t increment)
+{
+  AppendFrameHeader(out, 4, kWindowUpdate, 0, stream_id);
+  AppendUint32(out, increment & 0x7fffffff);
+}
+
+void Http2Codec::AppendRstStream(std::string& out, uint32_t stream_id, ErrorCode error)
+{
+  AppendFrameHeader(out, 4, kRstStream, 0, stream_id);
+  AppendUint32(out, error);
+}
+
+void Http2Codec::AppendGoAway(std::string& out, uint32_t last_stream_id, ErrorCode error)
+{
+  AppendFrameHeader(out, 8, kGoAway, 0, 0);
+  AppendUint32(out, last_stream_id & 0x7fffffff);
+  AppendUint32(out, error);
+}
+
+void Http2Codec::AppendHeaders(std::string& out, uint32_t stream_id, StringView block,
+                               bool end_stream, size_t max_frame_size)
+{
+  // END_STREAM is only set in HEADERS even if CONTINUATION follows
+  FrameType type = kHeaders;
+  uint8_t flags = end_stream ? kEndStream : 0;
+
+  do {
+    const auto len = std::min(block.size(), max_frame_size);
+    const bool last = len == block.size();
+
+    AppendFrameHeader(out, len, type, flags | (last ? kEndHeaders : 0), stream_id);
+    out.append(block.data(), len);
+    block.remove_prefix(len);
+
+    type = kContinuation;
+    flags = 0;
+  } while (!block.empty());
+}
+
+auto Http2Codec::Parse(StringView data, size_t max_frame_size,
+                       Frame& frame, size_t& consumed) noexcept -> Result
+{
+  if (data.size() < kHeaderSize) return kShort;
+
+  auto p = reinterpret_cast<unsigned char const*>(data.data());
+  const size_t length = (p[0] << 16) | (p[1] << 8) | p[2];
+
+  if (length > max_frame_size) return kBad;
+  if (data.size() < kHeaderSize + length) return kShort;
+
+  frame.type = p[3];
+  frame.flags = p[4];
+  frame.stream_id = ReadUint32(data.substr(5, 4)) & 0x7fffffff;
+  frame.payload = data.substr(kHeaderSize, length);
+  consumed = kHeaderSize + length;
+  return kGood;
+}
+
+bool Http2Codec::RemovePadding(Frame& frame) noexcept
+{
+  if (!(frame.flags & kPadded)) return true;
+
+  auto& payload = frame.payload;
+  if (payload.empty()) return false;
+
+  const size_t padding = static_cast<uint8_t>(payload[0]);
+  payload.remove_prefix(1);
+
+  if (padding > payload.size()) return false;
+
+  payload = payload.substr(0, payload.size() - padding);
+  return true;
+}
+
+bool Http2Codec::ParseHeadersPayload(Frame& frame, Priority& priority, bool& has_priority) noexcept
+{
+  if (!RemovePadding(frame)) return false;
+
+  has_priority = (frame.flags & kPriorityFlag) != 0;
+
+  if (has_priority) {
+    if (frame.payload.size() < 5) return false;
+
+    ParsePriority(frame.payload.substr(0, 5), priority);
+    frame.payload.remove_prefix(5);
+  }
+
+  return true;
+}
+
+bool Http2Codec::ParsePriority(StringView payload, Priority& priority) noexcept
+{
+  if (payload.size() != 5) return false;
+
+  const uint32_t dependency = ReadUint32(payload);
+  priority.exclusive = (dependency >> 31) != 0;
+  priority.dependency = dependency & 0x7fffffff;
+  priority.weight = static_cast<uint8_t>(payload[4]) + 1;
+  return true;
+}
+
+bool Http2Codec::ParseSettings(StringView payload, std::vector<Setting>& settings)
+{
+  if (payload.size() % 6 != 0) return false;
+
+  settings.clear();
+
+  for (; !payload.empty(); payload.remove_prefix(6)) {
+    const uint16_t id = (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]);
+    settings.emplace_back(id, ReadUint32(payload.substr(2, 4)));
+  }
+
+  return true;
+}
+
+uint32_t Http2Codec::ReadUint32(StringView data) noexcept
+{
+  auto p = reinterpret_cast<unsigned char const*>(data.data());
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+char const* Http2Codec::GetErrorString(ErrorCode error) noexcept
+{
+  static char const* const kStrings[] = {
+    "NO_ERROR",
+    "PROTOCOL_ERROR",
+    "INTERNAL_ERROR",
+    "FLOW_CONTROL_ERROR",
+    "SETTINGS_TIMEOUT",
+    "STREAM_CLOSED",
+    "FRAME_SIZE_ERROR",
+    "REFUSED_STREAM",
+    "CANCEL",
+    "COMPRESSION_ERROR",
+    "CONNECT_ERROR",
+    "ENHANCE_YOUR_CALM",
+    "INADEQUATE_SECURITY",
+    "HTTP_1_1_REQUIRED",
+  };
+
+  return error <= kHttp11Required ? kStrings[error] : "UNKNOWN_ERROR";
+}
+
+} // namespace http
@@ -0,0 +1,158 @@
+#ifndef KANON_HTTP2_CODEC_H
+#define KANON_HTTP2_CODEC_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+
+namespace http {
+
+/**
+ * The frames of HTTP/2(RFC 7540).
+ *
+ * Each frame is a 9 bytes header followed by the payload:
+ *
+ * | length(3) | type(1) | flags(1) | R(1 bit) stream id(31 bits) |
+ *
+ * The integers are big endian. The frames of different streams can
+ * be interleaved in a connection except the header block, which is
+ * sent by HEADERS and CONTINUATION contiguously.
+ */
+class Http2Codec {
+ public:
+  enum FrameType : uint8_t {
+    kData = 0,
+    kHeaders,
+    kPriority,
+    kRstStream,
+    kSettings,
+    kPushPromise,
+    kPing,
+    kGoAway,
+    kWindowUpdate,
+    kContinuation,
+  };
+
+  enum Flag : uint8_t {
+    kEndStream = 0x1,
+    kAck = 0x1, /** SETTINGS and PING */
+    kEndHeaders = 0x4,
+    kPadded = 0x8,
+    kPriorityFlag = 0x20,
+  };
+
+  enum ErrorCode : uint32_t {
+    kNoError = 0,
+    kProtocolError,
+    kInternalError,
+    kFlowControlError,
+    kSettingsTimeout,
+    kStreamClosed,
+    kFrameSizeError,
+    kRefusedStream,
+    kCancel,
+    kCompressionError,
+    kConnectError,
+    kEnhanceYourCalm,
+    kInadequateSecurity,
+    kHttp11Required,
+  };
+
+  enum SettingId : uint16_t {
+    kSettingHeaderTableSize = 1,
+    kSettingEnablePush,
+    kSettingMaxConcurrentStreams,
+    kSettingInitialWindowSize,
+    kSettingMaxFrameSize,
+    kSettingMaxHeaderListSize,
+  };
+
+  enum Result {
+    kGood = 0,
+    kShort, /** Need more data */
+    kBad, /** FRAME_SIZE_ERROR */
+  };
+
+  struct Frame {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream_id;
+    kanon::StringView payload;
+  };
+
+  /** The priority of HEADERS and PRIORITY */
+  struct Priority {
+    uint32_t dependency = 0;
+    bool exclusive = false;
+    uint16_t weight = 16; /** 1~256 */
+  };
+
+  using Setting = std::pair<uint16_t, uint32_t>;
+
+  static constexpr size_t kHeaderSize = 9;
+  static constexpr size_t kDefaultMaxFrameSize = 16384;
+  static constexpr size_t kMaxFrameSize = (1 << 24) - 1;
+  static constexpr int64_t kDefaultWindowSize = 65535;
+  static constexpr int64_t kMaxWindowSize = (1u << 31) - 1;
+
+  /** The client connection preface, followed by SETTINGS */
+  static constexpr char const kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+  static constexpr size_t kPrefaceSize = sizeof(kPreface) - 1;
+
+  /**
+   * \return 1 if \p data starts with the preface,
+   *         0 if it is the prefix of preface(need more data),
+   *         -1 otherwise
+   */
+  static int MatchPreface(kanon::StringView data) noexcept;
+
+  static void AppendFrameHeader(std::string& out, size_t length, FrameType type,
+                                uint8_t flags, uint32_t stream_id);
+
+  static void AppendSettings(std::string& out, std::vector<Setting> const& settings);
+  static void AppendSettingsAck(std::string& out);
+  static void AppendPing(std::string& out, kanon::StringView opaque, bool ack);
+  static void AppendWindowUpdate(std::string& out, uint32_t stream_id, uint32_t increment);
+  static void AppendRstStream(std::string& out, uint32_t stream_id, ErrorCode error);
+  static void AppendGoAway(std::string& out, uint32_t last_stream_id, ErrorCode error);
+
+  /**
+   * Append the header block by HEADERS and CONTINUATION if it is larger
+   * than \p max_frame_size
+   */
+  static void AppendHeaders(std::string& out, uint32_t stream_id, kanon::StringView block,
+                            bool end_stream, size_t max_frame_size);
+
+  /**
+   * Parse a frame at the beginning of \p data
+   * \param max_frame_size The SETTINGS_MAX_FRAME_SIZE sent to peer
+   * \param consumed The size of the frame if kGood
+   * \return kBad if the length exceeds \p max_frame_size
+   */
+  static Result Parse(kanon::StringView data, size_t max_frame_size,
+                      Frame& frame, size_t& consumed) noexcept;
+
+  /**
+   * Remove the padding of DATA and HEADERS, and the priority of HEADERS
+   * \return false if the padding is longer than the payload(PROTOCOL_ERROR)
+   */
+  static bool ParseHeadersPayload(Frame& frame, Priority& priority, bool& has_priority) noexcept;
+  static bool RemovePadding(Frame& frame) noexcept;
+
+  /** \return false if the length is not 5 */
+  static bool ParsePriority(kanon::StringView payload, Priority& priority) noexcept;
+
+  /** \return false if the length is not a multiple of 6 */
+  static bool ParseSettings(kanon::StringView payload, std::vector<Setting>& settings);
+
+  static uint32_t ReadUint32(kanon::StringView data) noexcept;
+
+  static char const* GetErrorString(ErrorCode error) noexcept;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP2_CODEC_H
@@ -0,0 +1,1059 @@
+#include "http2/http2_connection.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <kanon/log/logger.h>
+#include <kanon/net/tcp_connection.h>
+
+#include "common/http_response.h"
+#include "config/http_config.h"
+#include "http2/http_parser.h"
+#include "http2/http_server2.h"
+#include "unix/stat.h"
+
+using namespace kanon;
+using namespace unix;
+
+#define _PEER_IP \
+  conn_->GetPeerAddr().ToIp()
+
+namespace http {
+
+constexpr size_t Http2Connection::kOutputLimit_;
+constexpr size_t Http2Connection::kMaxHeaderListSize_;
+constexpr int Http2Connection::kIdleTimeout_;
+
+/** The payload of HTTP2-Settings is base64url without padding(RFC 4648) */
+static bool Base64UrlDecode(StringView str, std::string& out)
+{
+  while (!str.empty() && str[str.size() - 1] == '=') {
+    str.remove_suffix(1);
+  }
+
+  if (str.size() % 4 == 1) return false;
+
+  uint32_t bits = 0;
+  int nbits = 0;
+
+  for (char c : str) {
+    int value;
+    if (c >= 'A' && c <= 'Z') value = c - 'A';
+    else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') value = c - '0' + 52;
+    else if (c == '-') value = 62;
+    else if (c == '_') value = 63;
+    else return false;
+
+    bits = (bits << 6) | value;
+    nbits += 6;
+
+    if (nbits >= 8) {
+      nbits -= 8;
+      out += static_cast<char>(bits >> nbits);
+    }
+  }
+
+  return true;
+}
+
+Http2Connection::Http2Connection(HttpServer& server, TcpConnectionPtr const& conn,
+                                 TlsChannelPtr tls)
+  : server_(&server)
+  , conn_(conn)
+  , tls_(std::move(tls))
+{
+  decoder_.SetMaxHeaderListSize(kMaxHeaderListSize_);
+}
+
+Http2Connection::~Http2Connection() noexcept
+{
+  LOG_DEBUG << "Http2Connection is destroyed";
+}
+
+void Http2Connection::Start()
+{
+  LOG_DEBUG << _PEER_IP << " HTTP/2 with prior knowledge";
+  Increment(server_->GetStats().http2_connections);
+  SendPreface();
+  StartIdleTimer();
+}
+
+bool Http2Connection::StartUpgrade(StringView settings, HttpRequest const& request)
+{
+  std::string payload;
+  std::vector<Http2Codec::Setting> setting_list;
+
+  if (!Base64UrlDecode(settings, payload) ||
+      !Http2Codec::ParseSettings(payload, setting_list) ||
+      ApplySettings(setting_list) != Http2Codec::kNoError) {
+    LOG_DEBUG << _PEER_IP << " The HTTP2-Settings is invalid, keep HTTP/1.1";
+    return false;
+  }
+
+  LOG_DEBUG << _PEER_IP << " Upgrade to h2c";
+  Increment(server_->GetStats().http2_connections);
+
+  out_ = "HTTP/1.1 101 Switching Protocols\r\n"
+         "Connection: Upgrade\r\n"
+         "Upgrade: h2c\r\n\r\n";
+  Send(out_);
+  SendPreface();
+
+  // The request is the stream 1 which is half-closed(remote)
+  auto stream = new Stream(1);
+  streams_.emplace(1, StreamPtr(stream));
+  last_stream_id_ = 1;
+
+  stream->remote_closed = true;
+  stream->send_window = initial_window_;
+  stream->request.url = request.url;
+  stream->request.query.assign(request.query.data(), request.query.size());
+  stream->request.method = request.method;
+  stream->request.is_static = request.is_static;
+
+  for (auto const& header : request.headers) {
+    if (!::strcasecmp(header.first.c_str(), "Host")) {
+      stream->authority.assign(header.second.data(), header.second.size());
+    } else if (!::strcasecmp(header.first.c_str(), "Priority")) {
+      ParsePriorityHeader(*stream, StringView(header.second.data(), header.second.size()));
+    }
+  }
+
+  Serve(*stream);
+  Schedule();
+  return true;
+}
+
+void Http2Connection::SendPreface()
+{
+  // The server preface is a SETTINGS frame.
+  // The dynamic table of decoder keeps the default size
+  out_.clear();
+  Http2Codec::AppendSettings(out_, {
+    { Http2Codec::kSettingMaxConcurrentStreams,
+      static_cast<uint32_t>(g_config.http2_max_concurrent_streams) },
+    { Http2Codec::kSettingEnablePush, 0 },
+    { Http2Codec::kSettingMaxHeaderListSize, static_cast<uint32_t>(kMaxHeaderListSize_) },
+  });
+  Send(out_);
+}
+
+auto Http2Connection::ApplySettings(std::vector<Http2Codec::Setting> const& settings) -> ErrorCode
+{
+  for (auto const& setting : settings) {
+    const uint32_t value = setting.second;
+
+    switch (setting.first) {
+      case Http2Codec::kSettingEnablePush:
+        if (value > 1) return Http2Codec::kProtocolError;
+        break;
+
+      case Http2Codec::kSettingInitialWindowSize: {
+        if (value > Http2Codec::kMaxWindowSize) return Http2Codec::kFlowControlError;
+
+        // The change is applied to all open streams(RFC 7540 6.9.2)
+        const int64_t delta = static_cast<int64_t>(value) - initial_window_;
+        initial_window_ = value;
+
+        for (auto& pair : streams_) {
+          pair.second->send_window += delta;
+          if (pair.second->send_window > Http2Codec::kMaxWindowSize)
+            return Http2Codec::kFlowControlError;
+        }
+      }
+      break;
+
+      case Http2Codec::kSettingMaxFrameSize:
+        if (value < Http2Codec::kDefaultMaxFrameSize || value > Http2Codec::kMaxFrameSize)
+          return Http2Codec::kProtocolError;
+        max_frame_size_ = value;
+        break;
+
+      // The encoder doesn't use the dynamic table and the server doesn't push,
+      // the header list of response is small
+      default:
+        break;
+    }
+  }
+
+  return Http2Codec::kNoError;
+}
+
+void Http2Connection::OnMessage(Buffer& buffer)
+{
+  if (closed_) {
+    buffer.AdvanceAll();
+    return;
+  }
+
+  if (!preface_received_) {
+    const int ret = Http2Codec::MatchPreface(buffer.ToStringView());
+
+    if (ret == 0) return;
+
+    if (ret < 0) {
+      ConnectionError(Http2Codec::kProtocolError, "Bad connection preface");
+      buffer.AdvanceAll();
+      return;
+    }
+
+    preface_received_ = true;
+    buffer.AdvanceRead(Http2Codec::kPrefaceSize);
+  }
+
+  Frame frame;
+  size_t consumed = 0;
+
+  for (;;) {
+    // The max frame size sent to the peer is the default
+    const auto ret = Http2Codec::Parse(buffer.ToStringView(), Http2Codec::kDefaultMaxFrameSize,
+                                       frame, consumed);
+
+    if (ret == Http2Codec::kShort) break;
+
+    if (ret == Http2Codec::kBad) {
+      ConnectionError(Http2Codec::kFrameSizeError, "The frame is too large");
+      buffer.AdvanceAll();
+      return;
+    }
+
+    LOG_DEBUG << "HTTP/2 frame: type = " << (int)frame.type << ", flags = " << (int)frame.flags
+              << ", stream = " << frame.stream_id << ", length = " << frame.payload.size();
+
+    // The payload refers to the buffer, it is consumed after handled
+    const bool ok = HandleFrame(frame);
+    buffer.AdvanceRead(consumed);
+
+    if (!ok) {
+      buffer.AdvanceAll();
+      return;
+    }
+  }
+
+  Schedule();
+}
+
+bool Http2Connection::OnWriteComplete()
+{
+  Schedule();
+  return !conn_->GetOutputBuffer()->HasReadable();
+}
+
+void Http2Connection::Close()
+{
+  closed_ = true;
+  CancelIdleTimer();
+  streams_.clear();
+}
+
+bool Http2Connection::HandleFrame(Frame& frame)
+{
+  if (!settings_received_ && frame.type != Http2Codec::kSettings) {
+    return ConnectionError(Http2Codec::kProtocolError, "The first frame is not SETTINGS");
+  }
+
+  // The header block can't be interleaved by any other frame
+  if (header_stream_id_ != 0 &&
+      (frame.type != Http2Codec::kContinuation || frame.stream_id != header_stream_id_)) {
+    return ConnectionError(Http2Codec::kProtocolError, "The header block is interrupted");
+  }
+
+  switch (frame.type) {
+    case Http2Codec::kData:
+      return OnData(frame);
+    case Http2Codec::kHeaders:
+      return OnHeaders(frame);
+    case Http2Codec::kPriority:
+      return OnPriority(frame);
+    case Http2Codec::kRstStream:
+      return OnRstStream(frame);
+    case Http2Codec::kSettings:
+      return OnSettings(frame);
+    case Http2Codec::kPushPromise:
+      return ConnectionError(Http2Codec::kProtocolError, "The client can't push");
+    case Http2Codec::kPing:
+      return OnPing(frame);
+    case Http2Codec::kGoAway:
+      return OnGoAway(frame);
+    case Http2Codec::kWindowUpdate:
+      return OnWindowUpdate(frame);
+    case Http2Codec::kContinuation:
+      return OnContinuation(frame);
+  }
+
+  // The unknown frame is ignored
+  return true;
+}
+
+bool Http2Connection::OnData(Frame& frame)
+{
+  if (frame.stream_id == 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "DATA of stream 0");
+  }
+
+  // The padding is counted by the flow control
+  const uint32_t length = frame.payload.size();
+
+  if (!Http2Codec::RemovePadding(frame)) {
+    return ConnectionError(Http2Codec::kProtocolError, "Bad padding of DATA");
+  }
+
+  recv_consumed_ += length;
+  if (recv_consumed_ > recv_window_) {
+    return ConnectionError(Http2Codec::kFlowControlError, "The connection window is exceeded");
+  }
+
+  out_.clear();
+
+  // The body is discarded, the window is replenished when half is consumed
+  if (recv_consumed_ >= recv_window_ / 2) {
+    Http2Codec::AppendWindowUpdate(out_, 0, recv_consumed_);
+    recv_consumed_ = 0;
+  }
+
+  auto iter = streams_.find(frame.stream_id);
+
+  if (iter == streams_.end()) {
+    if (frame.stream_id > last_stream_id_) {
+      return ConnectionError(Http2Codec::kProtocolError, "DATA of idle stream");
+    }
+
+    // The stream is reset or complete
+    Send(out_);
+    return true;
+  }
+
+  auto& stream = *iter->second;
+
+  if (stream.remote_closed) {
+    Send(out_);
+    ResetStream(stream.id, Http2Codec::kStreamClosed);
+    return true;
+  }
+
+  stream.recv_consumed += length;
+
+  if (frame.flags & Http2Codec::kEndStream) {
+    stream.remote_closed = true;
+  } else if (stream.recv_consumed >= Http2Codec::kDefaultWindowSize / 2) {
+    Http2Codec::AppendWindowUpdate(out_, stream.id, stream.recv_consumed);
+    stream.recv_consumed = 0;
+  }
+
+  Send(out_);
+  return true;
+}
+
+bool Http2Connection::OnHeaders(Frame& frame)
+{
+  if (frame.stream_id == 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "HEADERS of stream 0");
+  }
+
+  if (!Http2Codec::ParseHeadersPayload(frame, header_priority_, header_has_priority_)) {
+    return ConnectionError(Http2Codec::kProtocolError, "Bad padding of HEADERS");
+  }
+
+  header_stream_id_ = frame.stream_id;
+  header_end_stream_ = (frame.flags & Http2Codec::kEndStream) != 0;
+  header_block_.assign(frame.payload.data(), frame.payload.size());
+
+  if (frame.flags & Http2Codec::kEndHeaders) {
+    return OnHeaderBlock();
+  }
+
+  return true;
+}
+
+bool Http2Connection::OnContinuation(Frame& frame)
+{
+  if (header_stream_id_ == 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "Unexpected CONTINUATION");
+  }
+
+  if (header_block_.size() + frame.payload.size() > kMaxHeaderListSize_) {
+    return ConnectionError(Http2Codec::kEnhanceYourCalm, "The header block is too large");
+  }
+
+  header_block_.append(frame.payload.data(), frame.payload.size());
+
+  if (frame.flags & Http2Codec::kEndHeaders) {
+    return OnHeaderBlock();
+  }
+
+  return true;
+}
+
+bool Http2Connection::OnHeaderBlock()
+{
+  const uint32_t id = header_stream_id_;
+  header_stream_id_ = 0;
+
+  // The block is decoded even if the stream is refused,
+  // otherwise the dynamic table is inconsistent with the peer
+  if (!decoder_.Decode(header_block_, headers_)) {
+    return ConnectionError(Http2Codec::kCompressionError, "Failed to decode the header block");
+  }
+
+  auto iter = streams_.find(id);
+
+  if (iter != streams_.end()) {
+    // The trailers must end the stream
+    auto& stream = *iter->second;
+
+    if (stream.remote_closed) {
+      ResetStream(id, Http2Codec::kStreamClosed);
+    } else if (!header_end_stream_) {
+      ResetStream(id, Http2Codec::kProtocolError);
+    } else {
+      stream.remote_closed = true;
+    }
+
+    return true;
+  }
+
+  if (id <= last_stream_id_) {
+    // The stream is closed, e.g. the client hasn't seen RST_STREAM
+    return true;
+  }
+
+  if (id % 2 == 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "The stream id of client is even");
+  }
+
+  last_stream_id_ = id;
+
+  if (goaway_received_) return true;
+
+  if (streams_.size() >= static_cast<size_t>(g_config.http2_max_concurrent_streams)) {
+    LOG_WARN << _PEER_IP << " Too many concurrent streams, refuse the stream " << id;
+    out_.clear();
+    Http2Codec::AppendRstStream(out_, id, Http2Codec::kRefusedStream);
+    Send(out_);
+    Increment(server_->GetStats().http2_streams_reset);
+    return true;
+  }
+
+  auto stream = new Stream(id);
+  streams_.emplace(id, StreamPtr(stream));
+  CancelIdleTimer();
+
+  stream->remote_closed = header_end_stream_;
+  stream->send_window = initial_window_;
+
+  if (header_has_priority_) {
+    if (header_priority_.dependency == id) {
+      ResetStream(id, Http2Codec::kProtocolError);
+      return true;
+    }
+
+    stream->priority = header_priority_;
+  }
+
+  if (!BuildRequest(*stream, headers_)) {
+    LOG_DEBUG << _PEER_IP << " The request of stream " << id << " is malformed";
+    ResetStream(id, Http2Codec::kProtocolError);
+    return true;
+  }
+
+  // The body isn't used by the static contents,
+  // the response is sent without waiting for it
+  Serve(*stream);
+  return true;
+}
+
+bool Http2Connection::OnPriority(Frame const& frame)
+{
+  if (frame.stream_id == 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "PRIORITY of stream 0");
+  }
+
+  Http2Codec::Priority priority;
+
+  if (!Http2Codec::ParsePriority(frame.payload, priority)) {
+    ResetStream(frame.stream_id, Http2Codec::kFrameSizeError);
+    return true;
+  }
+
+  if (priority.dependency == frame.stream_id) {
+    ResetStream(frame.stream_id, Http2Codec::kProtocolError);
+    return true;
+  }
+
+  // The priority of idle or closed stream is not kept
+  auto iter = streams_.find(frame.stream_id);
+  if (iter != streams_.end()) {
+    iter->second->priority = priority;
+  }
+
+  return true;
+}
+
+bool Http2Connection::OnRstStream(Frame const& frame)
+{
+  if (frame.stream_id == 0 || frame.stream_id > last_stream_id_) {
+    return ConnectionError(Http2Codec::kProtocolError, "RST_STREAM of idle stream");
+  }
+
+  if (frame.payload.size() != 4) {
+    return ConnectionError(Http2Codec::kFrameSizeError, "The length of RST_STREAM is not 4");
+  }
+
+  LOG_DEBUG << _PEER_IP << " The stream " << frame.stream_id << " is reset by peer: "
+            << Http2Codec::GetErrorString(
+                 static_cast<ErrorCode>(Http2Codec::ReadUint32(frame.payload)));
+
+  CloseStream(frame.stream_id);
+  return true;
+}
+
+bool Http2Connection::OnSettings(Frame const& frame)
+{
+  if (frame.stream_id != 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "SETTINGS of stream");
+  }
+
+  if (frame.flags & Http2Codec::kAck) {
+    if (!frame.payload.empty()) {
+      return ConnectionError(Http2Codec::kFrameSizeError, "SETTINGS ACK with payload");
+    }
+
+    return true;
+  }
+
+  std::vector<Http2Codec::Setting> settings;
+
+  if (!Http2Codec::ParseSettings(frame.payload, settings)) {
+    return ConnectionError(Http2Codec::kFrameSizeError, "The length of SETTINGS is not a multiple of 6");
+  }
+
+  const auto error = ApplySettings(settings);
+
+  if (error != Http2Codec::kNoError) {
+    return ConnectionError(error, "Invalid SETTINGS");
+  }
+
+  settings_received_ = true;
+  out_.clear();
+  Http2Codec::AppendSettingsAck(out_);
+  Send(out_);
+  return true;
+}
+
+bool Http2Connection::OnPing(Frame const& frame)
+{
+  if (frame.stream_id != 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "PING of stream");
+  }
+
+  if (frame.payload.size() != 8) {
+    return ConnectionError(Http2Codec::kFrameSizeError, "The length of PING is not 8");
+  }
+
+  if (!(frame.flags & Http2Codec::kAck)) {
+    out_.clear();
+    Http2Codec::AppendPing(out_, frame.payload, true);
+    Send(out_);
+  }
+
+  return true;
+}
+
+bool Http2Connection::OnGoAway(Frame const& frame)
+{
+  if (frame.stream_id != 0) {
+    return ConnectionError(Http2Codec::kProtocolError, "GOAWAY of stream");
+  }
+
+  if (frame.payload.size() < 8) {
+    return ConnectionError(Http2Codec::kFrameSizeError, "The length of GOAWAY is less than 8");
+  }
+
+  LOG_DEBUG << _PEER_IP << " GOAWAY is received: "
+            << Http2Codec::GetErrorString(
+                 static_cast<ErrorCode>(Http2Codec::ReadUint32(frame.payload.substr(4, 4))));
+
+  // The open streams are completed, then the connection is closed
+  goaway_received_ = true;
+
+  if (streams_.empty()) {
+    Close();
+    conn_->ShutdownWrite();
+    return false;
+  }
+
+  return true;
+}
+
+bool Http2Connection::OnWindowUpdate(Frame const& frame)
+{
+  if (frame.payload.size() != 4) {
+    return ConnectionError(Http2Codec::kFrameSizeError, "The length of WINDOW_UPDATE is not 4");
+  }
+
+  const uint32_t increment = Http2Codec::ReadUint32(frame.payload) & 0x7fffffff;
+
+  if (frame.stream_id == 0) {
+    if (increment == 0) {
+      return ConnectionError(Http2Codec::kProtocolError, "The increment of window is 0");
+    }
+
+    send_window_ += increment;
+
+    if (send_window_ > Http2Codec::kMaxWindowSize) {
+      return ConnectionError(Http2Codec::kFlowControlError, "The connection window overflows");
+    }
+
+    return true;
+  }
+
+  auto iter = streams_.find(frame.stream_id);
+
+  if (iter == streams_.end()) {
+    if (frame.stream_id > last_stream_id_) {
+      return ConnectionError(Http2Codec::kProtocolError, "WINDOW_UPDATE of idle stream");
+    }
+
+    return true;
+  }
+
+  auto& stream = *iter->second;
+
+  if (increment == 0) {
+    ResetStream(stream.id, Http2Codec::kProtocolError);
+    return true;
+  }
+
+  stream.send_window += increment;
+
+  if (stream.send_window > Http2Codec::kMaxWindowSize) {
+    ResetStream(stream.id, Http2Codec::kFlowControlError);
+  }
+
+  return true;
+}
+
+bool Http2Connection::BuildRequest(Stream& stream, std::vector<Hpack::Header> const& headers)
+{
+  StringView method;
+  StringView scheme;
+  StringView path;
+  bool regular_seen = false;
+
+  for (auto const& header : headers) {
+    StringView name(header.first);
+    StringView value(header.second);
+
+    if (!name.empty() && name[0] == ':') {
+      // The pseudo headers precede the regular headers
+      if (regular_seen) return false;
+
+      if (name == ":method") method = value;
+      else if (name == ":scheme") scheme = value;
+      else if (name == ":path") path = value;
+      else if (name == ":authority") stream.authority = header.second;
+      else return false;
+
+      continue;
+    }
+
+    regular_seen = true;
+
+    // The field names must be lowercase
+    if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; })) {
+      return false;
+    }
+
+    // The connection-specific headers are not allowed(RFC 7540 8.1.2.2)
+    if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+        name == "transfer-encoding" || name == "upgrade") {
+      return false;
+    }
+
+    if (name == "te" && value != "trailers") return false;
+
+    if (name == "host" && stream.authority.empty()) {
+      stream.authority = header.second;
+    } else if (name == "priority") {
+      ParsePriorityHeader(stream, value);
+    }
+  }
+
+  if (method.empty() || scheme.empty() || path.empty()) return false;
+
+  auto& request = stream.request;
+
+  if (method == "GET") request.method = HttpMethod::kGet;
+  else if (method == "HEAD") request.method = HttpMethod::kHead;
+  else if (method == "POST") request.method = HttpMethod::kPost;
+  else if (method == "PUT") request.method = HttpMethod::kPut;
+  else request.method = HttpMethod::kNotSupport;
+
+  request.version = HttpVersion::kHttp11;
+
+  HttpParser parser;
+  return parser.ParseUrl(path, &request) == HttpParser::kGood;
+}
+
+void Http2Connection::ParsePriorityHeader(Stream& stream, StringView value) noexcept
+{
+  // e.g. "u=1, i", only the urgency is used
+  for (size_t i = 0; i + 2 < value.size(); ++i) {
+    if (value[i] == 'u' && value[i + 1] == '=' &&
+        (i == 0 || value[i - 1] == ' ' || value[i - 1] == ',')) {
+      if (value[i + 2] >= '0' && value[i + 2] <= '7') {
+        stream.urgency = value[i + 2] - '0';
+      }
+
+      return;
+    }
+  }
+}
+
+void Http2Connection::Serve(Stream& stream)
+{
+  auto& request = stream.request;
+  stream.served = true;
+
+  Increment(server_->GetStats().requests);
+  Increment(server_->GetStats().http2_streams);
+
+  LOG_INFO << _PEER_IP << " "
+    << request.url << " "
+    << GetMethodString(request.method) << " "
+    << "HTTP/2 stream " << stream.id;
+
+  if (!g_config.status_path.empty() && request.url == g_config.status_path) {
+    server_->RenderStats(stream.body);
+    if (request.method != HttpMethod::kHead) stream.size = stream.body.size();
+    SendHeaders(stream, 200, "text/plain", stream.body.size());
+    return;
+  }
+
+  const bool is_get = request.method == HttpMethod::kGet ||
+                      request.method == HttpMethod::kHead;
+  auto& router = server_->GetRouter();
+  RouteMatch match;
+
+  if (!router.IsEmpty() && router.Match(request.method, request.url, match)) {
+    auto route = match.route;
+
+    if (route->kind != Route::kStatic) {
+      // The plugins, FastCGI and proxy write HTTP/1.x responses
+      LOG_DEBUG << "The route " << route->pattern << " requires HTTP/1.1";
+      Increment(server_->GetStats().http2_streams_reset);
+      ResetStream(stream.id, Http2Codec::kHttp11Required);
+      return;
+    }
+
+    if (!is_get) {
+      ServeError(stream, HttpStatusCode::k501NotImplemeted, "The service is not implemeted");
+      return;
+    }
+
+    std::string path(route->target);
+    path.append(match.rest.data(), match.rest.size());
+    ServeFile(stream, path);
+    return;
+  }
+
+  if (request.url == "/")
+    request.url += g_config.homepage_path;
+
+  if (is_get && request.is_static) {
+    ServeFile(stream, g_config.root_path + request.url);
+  } else if (request.method == HttpMethod::kGet || request.method == HttpMethod::kPost) {
+    Increment(server_->GetStats().http2_streams_reset);
+    ResetStream(stream.id, Http2Codec::kHttp11Required);
+  } else {
+    ServeError(stream, HttpStatusCode::k501NotImplemeted, "The service is not implemeted");
+  }
+}
+
+void Http2Connection::ServeFile(Stream& stream, std::string const& path)
+{
+  Stat stat;
+
+  if (!stat.Open(path)) {
+    if (errno == ENOENT) {
+      ServeError(stream, HttpStatusCode::k404NotFound, "The file does not exist");
+    } else if (errno == EACCES) {
+      ServeError(stream, HttpStatusCode::k403Forbidden, "No permission to access the file");
+    } else {
+      ServeError(stream, HttpStatusCode::k500InternalServerError,
+                 "Can't get any infomation of the file");
+    }
+    return;
+  }
+
+  if (!stat.IsRegular() || !stat.IsUserR()) {
+    ServeError(stream, HttpStatusCode::k403Forbidden, "Can't read requested file");
+    return;
+  }
+
+  const size_t file_size = stat.GetFileSize();
+
+  if (file_size > 0 && stream.request.method != HttpMethod::kHead) {
+    if (!g_config.use_mmap) {
+      stream.file_fd = server_->GetFd(path);
+    } else {
+      stream.file_addr = server_->GetAddr(path, file_size);
+    }
+
+    if (!stream.file_fd && !stream.file_addr) {
+      LOG_SYSERROR << "Failed to open the file: " << path << "(But it exists)";
+      ServeError(stream, HttpStatusCode::k500InternalServerError,
+                 "The pape does exists, but error occurred in server");
+      return;
+    }
+
+    stream.size = file_size;
+  }
+
+  SendHeaders(stream, 200, HttpResponse::GetFileType(path), file_size);
+}
+
+void Http2Connection::ServeError(Stream& stream, HttpStatusCode code, StringView msg)
+{
+  LOG_INFO << _PEER_IP << " " << GetStatusCode(code) << " "
+           << GetStatusCodeString(code) << " " << msg;
+
+  // The error page without the HTTP/1.x header
+  auto response = GetClientError(code, msg);
+  auto page = response.GetBuffer().ToStringView();
+  const auto pos = page.find("\r\n\r\n");
+
+  if (pos != StringView::npos) {
+    page.remove_prefix(pos + 4);
+  }
+
+  if (stream.request.method != HttpMethod::kHead) {
+    stream.body.assign(page.data(), page.size());
+    stream.size = stream.body.size();
+  }
+
+  SendHeaders(stream, GetStatusCode(code), "text/html", page.size());
+}
+
+void Http2Connection::SendHeaders(Stream& stream, int status, StringView content_type,
+                                  int64_t content_length)
+{
+  std::string block;
+  encoder_.Append(block, ":status", std::to_string(status));
+  encoder_.Append(block, "content-type", content_type);
+  encoder_.Append(block, "content-length", std::to_string(content_length));
+  encoder_.Append(block, "server", "kanon_httpd");
+
+  const bool end_stream = stream.size == 0;
+
+  out_.clear();
+  Http2Codec::AppendHeaders(out_, stream.id, block, end_stream, max_frame_size_);
+  Send(out_);
+
+  if (end_stream) {
+    CompleteStream(stream);
+    return;
+  }
+
+  // The stream joins the scheduler at the current virtual time,
+  // it can't take the share when it is not ready
+  stream.sending = true;
+  stream.vtime = std::max(stream.vtime, vtime_);
+}
+
+void Http2Connection::Schedule()
+{
+  if (closed_) return;
+
+  auto output = conn_->GetOutputBuffer();
+
+  while (output->GetReadableSize() < kOutputLimit_ && send_window_ > 0) {
+    auto stream = PickStream();
+    if (!stream) break;
+
+    SendData(*stream);
+  }
+}
+
+auto Http2Connection::PickStream() -> Stream*
+{
+  auto ready = [](Stream const& stream) {
+    return stream.sending && stream.send_window > 0;
+  };
+
+  auto before = [](Stream const* x, Stream const* y) {
+    if (x->urgency != y->urgency) return x->urgency < y->urgency;
+    if (x->vtime != y->vtime) return x->vtime < y->vtime;
+    return x->id < y->id;
+  };
+
+  Stream* best = nullptr;
+  // The fallback if the dependencies form a cycle
+  Stream* best_any = nullptr;
+
+  for (auto& pair : streams_) {
+    auto stream = pair.second.get();
+    if (!ready(*stream)) continue;
+
+    if (!best_any || before(stream, best_any)) best_any = stream;
+
+    // The stream depending on a ready stream waits for it
+    if (stream->priority.dependency != 0) {
+      auto parent = streams_.find(stream->priority.dependency);
+      if (parent != streams_.end() && ready(*parent->second)) continue;
+    }
+
+    if (!best || before(stream, best)) best = stream;
+  }
+
+  return best ? best : best_any;
+}
+
+void Http2Connection::SendData(Stream& stream)
+{
+  const uint64_t remaining = stream.size - stream.offset;
+  const size_t n = std::min<uint64_t>({
+    remaining,
+    static_cast<uint64_t>(stream.send_window),
+    static_cast<uint64_t>(send_window_),
+    max_frame_size_ });
+  const bool end_stream = n == remaining;
+
+  out_.clear();
+  Http2Codec::AppendFrameHeader(out_, n, Http2Codec::kData,
+                                end_stream ? Http2Codec::kEndStream : 0, stream.id);
+
+  const size_t header_size = out_.size();
+  out_.resize(header_size + n);
+  char* data = &out_[header_size];
+
+  if (stream.file_fd) {
+    const ssize_t readn = ::pread(*stream.file_fd, data, n, stream.offset);
+
+    // The file is truncated or error occurred
+    if (readn != static_cast<ssize_t>(n)) {
+      LOG_SYSERROR << "Failed to read the file of stream " << stream.id;
+      ResetStream(stream.id, Http2Codec::kInternalError);
+      return;
+    }
+  } else if (stream.file_addr) {
+    ::memcpy(data, *stream.file_addr + stream.offset, n);
+  } else {
+    ::memcpy(data, stream.body.data() + stream.offset, n);
+  }
+
+  Send(out_);
+
+  stream.offset += n;
+  stream.send_window -= n;
+  send_window_ -= n;
+
+  // Weighted fair queuing, the virtual time advances
+  // inversely to the weight
+  vtime_ = stream.vtime;
+  stream.vtime += n * 256 / stream.priority.weight;
+
+  if (end_stream) {
+    CompleteStream(stream);
+  }
+}
+
+void Http2Connection::CompleteStream(Stream& stream)
+{
+  const uint32_t id = stream.id;
+
+  // The client is still sending the body which is not used,
+  // tell it to stop(RFC 7540 8.1)
+  if (!stream.remote_closed) {
+    out_.clear();
+    Http2Codec::AppendRstStream(out_, id, Http2Codec::kNoError);
+    Send(out_);
+  }
+
+  CloseStream(id);
+}
+
+void Http2Connection::CloseStream(uint32_t stream_id)
+{
+  streams_.erase(stream_id);
+
+  if (streams_.empty() && !closed_) {
+    if (goaway_received_) {
+      Close();
+      conn_->ShutdownWrite();
+    } else {
+      StartIdleTimer();
+    }
+  }
+}
+
+void Http2Connection::ResetStream(uint32_t stream_id, ErrorCode error)
+{
+  LOG_DEBUG << _PEER_IP << " Reset the stream " << stream_id << ": "
+            << Http2Codec::GetErrorString(error);
+
+  out_.clear();
+  Http2Codec::AppendRstStream(out_, stream_id, error);
+  Send(out_);
+  CloseStream(stream_id);
+}
+
+bool Http2Connection::ConnectionError(ErrorCode error, char const* reason)
+{
+  LOG_ERROR << _PEER_IP << " HTTP/2 connection error("
+            << Http2Codec::GetErrorString(error) << "): " << reason;
+
+  out_.clear();
+  Http2Codec::AppendGoAway(out_, last_stream_id_, error);
+  Send(out_);
+
+  Close();
+  conn_->ShutdownWrite();
+  return false;
+}
+
+void Http2Connection::Send(std::string const& out)
+{
+  if (out.empty()) return;
+
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Send(out);
+    return;
+  }
+#endif
+
+  conn_->Send(out);
+}
+
+void Http2Connection::StartIdleTimer()
+{
+  if (closed_ || idle_timer_id_) return;
+
+  idle_timer_id_ = conn_->GetLoop()->RunAfter([this]() {
+    idle_timer_id_ = kanon::optional<TimerId>();
+    LOG_DEBUG << _PEER_IP << " The HTTP/2 connection is idle, close it";
+
+    out_.clear();
+    Http2Codec::AppendGoAway(out_, last_stream_id_, Http2Codec::kNoError);
+    Send(out_);
+
+    Close();
+    conn_->ShutdownWrite();
+  }, kIdleTimeout_);
+}
+
+void Http2Connection::CancelIdleTimer()
+{
+  if (idle_timer_id_) {
+    conn_->GetLoop()->CancelTimer(*idle_timer_id_);
+    idle_timer_id_ = kanon::optional<TimerId>();
+  }
+}
+
+} // namespace http
@@ -0,0 +1,212 @@
+#ifndef KANON_HTTP2_CONNECTION_H
+#define KANON_HTTP2_CONNECTION_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <kanon/net/buffer.h>
+#include <kanon/net/callback.h>
+#include <kanon/net/timer/timer_id.h>
+#include <kanon/string/string_view.h>
+#include <kanon/util/noncopyable.h>
+#include <kanon/util/optional.h>
+
+#include "http2/hpack.h"
+#include "http2/http2_codec.h"
+#include "http2/http_request.h"
+#include "http2/tls_channel.h"
+
+namespace http {
+
+class HttpServer;
+
+/**
+ * A connection speaking HTTP/2 over cleartext(h2c).
+ *
+ * The session switches to it when the connection starts with the
+ * preface(prior knowledge) or the request is upgraded by Upgrade: h2c.
+ * The requests are multiplexed as streams, the static files and the
+ * status page are served on the streams. The other routes(plugins,
+ * FastCGI and proxy) write HTTP/1.x to the connection, the stream is
+ * reset with HTTP_1_1_REQUIRED so the client retries it over HTTP/1.1.
+ *
+ * The response bodies are sent by the scheduler when the output buffer
+ * is drained, at most kOutputLimit_ bytes are buffered. The ready stream
+ * is picked by the urgency of priority header(RFC 9218) first, then the
+ * weighted fair queuing of the weights(RFC 7540), the stream depending
+ * on a ready one is sent after it. Both the connection and stream
+ * windows of peer are respected.
+ */
+class Http2Connection : kanon::noncopyable {
+ public:
+  /** \param tls The frames are encrypted by it if not null(negotiated by ALPN) */
+  Http2Connection(HttpServer& server, kanon::TcpConnectionPtr const& conn,
+                  TlsChannelPtr tls = TlsChannelPtr());
+  ~Http2Connection() noexcept;
+
+  /** Prior knowledge, the preface is expected in the input */
+  void Start();
+
+  /**
+   * Switched from HTTP/1.1 and the 101 response has been sent,
+   * the \p request is served as stream 1, then the preface is expected.
+   * \param settings The value of HTTP2-Settings(base64url SETTINGS payload)
+   * \return false if the settings are invalid, the connection is closed
+   */
+  bool StartUpgrade(kanon::StringView settings, HttpRequest const& request);
+
+  /** Handle the frames in \p buffer, the incomplete frame is left */
+  void OnMessage(kanon::Buffer& buffer);
+
+  /**
+   * Send the streams when the output buffer is drained
+   * \return true if nothing is buffered
+   */
+  bool OnWriteComplete();
+
+  /** The connection is closed, release the files */
+  void Close();
+
+ private:
+  using Frame = Http2Codec::Frame;
+  using ErrorCode = Http2Codec::ErrorCode;
+
+  struct Stream {
+    explicit Stream(uint32_t stream_id)
+      : id(stream_id)
+    {
+    }
+
+    uint32_t id;
+
+    /** END_STREAM is received, i.e. half-closed(remote) */
+    bool remote_closed = false;
+    bool served = false;
+    std::string authority;
+    HttpRequest request;
+
+    int64_t send_window = 0;
+    /** The bytes received since the last WINDOW_UPDATE */
+    uint32_t recv_consumed = 0;
+
+    Http2Codec::Priority priority;
+    /** 0(highest) ~ 7 of RFC 9218, 3 by default */
+    int urgency = 3;
+    /** The virtual finish time of weighted fair queuing */
+    uint64_t vtime = 0;
+
+    /** The body is sent from one of them */
+    std::shared_ptr<int> file_fd;
+    std::shared_ptr<char*> file_addr;
+    std::string body;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    /** The header is sent, the body is waiting for the scheduler */
+    bool sending = false;
+  };
+
+  using StreamPtr = std::unique_ptr<Stream>;
+
+  void SendPreface();
+  /** \return the error code if invalid */
+  ErrorCode ApplySettings(std::vector<Http2Codec::Setting> const& settings);
+
+  /** \return false if the connection is closed */
+  bool HandleFrame(Frame& frame);
+  bool OnData(Frame& frame);
+  bool OnHeaders(Frame& frame);
+  bool OnContinuation(Frame& frame);
+  bool OnHeaderBlock();
+  bool OnPriority(Frame const& frame);
+  bool OnRstStream(Frame const& frame);
+  bool OnSettings(Frame const& frame);
+  bool OnPing(Frame const& frame);
+  bool OnGoAway(Frame const& frame);
+  bool OnWindowUpdate(Frame const& frame);
+
+  /**
+   * Build the request from the decoded header list
+   * \return false if it is malformed
+   */
+  bool BuildRequest(Stream& stream, std::vector<Hpack::Header> const& headers);
+  void ParsePriorityHeader(Stream& stream, kanon::StringView value) noexcept;
+
+  // Serve the request when END_STREAM is received
+  void Serve(Stream& stream);
+  void ServeFile(Stream& stream, std::string const& path);
+  void ServeError(Stream& stream, HttpStatusCode code, kanon::StringView msg);
+  void SendHeaders(Stream& stream, int status, kanon::StringView content_type,
+                   int64_t content_length);
+
+  /** Send DATA of the ready streams until the output buffer is full */
+  void Schedule();
+  Stream* PickStream();
+  void SendData(Stream& stream);
+
+  /** The response is sent, the body of request is not needed any more */
+  void CompleteStream(Stream& stream);
+  /** The stream is complete or reset, it is removed */
+  void CloseStream(uint32_t stream_id);
+  void ResetStream(uint32_t stream_id, ErrorCode error);
+
+  /** Send GOAWAY with \p error and close the connection, \return false */
+  bool ConnectionError(ErrorCode error, char const* reason);
+
+  void Send(std::string const& out);
+
+  void StartIdleTimer();
+  void CancelIdleTimer();
+
+  HttpServer* server_;
+  kanon::TcpConnectionPtr conn_;
+  TlsChannelPtr tls_;
+
+  bool preface_received_ = false;
+  bool settings_received_ = false;
+  bool goaway_received_ = false;
+  bool closed_ = false;
+
+  std::unordered_map<uint32_t, StreamPtr> streams_;
+  /** The largest stream opened by the client */
+  uint32_t last_stream_id_ = 0;
+
+  /** The header block being received by CONTINUATION */
+  uint32_t header_stream_id_ = 0;
+  bool header_end_stream_ = false;
+  bool header_has_priority_ = false;
+  Http2Codec::Priority header_priority_;
+  std::string header_block_;
+
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  std::vector<Hpack::Header> headers_;
+
+  /** The settings of peer */
+  int64_t initial_window_ = Http2Codec::kDefaultWindowSize;
+  size_t max_frame_size_ = Http2Codec::kDefaultMaxFrameSize;
+
+  int64_t send_window_ = Http2Codec::kDefaultWindowSize;
+  /** The bytes received since the last WINDOW_UPDATE of connection */
+  uint32_t recv_consumed_ = 0;
+  int64_t recv_window_ = Http2Codec::kDefaultWindowSize;
+
+  /** The virtual time of the last stream sent */
+  uint64_t vtime_ = 0;
+
+  kanon::optional<kanon::TimerId> idle_timer_id_;
+
+  /** Reused for the frames sent */
+  std::string out_;
+
+  static constexpr size_t kOutputLimit_ = 64 << 10;
+  static constexpr size_t kMaxHeaderListSize_ = 64 << 10;
+  /** The idle connection is closed, longer than HTTP/1.1 since it is shared */
+  static constexpr int kIdleTimeout_ = 60;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP2_CONNECTION_H
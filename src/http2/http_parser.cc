@@ -1,4 +1,7 @@
 #include "http_parser.h"
+
+#include <tuple>
+
 #include "common/http_constant.h"
 #include "http2/http_request.h"
 #include "http2/http_server2.h"
@@ -119,50 +122,11 @@ HttpParser::ParseResult HttpParser::ParseHeaderLine(StringView line, HttpRequest
     return kError;
   }
 
-  auto url = line.substr(0, space_pos);
-
-  if (url.size() == 0) {
-    error_ = {
-      HttpStatusCode::k400BadRequest,
-      "The URL is empty"};
-    return kError;
-  }
-
-  LOG_DEBUG << "The URL = " << url;
-
-  const auto url_size = url.size();
-  request->url = url.ToString();
-
-  // FIXME Server no need to consider scheme and host:port ? 
-
-  if (url[0] != '/') {
-    error_ = {
-      HttpStatusCode::k400BadRequest,
-      "The first character of content path is not /"};
+  if (ParseUrl(line.substr(0, space_pos), request) == kError) {
     return kError;
   }
 
-  url.remove_prefix(1);
-
-  StringView::size_type slash_pos = StringView::npos;
-  StringView directory;
-
-  while ( (slash_pos = url.find('/') ) != StringView::npos) {
-    directory = url.substr(0, slash_pos);
-
-    if (directory.empty() || directory == ".." || directory == "." || directory.contains('%')) {
-      request->is_complex = true;
-    }
-
-    url.remove_prefix(slash_pos+1);
-  }
-
-  if (url.contains('?')) {
-    request->is_complex = true;
-    request->is_static = false;
-  }
-
-  line.remove_prefix(url_size+1);
+  line.remove_prefix(space_pos+1);
 
   // Check the http version
   auto http_version = line.substr(0, line.size());
@@ -213,13 +177,79 @@ HttpParser::ParseResult HttpParser::ParseHeaderLine(StringView line, HttpRequest
     return kError;
   }
 
+  return kGood;
+}
+
+HttpParser::ParseResult HttpParser::ParseUrl(StringView url, HttpRequest* request) {
+  if (url.size() == 0) {
+    error_ = {
+      HttpStatusCode::k400BadRequest,
+      "The URL is empty"};
+    return kError;
+  }
+
+  LOG_DEBUG << "The URL = " << url;
+
+  request->url = url.ToString();
+
+  // FIXME Server no need to consider scheme and host:port ? 
+
+  if (url[0] != '/') {
+    error_ = {
+      HttpStatusCode::k400BadRequest,
+      "The first character of content path is not /"};
+    return kError;
+  }
+
+  url.remove_prefix(1);
+
+  StringView::size_type slash_pos = StringView::npos;
+  StringView directory;
+
+  while ( (slash_pos = url.find('/') ) != StringView::npos) {
+    directory = url.substr(0, slash_pos);
+
+    if (directory.empty() || directory == ".." || directory == "." || directory.contains('%')) {
+      request->is_complex = true;
+    }
+
+    url.remove_prefix(slash_pos+1);
+  }
+
+  // The last segment, e.g. /A/.. and /%2e%2e
+  directory = url.substr(0, url.find('?'));
+
+  if (directory == ".." || directory == "." || directory.contains('%')) {
+    request->is_complex = true;
+  }
+
+  if (url.contains('?')) {
+    request->is_complex = true;
+    request->is_static = false;
+  }
+
   if (request->is_complex) {
-    ParseComplexUrl(request);
+    return ParseComplexUrl(request);
   }
 
   return kGood;
 }
 
+/** \return -1 if \p c is not a hexadecimal digit */
+static inline int HexDigit(char c) noexcept {
+  if (c >= '0' && c <= '9') return c - '0';
+
+  c = c | 0x20; // to lower case letter
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+
+  return -1;
+}
+
+/** Remove the last segment of \p url which ends with /, the root is kept */
+static inline void PopSegment(ArenaString& url) {
+  url.erase(url.rfind('/', url.size() - 2) + 1);
+}
+
 HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
   /**
    * The following cases are complex:
@@ -239,12 +269,11 @@ HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
    * the character and go to next state. According the state,
    * we can determine the best choice so avoid multi traverse.
    */
-  std::string transfer_url;
+  ArenaString transfer_url(request->query.get_allocator());
   transfer_url.reserve(request->url.size());
 
   enum ComplexUrlState {
     kUsual = 0,
-    kQuery,
     kSlash,
     kDot,
     kDoubleDot,
@@ -252,36 +281,70 @@ HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
     kPersentSecond,
   } state = kUsual;
 
-  // Because there exists such case:
-  // /% Hex Hex
-  // And also %Hex Hex maybe . or %,
-  // we should back to kSlash state
-  auto persent_trap = state; // trap persent state to back previous state
+  // The decoded character of % Hex Hex goes through the states of path
+  // as the others, e.g. /%2e%2e/ is /../ and can't escape the root.
+  // Therefore, trap the state before % to back to it after decoded.
+  auto persent_trap = state;
 
   unsigned char decode_persent = 0; // Hexadecimal digit * 2 after %, i.e. % Hex Hex
 
   LOG_TRACE << "Start parsing the complex URL";
 
-  for (auto c : request->url) {
+  // The query string is decoded by ParseArgs() after split,
+  // since the encoded & and = are not separators
+  StringView url(request->url);
+  const auto query_pos = url.find('?');
+
+  for (auto c : url.substr(0, query_pos)) {
+    if (state == ComplexUrlState::kPersentFirst) {
+      const int digit = HexDigit(c);
+
+      if (digit < 0) {
+        error_ = {
+          HttpStatusCode::k400BadRequest,
+          "The first digit of persent-encoding is invalid"};
+        return kError;
+      }
+
+      decode_persent = digit;
+      state = ComplexUrlState::kPersentSecond;
+      continue;
+    }
+
+    if (state == ComplexUrlState::kPersentSecond) {
+      const int digit = HexDigit(c);
+
+      if (digit < 0) {
+        error_ = {
+          HttpStatusCode::k400BadRequest,
+          "The second digit of persent-encoding is invalid"};
+        return kError;
+      }
+
+      c = (char)((decode_persent << 4) + digit);
+      state = persent_trap;
+    } else if (c == '%') {
+      persent_trap = state;
+      state = ComplexUrlState::kPersentFirst;
+      continue;
+    }
+
+    // The control characters(including NUL) can't be in the path
+    // of file, and the raw CRLF splits the request forwarded
+    if ((unsigned char)c < 0x20 || c == 0x7f) {
+      error_ = {
+        HttpStatusCode::k400BadRequest,
+        "The URL contains control character"};
+      return kError;
+    }
+
     switch (state) {
       case ComplexUrlState::kUsual:
-        switch (c) {
-        case '/':
+        if (c == '/') {
           state = kSlash;
-          transfer_url += c;
-          break;
-        case '%':
-          persent_trap = state;
-          state = ComplexUrlState::kPersentFirst;
-          break;
-        case '?':
-          transfer_url += c;
-          break;
-        default:
-          transfer_url += c;
-          break;
         }
-        
+
+        transfer_url += c;
         break;
       
       case ComplexUrlState::kSlash:
@@ -292,10 +355,6 @@ HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
         case '.':
           state = ComplexUrlState::kDot;
           break;
-        case '%':
-          persent_trap = state;
-          state = ComplexUrlState::kPersentFirst;
-          break;
         default:
           transfer_url += c;
           state = ComplexUrlState::kUsual;
@@ -313,11 +372,9 @@ HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
         case '.':
           state = ComplexUrlState::kDoubleDot;
           break;
-        case '%':
-          persent_trap = state;
-          state = ComplexUrlState::kPersentFirst;
-          break;
         default:
+          // e.g. /.hidden
+          transfer_url += '.';
           transfer_url += c;
           state = ComplexUrlState::kUsual;
           break;
@@ -328,77 +385,48 @@ HttpParser::ParseResult HttpParser::ParseComplexUrl(HttpRequest* request) {
         switch (c) {
         // A/B/../ ==> A/
         case '/':
-          transfer_url.erase(transfer_url.rfind('/', transfer_url.size() - 2) + 1);
-
+          PopSegment(transfer_url);
           state = ComplexUrlState::kSlash;
           break;
-        case '%':
-          persent_trap = state;
-          state = ComplexUrlState::kPersentFirst;
-          break; 
 
         default:
-          state = ComplexUrlState::kUsual;
+          // e.g. /..name
+          transfer_url += "..";
           transfer_url += c;
+          state = ComplexUrlState::kUsual;
           break;
         }
         break;
-      
-      case ComplexUrlState::kPersentFirst:
-        if (std::isdigit(c)) {
-          decode_persent = c - '0';
-          state = ComplexUrlState::kPersentSecond;
-          break;
-        }
-        
-        c = c | 0x20; // to lower case letter
 
-        if (std::isdigit(c)) {
-          decode_persent = c - 'a' + 10;
-          state = ComplexUrlState::kPersentSecond;
-          break;
-        }
-        
-        error_ = {
-          HttpStatusCode::k400BadRequest,
-          "The first digit of persent-encoding is invalid"};
-        return kError;
-        break; 
-
-      case ComplexUrlState::kPersentSecond:
-        if (std::isdigit(c)) {
-          decode_persent = (decode_persent << 4) + c - '0';
-          state = persent_trap;
-          transfer_url += (char)decode_persent;
-          break;
-        }
-        
-        c = c | 0x20;
-
-        if (std::isdigit(c)) {
-          decode_persent = (decode_persent << 4) + c - 'a' + 10;
-          state = persent_trap;
-          transfer_url += (char)decode_persent;
-          break;
-        }
-        
-        error_ = {
-          HttpStatusCode::k400BadRequest,
-          "The second digit of persent-encoding is invalid"};
-        return kError;
+      default:
+        break;
     } // end switch (state)
   } // end for
 
-  if (request->is_static) {
-    request->url = std::move(transfer_url);
-  } else {
-    const auto query_pos = transfer_url.find('?');
-    KANON_ASSERT(query_pos != std::string::npos, "The ? must be in the URL");
+  switch (state) {
+    case ComplexUrlState::kPersentFirst:
+    case ComplexUrlState::kPersentSecond:
+      error_ = {
+        HttpStatusCode::k400BadRequest,
+        "The persent-encoding is incomplete"};
+      return kError;
+
+    // A/B/.. ==> A/
+    case ComplexUrlState::kDoubleDot:
+      PopSegment(transfer_url);
+      break;
 
-    request->url = transfer_url.substr(0, query_pos);
-    request->query = transfer_url.substr(query_pos+1);
+    default:
+      break;
   }
 
+  // The url is the storage of query, assign it later
+  if (query_pos != StringView::npos) {
+    request->query.assign(url.data() + query_pos + 1, url.size() - query_pos - 1);
+  }
+
+  request->url.assign(transfer_url.data(), transfer_url.size());
+
   return kGood;
 }
 
@@ -417,9 +445,14 @@ HttpParser::ParseResult HttpParser::ParseHeaderField(StringView header, HttpRequ
   LOG_DEBUG << "Header field: [" << header.substr(0, colon_pos) << 
     ": " << header.substr(colon_pos+2) << "]";
 
+  auto field = header.substr(0, colon_pos);
+  auto value = header.substr(colon_pos+2);
+  auto alloc = request->query.get_allocator();
+
   request->headers.emplace(
-    header.substr(0, colon_pos).ToString(), 
-    header.substr(colon_pos+2).ToString());
+    std::piecewise_construct,
+    std::forward_as_tuple(field.data(), field.size(), alloc),
+    std::forward_as_tuple(value.data(), value.size(), alloc));
 
   return kShort;
 }
@@ -33,6 +33,13 @@ class HttpParser : kanon::noncopyable {
   // Parse http request
   ParseResult Parse(Buffer& buffer, HttpRequest* request); 
 
+  /**
+   * Parse the request target, the dot segments and percent-encoding
+   * are resolved, and the query string is split.
+   * Also used by the HTTP/2 streams whose :path isn't in a request line.
+   */
+  ParseResult ParseUrl(StringView url, HttpRequest* request);
+
   HttpError const& error() const noexcept {
     return error_;
   }
@@ -40,6 +47,11 @@ class HttpParser : kanon::noncopyable {
   HttpError& error() noexcept {
     return error_;
   }
+
+  void Reset() noexcept {
+    parse_phase_ = kHeaderLine;
+    content_length_ = -1;
+  }
  private:
   ParseResult ParseHeaderLine(StringView line, HttpRequest* request);
 
@@ -78,11 +90,6 @@ class HttpParser : kanon::noncopyable {
     }
   }
 
-  void Reset() noexcept {
-    parse_phase_ = kHeaderLine;
-    content_length_ = -1;
-  }
-
   void SetHeaderMetadata(HttpRequest* request) {
     auto iter = request->headers.find("Connection");
 
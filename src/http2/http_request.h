@@ -11,6 +11,15 @@
 namespace http {
 
 struct HttpRequest {
+  /**
+   * \param arena The query and headers are allocated from it if not null
+   */
+  explicit HttpRequest(Arena* arena = nullptr)
+    : query(ArenaAllocator<char>(arena))
+    , headers(ArenaHeaderMap::allocator_type(arena))
+  {
+  }
+
   /*
    * The metadata for parsing header line of a http request
    */
@@ -18,14 +27,14 @@ struct HttpRequest {
   bool is_static = true; /** Static page */
   bool is_complex = false; /** Complex URL, e.g. %Hex Hex */
   std::string url; /** The URL part */
-  std::string query; /** query string */
+  ArenaString query; /** query string */
   HttpMethod method = HttpMethod::kNotSupport; /** method of header line */
   HttpVersion version = HttpVersion::kNotSupport; /** version code of header line */
 
   /**
    * Store the header fields
    */
-  HeaderMap headers;
+  ArenaHeaderMap headers;
 
   /**
    * Store the body of a http request
@@ -33,6 +42,28 @@ struct HttpRequest {
   std::string body;
 
   bool is_keep_alive = false; /** Determine if a keep-alive connection */
+
+  /**
+   * Reset to the initial state for the next request.
+   * The capacity of the url and body is kept to avoid reallocation.
+   *
+   * The memory of query and headers is dropped since the arena
+   * is going to be reset, they are allocated from \p arena then.
+   */
+  void Reset(Arena* arena = nullptr) noexcept {
+    is_static = true;
+    is_complex = false;
+    url.clear();
+    method = HttpMethod::kNotSupport;
+    version = HttpVersion::kNotSupport;
+    body.clear();
+    is_keep_alive = false;
+
+    // Don't use clear(), the buckets and capacity are kept.
+    // Destroying them is cheap since the deallocation of arena is no-op
+    ArenaString(ArenaAllocator<char>(arena)).swap(query);
+    ArenaHeaderMap(ArenaHeaderMap::allocator_type(arena)).swap(headers);
+  }
 };
 
 } // http
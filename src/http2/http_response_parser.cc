@@ -0,0 +1,250 @@
+#include "http2/http_response_parser.h"
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+static StringView Trim(StringView str) noexcept
+{
+  while (!str.empty() && (str[0] == ' ' || str[0] == '\t')) {
+    str.remove_prefix(1);
+  }
+
+  while (!str.empty() && (str[str.size()-1] == ' ' || str[str.size()-1] == '\t')) {
+    str = str.substr(0, str.size()-1);
+  }
+
+  return str;
+}
+
+static bool EqualsIgnoreCase(StringView str, char const* literal, size_t len) noexcept
+{
+  return str.size() == len && ::strncasecmp(str.data(), literal, len) == 0;
+}
+
+#define EQUALS_IGNORE_CASE(str, literal) \
+  EqualsIgnoreCase(str, literal, sizeof(literal) - 1)
+
+/** Get a line without CRLF, \return false if incomplete */
+static bool GetLine(StringView& data, StringView& line) noexcept
+{
+  auto lf_pos = data.find('\n');
+
+  if (lf_pos == StringView::npos) return false;
+
+  line = data.substr(0, lf_pos);
+  data.remove_prefix(lf_pos + 1);
+
+  if (!line.empty() && line[line.size()-1] == '\r') {
+    line = line.substr(0, line.size()-1);
+  }
+
+  return true;
+}
+
+void HttpResponseParser::Reset(bool no_body)
+{
+  state_ = State::kHead;
+  no_body_ = no_body;
+  status_ = 0;
+  reason_.clear();
+  headers_.clear();
+  content_length_ = -1;
+  keep_alive_ = false;
+  remaining_ = 0;
+}
+
+auto HttpResponseParser::ParseStatusLine(StringView line) -> Result
+{
+  // e.g. HTTP/1.1 200 OK
+  if (line.size() < 12 || !line.starts_with("HTTP/1.")) {
+    return kBad;
+  }
+
+  const bool http11 = line[7] == '1';
+
+  if (line[8] != ' ') return kBad;
+
+  status_ = ::atoi(line.substr(9, 3).ToString().c_str());
+
+  if (status_ < 100 || status_ > 999) return kBad;
+
+  reason_ = line.size() > 13 ? Trim(line.substr(13)).ToString() : std::string();
+  keep_alive_ = http11;
+  return kGood;
+}
+
+auto HttpResponseParser::ParseHead(StringView data, size_t& consumed) -> Result
+{
+  StringView rest = data;
+  StringView line;
+
+  if (!GetLine(rest, line)) return kShort;
+
+  headers_.clear();
+
+  if (ParseStatusLine(line) != kGood) return kBad;
+
+  bool chunked = false;
+  content_length_ = -1;
+
+  for (;;) {
+    if (!GetLine(rest, line)) return kShort;
+
+    // The blank line ends the header
+    if (line.empty()) break;
+
+    auto colon_pos = line.find(':');
+
+    if (colon_pos == StringView::npos || colon_pos == 0) {
+      return kBad;
+    }
+
+    auto name = line.substr(0, colon_pos);
+    auto value = Trim(line.substr(colon_pos + 1));
+
+    if (EQUALS_IGNORE_CASE(name, "Content-Length")) {
+      char* end = nullptr;
+      auto str = value.ToString();
+      content_length_ = ::strtoll(str.c_str(), &end, 10);
+
+      if (str.empty() || *end != 0 || content_length_ < 0) return kBad;
+    }
+    else if (EQUALS_IGNORE_CASE(name, "Transfer-Encoding")) {
+      chunked = value.size() >= 7 &&
+        EQUALS_IGNORE_CASE(value.substr(value.size() - 7), "chunked");
+    }
+    else if (EQUALS_IGNORE_CASE(name, "Connection")) {
+      if (EQUALS_IGNORE_CASE(value, "close")) {
+        keep_alive_ = false;
+      }
+      else if (EQUALS_IGNORE_CASE(value, "keep-alive")) {
+        keep_alive_ = true;
+      }
+    }
+
+    headers_.emplace_back(name.ToString(), value.ToString());
+  }
+
+  consumed = data.size() - rest.size();
+
+  // The chunked takes precedence over the Content-Length
+  if (chunked) content_length_ = -1;
+
+  if ((status_ >= 100 && status_ < 200) || status_ == 204 || status_ == 304) {
+    content_length_ = 0;
+    state_ = State::kDone;
+  }
+  else if (no_body_) {
+    // The length of HEAD response is kept
+    state_ = State::kDone;
+  }
+  else if (chunked) {
+    state_ = State::kChunkSize;
+  }
+  else if (content_length_ >= 0) {
+    remaining_ = content_length_;
+    state_ = remaining_ == 0 ? State::kDone : State::kLength;
+  }
+  else {
+    keep_alive_ = false;
+    state_ = State::kUntilClose;
+  }
+
+  return kGood;
+}
+
+auto HttpResponseParser::ParseBody(StringView data, StringView& piece, size_t& consumed) -> Result
+{
+  piece = StringView();
+  consumed = 0;
+
+  switch (state_) {
+    case State::kLength:
+    case State::kChunkData: {
+      if (data.empty()) return kShort;
+
+      const auto n = std::min<uint64_t>(remaining_, data.size());
+      piece = data.substr(0, n);
+      consumed = n;
+      remaining_ -= n;
+
+      if (remaining_ == 0) {
+        state_ = state_ == State::kLength ? State::kDone : State::kChunkDataEnd;
+      }
+    }
+      return kGood;
+
+    case State::kUntilClose:
+      if (data.empty()) return kShort;
+
+      piece = data;
+      consumed = data.size();
+      return kGood;
+
+    case State::kChunkSize: {
+      StringView rest = data;
+      StringView line;
+
+      if (!GetLine(rest, line)) {
+        // The size line is short, the extensions are not expected to be long
+        return data.size() > 1024 ? kBad : kShort;
+      }
+
+      // Ignore the chunk extensions
+      auto semicolon_pos = line.find(';');
+      if (semicolon_pos != StringView::npos) line = line.substr(0, semicolon_pos);
+      line = Trim(line);
+
+      char* end = nullptr;
+      auto str = line.ToString();
+      remaining_ = ::strtoull(str.c_str(), &end, 16);
+
+      if (str.empty() || *end != 0) return kBad;
+
+      consumed = data.size() - rest.size();
+      state_ = remaining_ == 0 ? State::kTrailer : State::kChunkData;
+    }
+      return kGood;
+
+    case State::kChunkDataEnd: {
+      StringView rest = data;
+      StringView line;
+
+      if (!GetLine(rest, line)) return data.size() > 2 ? kBad : kShort;
+      if (!line.empty()) return kBad;
+
+      consumed = data.size() - rest.size();
+      state_ = State::kChunkSize;
+    }
+      return kGood;
+
+    case State::kTrailer: {
+      StringView rest = data;
+      StringView line;
+
+      if (!GetLine(rest, line)) return kShort;
+
+      // The trailer fields are dropped
+      consumed = data.size() - rest.size();
+
+      if (line.empty()) state_ = State::kDone;
+    }
+      return kGood;
+
+    case State::kHead:
+      return kBad;
+
+    case State::kDone:
+      return kShort;
+  }
+
+  return kBad;
+}
+
+} // namespace http
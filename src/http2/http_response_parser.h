@@ -0,0 +1,98 @@
+#ifndef KANON_HTTP_RESPONSE_PARSER_H
+#define KANON_HTTP_RESPONSE_PARSER_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+/**
+ * Parse the response of upstream incrementally.
+ *
+ * The header is parsed once it is complete, then the body is decoded
+ * piece by piece as it arrives(Content-Length, chunked or delimited by
+ * closing), so it is forwarded without being buffered as a whole.
+ */
+class HttpResponseParser : kanon::noncopyable {
+ public:
+  enum Result {
+    kGood = 0,
+    kShort, /** Need more data */
+    kBad,
+  };
+
+  using Header = std::pair<std::string, std::string>;
+
+  /**
+   * Prepare for the next response
+   * \param no_body The request is HEAD, its response has no body
+   */
+  void Reset(bool no_body = false);
+
+  /**
+   * Parse the status line and header at the beginning of \p data
+   * \param consumed The size of header including the blank line if kGood
+   */
+  Result ParseHead(kanon::StringView data, size_t& consumed);
+
+  /**
+   * Decode the next piece of body at the beginning of \p data.
+   * The chunked framing is removed, so \p piece may be empty when
+   * only the framing is consumed.
+   * \return kShort if nothing can be consumed
+   */
+  Result ParseBody(kanon::StringView data, kanon::StringView& piece, size_t& consumed);
+
+  bool IsHeadDone() const noexcept { return state_ != State::kHead; }
+  bool IsComplete() const noexcept { return state_ == State::kDone; }
+  /** The body is delimited by closing the connection */
+  bool IsUntilClose() const noexcept { return state_ == State::kUntilClose; }
+
+  int GetStatus() const noexcept { return status_; }
+  std::string const& GetReason() const noexcept { return reason_; }
+  std::vector<Header> const& GetHeaders() const noexcept { return headers_; }
+
+  /**
+   * -1 if the body is chunked or delimited by closing.
+   * The response of HEAD has no body, but its length is kept.
+   */
+  int64_t GetContentLength() const noexcept { return content_length_; }
+
+  /** The connection can be reused after the response */
+  bool IsKeepAlive() const noexcept { return keep_alive_; }
+
+ private:
+  enum class State {
+    kHead = 0,
+    kLength,
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd, /** The CRLF after chunk data */
+    kTrailer,
+    kUntilClose,
+    kDone,
+  };
+
+  Result ParseStatusLine(kanon::StringView line);
+
+  State state_ = State::kHead;
+  bool no_body_ = false;
+
+  int status_ = 0;
+  std::string reason_;
+  std::vector<Header> headers_;
+  int64_t content_length_ = -1;
+  bool keep_alive_ = false;
+
+  /** The bytes of body or chunk not received */
+  uint64_t remaining_ = 0;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_RESPONSE_PARSER_H
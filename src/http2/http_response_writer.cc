@@ -0,0 +1,275 @@
+#include "http2/http_response_writer.h"
+
+#include <stdio.h>
+
+#include <kanon/log/logger.h>
+
+#include "common/http_response.h"
+#include "config/http_config.h"
+
+using namespace kanon;
+
+namespace http {
+
+void HttpResponseWriter::Begin(TcpConnectionPtr const& conn, TlsChannelPtr const& tls,
+                               HttpVersion version, bool keep_alive, size_t high_water_mark)
+{
+  conn_ = conn;
+  tls_ = tls;
+  version_ = version;
+  keep_alive_ = keep_alive;
+  chunked_ = false;
+  in_worker_ = false;
+  high_water_mark_ = high_water_mark;
+  state_ = State::kStarted;
+  headers_.clear();
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  drain_callback_ = DrainCallback();
+  pending_bytes_ = 0;
+  queued_bytes_ = 0;
+}
+
+void HttpResponseWriter::Finish() noexcept
+{
+  conn_.reset();
+  tls_.reset();
+  in_worker_ = false;
+  state_ = State::kIdle;
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  drain_callback_ = DrainCallback();
+}
+
+void HttpResponseWriter::Close()
+{
+  if (state_ == State::kIdle || state_ == State::kEnded) return;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    state_ = State::kClosed;
+    drain_callback_ = DrainCallback();
+  }
+
+  drained_.notify_all();
+}
+
+void HttpResponseWriter::OnDrain()
+{
+  DrainCallback cb;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // The write-complete before the queued sends of worker is not a drain,
+    // the next one comes after they are appended to the output buffer
+    if (queued_bytes_ != 0) return;
+
+    pending_bytes_ = 0;
+    // The callback may reset itself, so call a copy
+    cb = drain_callback_;
+  }
+
+  drained_.notify_all();
+
+  const auto state = state_.load();
+
+  if (cb && !in_worker_ &&
+      (state == State::kStarted || state == State::kHeadSent)) {
+    cb();
+  }
+}
+
+void HttpResponseWriter::OnWorkerSendQueued(size_t len)
+{
+  bool drained = false;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    queued_bytes_ -= len;
+
+    // The output buffer may have been drained by the direct write,
+    // then no write-complete follows
+    if (queued_bytes_ == 0 && conn_ && conn_->GetOutputBuffer()->GetReadableSize() == 0) {
+      pending_bytes_ = 0;
+      drained = true;
+    }
+  }
+
+  if (drained) {
+    drained_.notify_all();
+  }
+}
+
+bool HttpResponseWriter::HasDrainCallback() const noexcept
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return static_cast<bool>(drain_callback_);
+}
+
+void HttpResponseWriter::SetDrainCallback(DrainCallback cb)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  drain_callback_ = std::move(cb);
+}
+
+void HttpResponseWriter::AddHeader(StringView field, StringView value)
+{
+  if (state_ != State::kStarted) {
+    LOG_WARN << "The header fields have been sent, ignore " << field;
+    return;
+  }
+
+  headers_.append(field.data(), field.size());
+  headers_ += ": ";
+  headers_.append(value.data(), value.size());
+  headers_ += "\r\n";
+}
+
+void HttpResponseWriter::WriteHead(HttpStatusCode code, int64_t content_length)
+{
+  WriteHead(GetStatusCode(code), GetStatusCodeString(code), content_length);
+}
+
+void HttpResponseWriter::WriteHead(int status, StringView reason, int64_t content_length)
+{
+  if (state_ != State::kStarted) return;
+
+  HttpResponse head(true);
+  head.AddHeaderLine(status, reason, version_);
+
+  if (content_length >= 0) {
+    head.AddHeader("Content-Length", std::to_string(content_length));
+  } else if (version_ == HttpVersion::kHttp11) {
+    chunked_ = true;
+    head.AddHeader("Transfer-Encoding", "chunked");
+  } else {
+    // The end of body is indicated by closing the connection
+    keep_alive_ = false;
+  }
+
+  head.AddHeader("Connection", keep_alive_ ? "Keep-Alive" : "close");
+  head.GetBuffer().Append(headers_);
+  head.AddBlackLine();
+
+  state_ = State::kHeadSent;
+  auto const data = head.GetBuffer().ToStringView();
+  Send(data.data(), data.size());
+}
+
+bool HttpResponseWriter::Write(StringView data)
+{
+  if (state_ == State::kStarted) {
+    WriteHead(HttpStatusCode::k200OK);
+  }
+
+  if (state_ != State::kHeadSent) {
+    return false;
+  }
+
+  if (data.empty()) {
+    // The empty chunk is the end of body
+    return true;
+  }
+
+  size_t sent = data.size();
+
+  if (chunked_) {
+    char size_line[32];
+    const int n = ::snprintf(size_line, sizeof size_line, "%zx\r\n", data.size());
+
+    chunk_.clear();
+    chunk_.append(size_line, n);
+    chunk_.append(data.data(), data.size());
+    chunk_ += "\r\n";
+    sent = chunk_.size();
+    Send(chunk_.data(), chunk_.size());
+  } else {
+    Send(data.data(), data.size());
+  }
+
+  if (high_water_mark_ == 0) {
+    return true;
+  }
+
+  if (in_worker_) {
+    size_t pending;
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      pending_bytes_ += sent;
+      queued_bytes_ += sent;
+      pending = pending_bytes_;
+    }
+
+    // The data is queued to the loop, mark it after the send.
+    // The session is held by the blocking job until its completion
+    // which is queued after the mark, so this is alive
+    conn_->GetLoop()->QueueToLoop([this, sent]() {
+      OnWorkerSendQueued(sent);
+    });
+
+    // Block until it is sent
+    if (pending >= high_water_mark_) {
+      return WaitDrained();
+    }
+
+    return true;
+  }
+
+  return conn_->GetOutputBuffer()->GetReadableSize() < high_water_mark_;
+}
+
+void HttpResponseWriter::Send(char const* data, size_t len)
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Send(StringView(data, len));
+    return;
+  }
+#endif
+
+  conn_->Send(data, len);
+}
+
+bool HttpResponseWriter::WaitDrained()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto pred = [this]() {
+    return pending_bytes_ == 0 || state_ == State::kClosed;
+  };
+
+  if (g_config.drain_timeout <= 0) {
+    drained_.wait(lock, pred);
+  } else if (!drained_.wait_for(lock, std::chrono::seconds(g_config.drain_timeout), pred)) {
+    // The peer doesn't read, the worker can't be blocked forever
+    LOG_WARN << "The response is not drained in " << g_config.drain_timeout
+             << " seconds, close the connection";
+    state_ = State::kClosed;
+    conn_->ForceClose();
+    return false;
+  }
+
+  return state_ != State::kClosed;
+}
+
+void HttpResponseWriter::End()
+{
+  if (state_ == State::kStarted) {
+    WriteHead(HttpStatusCode::k200OK, 0);
+  }
+
+  if (state_ != State::kHeadSent) return;
+
+  if (chunked_) {
+    Send("0\r\n\r\n", 5);
+  }
+
+  state_ = State::kEnded;
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  drain_callback_ = DrainCallback();
+}
+
+} // namespace http
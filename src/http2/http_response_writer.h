@@ -0,0 +1,121 @@
+#ifndef KANON_HTTP_RESPONSE_WRITER_IMPL_H
+#define KANON_HTTP_RESPONSE_WRITER_IMPL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include <kanon/net/user_server.h>
+#include <kanon/util/noncopyable.h>
+
+#include "plugin/response_writer.h"
+#include "http2/tls_channel.h"
+
+namespace http {
+
+/**
+ * The ResponseWriter of a session.
+ *
+ * Used in the IO loop, or in the worker thread when the blocking
+ * plugin is running.
+ * In the IO loop, the writer is congested if the output buffer reaches
+ * the high-water mark. The output buffer can't be accessed in the worker,
+ * so the bytes sent since the last drain are counted instead, they are
+ * cleared only when the sends queued by the worker have reached the
+ * output buffer and it is drained.
+ */
+class HttpResponseWriter : public ResponseWriter
+                         , kanon::noncopyable {
+ public:
+  HttpResponseWriter() = default;
+  ~HttpResponseWriter() noexcept override = default;
+
+  /**
+   * Start a response
+   * \param tls The response is encrypted by it if not null
+   * \param high_water_mark 0 means never congested
+   */
+  void Begin(kanon::TcpConnectionPtr const& conn, TlsChannelPtr const& tls,
+             HttpVersion version, bool keep_alive, size_t high_water_mark);
+
+  /** Release the connection and callback when the response is complete */
+  void Finish() noexcept;
+
+  /** The connection is closed before End() */
+  void Close();
+
+  /** Write() blocks until drained instead of returning false */
+  void SetInWorker(bool in_worker) noexcept { in_worker_ = in_worker; }
+  bool IsInWorker() const noexcept { return in_worker_; }
+
+  bool HasDrainCallback() const noexcept;
+
+  /** Called in the IO loop when the output buffer is drained */
+  void OnDrain();
+
+  /** Begin() is called and Finish() is not */
+  bool IsActive() const noexcept { return state_ != State::kIdle; }
+  bool IsEnded() const noexcept { return state_ == State::kEnded; }
+  bool IsHeadSent() const noexcept
+  { return state_ == State::kHeadSent || state_ == State::kEnded; }
+  /** false if the connection must be closed to delimit the body */
+  bool IsKeepAlive() const noexcept { return keep_alive_; }
+
+  void AddHeader(kanon::StringView field, kanon::StringView value) override;
+  void WriteHead(HttpStatusCode code, int64_t content_length = -1) override;
+  /** The status is not limited to HttpStatusCode, e.g. forwarded from upstream */
+  void WriteHead(int status, kanon::StringView reason, int64_t content_length = -1);
+  bool Write(kanon::StringView data) override;
+  void End() override;
+  void SetDrainCallback(DrainCallback cb) override;
+
+ private:
+  enum class State {
+    kIdle = 0,
+    kStarted, /** The header is not sent */
+    kHeadSent,
+    kEnded,
+    kClosed,
+  };
+
+  /** \return false if closed or timeout */
+  bool WaitDrained();
+
+  /** Called in the IO loop when the data sent by worker is in the output buffer */
+  void OnWorkerSendQueued(size_t len);
+
+  void Send(char const* data, size_t len);
+
+  kanon::TcpConnectionPtr conn_;
+  TlsChannelPtr tls_;
+  HttpVersion version_ = HttpVersion::kHttp11;
+  bool keep_alive_ = false;
+  bool chunked_ = false;
+  bool in_worker_ = false;
+
+  // Modified by worker and loop
+  std::atomic<State> state_{State::kIdle};
+  size_t high_water_mark_ = 0;
+
+  /** The header fields added by plugin */
+  std::string headers_;
+  /** Reused to assemble the chunks */
+  std::string chunk_;
+
+  /** Set by the plugin in the worker, called in the loop */
+  DrainCallback drain_callback_;
+
+  /** The bytes sent by the worker since the last drain */
+  size_t pending_bytes_ = 0;
+  /** The bytes sent by the worker which are not in the output buffer yet */
+  size_t queued_bytes_ = 0;
+  /** Guard the drain callback and the bytes above */
+  mutable std::mutex mutex_;
+  std::condition_variable drained_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_RESPONSE_WRITER_IMPL_H
@@ -6,6 +6,8 @@
 #include <kanon/util/macro.h>
 #include <kanon/util/optional.h>
 
+#include "config/http_config.h"
+#include "unix/affinity.h"
 #include "unix/fd_wrapper.h"
 #include "unix/mmap.h"
 
@@ -16,13 +18,54 @@ using namespace unix;
 
 namespace http {
 
-HttpServer::HttpServer(EventLoop* loop, InetAddr const& addr)
-  : TcpServer(loop, addr, "HttpServer")
+HttpServer::HttpServer(EventLoop* loop, InetAddr const& addr, bool reuseport)
+  : HttpServer(loop, addr, reuseport, nullptr)
 {
+}
+
+HttpServer::HttpServer(EventLoop* loop, InetAddr const& addr, HttpServer& primary)
+  : HttpServer(loop, addr, true, &primary)
+{
+}
+
+HttpServer::HttpServer(EventLoop* loop, InetAddr const& addr, bool reuseport, HttpServer* primary)
+  : TcpServer(loop, addr, "HttpServer", reuseport)
+  , primary_(primary ? primary : this)
+  , base_loop_(loop)
+  , stats_(&own_stats_)
+  , admission_(own_stats_)
+{
+  if (primary_ == this) {
+    if (g_config.plugin_hot_reload) {
+      plugins_.EnableHotReload(loop);
+    }
+
+    BuildRouter();
+
+    if (g_config.plugin_cache_size > 0) {
+      response_cache_.reset(new ResponseCache(g_config.plugin_cache_size));
+    }
+  }
+
+  // Pin before the loop runs, so the buffers and per-loop states
+  // are allocated on the local node from the start
+  SetThreadInitCallback([this](EventLoop* io_loop) {
+    PinIoThread(io_loop);
+  });
+
   SetConnectionCallback([this](TcpConnectionPtr const& conn) {
 
     if (conn->IsConnected()) {
-      auto session = std::make_shared<HttpSession>(*this, conn);
+      auto& admission = GetAdmissionControl();
+      auto loop_state = admission.GetLoopState(conn->GetLoop());
+
+      if (!admission.TryAdmit(loop_state)) {
+        LOG_INFO << conn->GetPeerAddr().ToIp() << " 503 Server Unavailable(shed)";
+        admission.Reject(conn);
+        return;
+      }
+
+      auto session = HttpSession::Create(*this, conn, loop_state);
       session->Setup();
       LOG_DEBUG << "[Session #" << session->GetId() << "] constructed";
       LOG_INFO << conn->GetPeerAddr().ToIp() << " connected";
@@ -39,7 +82,14 @@ HttpServer::HttpServer(EventLoop* loop, InetAddr const& addr)
       // 1. Use auto&
       // 2. Set empty context to desctory shared_ptr
       //    conn->SetContext();
-      auto& session = *kanon::AnyCast<std::shared_ptr<HttpSession>>(conn->GetContext());
+      auto p_session = kanon::AnyCast<std::shared_ptr<HttpSession>>(conn->GetContext());
+
+      // The connection is rejected by admission control
+      if (!p_session) {
+        return;
+      }
+
+      auto& session = *p_session;
       LOG_DEBUG << "[Session #" << session->GetId() << "] destroyed";
       conn->SetWriteCompleteCallback(WriteCompleteCallback());
       session->Teardown();
@@ -57,8 +107,179 @@ HttpServer::~HttpServer() noexcept
 {
 }
 
+void HttpServer::SetStats(ServerStats& stats, SharedStatsTable const* table) noexcept
+{
+  stats_ = &stats;
+  stats_table_ = table;
+  admission_.SetStats(stats);
+}
+
+void HttpServer::BuildRouter()
+{
+  for (auto const& line : g_config.routes) {
+    std::string error;
+    auto route = router_.AddRoute(line, error);
+
+    if (!route) {
+      LOG_ERROR << "Invalid route [" << line << "]: " << error;
+      continue;
+    }
+
+    if (route->kind == Route::kFastCgi) {
+      std::string ip;
+      uint16_t port;
+
+      if (!FcgiUpstream::ParseAddress(route->target, ip, port, error)) {
+        LOG_ERROR << "Invalid FastCGI address of route " << route->pattern << ": " << error;
+      }
+
+      continue;
+    }
+
+    if (route->kind == Route::kProxy) {
+      std::vector<std::pair<std::string, uint16_t>> addrs;
+
+      if (!HttpUpstream::ParseAddresses(route->target, addrs, error)) {
+        LOG_ERROR << "Invalid upstream of route " << route->pattern << ": " << error;
+      }
+
+      continue;
+    }
+
+    if (route->target[0] != '/') {
+      route->target.insert(0, 1, '/');
+      route->target.insert(0, g_config.root_path);
+    }
+
+    if (route->kind == Route::kPlugin) {
+      route->plugin = plugins_.Get(route->target, error);
+
+      // Try again when requested, it may be deployed later
+      if (!route->plugin) {
+        LOG_ERROR << "Failed to load the plugin of route " << route->pattern << ": " << error;
+      }
+    }
+  }
+
+  LOG_INFO << "The routing table has " << router_.GetSize() << " routes";
+}
+
+PluginWorkerPool* HttpServer::GetPluginWorkerPool()
+{
+  if (primary_ != this) {
+    return primary_->GetPluginWorkerPool();
+  }
+
+  if (g_config.plugin_worker_threads <= 0) {
+    return nullptr;
+  }
+
+  std::call_once(plugin_workers_once_, [this]() {
+    plugin_workers_.reset(new PluginWorkerPool(
+      g_config.plugin_worker_threads, g_config.plugin_queue_size, *stats_));
+  });
+
+  return plugin_workers_.get();
+}
+
+FcgiUpstream* HttpServer::GetFcgiUpstream(EventLoop* loop, std::string const& address)
+{
+  if (primary_ != this) {
+    return primary_->GetFcgiUpstream(loop, address);
+  }
+
+  MutexGuard guard(mutex_upstreams_);
+
+  auto& upstream = fcgi_upstreams_[std::make_pair(loop, address)];
+
+  if (!upstream) {
+    std::string ip;
+    uint16_t port = 0;
+    std::string error;
+
+    // The error has been reported by BuildRouter()
+    if (!FcgiUpstream::ParseAddress(address, ip, port, error)) {
+      return nullptr;
+    }
+
+    upstream.reset(new FcgiUpstream(loop, InetAddr(ip, port),
+                                    g_config.fastcgi_max_connections,
+                                    g_config.fastcgi_max_requests,
+                                    g_config.fastcgi_queue_size));
+  }
+
+  return upstream.get();
+}
+
+HttpUpstream* HttpServer::GetHttpUpstream(EventLoop* loop, std::string const& addresses)
+{
+  if (primary_ != this) {
+    return primary_->GetHttpUpstream(loop, addresses);
+  }
+
+  MutexGuard guard(mutex_upstreams_);
+
+  auto& upstream = http_upstreams_[std::make_pair(loop, addresses)];
+
+  if (!upstream) {
+    std::vector<std::pair<std::string, uint16_t>> addrs;
+    std::string error;
+
+    // The error has been reported by BuildRouter()
+    if (!HttpUpstream::ParseAddresses(addresses, addrs, error)) {
+      return nullptr;
+    }
+
+    std::vector<InetAddr> peers;
+
+    for (auto const& addr : addrs) {
+      peers.emplace_back(addr.first, addr.second);
+    }
+
+    HttpUpstream::Options options;
+    options.balance = g_config.proxy_balance == "least_conn" ?
+      HttpUpstream::kLeastConn : HttpUpstream::kRoundRobin;
+    options.max_idle = g_config.proxy_max_idle_connections;
+    options.max_fails = g_config.proxy_max_fails;
+    options.fail_timeout = g_config.proxy_fail_timeout;
+
+    upstream.reset(new HttpUpstream(loop, peers, options));
+  }
+
+  return upstream.get();
+}
+
+void HttpServer::PinIoThread(EventLoop* loop)
+{
+  // The base loop is the acceptor, it is also the IO loop
+  // when the loop number is 0, don't pin it here
+  if (io_cpus_.empty() || loop == base_loop_) return;
+
+  const int index = io_thread_index_.fetch_add(1, std::memory_order_relaxed);
+  const int cpu = io_cpus_[index % io_cpus_.size()];
+
+  if (!unix::PinThread(cpu)) {
+    LOG_SYSERROR << "Failed to pin the IO thread " << index << " to CPU " << cpu;
+  } else {
+    LOG_INFO << "The IO thread " << index << " is pinned to CPU " << cpu;
+  }
+}
+
+void HttpServer::RenderStats(std::string& out) const
+{
+  if (primary_->stats_table_) {
+    primary_->stats_table_->Render(out);
+  } else {
+    primary_->stats_->Render(out);
+  }
+}
+
 std::shared_ptr<int> HttpServer::GetFd(std::string const& path)
 {
+  if (primary_ != this) {
+    return primary_->GetFd(path);
+  }
+
   /* 
    * The race condition between GetFd() and deleter:
    * Call the deleter but lock is preempted by other thread calling GetFd()
@@ -122,6 +343,10 @@ std::shared_ptr<int> HttpServer::GetFd(std::string const& path)
 }
 
 std::shared_ptr<char*> HttpServer::GetAddr(std::string const& pathname, size_t len) {
+  if (primary_ != this) {
+    return primary_->GetAddr(pathname, len);
+  }
+
   MutexGuard guard(mutex_addr_);
 
   auto& wp = addr_map_[pathname];
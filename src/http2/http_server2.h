@@ -2,33 +2,177 @@
 #define KANON_HTTP_SERVER2_H
 
 #include <sys/types.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <kanon/net/user_server.h>
 #include <kanon/thread/rw_lock.h>
 #include <kanon/util/optional.h>
 
+#include "http2/admission_control.h"
+#include "http2/fcgi_upstream.h"
+#include "http2/http_upstream.h"
+#include "http2/plugin_registry.h"
+#include "http2/plugin_worker_pool.h"
+#include "http2/response_cache.h"
+#include "http2/router.h"
+#include "http2/server_stats.h"
+#include "http2/tls_context.h"
+
 namespace http {
 
 class HttpSession;
 
 class HttpServer : public kanon::TcpServer {
   friend class HttpSession;
+  friend class Http2Connection;
 public:
-  HttpServer(EventLoop* loop, InetAddr const& addr);
+  /**
+   * \param reuseport Set SO_REUSEPORT to the listening socket, then
+   *                  multiple servers can listen on the same port
+   */
+  HttpServer(EventLoop* loop, InetAddr const& addr, bool reuseport = false);
+
+  /**
+   * Listen on the same port with \p primary by SO_REUSEPORT and
+   * share the file caches and counters of it.
+   * Used by the multi-acceptor mode.
+   */
+  HttpServer(EventLoop* loop, InetAddr const& addr, HttpServer& primary);
 
   ~HttpServer() noexcept;
+
+  /**
+   * Update \p stats instead of the counters owned by the server,
+   * e.g. the slot of the worker process in the shared memory.
+   * \param table If not null, the status page shows the sum of the table
+   * \note Must be called before StartRun()
+   */
+  void SetStats(ServerStats& stats, SharedStatsTable const* table = nullptr) noexcept;
+
+  ServerStats const& GetStats() const noexcept
+  { return *primary_->stats_; }
+
+  /**
+   * Terminate TLS by \p context, the connections starting with a
+   * handshake record are encrypted.
+   * \note Must be called before StartRun(), \p context outlives the server
+   */
+  void SetTlsContext(TlsContext const* context) noexcept { tls_context_ = context; }
+
+  /** Render the counters shown in the status page */
+  void RenderStats(std::string& out) const;
+
+  /**
+   * Pin the IO threads to \p cpus in round-robin.
+   * Each loop thread is pinned in its init callback before the loop
+   * runs, so the memory allocated by the thread(e.g. buffers and
+   * per-loop states) is on the local node.
+   * The acceptor(main thread) is pinned by the caller.
+   * \note Must be called before StartRun()
+   */
+  void SetCpuAffinity(std::vector<int> cpus) { io_cpus_ = std::move(cpus); }
+
 private:
+  HttpServer(EventLoop* loop, InetAddr const& addr, bool reuseport, HttpServer* primary);
+
+  ServerStats& GetStats() noexcept
+  { return *primary_->stats_; }
+
+  AdmissionControl& GetAdmissionControl() noexcept
+  { return primary_->admission_; }
+
+  PluginRegistry& GetPluginRegistry() noexcept
+  { return primary_->plugins_; }
+
+  Router const& GetRouter() const noexcept
+  { return primary_->router_; }
+
+  /** \return nullptr if TLS is disabled */
+  TlsContext const* GetTlsContext() const noexcept
+  { return primary_->tls_context_; }
+
+  /** \return nullptr if PluginCacheSize is 0 */
+  ResponseCache* GetResponseCache() noexcept
+  { return primary_->response_cache_.get(); }
+
+  /**
+   * Created when the first blocking plugin is served.
+   * \return nullptr if PluginWorkerThreads is 0
+   */
+  PluginWorkerPool* GetPluginWorkerPool();
+
+  /**
+   * The connections of the IO loop to the FastCGI application,
+   * created when the first request of the loop is proxied.
+   * \param address The target of route(ip:port)
+   * \return nullptr if the address is invalid
+   */
+  FcgiUpstream* GetFcgiUpstream(EventLoop* loop, std::string const& address);
+
+  /**
+   * The keep-alive connections of the IO loop to the upstream servers,
+   * created when the first request of the loop is proxied.
+   * \param addresses The target of route(ip:port[,ip:port...])
+   * \return nullptr if the addresses are invalid
+   */
+  HttpUpstream* GetHttpUpstream(EventLoop* loop, std::string const& addresses);
+
+  void PinIoThread(EventLoop* loop);
+
+  /**
+   * Compile the Route lines in the config and load their plugins,
+   * the invalid route is skipped with error.
+   */
+  void BuildRouter();
+
   // Cache factory method
   // @see Modern Effective C++ Item 21
   std::shared_ptr<int> GetFd(std::string const& path);
   std::shared_ptr<char*> GetAddr(std::string const& path, size_t len);
 
+  /**
+   * The server which owns the shared caches and counters.
+   * Point to this if the server is not created from other.
+   */
+  HttpServer* primary_;
+
+  EventLoop* base_loop_;
+  std::vector<int> io_cpus_;
+  std::atomic<int> io_thread_index_{0};
+
   kanon::MutexLock mutex_;
   std::unordered_map<std::string, std::weak_ptr<int>> fd_map_;
 
   kanon::MutexLock mutex_addr_;
   std::unordered_map<std::string, std::weak_ptr<char*>> addr_map_;
+
+  ServerStats own_stats_;
+  ServerStats* stats_;
+  SharedStatsTable const* stats_table_ = nullptr;
+
+  AdmissionControl admission_;
+
+  TlsContext const* tls_context_ = nullptr;
+
+  PluginRegistry plugins_;
+
+  /** Built at startup and read-only afterwards */
+  Router router_;
+
+  std::unique_ptr<ResponseCache> response_cache_;
+
+  std::once_flag plugin_workers_once_;
+  std::unique_ptr<PluginWorkerPool> plugin_workers_;
+
+  /** Keyed by the IO loop and target of route, used by the loop only */
+  kanon::MutexLock mutex_upstreams_;
+  std::map<std::pair<EventLoop*, std::string>, std::unique_ptr<FcgiUpstream>> fcgi_upstreams_;
+  std::map<std::pair<EventLoop*, std::string>, std::unique_ptr<HttpUpstream>> http_upstreams_;
 };
 
 } // namespace http
@@ -0,0 +1,82 @@
+#include "http2/http_server_group.h"
+
+#include <kanon/log/logger.h>
+
+#include "unix/affinity.h"
+
+using namespace kanon;
+
+namespace http {
+
+HttpServerGroup::HttpServerGroup(EventLoop* loop, InetAddr const& addr, int thread_num)
+  : addr_(addr)
+  , server_(loop, addr, true)
+  , thread_num_(thread_num)
+{
+}
+
+HttpServerGroup::~HttpServerGroup() noexcept
+{
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto loop : loops_) {
+      loop->Quit();
+    }
+  }
+
+  for (auto& thr : threads_) {
+    thr.join();
+  }
+}
+
+void HttpServerGroup::StartRun()
+{
+  PinCpu(0);
+  server_.StartRun();
+
+  threads_.reserve(thread_num_);
+  for (int i = 1; i <= thread_num_; ++i) {
+    threads_.emplace_back(&HttpServerGroup::ThreadFunc, this, i);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this]() {
+    return loops_.size() == static_cast<size_t>(thread_num_);
+  });
+
+  LOG_INFO << thread_num_ + 1 << " acceptors are listening on " << addr_.ToIpPort();
+}
+
+void HttpServerGroup::ThreadFunc(int index)
+{
+  PinCpu(index);
+
+  EventLoop loop;
+  HttpServer server(&loop, addr_, server_);
+
+  server.StartRun();
+  loop.SetEdgeTriggerMode();
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    loops_.push_back(&loop);
+  }
+  cond_.notify_one();
+
+  loop.StartLoop();
+}
+
+void HttpServerGroup::PinCpu(int index)
+{
+  if (cpus_.empty()) return;
+
+  const int cpu = cpus_[index % cpus_.size()];
+
+  if (!unix::PinThread(cpu)) {
+    LOG_SYSERROR << "Failed to pin the acceptor " << index << " to CPU " << cpu;
+  } else {
+    LOG_INFO << "The acceptor " << index << " is pinned to CPU " << cpu;
+  }
+}
+
+} // namespace http
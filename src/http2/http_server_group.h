@@ -0,0 +1,70 @@
+#ifndef KANON_HTTP_SERVER_GROUP_H
+#define KANON_HTTP_SERVER_GROUP_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <kanon/net/user_server.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/http_server2.h"
+
+namespace http {
+
+/**
+ * Multi-acceptor mode.
+ *
+ * Each IO thread owns an EventLoop and a HttpServer listening on
+ * the same port by SO_REUSEPORT, the kernel distributes the new
+ * connections to them. The connection is accepted and handled in
+ * the same thread, there is no cross-thread handoff.
+ *
+ * The main loop also accepts and handles connections.
+ * All servers share the file caches and counters of the main server.
+ */
+class HttpServerGroup : kanon::noncopyable {
+ public:
+  /**
+   * \param thread_num The number of IO threads except the main thread
+   */
+  HttpServerGroup(EventLoop* loop, InetAddr const& addr, int thread_num);
+
+  /**
+   * Quit the loops of IO threads and join them
+   */
+  ~HttpServerGroup() noexcept;
+
+  /**
+   * Pin the i-th acceptor(the main thread is the 0-th) to cpus[i % cpus.size()]
+   */
+  void SetCpuAffinity(std::vector<int> cpus) { cpus_ = std::move(cpus); }
+
+  /**
+   * Start the main server and the IO threads.
+   * Return after all IO threads are listening.
+   */
+  void StartRun();
+
+  HttpServer& GetMainServer() noexcept { return server_; }
+
+ private:
+  void ThreadFunc(int index);
+  void PinCpu(int index);
+
+  InetAddr addr_;
+  HttpServer server_;
+  int thread_num_;
+  std::vector<int> cpus_;
+
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<EventLoop*> loops_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_SERVER_GROUP_H
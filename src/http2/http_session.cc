@@ -1,8 +1,12 @@
 #include "http_session.h"
 
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <chrono>
 
 #include <kanon/log/logger.h>
 #include <kanon/net/buffer.h>
@@ -19,10 +23,12 @@
 
 #include "http2/http_parser.h"
 #include "http2/http_request.h"
-#include "plugin/plugin_loader.h"
+#include "http2/plugin_instance_pool.h"
 #include "plugin/http_dynamic_response_interface.h"
 #include "unix/fd_wrapper.h"
 #include "unix/stat.h"
+#include "util/free_list_allocator.h"
+#include "util/object_pool.h"
 
 #include "http_server2.h"
 
@@ -45,22 +51,110 @@ HttpSession::HttpSession()
 {
 }
 
-HttpSession::HttpSession(HttpServer& server, TcpConnectionPtr const& conn)
+HttpSession::HttpSession(HttpServer& server, TcpConnectionPtr const& conn,
+                         AdmissionControl::LoopState* loop_state)
   : HttpSession()
+{
+  Init(server, conn, loop_state);
+}
+
+std::shared_ptr<HttpSession> HttpSession::Create(
+  HttpServer& server, TcpConnectionPtr const& conn,
+  AdmissionControl::LoopState* loop_state)
+{
+  using Pool = ObjectPool<HttpSession>;
+
+  std::shared_ptr<HttpSession> session(Pool::GetLocal().AcquireRaw(),
+                                       Pool::Releaser(),
+                                       FreeListAllocator<HttpSession>());
+  session->Init(server, conn, loop_state);
+  return session;
+}
+
+void HttpSession::Init(HttpServer& server, TcpConnectionPtr const& conn,
+                       AdmissionControl::LoopState* loop_state)
 {
   server_ = &server;
   conn_ = conn;
+  loop_state_ = loop_state;
+}
+
+void HttpSession::Reset() noexcept
+{
+  LOG_DEBUG << "HttpSession " << id_ << " is recycled";
+
+  server_ = nullptr;
+  conn_.reset();
+  loop_state_ = nullptr;
+  request_inflight_ = false;
+
+  parser_.Reset();
+  request_.Reset();
+  arena_.Reset();
+  parsing_ = false;
+  route_match_.Reset();
+
+  write_state_ = WriteState::kIdle;
+  file_fd_.reset();
+  file_addr_.reset();
+  writer_.Finish();
+  stream_generator_.reset();
+  stream_plugin_.reset();
+  paused_ = false;
+  next_request_scheduled_ = false;
+
+  cache_key_.clear();
+  cache_filling_ = false;
+  cache_bypass_ = false;
+  cache_plugin_.reset();
+  h2_.reset();
+  ws_.reset();
+  tls_.reset();
+  tls_checked_ = false;
+
+  fcgi_upstream_ = nullptr;
+  fcgi_request_id_ = 0;
+
+  proxy_upstream_ = nullptr;
+  proxy_conn_.reset();
+  proxy_request_.clear();
+  proxy_acquiring_ = false;
+  proxy_retried_ = false;
+  proxy_paused_ = false;
+  proxy_eof_ = false;
+
+  keep_alive_timer_id_ = kanon::optional<TimerId>();
+  connection_timer_id_ = kanon::optional<TimerId>();
+
+  cur_filesize_ = 0;
+  cache_filesize_ = 0;
+  id_ = counter_.GetAndAdd(1);
 }
 
 void HttpSession::Setup() {
   LOG_DEBUG << "This new established connection will be closed after 60s if no message coming";
   connection_timer_id_ = conn_->GetLoop()->RunAfter([this]() {
     LogClose();
-    conn_->ShutdownWrite();
+    ShutdownWrite();
   }, 60);
 
-  conn_->SetMessageCallback(std::bind(
-    &HttpSession::OnMessage, this, kanon::_1, kanon::_2, kanon::_3));
+  // Only capture this, the closure is stored in the small buffer of
+  // std::function instead of the heap(std::bind object is too large)
+  conn_->SetMessageCallback([this](TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp recv) {
+    OnMessage(conn, buffer, recv);
+  });
+
+  conn_->SetWriteCompleteCallback([this](TcpConnectionPtr const& conn) {
+    KANON_UNUSED(conn);
+    return OnWriteComplete();
+  });
+
+  if (g_config.high_water_mark > 0) {
+    conn_->SetHighWaterMarkCallback([this](TcpConnectionPtr const& conn, size_t size) {
+      KANON_UNUSED(conn);
+      OnHighWaterMark(size);
+    }, g_config.high_water_mark);
+  }
 }
 
 HttpSession::~HttpSession() noexcept
@@ -71,6 +165,40 @@ HttpSession::~HttpSession() noexcept
 void HttpSession::Teardown() {
   CancelKeepAliveTimer(); 
   CancelConnectionTimeoutTimer();
+  EndRequest();
+
+  if (ws_) {
+    ws_->OnClose();
+  }
+
+  // Stop the streaming plugin
+  writer_.Close();
+  stream_generator_.reset();
+  stream_plugin_.reset();
+  cache_plugin_.reset();
+
+  if (h2_) {
+    h2_->Close();
+  }
+
+  // The response of FastCGI is discarded
+  if (fcgi_request_id_ != 0) {
+    fcgi_upstream_->Abort(fcgi_request_id_);
+    fcgi_request_id_ = 0;
+  }
+
+  // The response is not complete, the upstream connection can't be reused
+  proxy_acquiring_ = false;
+
+  if (proxy_conn_) {
+    proxy_upstream_->Release(proxy_conn_, false);
+    proxy_conn_.reset();
+  }
+
+  if (loop_state_) {
+    server_->GetAdmissionControl().Release(loop_state_);
+    loop_state_ = nullptr;
+  }
 }
 
 void HttpSession::OnMessage(TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp recv_time)
@@ -83,16 +211,199 @@ void HttpSession::OnMessage(TcpConnectionPtr const& conn, Buffer& buffer, TimeSt
 
   CancelConnectionTimeoutTimer();
   CancelKeepAliveTimer();
-  
-  HttpParser parser;
-  HttpRequest request;
+
+  if (!CheckBufferLimit(buffer.GetReadableSize(), "input")) {
+    return;
+  }
+
+  if (!tls_checked_) {
+    tls_checked_ = true;
+    StartTls(buffer);
+  }
+
+  if (tls_ && !ReadTlsRecords(buffer)) {
+    return;
+  }
+
+  auto& input = GetInputBuffer();
+
+  if (h2_) {
+    h2_->OnMessage(input);
+    return;
+  }
+
+  if (ws_) {
+    ws_->OnMessage(input);
+    return;
+  }
+
+  HandleRequest(input);
+}
+
+void HttpSession::StartTls(Buffer& buffer)
+{
+#ifdef KANON_HTTP_TLS
+  auto context = server_->GetTlsContext();
+
+  // The content type of record is handshake(22)
+  if (!context || buffer.ToStringView()[0] != 0x16) {
+    return;
+  }
+
+  // Don't own the connection, the channel is owned by it through the session
+  std::weak_ptr<TcpConnection> wp(conn_);
+
+  tls_ = std::make_shared<TlsChannel>(*context, conn_->GetFd(), [wp](StringView data) {
+    auto conn = wp.lock();
+
+    if (!conn) return true;
+
+    conn->Send(data);
+    return !conn->GetOutputBuffer()->HasReadable();
+  });
+
+  tls_->SetLoop(conn_->GetLoop());
+#else
+  KANON_UNUSED(buffer);
+#endif
+}
+
+bool HttpSession::ReadTlsRecords(Buffer& buffer)
+{
+#ifdef KANON_HTTP_TLS
+  const bool handshake_done = tls_->IsHandshakeDone();
+
+  if (!tls_->OnMessage(buffer)) {
+    LOG_WARN << _PEER_IP << " Invalid TLS record, close the connection";
+    Increment(server_->GetStats().tls_failures);
+    conn_->ForceClose();
+    return false;
+  }
+
+  if (!handshake_done && tls_->IsHandshakeDone()) {
+    auto& stats = server_->GetStats();
+    Increment(stats.tls_handshakes);
+
+    if (tls_->IsSessionReused()) {
+      Increment(stats.tls_resumed);
+    }
+
+    if (tls_->IsKernelOffload()) {
+      Increment(stats.tls_kernel_offload);
+    }
+
+    LOG_DEBUG << "TLS handshake is done, ALPN: " << tls_->GetAlpn();
+  }
+
+  return tls_->GetInputBuffer().HasReadable();
+#else
+  KANON_UNUSED(buffer);
+  return true;
+#endif
+}
+
+void HttpSession::Send(StringView data)
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Send(data);
+    return;
+  }
+#endif
+
+  conn_->Send(data);
+}
+
+void HttpSession::Send(Buffer& buffer)
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Send(buffer.ToStringView());
+    buffer.AdvanceAll();
+    return;
+  }
+#endif
+
+  conn_->Send(buffer);
+}
+
+void HttpSession::ShutdownWrite()
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Shutdown();
+  }
+#endif
+
+  conn_->ShutdownWrite();
+}
+
+void HttpSession::HandleRequest(Buffer& buffer)
+{
+  // The pipelined requests are served one by one,
+  // the next one is parsed when the current response is complete.
+  // If the output buffer reaches the high-water mark, the requests
+  // are left in the input buffer until it is drained.
+  if (IsBusy()) {
+    LOG_DEBUG << "The session is busy, the request is pending";
+    return;
+  }
+
+  if (!parsing_ && g_config.enable_http2) {
+    // HTTP/2 with prior knowledge, the preface is not a HTTP/1.x request
+    const int ret = Http2Codec::MatchPreface(buffer.ToStringView());
+
+    if (ret == 0) return;
+
+    if (ret > 0) {
+      h2_.reset(new Http2Connection(*server_, conn_, tls_));
+      h2_->Start();
+      h2_->OnMessage(buffer);
+      return;
+    }
+  }
+
+  if (!parsing_) {
+    // The previous response is complete(see IsBusy()),
+    // its memory is freed at once
+    request_.Reset(&arena_);
+    arena_.Reset();
+    parsing_ = true;
+  }
+
+  auto& request = request_;
   HttpParser::ParseResult ret;
 
-  if ( (ret = parser.Parse(buffer, &request) ) == HttpParser::kGood) {
+  if ( (ret = parser_.Parse(buffer, &request) ) == HttpParser::kGood) {
+    parsing_ = false;
+    CancelKeepAliveTimer();
+
+    if (g_config.enable_http2 && UpgradeToHttp2(request)) {
+      return;
+    }
+
+    BeginRequest();
+
+    if (!g_config.status_path.empty() && request.url == g_config.status_path) {
+      ServeStatus(request);
+      return;
+    }
+
+    // The routing table takes precedence over the legacy mapping
+    auto& router = server_->GetRouter();
+
+    if (!router.IsEmpty() && router.Match(request.method, request.url, route_match_)) {
+      path_offset_ = 0;
+      LogRequest(request);
+      ServeRoute(request);
+      return;
+    }
+
     if (request.url == "/")
       request.url += g_config.homepage_path;
     LogRequest(request);
     request.url.insert(0, g_config.root_path.data(), g_config.root_path.size());
+    path_offset_ = g_config.root_path.size();
 
     switch (request.method) {
       case HttpMethod::kGet: {
@@ -113,11 +424,172 @@ void HttpSession::OnMessage(TcpConnectionPtr const& conn, Buffer& buffer, TimeSt
   }
 
   if (ret == HttpParser::kError) {
-    error_ = std::move(parser.error());
+    parsing_ = false;
+    error_ = std::move(parser_.error());
     SendErrorResponse();
   }
 }
 
+bool HttpSession::UpgradeToHttp2(HttpRequest const& req)
+{
+  // h2c is cleartext only, h2 over TLS is selected by ALPN
+  if (tls_) return false;
+
+  bool h2c = false;
+  StringView settings;
+
+  for (auto const& header : req.headers) {
+    auto name = ToStringView(header.first);
+    auto value = ToStringView(header.second);
+
+    if (name.size() == 7 && ::strncasecmp(name.data(), "Upgrade", 7) == 0) {
+      // e.g. Upgrade: websocket, h2c
+      for (size_t i = 0; i + 3 <= value.size(); ++i) {
+        if (::strncasecmp(value.data() + i, "h2c", 3) == 0) {
+          h2c = true;
+          break;
+        }
+      }
+    } else if (name.size() == 14 && ::strncasecmp(name.data(), "HTTP2-Settings", 14) == 0) {
+      settings = value;
+    }
+  }
+
+  // The body of upgrade request would be the stream 1,
+  // keep HTTP/1.1 for it since the dynamic contents are not multiplexed
+  if (!h2c || settings.empty() || !req.body.empty()) {
+    return false;
+  }
+
+  h2_.reset(new Http2Connection(*server_, conn_));
+
+  if (!h2_->StartUpgrade(settings, req)) {
+    h2_.reset();
+    return false;
+  }
+
+  // The preface may follow the request
+  h2_->OnMessage(GetInputBuffer());
+  return true;
+}
+
+void HttpSession::ScheduleNextRequest()
+{
+  if (ws_ || next_request_scheduled_ || IsBusy() || !GetInputBuffer().HasReadable()) {
+    return;
+  }
+
+  // Don't serve it in the current call stack, e.g. the write complete callback
+  next_request_scheduled_ = true;
+  std::weak_ptr<HttpSession> wp(shared_from_this());
+
+  conn_->GetLoop()->QueueToLoop([wp]() {
+    auto session = wp.lock();
+
+    if (session) {
+      session->next_request_scheduled_ = false;
+
+      if (session->conn_->IsConnected()) {
+        session->HandleRequest(session->GetInputBuffer());
+      }
+    }
+  });
+}
+
+bool HttpSession::OnWriteComplete()
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->OnOutputDrained();
+  }
+#endif
+
+  if (h2_) {
+    return h2_->OnWriteComplete();
+  }
+
+  if (writer_.IsActive()) {
+    writer_.OnDrain();
+
+    // The completion of blocking plugin is posted by the worker
+    if (writer_.IsEnded() && !writer_.IsInWorker()) {
+      OnDynamicContentComplete();
+    }
+  }
+
+  switch (write_state_) {
+    case WriteState::kSendingFile:
+      return SendFile();
+    case WriteState::kSendingMmap:
+      return SendFileOfMmap();
+    case WriteState::kLastWrite:
+      write_state_ = WriteState::kIdle;
+      file_fd_.reset();
+      file_addr_.reset();
+      CloseConnection(request_);
+      break;
+    case WriteState::kIdle:
+      break;
+  }
+
+  if (paused_) {
+    LOG_DEBUG << "The output buffer is drained, resume serving requests";
+    paused_ = false;
+    ScheduleNextRequest();
+  }
+
+  if (!IsBusy() && write_state_ == WriteState::kIdle) {
+    TrimBuffers();
+  }
+
+  return true;
+}
+
+void HttpSession::TrimBuffers()
+{
+  if (g_config.idle_buffer_size <= 0) return;
+
+  const size_t idle_size = g_config.idle_buffer_size;
+
+  // Shrink only if it is much larger than the idle size,
+  // avoid reallocating for every response of similar size
+  auto trim = [this, idle_size](Buffer& buffer) {
+    if (buffer.GetCapacity() > kTrimFactor_ * idle_size) {
+      LOG_DEBUG << "Trim the buffer from " << buffer.GetCapacity() << " bytes";
+      buffer.Shrink(idle_size);
+      Increment(server_->GetStats().buffers_trimmed);
+    }
+  };
+
+  trim(*conn_->GetOutputBuffer());
+
+  // The pending request is kept
+  trim(GetInputBuffer());
+}
+
+void HttpSession::OnHighWaterMark(size_t size)
+{
+  LOG_DEBUG << "The output buffer reaches the high-water mark: " << size;
+
+  if (CheckBufferLimit(size, "output")) {
+    paused_ = true;
+  }
+}
+
+bool HttpSession::CheckBufferLimit(size_t size, char const* which)
+{
+  if (g_config.max_connection_buffer > 0 &&
+      size > static_cast<size_t>(g_config.max_connection_buffer)) {
+    LOG_WARN << _PEER_IP << " The " << which << " buffer exceeds the limit("
+             << size << " bytes), close the connection";
+    Increment(server_->GetStats().closed_over_limit);
+    conn_->ForceClose();
+    return false;
+  }
+
+  return true;
+}
+
 void HttpSession::ServeFile(HttpRequest const& req)
 {
   Stat stat;
@@ -127,10 +599,13 @@ void HttpSession::ServeFile(HttpRequest const& req)
     return;
   }
 
-  HttpResponse response(true);
+  auto p_response = ObjectPool<HttpResponse>::GetLocal().Acquire();
+  auto& response = *p_response;
+  response.Reset(true);
 
   off_t file_size = stat.GetFileSize();
   cur_filesize_ = file_size;
+  cache_filesize_ = 0;
 
   LOG_DEBUG << "file_size = " << file_size;
 
@@ -189,34 +664,32 @@ void HttpSession::ServeFile(HttpRequest const& req)
     cache_filesize_ += readn;
     LOG_DEBUG << "Sending file...";
 
+    // The rest is sent in the write complete callback,
+    // i.e. at most one slice is buffered in the output buffer
     if (!g_config.use_mmap) {
-      conn_->SetWriteCompleteCallback([&req, fd, session = this](TcpConnectionPtr const& conn) {
-        KANON_UNUSED(conn);
-        return session->SendFile(fd, req);
-      });
+      file_fd_ = std::move(fd);
+      write_state_ = WriteState::kSendingFile;
     } else {
-      conn_->SetWriteCompleteCallback([&req, addr, session = this](TcpConnectionPtr const& conn) {
-        KANON_UNUSED(conn);
-        return session->SendFileOfMmap(addr, req);
-      });
-
+      file_addr_ = std::move(addr);
+      write_state_ = WriteState::kSendingMmap;
     }
 
-    conn_->Send(response.GetBuffer());
+    Send(response.GetBuffer());
   } else {
     LOG_DEBUG << "File has been sent";
 
     SetLastWriteComplete(req);
-    conn_->Send(response.GetBuffer());
+    Send(response.GetBuffer());
   }
   
 }
 
-bool HttpSession::SendFile(std::shared_ptr<int> const& fd, HttpRequest const& req)
+bool HttpSession::SendFile()
 {
+  auto const& req = request_;
   char buf[kFileBufferSize_];
 
-  auto readn = ::pread(*fd, buf, sizeof buf, cache_filesize_);
+  auto readn = ::pread(*file_fd_, buf, sizeof buf, cache_filesize_);
   
   LOG_DEBUG << "readn = " << readn;
   LOG_DEBUG << "The offset = " << cache_filesize_;
@@ -232,131 +705,1360 @@ bool HttpSession::SendFile(std::shared_ptr<int> const& fd, HttpRequest const& re
       LOG_DEBUG << "File has been sent";
 
       SetLastWriteComplete(req); 
-      conn_->Send(buf, readn);
+      Send(StringView(buf, readn));
 
       return !conn_->GetOutputBuffer()->HasReadable();
     } else {
-      conn_->Send(buf, readn);
+      Send(StringView(buf, readn));
       return false;
     }
       
   } else {
     LOG_DEBUG << "File has been sent";
 
-    conn_->SetWriteCompleteCallback(WriteCompleteCallback());
+    write_state_ = WriteState::kIdle;
+    file_fd_.reset();
     CloseConnection(req);
     return true;
   }
 }
 
-bool HttpSession::SendFileOfMmap(std::shared_ptr<char*> const& addr, HttpRequest const& req) {
+bool HttpSession::SendFileOfMmap() {
+  auto const& req = request_;
+  auto const& addr = file_addr_;
   auto left = cur_filesize_ - cache_filesize_; 
 
   LOG_DEBUG << "The offset = " << cache_filesize_ << "; left = " << left;
 
   if (left > kFileBufferSize_) {
-    conn_->Send(*addr + cache_filesize_, kFileBufferSize_);
+    Send(StringView(*addr + cache_filesize_, kFileBufferSize_));
     cache_filesize_ += kFileBufferSize_;
     return false;
   } else {
     LOG_DEBUG << "File has been sent";
 
-    // SetLastWriteComplete() will override the addr
-    // Must guard here!
-    auto guard = addr;
+    // The addr is released after the last write complete
     SetLastWriteComplete(req);
-    conn_->Send(*guard + cache_filesize_, left);
+    Send(StringView(*addr + cache_filesize_, left));
 
     return !conn_->GetOutputBuffer()->HasReadable();
   }
 }
 
-void HttpSession::ServeDynamicContent(HttpRequest const& req)
+void HttpSession::ServeRoute(HttpRequest& req)
 {
-  plugin::PluginLoader<HttpDynamicResponseInterface> loader;
+  auto route = route_match_.route;
+
+  LOG_DEBUG << "The route of " << req.url << ": " << route->pattern;
+
+  if (route->kind == Route::kStatic) {
+    if (req.method != HttpMethod::kGet) {
+      NotImplementation(req);
+      return;
+    }
+
+    // The rest refers to the URL, build the path in the other string
+    route_path_.assign(route->target);
+    route_path_.append(route_match_.rest.data(), route_match_.rest.size());
+    req.url.swap(route_path_);
+    ServeFile(req);
+    return;
+  }
+
+  if (route->kind == Route::kFastCgi) {
+    ServeFastCgi(req);
+    return;
+  }
+
+  if (route->kind == Route::kProxy) {
+    ServeProxy(req);
+    return;
+  }
+
+  req.is_static = false;
+  auto plugin = route->plugin;
+
+  // The cached plugin is stale if it can be reloaded
+  if (!plugin || g_config.plugin_hot_reload) {
+    std::string error;
+    plugin = server_->GetPluginRegistry().Get(route->target, error);
 
+    if (!plugin) {
+      LOG_ERROR << "Failed to load the plugin of route " << route->pattern << ": " << error;
+      error_ = {HttpStatusCode::k404NotFound, "The page is not found"};
+      SendErrorResponse();
+      return;
+    }
+  }
+
+  ServeDynamicContent(req, std::move(plugin));
+}
+
+void HttpSession::ServeDynamicContent(HttpRequest const& req)
+{
   assert(!req.is_static);
 
-  LOG_DEBUG << "query = " << req.query;
-  LOG_INFO << _PEER_IP << " " << req.query;
-  auto error = loader.Open(req.url);
+  std::string error;
+  auto plugin = server_->GetPluginRegistry().Get(req.url, error);
 
-  if (error) {
+  if (!plugin) {
     LOG_SYSERROR << "Failed to open shared object: " << req.url;
-    LOG_SYSERROR << "Error Message: " << *error;
+    LOG_SYSERROR << "Error Message: " << error;
     error_ = {HttpStatusCode::k404NotFound, "The page is not found"};
     SendErrorResponse();
     return ;
   }
 
-  auto create_func = loader.GetCreateFunc();
+  ServeDynamicContent(req, std::move(plugin));
+}
+
+void HttpSession::ServeDynamicContent(HttpRequest const& req, PluginRegistry::PluginPtr plugin)
+{
+  LOG_DEBUG << "query = " << ToStringView(req.query);
+  LOG_INFO << _PEER_IP << " " << ToStringView(req.query);
 
-  std::unique_ptr<HttpDynamicResponseInterface> generator(create_func());
-  generator->SetConnection(conn_);
+  // The plugin is kept loaded until the generator is released
+  auto generator = PluginInstancePool::GetLocal().Acquire(plugin, conn_->GetLoop());
   generator->SetVersion(req.version);
 
-  HttpResponse first(false);
+  // The bytes sent by conn_ would bypass TLS
+  if (!tls_) {
+    generator->SetConnection(conn_);
+  }
 
-  assert(req.version != HttpVersion::kNotSupport);
-  first.AddHeaderLine(HttpStatusCode::k200OK, req.version);
-  
-  if (req.is_keep_alive) {
-    first.AddHeader("Connection", "Keep-Alive");
+  if (plugin->abi_version >= 3 && ServeWebSocket(req, plugin, generator)) {
+    return;
   }
 
-  if (req.method == HttpMethod::kPost) {
-    generator->GenResponseForPost(req.body, first);
+  const auto policy = generator->GetCachePolicy();
+  const bool cacheable = policy.ttl_ms > 0 && !generator->IsStreaming();
+  auto cache = server_->GetResponseCache();
+
+  // Before version 4, the plugin sends the response by the connection itself
+  if (tls_ && plugin->abi_version < 4 && !cacheable && !generator->IsStreaming()) {
+    LOG_ERROR << "The plugin " << plugin->path << "(ABI " << plugin->abi_version
+              << ") sends by the connection, rebuild it to be served over TLS";
+    error_ = {HttpStatusCode::k500InternalServerError, "The plugin can't be served over TLS"};
+    SendErrorResponse();
+    return;
   }
-  else if (req.method == HttpMethod::kGet) {
-    generator->GenResponseForGet(ParseArgs(req.query), first);
+
+  if (cacheable && cache && req.method == HttpMethod::kGet && !cache_bypass_) {
+    if (ServeFromCache(req, *cache, plugin, generator, policy)) {
+      return;
+    }
   }
-}
 
-void HttpSession::CloseConnection(HttpRequest const& req)
-{
-  if (req.is_keep_alive) {
-    LOG_DEBUG << "Keep-Alive connection will keep 5s if no new message coming";
-    keep_alive_timer_id_ = conn_->GetLoop()->RunAfter([this]() {
-      LogClose();
-      conn_->ShutdownWrite();
-    }, 5);
+  cache_bypass_ = false;
+
+  auto p_first = ObjectPool<HttpResponse>::GetLocal().Acquire();
+  auto& first = *p_first;
+
+  // The status line of cacheable response is added when sent,
+  // see SendCachedResponse()
+  if (!cacheable) {
+    assert(req.version != HttpVersion::kNotSupport);
+    first.AddHeaderLine(HttpStatusCode::k200OK, req.version);
+
+    if (req.is_keep_alive) {
+      first.AddHeader("Connection", "Keep-Alive");
+    }
   }
-  else {
-    LOG_DEBUG << "Non-Keep-Alive(Close) Connection will be closed at immediately";
-    LogClose();
-    conn_->ShutdownWrite();
+
+  if (generator->IsStreaming()) {
+    writer_.Begin(conn_, tls_, req.version, req.is_keep_alive, g_config.high_water_mark);
   }
-}
 
-void HttpSession::SendErrorResponse()
-{
-  LOG_TRACE << "Error occurred, send error page to client";
-  LOG_DEBUG << "Error: (" << GetStatusCode(error_.code)
-    << ", " << GetStatusCodeString(error_.code)
-    << ", " << error_.msg << ")";
-  
-  LogError();
-  conn_->Send(GetClientError(
-    error_.code, error_.msg).GetBuffer());
+  if (generator->IsBlocking()) {
+    auto workers = server_->GetPluginWorkerPool();
 
-  CancelKeepAliveTimer();
-  LogClose();
-  conn_->ShutdownWrite();
-}
+    if (workers) {
+      ServeBlockingContent(*workers, std::move(plugin), std::move(generator), std::move(p_first));
+      return;
+    }
+  }
 
-void HttpSession::NotImplementation(HttpRequest const& req)
-{
-  LOG_TRACE << "The service of " << GetMethodString(req.method) << " is not implemeted";
+  GenDynamicResponse(req, *plugin, *generator, first);
 
-  error_ = {HttpStatusCode::k501NotImplemeted,
-            "The service is not implemeted"};
-  SendErrorResponse();
+  if (writer_.IsActive() && !writer_.IsEnded()) {
+    ContinueStreaming(std::move(plugin), std::move(generator));
+    return;
+  }
+
+  OnDynamicContentComplete();
 }
 
-void HttpSession::CancelKeepAliveTimer()
+void HttpSession::ContinueStreaming(PluginRegistry::PluginPtr plugin,
+                                    PluginInstancePool::InstancePtr generator)
 {
-  if (keep_alive_timer_id_) {
-    conn_->GetLoop()->CancelTimer(*keep_alive_timer_id_);
+  if (!writer_.HasDrainCallback()) {
+    LOG_WARN << "The streaming plugin " << plugin->path
+             << " returns without End() and drain callback, end it";
+    writer_.End();
+    OnDynamicContentComplete();
+    return;
+  }
+
+  // The plugin continues in the drain callback
+  stream_plugin_ = std::move(plugin);
+  stream_generator_ = std::move(generator);
+
+  // The write complete callback isn't called if nothing is buffered
+  if (!conn_->GetOutputBuffer()->HasReadable()) {
+    std::weak_ptr<HttpSession> wp(shared_from_this());
+
+    conn_->GetLoop()->QueueToLoop([wp]() {
+      auto session = wp.lock();
+
+      if (session && session->conn_->IsConnected()) {
+        session->OnWriteComplete();
+      }
+    });
+  }
+}
+
+/** The comma-separated \p value contains \p token(case-insensitive) */
+static bool HasToken(StringView value, StringView token)
+{
+  while (!value.empty()) {
+    const auto comma = value.find(',');
+    auto item = value.substr(0, comma);
+
+    while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+    while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+
+    if (item.size() == token.size() &&
+        ::strncasecmp(item.data(), token.data(), token.size()) == 0) {
+      return true;
+    }
+
+    if (comma == StringView::npos) break;
+    value.remove_prefix(comma + 1);
+  }
+
+  return false;
+}
+
+bool HttpSession::ServeWebSocket(HttpRequest const& req,
+                                 PluginRegistry::PluginPtr& plugin,
+                                 PluginInstancePool::InstancePtr& generator)
+{
+  RequestView view;
+  FillRequestView(req, view);
+
+  if (!HasToken(view.GetHeader("Upgrade"), "websocket")) {
+    return false;
+  }
+
+  // The handshake of RFC 6455, the key is 16 bytes in base64
+  auto key = view.GetHeader("Sec-WebSocket-Key");
+
+  if (req.method != HttpMethod::kGet || req.version != HttpVersion::kHttp11 ||
+      !HasToken(view.GetHeader("Connection"), "upgrade") ||
+      view.GetHeader("Sec-WebSocket-Version") != "13" || key.size() != 24) {
+    error_ = {HttpStatusCode::k400BadRequest, "Invalid WebSocket handshake"};
+    SendErrorResponse();
+    return true;
+  }
+
+  auto args = GetArgs(req, &arena_);
+  view.SetArgs(args);
+
+  ws_ = std::make_shared<WebSocketConnection>(conn_, tls_, server_->GetStats());
+
+  if (!generator->AcceptWebSocket(view, ws_)) {
+    ws_->OnClose();
+    ws_.reset();
+    return false;
+  }
+
+  std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                         "Upgrade: websocket\r\n"
+                         "Connection: Upgrade\r\n"
+                         "Sec-WebSocket-Accept: ";
+  response += WebSocketCodec::GetAcceptKey(key);
+  response += "\r\n\r\n";
+  Send(response);
+
+  Increment(server_->GetStats().websocket_connections);
+  ws_->Open();
+
+  // The socket is not a request in progress of admission control,
+  // the plugin is kept until it is closed
+  EndRequest();
+  stream_plugin_ = std::move(plugin);
+  stream_generator_ = std::move(generator);
+
+  // The frames sent with the handshake
+  if (GetInputBuffer().HasReadable()) {
+    ws_->OnMessage(GetInputBuffer());
+  }
+
+  return true;
+}
+
+namespace {
+
+/**
+ * The states of a request served by the worker pool.
+ * Released in the loop thread, so the generator and response
+ * return to the pools of the loop.
+ */
+struct BlockingJob {
+  std::shared_ptr<HttpSession> session;
+  // Declared before generator, the plugin is unloaded after it is released
+  PluginRegistry::PluginPtr plugin;
+  PluginInstancePool::InstancePtr generator;
+  ObjectPool<HttpResponse>::Ptr response;
+};
+
+} // namespace
+
+void HttpSession::ServeBlockingContent(PluginWorkerPool& workers,
+                                       PluginRegistry::PluginPtr plugin,
+                                       PluginInstancePool::InstancePtr generator,
+                                       ObjectPool<HttpResponse>::Ptr response)
+{
+  // The session is busy until the job completes(see IsBusy()),
+  // so the request and arena are not touched by the loop meanwhile
+  auto job = std::make_shared<BlockingJob>();
+  job->session = shared_from_this();
+  job->plugin = std::move(plugin);
+  job->generator = std::move(generator);
+  job->response = std::move(response);
+
+  auto loop = conn_->GetLoop();
+  writer_.SetInWorker(true);
+
+  const bool submitted = workers.TrySubmit([job, loop]() mutable {
+    auto session = job->session.get();
+    bool failed = true;
+
+    // The completion must be queued to the loop even if the plugin throws,
+    // otherwise the session is busy forever and the job is released here
+    try {
+      session->GenDynamicResponse(session->request_, *job->plugin,
+                                  *job->generator, *job->response);
+      failed = false;
+    } catch (std::exception const& ex) {
+      LOG_ERROR << "Exception is thrown by the blocking plugin "
+                << job->plugin->path << ": " << ex.what();
+    } catch (...) {
+      LOG_ERROR << "Unknown exception is thrown by the blocking plugin "
+                << job->plugin->path;
+    }
+
+    // The blocking plugin can't continue in the drain callback
+    if (!failed && session->writer_.IsActive() && !session->writer_.IsEnded()) {
+      session->writer_.End();
+    }
+
+    // The data sent by plugin is queued to the loop before it
+    loop->QueueToLoop([job = std::move(job), failed]() {
+      if (failed) {
+        job->session->OnBlockingContentFailed();
+      } else {
+        job->session->OnDynamicContentComplete();
+      }
+    });
+  });
+
+  if (!submitted) {
+    LOG_WARN << _PEER_IP << " 503 The queue of plugin workers is full";
+
+    if (cache_filling_) {
+      cache_filling_ = false;
+      server_->GetResponseCache()->Abort(cache_key_);
+    }
+
+    writer_.Finish();
+    EndRequest();
+
+    // Not AdmissionControl::Reject(), the response must be encrypted
+    // if TLS
+    Send(server_->GetAdmissionControl().GetUnavailableResponse());
+    CancelKeepAliveTimer();
+    LogClose();
+    ShutdownWrite();
+  }
+}
+
+void HttpSession::OnBlockingContentFailed()
+{
+  // Wake up the identical requests, they run the plugin by themselves
+  if (cache_filling_) {
+    cache_filling_ = false;
+    server_->GetResponseCache()->Abort(cache_key_);
+  }
+
+  const bool head_sent = writer_.IsActive() && writer_.IsHeadSent();
+  writer_.Finish();
+
+  // Closed when the blocking plugin is running
+  if (!conn_->IsConnected()) {
+    EndRequest();
+    return;
+  }
+
+  if (!head_sent) {
+    error_ = {HttpStatusCode::k500InternalServerError, "The plugin failed"};
+    SendErrorResponse();
+    return;
+  }
+
+  // The response is truncated, only closing can tell the client
+  EndRequest();
+  LogClose();
+  ShutdownWrite();
+}
+
+void HttpSession::GenDynamicResponse(HttpRequest const& req,
+                                     PluginRegistry::Plugin const& plugin,
+                                     HttpDynamicResponseInterface& generator,
+                                     HttpResponse& first)
+{
+  RequestView view;
+  FillRequestView(req, view);
+
+  auto args = GetArgs(req, &arena_);
+
+  // The form body is parsed as the query,
+  // the other bodies are left to the plugin
+  if (req.method == HttpMethod::kPost &&
+      view.GetHeader("Content-Type").starts_with("application/x-www-form-urlencoded")) {
+    args.Parse(req.body);
+  }
+
+  view.SetArgs(args);
+
+  if (writer_.IsActive()) {
+    // The streaming response is sent by the plugin
+    generator.StreamResponse(view, writer_);
+    return;
+  }
+
+  const auto policy = generator.GetCachePolicy();
+
+  // The cached response is served to the other clients and refreshed
+  // without the request(see RevalidateJob), it must not depend on them
+  if (policy.ttl_ms > 0) {
+    view.SetHeaders(nullptr);
+    view.SetPeerAddr(nullptr);
+  }
+
+  generator.GenResponse(view, first);
+
+  if (policy.ttl_ms > 0) {
+    SendCacheableResponse(req, first, policy);
+  }
+  // Since version 4, the response left by the plugin is sent by the server
+  else if (plugin.abi_version >= 4 && first.GetBuffer().HasReadable()) {
+    Send(first.GetBuffer());
+  }
+}
+
+ArgsMap HttpSession::GetArgs(HttpRequest const& req, Arena* arena)
+{
+  auto args = ParseArgs(ToStringView(req.query), arena);
+
+  // The parameters of route take precedence over the query
+  for (auto const& param : route_match_.params) {
+    args.Set(param.first, param.second);
+  }
+
+  return args;
+}
+
+void HttpSession::FillRequestView(HttpRequest const& req, RequestView& view)
+{
+  view.SetMethod(req.method);
+  view.SetVersion(req.version);
+  view.SetKeepAlive(req.is_keep_alive);
+  view.SetPath(StringView(req.url).substr(path_offset_));
+  view.SetQuery(ToStringView(req.query));
+  view.SetBody(req.body);
+  view.SetHeaders(&req.headers);
+  view.SetPeerAddr(&conn_->GetPeerAddr());
+}
+
+static int64_t GetNowUs() noexcept
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool HttpSession::ServeFromCache(HttpRequest const& req, ResponseCache& cache,
+                                 PluginRegistry::PluginPtr const& plugin,
+                                 PluginInstancePool::InstancePtr& generator,
+                                 CachePolicy const& policy)
+{
+  ResponseCache::MakeKey(req.method, req.url, ToStringView(req.query), cache_key_);
+
+  std::weak_ptr<HttpSession> wp(shared_from_this());
+  auto loop = conn_->GetLoop();
+  ResponseCache::EntryPtr entry;
+
+  // The waiter is called in the thread which fills the entry
+  const auto result = cache.Lookup(cache_key_, GetNowUs(), entry,
+    [wp, loop](ResponseCache::EntryPtr const& entry) {
+      loop->QueueToLoop([wp, entry]() {
+        auto session = wp.lock();
+
+        if (session) {
+          session->OnCacheFilled(entry);
+        }
+      });
+  });
+
+  auto& stats = server_->GetStats();
+
+  switch (result) {
+    case ResponseCache::kHit:
+      Increment(stats.plugin_cache_hits);
+      SendCachedResponse(req, entry->response);
+      OnDynamicContentComplete();
+      return true;
+
+    case ResponseCache::kRevalidate:
+      Increment(stats.plugin_cache_stale);
+      SendCachedResponse(req, entry->response);
+      RevalidateCache(req, cache, plugin, std::move(generator), policy);
+      OnDynamicContentComplete();
+      return true;
+
+    case ResponseCache::kPending:
+      // The session is busy until the identical request is done
+      LOG_DEBUG << "Wait for the identical request: " << cache_key_;
+      Increment(stats.plugin_cache_coalesced);
+      cache_plugin_ = plugin;
+      return true;
+
+    case ResponseCache::kMiss:
+      Increment(stats.plugin_cache_misses);
+      cache_filling_ = true;
+      return false;
+  }
+
+  return false;
+}
+
+void HttpSession::OnCacheFilled(ResponseCache::EntryPtr const& entry)
+{
+  auto plugin = std::move(cache_plugin_);
+
+  // Closed when waiting
+  if (!conn_->IsConnected()) return;
+
+  if (entry) {
+    SendCachedResponse(request_, entry->response);
+    OnDynamicContentComplete();
+    return;
+  }
+
+  // The identical request failed, run the plugin by itself
+  cache_bypass_ = true;
+  ServeDynamicContent(request_, std::move(plugin));
+}
+
+namespace {
+
+/**
+ * Refresh the stale entry in background.
+ * The plugin runs without connection, the response only fills the cache.
+ */
+struct RevalidateJob {
+  // Declared before generator, the plugin is unloaded after it is released
+  PluginRegistry::PluginPtr plugin;
+  PluginInstancePool::InstancePtr generator;
+  ObjectPool<HttpResponse>::Ptr response;
+  ResponseCache* cache;
+  CachePolicy policy;
+  std::string key;
+  ArgsMap args;
+  // No headers and peer in background
+  std::string path;
+  std::string query;
+
+  void Run()
+  {
+    // The key must leave the pendings, or the later misses wait forever
+    try {
+      RequestView view;
+      view.SetMethod(HttpMethod::kGet);
+      view.SetVersion(HttpVersion::kHttp11);
+      view.SetPath(path);
+      view.SetQuery(query);
+      view.SetArgs(args);
+      generator->GenResponse(view, *response);
+    } catch (std::exception const& ex) {
+      LOG_ERROR << "Exception is thrown by the plugin " << plugin->path
+                << " when revalidating: " << ex.what();
+      cache->Abort(key);
+      return;
+    } catch (...) {
+      LOG_ERROR << "Unknown exception is thrown by the plugin " << plugin->path
+                << " when revalidating";
+      cache->Abort(key);
+      return;
+    }
+
+    const auto now = GetNowUs();
+    cache->Fill(key, response->GetBuffer().ToStringView().ToString(),
+                now + policy.ttl_ms * 1000LL,
+                now + (policy.ttl_ms + policy.stale_ms) * 1000LL);
+  }
+};
+
+} // namespace
+
+void HttpSession::RevalidateCache(HttpRequest const& req, ResponseCache& cache,
+                                  PluginRegistry::PluginPtr const& plugin,
+                                  PluginInstancePool::InstancePtr generator,
+                                  CachePolicy const& policy)
+{
+  generator->SetConnection(TcpConnectionPtr());
+  generator->SetVersion(HttpVersion::kHttp11);
+
+  auto job = std::make_shared<RevalidateJob>();
+  job->plugin = plugin;
+  job->generator = std::move(generator);
+  job->response = ObjectPool<HttpResponse>::GetLocal().Acquire();
+  job->cache = &cache;
+  job->policy = policy;
+  job->key = cache_key_;
+  // The arena is reset by the next request
+  job->args = GetArgs(req, nullptr);
+
+  job->path = StringView(req.url).substr(path_offset_).ToString();
+  job->query = ToStringView(req.query).ToString();
+
+  auto loop = conn_->GetLoop();
+  auto workers = job->generator->IsBlocking() ? server_->GetPluginWorkerPool() : nullptr;
+
+  if (!workers) {
+    // Run after the stale response is sent
+    loop->QueueToLoop([job]() { job->Run(); });
+    return;
+  }
+
+  const bool submitted = workers->TrySubmit([job, loop]() mutable {
+    job->Run();
+
+    // Release the generator and response to the pools of the loop
+    loop->QueueToLoop([job = std::move(job)]() {});
+  });
+
+  if (!submitted) {
+    cache.Abort(job->key);
+  }
+}
+
+void HttpSession::SendCacheableResponse(HttpRequest const& req, HttpResponse& response,
+                                        CachePolicy const& policy)
+{
+  auto content = response.GetBuffer().ToStringView();
+
+  if (cache_filling_) {
+    cache_filling_ = false;
+
+    const auto now = GetNowUs();
+    server_->GetResponseCache()->Fill(cache_key_, content.ToString(),
+                                      now + policy.ttl_ms * 1000LL,
+                                      now + (policy.ttl_ms + policy.stale_ms) * 1000LL);
+  }
+
+  SendCachedResponse(req, content);
+}
+
+void HttpSession::SendCachedResponse(HttpRequest const& req, StringView response)
+{
+  auto p_head = ObjectPool<HttpResponse>::GetLocal().Acquire();
+  auto& head = *p_head;
+  head.Reset(true);
+
+  assert(req.version != HttpVersion::kNotSupport);
+  head.AddHeaderLine(HttpStatusCode::k200OK, req.version);
+
+  if (req.is_keep_alive) {
+    head.AddHeader("Connection", "Keep-Alive");
+  }
+
+  auto& buffer = head.GetBuffer();
+  buffer.Append(response.data(), response.size());
+  Send(buffer);
+}
+
+void HttpSession::OnDynamicContentComplete()
+{
+  if (writer_.IsActive()) {
+    const bool keep_alive = writer_.IsKeepAlive();
+
+    writer_.Finish();
+    stream_generator_.reset();
+    stream_plugin_.reset();
+
+    // The end of body is indicated by closing
+    if (!keep_alive && conn_->IsConnected()) {
+      EndRequest();
+      LogClose();
+      ShutdownWrite();
+      return;
+    }
+  }
+
+  EndRequest();
+
+  // Closed when the blocking plugin is running
+  if (!conn_->IsConnected()) return;
+
+  // The plugin may send a large body at once
+  if (CheckBufferLimit(conn_->GetOutputBuffer()->GetReadableSize(), "output")) {
+    ScheduleNextRequest();
+  }
+}
+
+void HttpSession::ServeFastCgi(HttpRequest const& req)
+{
+  auto route = route_match_.route;
+  auto upstream = server_->GetFcgiUpstream(conn_->GetLoop(), route->target);
+
+  Increment(server_->GetStats().fastcgi_requests);
+
+  if (!upstream) {
+    Increment(server_->GetStats().fastcgi_failures);
+    error_ = {HttpStatusCode::k502BadGateway, "The FastCGI application is unavailable"};
+    SendErrorResponse();
+    return;
+  }
+
+  std::string params;
+  BuildFastCgiParams(req, params);
+
+  writer_.Begin(conn_, tls_, req.version, req.is_keep_alive, g_config.high_water_mark);
+
+  // The session may be closed before the response
+  std::weak_ptr<HttpSession> wp(shared_from_this());
+  FcgiUpstream::Callbacks callbacks;
+
+  callbacks.on_head = [wp](int status, StringView reason,
+                           std::vector<FcgiUpstream::Pair> const& headers) {
+    auto session = wp.lock();
+    if (session) session->OnFastCgiHead(status, reason, headers);
+  };
+
+  callbacks.on_body = [wp](StringView data) {
+    auto session = wp.lock();
+    if (session) session->writer_.Write(data);
+  };
+
+  callbacks.on_end = [wp](bool ok) {
+    auto session = wp.lock();
+    if (session) session->OnFastCgiEnd(ok);
+  };
+
+  const auto id = upstream->Submit(params, req.body, std::move(callbacks));
+
+  if (id == 0) {
+    LOG_WARN << _PEER_IP << " 503 The queue of FastCGI application " << route->target << " is full";
+    Increment(server_->GetStats().fastcgi_failures);
+    writer_.Finish();
+    error_ = {HttpStatusCode::k503ServerUnavailable, "The FastCGI application is busy"};
+    SendErrorResponse();
+    return;
+  }
+
+  fcgi_upstream_ = upstream;
+  fcgi_request_id_ = id;
+}
+
+static void AppendHttpParam(std::string& params, StringView name, StringView value)
+{
+  // e.g. User-Agent -> HTTP_USER_AGENT
+  char buf[256];
+  size_t len = 5;
+  ::memcpy(buf, "HTTP_", len);
+
+  for (auto c : name) {
+    if (len == sizeof buf) return;
+
+    buf[len++] = c == '-' ? '_' : static_cast<char>(::toupper(static_cast<unsigned char>(c)));
+  }
+
+  FcgiCodec::AppendParam(params, StringView(buf, len), value);
+}
+
+void HttpSession::BuildFastCgiParams(HttpRequest const& req, std::string& params)
+{
+  auto const& peer = conn_->GetPeerAddr();
+  auto query = ToStringView(req.query);
+  char buf[32];
+
+  // The script is resolved under the RootPath, e.g. /php/index.php
+  std::string filename(g_config.root_path);
+  filename += req.url;
+
+  std::string uri(req.url);
+
+  if (!query.empty()) {
+    uri += '?';
+    uri.append(query.data(), query.size());
+  }
+
+  params.reserve(512 + req.headers.size() * 64);
+
+  FcgiCodec::AppendParam(params, "GATEWAY_INTERFACE", "CGI/1.1");
+  FcgiCodec::AppendParam(params, "SERVER_SOFTWARE", "kanon_httpd");
+  FcgiCodec::AppendParam(params, "SERVER_PROTOCOL", GetHttpVersionString(req.version));
+  FcgiCodec::AppendParam(params, "REQUEST_METHOD", GetMethodString(req.method));
+  FcgiCodec::AppendParam(params, "REQUEST_URI", uri);
+  FcgiCodec::AppendParam(params, "DOCUMENT_ROOT", g_config.root_path);
+  FcgiCodec::AppendParam(params, "SCRIPT_FILENAME", filename);
+  FcgiCodec::AppendParam(params, "SCRIPT_NAME", req.url);
+  FcgiCodec::AppendParam(params, "QUERY_STRING", query);
+  FcgiCodec::AppendParam(params, "REMOTE_ADDR", peer.ToIp());
+  ::snprintf(buf, sizeof buf, "%u", static_cast<unsigned>(peer.GetPort()));
+  FcgiCodec::AppendParam(params, "REMOTE_PORT", buf);
+  FcgiCodec::AppendParam(params, "SERVER_NAME", g_config.hostname);
+  ::snprintf(buf, sizeof buf, "%zu", req.body.size());
+  FcgiCodec::AppendParam(params, "CONTENT_LENGTH", buf);
+
+  for (auto const& header : req.headers) {
+    auto name = ToStringView(header.first);
+    auto value = ToStringView(header.second);
+
+    if (name.size() == 12 && ::strncasecmp(name.data(), "Content-Type", 12) == 0) {
+      FcgiCodec::AppendParam(params, "CONTENT_TYPE", value);
+      continue;
+    }
+
+    // HTTP_PROXY is trusted by some applications as the proxy(httpoxy)
+    if ((name.size() == 14 && ::strncasecmp(name.data(), "Content-Length", 14) == 0) ||
+        (name.size() == 5 && ::strncasecmp(name.data(), "Proxy", 5) == 0)) {
+      continue;
+    }
+
+    AppendHttpParam(params, name, value);
+  }
+}
+
+void HttpSession::OnFastCgiHead(int status, StringView reason,
+                                std::vector<FcgiUpstream::Pair> const& headers)
+{
+  int64_t content_length = -1;
+
+  for (auto const& header : headers) {
+    auto const& name = header.first;
+
+    // The framing of response is decided by the writer
+    if (name.size() == 14 && ::strncasecmp(name.data(), "Content-Length", 14) == 0) {
+      content_length = ::strtoll(header.second.ToString().c_str(), NULL, 10);
+      continue;
+    }
+
+    if ((name.size() == 10 && ::strncasecmp(name.data(), "Connection", 10) == 0) ||
+        (name.size() == 10 && ::strncasecmp(name.data(), "Keep-Alive", 10) == 0) ||
+        (name.size() == 17 && ::strncasecmp(name.data(), "Transfer-Encoding", 17) == 0)) {
+      continue;
+    }
+
+    writer_.AddHeader(name, header.second);
+  }
+
+  writer_.WriteHead(status, reason, content_length);
+}
+
+void HttpSession::OnFastCgiEnd(bool ok)
+{
+  fcgi_upstream_ = nullptr;
+  fcgi_request_id_ = 0;
+
+  if (!conn_->IsConnected()) return;
+
+  if (!writer_.IsActive()) return;
+
+  // The application failed before the response
+  if (!writer_.IsHeadSent()) {
+    Increment(server_->GetStats().fastcgi_failures);
+    writer_.Finish();
+    error_ = {HttpStatusCode::k502BadGateway, "The FastCGI application failed"};
+    SendErrorResponse();
+    return;
+  }
+
+  // The response is truncated, only closing can tell the client
+  if (!ok) {
+    Increment(server_->GetStats().fastcgi_failures);
+    writer_.Finish();
+    EndRequest();
+    LogClose();
+    ShutdownWrite();
+    return;
+  }
+
+  writer_.End();
+  OnDynamicContentComplete();
+}
+
+void HttpSession::ServeProxy(HttpRequest const& req)
+{
+  auto route = route_match_.route;
+  auto upstream = server_->GetHttpUpstream(conn_->GetLoop(), route->target);
+
+  Increment(server_->GetStats().proxy_requests);
+
+  if (!upstream) {
+    Increment(server_->GetStats().proxy_failures);
+    error_ = {HttpStatusCode::k502BadGateway, "The upstream server is unavailable"};
+    SendErrorResponse();
+    return;
+  }
+
+  proxy_upstream_ = upstream;
+  proxy_retried_ = false;
+  proxy_paused_ = false;
+  proxy_eof_ = false;
+  proxy_parser_.Reset(req.method == HttpMethod::kHead);
+  BuildProxyRequest(req);
+
+  writer_.Begin(conn_, tls_, req.version, req.is_keep_alive, g_config.high_water_mark);
+  AcquireProxyConnection();
+}
+
+// The fields only meaningful for a single connection
+static bool IsHopByHop(StringView name) noexcept
+{
+  static char const* const kFields[] = {
+    "Connection", "Keep-Alive", "Proxy-Connection", "Transfer-Encoding",
+    "TE", "Trailer", "Upgrade", "Content-Length",
+  };
+
+  for (auto field : kFields) {
+    const auto len = ::strlen(field);
+
+    if (name.size() == len && ::strncasecmp(name.data(), field, len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * The path has been decoded and normalized by the parser, encode it again
+ * except the unreserved characters, sub-delims, : @ and /, so the decoded
+ * space, CRLF, ? and # can't change the request of upstream.
+ */
+static void AppendEncodedPath(std::string& out, StringView path)
+{
+  static char const kHex[] = "0123456789ABCDEF";
+
+  for (auto c : path) {
+    const auto u = static_cast<unsigned char>(c);
+
+    if (::isalnum(u) || (c != '\0' && ::strchr("-._~!$&'()*+,;=:@/", c) != nullptr)) {
+      out += c;
+    } else {
+      out += '%';
+      out += kHex[u >> 4];
+      out += kHex[u & 0xf];
+    }
+  }
+}
+
+void HttpSession::BuildProxyRequest(HttpRequest const& req)
+{
+  auto& out = proxy_request_;
+  auto query = ToStringView(req.query);
+  StringView forwarded_for;
+  bool has_host = false;
+
+  out.clear();
+  out += GetMethodString(req.method);
+  out += ' ';
+  AppendEncodedPath(out, req.url);
+
+  if (!query.empty()) {
+    out += '?';
+    out.append(query.data(), query.size());
+  }
+
+  // The connection to upstream is always keep-alive
+  out += " HTTP/1.1\r\n";
+
+  for (auto const& header : req.headers) {
+    auto name = ToStringView(header.first);
+    auto value = ToStringView(header.second);
+
+    // The body has been received, don't let the server send 100 Continue
+    if (IsHopByHop(name) ||
+        (name.size() == 6 && ::strncasecmp(name.data(), "Expect", 6) == 0)) {
+      continue;
+    }
+
+    if (name.size() == 15 && ::strncasecmp(name.data(), "X-Forwarded-For", 15) == 0) {
+      forwarded_for = value;
+      continue;
+    }
+
+    if (name.size() == 4 && ::strncasecmp(name.data(), "Host", 4) == 0) {
+      has_host = true;
+    }
+
+    out.append(name.data(), name.size());
+    out += ": ";
+    out.append(value.data(), value.size());
+    out += "\r\n";
+  }
+
+  if (!has_host) {
+    out += "Host: ";
+    out += g_config.hostname;
+    out += "\r\n";
+  }
+
+  out += "X-Forwarded-For: ";
+
+  if (!forwarded_for.empty()) {
+    out.append(forwarded_for.data(), forwarded_for.size());
+    out += ", ";
+  }
+
+  out += conn_->GetPeerAddr().ToIp();
+  out += "\r\n";
+
+  if (!req.body.empty() || req.method == HttpMethod::kPost || req.method == HttpMethod::kPut) {
+    out += "Content-Length: ";
+    out += std::to_string(req.body.size());
+    out += "\r\n";
+  }
+
+  out += "\r\n";
+  out += req.body;
+}
+
+void HttpSession::AcquireProxyConnection()
+{
+  proxy_acquiring_ = true;
+
+  std::weak_ptr<HttpSession> wp(shared_from_this());
+  auto upstream = proxy_upstream_;
+
+  upstream->Acquire([wp, upstream](HttpUpstream::ConnectionPtr const& c) {
+    auto session = wp.lock();
+
+    // The client is gone, the fresh connection is kept for others
+    if (!session || !session->proxy_acquiring_) {
+      if (c) upstream->Release(c, true);
+      return;
+    }
+
+    session->OnProxyConnection(c);
+  });
+}
+
+void HttpSession::OnProxyConnection(HttpUpstream::ConnectionPtr const& c)
+{
+  proxy_acquiring_ = false;
+
+  if (!c) {
+    FailProxy("The upstream servers are unavailable");
+    return;
+  }
+
+  if (c->IsReused()) {
+    Increment(server_->GetStats().proxy_reused);
+  }
+
+  // The callbacks are reset when the connection is released
+  proxy_conn_ = c;
+
+  c->SetMessageCallback([this](Buffer& buffer) {
+    if (proxy_paused_) {
+      CheckProxyBuffer(buffer.GetReadableSize());
+      return;
+    }
+
+    OnProxyMessage(buffer);
+  });
+
+  c->SetCloseCallback([this]() {
+    OnProxyClose();
+  });
+
+  // Continue forwarding when the client drains the response
+  writer_.SetDrainCallback([this]() {
+    if (proxy_paused_ && proxy_conn_) {
+      proxy_paused_ = false;
+      OnProxyMessage(*proxy_conn_->GetConnection()->GetInputBuffer());
+    }
+  });
+
+  c->GetConnection()->Send(proxy_request_);
+}
+
+void HttpSession::OnProxyMessage(Buffer& buffer)
+{
+  if (!proxy_parser_.IsHeadDone()) {
+    size_t consumed = 0;
+    const auto result = proxy_parser_.ParseHead(buffer.ToStringView(), consumed);
+
+    if (result == HttpResponseParser::kShort) {
+      if (buffer.GetReadableSize() > kMaxProxyHeadSize_) {
+        FailProxy("The header of upstream response is too large");
+      }
+      else if (proxy_eof_) {
+        OnProxyEof(buffer);
+      }
+
+      return;
+    }
+
+    if (result == HttpResponseParser::kBad) {
+      FailProxy("The upstream response is invalid");
+      return;
+    }
+
+    buffer.AdvanceRead(consumed);
+
+    for (auto const& header : proxy_parser_.GetHeaders()) {
+      if (!IsHopByHop(header.first)) {
+        writer_.AddHeader(header.first, header.second);
+      }
+    }
+
+    auto content_length = proxy_parser_.GetContentLength();
+
+    // The HEAD response can't be chunked since it has no body
+    if (request_.method == HttpMethod::kHead && content_length < 0) {
+      content_length = 0;
+    }
+
+    writer_.WriteHead(proxy_parser_.GetStatus(), proxy_parser_.GetReason(), content_length);
+  }
+
+  while (!proxy_parser_.IsComplete()) {
+    StringView piece;
+    size_t consumed = 0;
+    const auto result = proxy_parser_.ParseBody(buffer.ToStringView(), piece, consumed);
+
+    if (result == HttpResponseParser::kShort) break;
+
+    if (result == HttpResponseParser::kBad) {
+      FailProxy("The body of upstream response is invalid");
+      return;
+    }
+
+    // The piece refers to the buffer, it is copied by Write()
+    const bool writable = piece.empty() || writer_.Write(piece);
+    buffer.AdvanceRead(consumed);
+
+    if (!writable) {
+      // The rest is left in the upstream buffer until the client drains
+      proxy_paused_ = true;
+      CheckProxyBuffer(buffer.GetReadableSize());
+      return;
+    }
+  }
+
+  if (proxy_parser_.IsComplete()) {
+    CompleteProxy(proxy_parser_.IsKeepAlive() && !proxy_eof_ && !buffer.HasReadable());
+    return;
+  }
+
+  if (proxy_eof_) {
+    OnProxyEof(buffer);
+  }
+}
+
+void HttpSession::CheckProxyBuffer(size_t size)
+{
+  if (g_config.proxy_max_buffer <= 0 ||
+      size <= static_cast<size_t>(g_config.proxy_max_buffer)) {
+    return;
+  }
+
+  LOG_WARN << _PEER_IP << " The upstream response buffered for the client exceeds "
+           << "the proxy limit(" << size << " bytes), abort the request";
+  Increment(server_->GetStats().proxy_closed_over_limit);
+
+  // The upstream server is fine, don't take it out of rotation
+  proxy_upstream_->Release(proxy_conn_, false);
+  proxy_conn_.reset();
+
+  // The head has been sent, only closing can tell the client
+  conn_->ForceClose();
+}
+
+void HttpSession::OnProxyClose()
+{
+  proxy_eof_ = true;
+
+  // The rest is forwarded when the client drains
+  if (!proxy_paused_) {
+    OnProxyMessage(*proxy_conn_->GetConnection()->GetInputBuffer());
+  }
+}
+
+// The request can be sent again safely(RFC 9110 9.2.2)
+static bool IsIdempotent(HttpMethod method) noexcept
+{
+  switch (method) {
+    case HttpMethod::kGet:
+    case HttpMethod::kHead:
+    case HttpMethod::kOptions:
+    case HttpMethod::kPut:
+    case HttpMethod::kDelete:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void HttpSession::OnProxyEof(Buffer& buffer)
+{
+  if (proxy_parser_.IsUntilClose()) {
+    CompleteProxy(false);
+    return;
+  }
+
+  // The idle connection may be closed by the server when it is reused,
+  // send the request again if it is idempotent
+  if (!proxy_parser_.IsHeadDone() && !buffer.HasReadable() && proxy_conn_->IsReused() &&
+      !proxy_retried_ && IsIdempotent(request_.method)) {
+    LOG_DEBUG << "The reused upstream connection is closed, retry the request";
+    proxy_retried_ = true;
+    proxy_eof_ = false;
+    proxy_upstream_->Release(proxy_conn_, false);
+    proxy_conn_.reset();
+    AcquireProxyConnection();
+    return;
+  }
+
+  FailProxy("The upstream connection is closed prematurely");
+}
+
+void HttpSession::CompleteProxy(bool reusable)
+{
+  proxy_upstream_->Release(proxy_conn_, reusable);
+  proxy_conn_.reset();
+
+  writer_.End();
+  OnDynamicContentComplete();
+}
+
+void HttpSession::FailProxy(char const* reason)
+{
+  LOG_ERROR << _PEER_IP << " " << reason;
+  Increment(server_->GetStats().proxy_failures);
+
+  if (proxy_conn_) {
+    proxy_upstream_->Fail(proxy_conn_);
+    proxy_conn_.reset();
+  }
+
+  const bool head_sent = writer_.IsHeadSent();
+  writer_.Finish();
+
+  if (!head_sent) {
+    error_ = {HttpStatusCode::k502BadGateway, reason};
+    SendErrorResponse();
+    return;
+  }
+
+  // The response is truncated, only closing can tell the client
+  EndRequest();
+  LogClose();
+  ShutdownWrite();
+}
+
+void HttpSession::ServeStatus(HttpRequest const& req)
+{
+  std::string body;
+  server_->RenderStats(body);
+
+  auto p_response = ObjectPool<HttpResponse>::GetLocal().Acquire();
+  auto& response = *p_response;
+  response.AddHeaderLine(HttpStatusCode::k200OK, req.version)
+          .AddHeader("Content-Type", "text/plain");
+
+  if (req.is_keep_alive) {
+    response.AddHeader("Connection", "Keep-Alive")
+            .AddHeader("Keep-Alive", "timeout=5");
+  }
+
+  response.AddBody(body);
+
+  SetLastWriteComplete(req);
+  Send(response.GetBuffer());
+}
+
+void HttpSession::CloseConnection(HttpRequest const& req)
+{
+  EndRequest();
+
+  if (req.is_keep_alive) {
+    LOG_DEBUG << "Keep-Alive connection will keep 5s if no new message coming";
+    keep_alive_timer_id_ = conn_->GetLoop()->RunAfter([this]() {
+      LogClose();
+      ShutdownWrite();
+    }, 5);
+
+    ScheduleNextRequest();
+  }
+  else {
+    LOG_DEBUG << "Non-Keep-Alive(Close) Connection will be closed at immediately";
+    LogClose();
+    ShutdownWrite();
+  }
+}
+
+void HttpSession::SendErrorResponse()
+{
+  LOG_TRACE << "Error occurred, send error page to client";
+  LOG_DEBUG << "Error: (" << GetStatusCode(error_.code)
+    << ", " << GetStatusCodeString(error_.code)
+    << ", " << error_.msg << ")";
+  
+  LogError();
+  EndRequest();
+  Send(GetClientError(
+    error_.code, error_.msg).GetBuffer());
+
+  CancelKeepAliveTimer();
+  LogClose();
+  ShutdownWrite();
+}
+
+void HttpSession::NotImplementation(HttpRequest const& req)
+{
+  LOG_TRACE << "The service of " << GetMethodString(req.method) << " is not implemeted";
+
+  error_ = {HttpStatusCode::k501NotImplemeted,
+            "The service is not implemeted"};
+  SendErrorResponse();
+}
+
+void HttpSession::BeginRequest()
+{
+  if (!request_inflight_ && loop_state_) {
+    request_inflight_ = true;
+    loop_state_->inflight_requests.fetch_add(1, std::memory_order_relaxed);
+    Increment(server_->GetStats().requests);
+  }
+}
+
+void HttpSession::EndRequest()
+{
+  if (request_inflight_) {
+    request_inflight_ = false;
+    loop_state_->inflight_requests.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void HttpSession::CancelKeepAliveTimer()
+{
+  if (keep_alive_timer_id_) {
+    conn_->GetLoop()->CancelTimer(*keep_alive_timer_id_);
     keep_alive_timer_id_ = kanon::optional<TimerId>();
     LOG_DEBUG << "The keep-alive timer is canceled";
   }
@@ -425,11 +2127,8 @@ bool HttpSession::SetErrorOfStat(Stat& stat, bool success) {
 }
 
 void HttpSession::SetLastWriteComplete(HttpRequest const& req) {
-  conn_->SetWriteCompleteCallback([session = this, &req] (TcpConnectionPtr const& conn) {
-    (void)conn;
-    session->CloseConnection(req);
-    return true;
-  });
+  KANON_UNUSED(req);
+  write_state_ = WriteState::kLastWrite;
 }
 
 inline void HttpSession::LogError() {
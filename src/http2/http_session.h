@@ -15,20 +15,57 @@
 #include "common/http_constant.h"
 #include "util/file.h"
 #include "unix/stat.h"
+#include "util/arena.h"
+#include "util/object_pool.h"
 #include "http_error.h"
+#include "http_parser.h"
+#include "http_response_writer.h"
 #include "http_request.h"
+#include "admission_control.h"
+#include "fcgi_upstream.h"
+#include "http_response_parser.h"
+#include "http_upstream.h"
+#include "http2_connection.h"
+#include "tls_channel.h"
+#include "websocket_connection.h"
+#include "plugin_instance_pool.h"
+#include "plugin_registry.h"
+#include "plugin_worker_pool.h"
+#include "response_cache.h"
+#include "router.h"
 
 namespace http {
 
 class HttpServer;
 
-class HttpSession : kanon::noncopyable {
+class HttpSession : kanon::noncopyable
+                  , public std::enable_shared_from_this<HttpSession> {
  public:
   HttpSession();
 
-  HttpSession(HttpServer& server, kanon::TcpConnectionPtr const& conn);
+  HttpSession(HttpServer& server, kanon::TcpConnectionPtr const& conn,
+              AdmissionControl::LoopState* loop_state);
   ~HttpSession() noexcept;
 
+  /**
+   * Get a session from the pool of the current IO loop.
+   * The session returns to the pool when the last reference
+   * is released, the shared_ptr control block is also allocated
+   * from the per-loop free list.
+   */
+  static std::shared_ptr<HttpSession> Create(
+    HttpServer& server, kanon::TcpConnectionPtr const& conn,
+    AdmissionControl::LoopState* loop_state);
+
+  void Init(HttpServer& server, kanon::TcpConnectionPtr const& conn,
+            AdmissionControl::LoopState* loop_state);
+
+  /**
+   * Reset to the unused state, called by the pool.
+   * The request and parser are reused by the next connection.
+   */
+  void Reset() noexcept;
+
   // For debugging 
   uint32_t GetId() const noexcept
   { return id_; }
@@ -39,13 +76,133 @@ private:
 
   void OnMessage(TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp recv);
 
+  // TLS
+  // Terminate TLS if the first message is a handshake record
+  void StartTls(Buffer& buffer);
+  // \return false if closed or no request is decrypted
+  bool ReadTlsRecords(Buffer& buffer);
+
+  // The requests received, decrypted if TLS
+  Buffer& GetInputBuffer() noexcept
+  { return tls_ ? tls_->GetInputBuffer() : *conn_->GetInputBuffer(); }
+  // Send the response, encrypted if TLS
+  void Send(kanon::StringView data);
+  void Send(Buffer& buffer);
+  // Close the sending side, with close_notify if TLS
+  void ShutdownWrite();
+
+  // Parse and serve one request in the buffer if not busy
+  void HandleRequest(Buffer& buffer);
+  // Serve the pipelined request in the input buffer later
+  void ScheduleNextRequest();
+
+  // Flow control
+  bool OnWriteComplete();
+  void OnHighWaterMark(size_t size);
+  /**
+   * Close the connection if the buffered bytes exceed the MaxConnectionBuffer
+   * \return false if closed
+   */
+  bool CheckBufferLimit(size_t size, char const* which);
+
+  /**
+   * Shrink the oversized buffers back to IdleBufferSize when
+   * the response is complete, e.g. after a large POST, then
+   * the idle keep-alive connections cost few memory.
+   */
+  void TrimBuffers();
+
+  bool IsBusy() const noexcept
+  { return request_inflight_ || paused_; }
+
   // Static contents
   void ServeFile(HttpRequest const& request);
-  bool SendFile(std::shared_ptr<int> const& fd, HttpRequest const& request);
-  bool SendFileOfMmap(std::shared_ptr<char*> const& addr, HttpRequest const& request);
+  bool SendFile();
+  bool SendFileOfMmap();
+
+  // Serve the request matched by the routing table
+  void ServeRoute(HttpRequest& request);
+
+  /**
+   * Switch to HTTP/2 if the request is Upgrade: h2c
+   * \return true if switched, the request is served as stream 1
+   */
+  bool UpgradeToHttp2(HttpRequest const& request);
 
   // Dynamic contents
   void ServeDynamicContent(HttpRequest const& request);
+  void ServeDynamicContent(HttpRequest const& request, PluginRegistry::PluginPtr plugin);
+  // Run the blocking plugin in the worker pool
+  void ServeBlockingContent(PluginWorkerPool& workers,
+                            PluginRegistry::PluginPtr plugin,
+                            PluginInstancePool::InstancePtr generator,
+                            ObjectPool<HttpResponse>::Ptr response);
+  // Pass the whole request to the plugin
+  void GenDynamicResponse(HttpRequest const& request,
+                          PluginRegistry::Plugin const& plugin,
+                          HttpDynamicResponseInterface& generator,
+                          HttpResponse& first);
+  // The query arguments and parameters of route
+  ArgsMap GetArgs(HttpRequest const& request, Arena* arena);
+  // Set the fields of the view except the arguments
+  void FillRequestView(HttpRequest const& request, RequestView& view);
+  void OnDynamicContentComplete();
+  // The blocking plugin throws, abort the cache key and send 500
+  void OnBlockingContentFailed();
+
+  // Response cache of plugins
+  // \return true if the request is served or waiting for the identical one
+  bool ServeFromCache(HttpRequest const& request, ResponseCache& cache,
+                      PluginRegistry::PluginPtr const& plugin,
+                      PluginInstancePool::InstancePtr& generator,
+                      CachePolicy const& policy);
+  void OnCacheFilled(ResponseCache::EntryPtr const& entry);
+  void RevalidateCache(HttpRequest const& request, ResponseCache& cache,
+                       PluginRegistry::PluginPtr const& plugin,
+                       PluginInstancePool::InstancePtr generator,
+                       CachePolicy const& policy);
+  // Send the response filled by the cacheable plugin, fill the cache if missed
+  void SendCacheableResponse(HttpRequest const& request, HttpResponse& response,
+                             CachePolicy const& policy);
+  void SendCachedResponse(HttpRequest const& request, kanon::StringView response);
+  // Keep the streaming plugin until ResponseWriter::End()
+  void ContinueStreaming(PluginRegistry::PluginPtr plugin,
+                         PluginInstancePool::InstancePtr generator);
+
+  // Proxy the request to the FastCGI application of route
+  void ServeFastCgi(HttpRequest const& request);
+  void BuildFastCgiParams(HttpRequest const& request, std::string& params);
+  void OnFastCgiHead(int status, kanon::StringView reason,
+                     std::vector<FcgiUpstream::Pair> const& headers);
+  void OnFastCgiEnd(bool ok);
+
+  // Forward the request to the upstream servers of route
+  void ServeProxy(HttpRequest const& request);
+  void BuildProxyRequest(HttpRequest const& request);
+  void AcquireProxyConnection();
+  void OnProxyConnection(HttpUpstream::ConnectionPtr const& conn);
+  // Forward the response in the input buffer of upstream connection
+  void OnProxyMessage(kanon::Buffer& buffer);
+  void OnProxyClose();
+  // Abort the request if the response buffered for the client exceeds ProxyMaxBuffer
+  void CheckProxyBuffer(size_t size);
+  // The upstream connection is closed and the data received is forwarded
+  void OnProxyEof(kanon::Buffer& buffer);
+  void CompleteProxy(bool reusable);
+  // The upstream server fails, reply 502 if the header is not sent
+  void FailProxy(char const* reason);
+
+  /**
+   * Switch to WebSocket if the request is Upgrade: websocket and
+   * the plugin accepts it
+   * \return false if not accepted, the request is served as a normal one
+   */
+  bool ServeWebSocket(HttpRequest const& request,
+                      PluginRegistry::PluginPtr& plugin,
+                      PluginInstancePool::InstancePtr& generator);
+
+  // Server status page
+  void ServeStatus(HttpRequest const& request);
 
   void SetLastWriteComplete(HttpRequest const& request);
   void CloseConnection(HttpRequest const& request);
@@ -64,6 +221,10 @@ private:
 
   void SendErrorResponse();
 
+  // Track the request in progress for admission control
+  void BeginRequest();
+  void EndRequest();
+
   // Timer control
   void CancelConnectionTimeoutTimer();
   void CancelKeepAliveTimer();
@@ -79,6 +240,128 @@ private:
    */
   TcpConnectionPtr conn_;
 
+  /**
+   * The state of the IO loop which the connection belongs to.
+   * Used by admission control to count the connections and
+   * requests in progress of the loop.
+   */
+  AdmissionControl::LoopState* loop_state_ = nullptr;
+  bool request_inflight_ = false;
+
+  /**
+   * The memory of a request(query, headers, arguments of plugin)
+   * is allocated from the arena, and it is reset when the next
+   * request starts.
+   * Must be declared before the request.
+   */
+  Arena arena_;
+
+  /**
+   * The request is parsed incrementally, the state must
+   * be kept since it may be split to multiple segments.
+   * The request is also used until its response is complete.
+   */
+  HttpParser parser_;
+  HttpRequest request_;
+  bool parsing_ = false;
+
+  /**
+   * The route of the request, refers to the URL of it.
+   * The static file path is built in route_path_, its capacity
+   * is kept for the next request.
+   */
+  RouteMatch route_match_;
+  std::string route_path_;
+
+  /** The root path inserted before the URL, skipped in the path passed to plugins */
+  size_t path_offset_ = 0;
+
+  /**
+   * Determine what to do when the output buffer is drained.
+   * The write complete callback is set once and dispatched
+   * on it, no closure is created per request.
+   */
+  enum class WriteState {
+    kIdle = 0,
+    kSendingFile, /** Send the rest of file by pread() */
+    kSendingMmap, /** Send the rest of mapped file */
+    kLastWrite, /** The last write of response */
+  };
+
+  WriteState write_state_ = WriteState::kIdle;
+  std::shared_ptr<int> file_fd_;
+  std::shared_ptr<char*> file_addr_;
+
+  /**
+   * The output buffer reaches the high-water mark,
+   * stop serving requests until it is drained
+   */
+  bool paused_ = false;
+  bool next_request_scheduled_ = false;
+
+  /**
+   * Used by the streaming plugins and WebSocket.
+   * The plugin continues writing in the drain callback,
+   * so it is kept until the response ends or the socket is closed.
+   */
+  HttpResponseWriter writer_;
+  PluginRegistry::PluginPtr stream_plugin_;
+  PluginInstancePool::InstancePtr stream_generator_;
+
+  /**
+   * The request proxied to the FastCGI application, its response
+   * is streamed by the writer_. Aborted if the connection is closed.
+   */
+  FcgiUpstream* fcgi_upstream_ = nullptr;
+  FcgiUpstream::RequestId fcgi_request_id_ = 0;
+
+  /**
+   * The request forwarded to the upstream server, kept until the
+   * response is complete since it is sent again if the reused
+   * connection has been closed by the server.
+   * The response is streamed by the writer_, the upstream buffer is
+   * not consumed while the client is congested(proxy_paused_).
+   */
+  HttpUpstream* proxy_upstream_ = nullptr;
+  HttpUpstream::ConnectionPtr proxy_conn_;
+  HttpResponseParser proxy_parser_;
+  std::string proxy_request_;
+  bool proxy_acquiring_ = false;
+  bool proxy_retried_ = false;
+  bool proxy_paused_ = false;
+  bool proxy_eof_ = false;
+
+  /**
+   * The request fills the entry of cache_key_ if cache_filling_.
+   * If the identical request is filling it, the plugin is kept
+   * until it is done.
+   * If cache_bypass_, the plugin is run without the cache,
+   * e.g. the identical request failed.
+   */
+  std::string cache_key_;
+  bool cache_filling_ = false;
+  bool cache_bypass_ = false;
+  PluginRegistry::PluginPtr cache_plugin_;
+
+  /**
+   * Set if the connection starts with a TLS handshake,
+   * the session reads and writes the plaintext by it.
+   */
+  TlsChannelPtr tls_;
+  bool tls_checked_ = false;
+
+  /**
+   * The connection speaks HTTP/2 once it is set,
+   * the input and write complete events are passed to it.
+   */
+  std::unique_ptr<Http2Connection> h2_;
+
+  /**
+   * The connection speaks WebSocket once it is set, the input is
+   * passed to it. Shared with the plugin which sends messages by it.
+   */
+  std::shared_ptr<WebSocketConnection> ws_;
+
   /**
    * Error metadata, used to construct error response
    */
@@ -105,6 +388,12 @@ private:
   static kanon::AtomicCounter32 counter_;
 
   static constexpr int32_t kFileBufferSize_ = 1 << 16;
+
+  // Trim the buffer if its capacity > kTrimFactor_ * IdleBufferSize
+  static constexpr size_t kTrimFactor_ = 4;
+
+  // The header of upstream response larger than it is invalid
+  static constexpr size_t kMaxProxyHeadSize_ = 64 << 10;
 };
 
 } // namespace http
@@ -0,0 +1,344 @@
+#include "http2/http_upstream.h"
+
+#include <stdlib.h>
+
+#include <kanon/log/logger.h>
+
+using namespace kanon;
+
+namespace http {
+
+// The server is treated as failed if not connected in time
+static constexpr double kConnectTimeout = 3;
+
+HttpUpstream::HttpUpstream(EventLoop* loop, std::vector<InetAddr> const& addrs,
+                           Options const& options)
+  : loop_(loop)
+  , options_(options)
+{
+  peers_.reserve(addrs.size());
+
+  for (auto const& addr : addrs) {
+    peers_.emplace_back(addr);
+  }
+}
+
+HttpUpstream::~HttpUpstream() noexcept
+{
+  for (auto& peer : peers_) {
+    for (auto const& c : peer.idle) {
+      c->closed_ = true;
+      c->client_->Stop();
+    }
+  }
+}
+
+bool HttpUpstream::ParseAddresses(StringView addresses,
+                                  std::vector<std::pair<std::string, uint16_t>>& addrs,
+                                  std::string& error)
+{
+  addrs.clear();
+
+  while (!addresses.empty()) {
+    auto comma_pos = addresses.find(',');
+    auto address = addresses.substr(0, comma_pos);
+    addresses.remove_prefix(comma_pos == StringView::npos ? addresses.size() : comma_pos + 1);
+
+    auto colon_pos = address.rfind(':');
+
+    if (colon_pos == StringView::npos || colon_pos == 0) {
+      error = "The address must be ip:port: " + address.ToString();
+      return false;
+    }
+
+    const int port = ::atoi(address.substr(colon_pos + 1).ToString().c_str());
+
+    if (port <= 0 || port > 65535) {
+      error = "Invalid port: " + address.ToString();
+      return false;
+    }
+
+    addrs.emplace_back(address.substr(0, colon_pos).ToString(), static_cast<uint16_t>(port));
+  }
+
+  if (addrs.empty()) {
+    error = "No upstream server";
+    return false;
+  }
+
+  return true;
+}
+
+void HttpUpstream::Acquire(AcquireCallback cb)
+{
+  Acquire(std::move(cb), 0);
+}
+
+void HttpUpstream::Acquire(AcquireCallback cb, size_t attempts)
+{
+  const int index = PickPeer();
+
+  if (index < 0) {
+    LOG_ERROR << "All upstream servers are down";
+    cb(nullptr);
+    return;
+  }
+
+  auto& peer = peers_[index];
+
+  // The most recently used one is less likely to be closed by the server
+  while (!peer.idle.empty()) {
+    auto c = std::move(peer.idle.back());
+    peer.idle.pop_back();
+    c->idle_ = false;
+
+    if (c->closed_ || !c->conn_->IsConnected()) continue;
+
+    ++peer.active;
+    cb(c);
+    return;
+  }
+
+  Connect(index, std::move(cb), attempts);
+}
+
+int HttpUpstream::PickPeer()
+{
+  const size_t n = peers_.size();
+  int best = -1;
+
+  for (size_t i = 0; i < n; ++i) {
+    const size_t index = (next_peer_ + i) % n;
+    auto const& peer = peers_[index];
+
+    if (peer.down) continue;
+
+    if (options_.balance == kRoundRobin) {
+      best = index;
+      break;
+    }
+
+    if (best < 0 || peer.active < peers_[best].active) {
+      best = index;
+    }
+  }
+
+  if (best >= 0) {
+    next_peer_ = best + 1;
+  }
+
+  return best;
+}
+
+void HttpUpstream::Connect(size_t index, AcquireCallback cb, size_t attempts)
+{
+  auto& peer = peers_[index];
+  auto c = std::make_shared<Connection>();
+  c->peer_ = index;
+  c->client_ = std::make_shared<TcpClient>(loop_, peer.addr, "HttpUpstream");
+  c->connect_callback_ = std::move(cb);
+  c->attempts_ = attempts;
+  ++peer.active;
+
+  std::weak_ptr<Connection> wp(c);
+
+  c->client_->SetConnectionCallback([this, wp](TcpConnectionPtr const& conn) {
+    auto c = wp.lock();
+    if (c) OnConnection(c, conn);
+  });
+
+  c->client_->SetMessageCallback([this, wp](TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp) {
+    auto c = wp.lock();
+    if (!c) return;
+
+    if (c->message_callback_) {
+      // The callback may be reset when the connection is released in it
+      auto cb = c->message_callback_;
+      cb(buffer);
+    }
+    else if (c->idle_) {
+      LOG_WARN << "The idle connection to " << peers_[c->peer_].addr.ToIpPort()
+               << " receives unexpected data, close it";
+      RemoveIdle(c);
+      Close(c);
+    }
+  });
+
+  loop_->RunAfter([this, wp]() {
+    auto c = wp.lock();
+
+    if (c && !c->conn_ && !c->closed_) {
+      LOG_ERROR << "Failed to connect to the upstream server " << peers_[c->peer_].addr.ToIpPort();
+      OnConnectFailed(c);
+    }
+  }, kConnectTimeout);
+
+  c->client_->Connect();
+}
+
+void HttpUpstream::OnConnection(ConnectionPtr const& c, TcpConnectionPtr const& conn)
+{
+  if (conn->IsConnected()) {
+    if (c->closed_) {
+      conn->ShutdownWrite();
+      return;
+    }
+
+    c->conn_ = conn;
+
+    auto cb = std::move(c->connect_callback_);
+    c->connect_callback_ = nullptr;
+    cb(c);
+    return;
+  }
+
+  if (c->closed_) return;
+
+  if (!c->conn_) {
+    OnConnectFailed(c);
+    return;
+  }
+
+  c->closed_ = true;
+  loop_->QueueToLoop([c]() {});
+
+  if (c->idle_) {
+    RemoveIdle(c);
+    return;
+  }
+
+  // The server closes the connection in use, e.g. the response
+  // is delimited by closing or the stale connection is reused
+  if (c->close_callback_) {
+    auto cb = std::move(c->close_callback_);
+    c->close_callback_ = nullptr;
+    cb();
+  }
+}
+
+void HttpUpstream::OnConnectFailed(ConnectionPtr const& c)
+{
+  auto cb = std::move(c->connect_callback_);
+  c->connect_callback_ = nullptr;
+
+  --peers_[c->peer_].active;
+  Close(c);
+  MarkFailure(c->peer_);
+
+  // Try the other servers
+  if (c->attempts_ + 1 < peers_.size()) {
+    Acquire(std::move(cb), c->attempts_ + 1);
+  }
+  else {
+    cb(nullptr);
+  }
+}
+
+void HttpUpstream::Release(ConnectionPtr const& c, bool reusable)
+{
+  auto& peer = peers_[c->peer_];
+  --peer.active;
+  peer.fails = 0;
+
+  c->message_callback_ = nullptr;
+  c->close_callback_ = nullptr;
+
+  if (reusable && !c->closed_ && c->conn_->IsConnected() && !peer.down &&
+      peer.idle.size() < options_.max_idle) {
+    c->idle_ = true;
+    c->reused_ = true;
+    peer.idle.push_back(c);
+    return;
+  }
+
+  Close(c);
+}
+
+void HttpUpstream::Fail(ConnectionPtr const& c)
+{
+  --peers_[c->peer_].active;
+  Close(c);
+  MarkFailure(c->peer_);
+}
+
+void HttpUpstream::Close(ConnectionPtr const& c)
+{
+  c->message_callback_ = nullptr;
+  c->close_callback_ = nullptr;
+
+  if (c->closed_) return;
+  c->closed_ = true;
+
+  if (c->conn_ && c->conn_->IsConnected()) {
+    c->client_->Disconnect();
+  }
+  else {
+    c->client_->Stop();
+  }
+
+  // The client can't be destroyed in its callback
+  loop_->QueueToLoop([c]() {});
+}
+
+void HttpUpstream::RemoveIdle(ConnectionPtr const& c)
+{
+  auto& idle = peers_[c->peer_].idle;
+
+  for (auto iter = idle.begin(); iter != idle.end(); ++iter) {
+    if (*iter == c) {
+      idle.erase(iter);
+      break;
+    }
+  }
+
+  c->idle_ = false;
+}
+
+void HttpUpstream::MarkFailure(size_t index)
+{
+  auto& peer = peers_[index];
+
+  if (++peer.fails < options_.max_fails || peer.down) return;
+
+  LOG_WARN << "The upstream server " << peer.addr.ToIpPort() << " failed "
+           << peer.fails << " times, take it out of rotation";
+
+  peer.down = true;
+
+  for (auto const& c : peer.idle) {
+    c->idle_ = false;
+    Close(c);
+  }
+
+  peer.idle.clear();
+  ScheduleHealthCheck(index);
+}
+
+void HttpUpstream::ScheduleHealthCheck(size_t index)
+{
+  loop_->RunAfter([this, index]() {
+    CheckHealth(index);
+  }, options_.fail_timeout);
+}
+
+void HttpUpstream::CheckHealth(size_t index)
+{
+  // Don't try the other servers
+  Connect(index, [this, index](ConnectionPtr const& c) {
+    if (!c) {
+      ScheduleHealthCheck(index);
+      return;
+    }
+
+    auto& peer = peers_[index];
+    LOG_INFO << "The upstream server " << peer.addr.ToIpPort() << " is up, put it back";
+
+    peer.down = false;
+    peer.fails = 0;
+
+    // The connection of check is used by the next request
+    Release(c, true);
+  }, peers_.size());
+}
+
+} // namespace http
@@ -0,0 +1,159 @@
+#ifndef KANON_HTTP_UPSTREAM_H
+#define KANON_HTTP_UPSTREAM_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kanon/net/user_client.h>
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+/**
+ * The keep-alive connections of an IO loop to the upstream servers
+ * of a proxy route.
+ *
+ * The connection is returned to the idle list of its server when the
+ * response is complete, and reused by the next request, so the proxied
+ * requests don't pay a TCP handshake each.
+ *
+ * The server is selected in round-robin or by the least active
+ * connections. A server failed MaxFails times in a row(refused, timed
+ * out or invalid response) is taken out of rotation, and it is checked
+ * by connecting to it every FailTimeout seconds until it recovers.
+ *
+ * \note Not thread-safe, must be used in the loop
+ */
+class HttpUpstream : kanon::noncopyable {
+ public:
+  enum Balance {
+    kRoundRobin = 0,
+    kLeastConn,
+  };
+
+  struct Options {
+    Balance balance = kRoundRobin;
+    /** The max idle connections per server */
+    size_t max_idle = 32;
+    int max_fails = 3;
+    /** The interval of health check when the server is down */
+    double fail_timeout = 10;
+  };
+
+  class Connection : kanon::noncopyable {
+    friend class HttpUpstream;
+   public:
+    using MessageCallback = std::function<void(kanon::Buffer& buffer)>;
+    using CloseCallback = std::function<void()>;
+
+    kanon::TcpConnectionPtr const& GetConnection() const noexcept { return conn_; }
+
+    /** The connection has served other requests */
+    bool IsReused() const noexcept { return reused_; }
+
+    /** Called when the response arrives */
+    void SetMessageCallback(MessageCallback cb) { message_callback_ = std::move(cb); }
+
+    /** Called when the connection is closed by the server while in use */
+    void SetCloseCallback(CloseCallback cb) { close_callback_ = std::move(cb); }
+
+   private:
+    size_t peer_ = 0;
+    kanon::TcpClientPtr client_;
+    kanon::TcpConnectionPtr conn_;
+    bool reused_ = false;
+    bool idle_ = false;
+    bool closed_ = false;
+    MessageCallback message_callback_;
+    CloseCallback close_callback_;
+
+    /** Called when connected, then the connection is in use */
+    std::function<void(std::shared_ptr<Connection> const&)> connect_callback_;
+    /** The servers tried by the acquiring */
+    size_t attempts_ = 0;
+  };
+
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  /** \param conn nullptr if all servers are down or failed */
+  using AcquireCallback = std::function<void(ConnectionPtr const& conn)>;
+
+  HttpUpstream(kanon::EventLoop* loop, std::vector<kanon::InetAddr> const& addrs,
+               Options const& options);
+  ~HttpUpstream() noexcept;
+
+  /**
+   * Get an idle connection or connect to a server.
+   * The callback may be called before returning if an idle one is reused.
+   * The other servers are tried if failed to connect.
+   */
+  void Acquire(AcquireCallback cb);
+
+  /**
+   * Return the connection when the request is done
+   * \param reusable false if the connection must be closed,
+   *                 e.g. the response is not complete or delimited by closing
+   */
+  void Release(ConnectionPtr const& conn, bool reusable);
+
+  /**
+   * The server failed to serve the request(e.g. invalid response),
+   * the connection is closed
+   */
+  void Fail(ConnectionPtr const& conn);
+
+  size_t GetPeerNum() const noexcept { return peers_.size(); }
+  bool IsPeerUp(size_t i) const noexcept { return !peers_[i].down; }
+  size_t GetIdleNum(size_t i) const noexcept { return peers_[i].idle.size(); }
+  size_t GetActiveNum(size_t i) const noexcept { return peers_[i].active; }
+
+  /**
+   * Parse ip:port[,ip:port...]
+   * \param error Set the error message if failed
+   */
+  static bool ParseAddresses(kanon::StringView addresses,
+                             std::vector<std::pair<std::string, uint16_t>>& addrs,
+                             std::string& error);
+
+ private:
+  struct Peer {
+    explicit Peer(kanon::InetAddr const& a)
+      : addr(a)
+    {
+    }
+
+    kanon::InetAddr addr;
+    /** The most recently used one is at the back */
+    std::vector<ConnectionPtr> idle;
+    size_t active = 0;
+    int fails = 0;
+    bool down = false;
+  };
+
+  /** \return -1 if all servers are down */
+  int PickPeer();
+
+  void Acquire(AcquireCallback cb, size_t attempts);
+  void Connect(size_t peer, AcquireCallback cb, size_t attempts);
+  void OnConnectFailed(ConnectionPtr const& conn);
+  void OnConnection(ConnectionPtr const& conn, kanon::TcpConnectionPtr const& tcp_conn);
+
+  void Close(ConnectionPtr const& conn);
+  void RemoveIdle(ConnectionPtr const& conn);
+
+  void MarkFailure(size_t peer);
+  void ScheduleHealthCheck(size_t peer);
+  void CheckHealth(size_t peer);
+
+  kanon::EventLoop* loop_;
+  Options options_;
+  std::vector<Peer> peers_;
+  size_t next_peer_ = 0;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_UPSTREAM_H
@@ -0,0 +1,323 @@
+#include "http2/master_process.h"
+
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <kanon/log/logger.h>
+
+#include "unix/process.h"
+#include "unix/socket.h"
+
+using namespace kanon;
+
+namespace http {
+
+// If a worker crashed in such seconds after spawned,
+// delay the respawn to avoid the busy fork loop
+static constexpr int kMinWorkerLifetime = 1;
+
+// The longest time of worker waiting for the connections closed
+static constexpr double kDrainTimeout = 10;
+
+static volatile sig_atomic_t g_quit = 0;
+
+static void OnQuit(int) { g_quit = 1; }
+static void OnChild(int) {}
+
+MasterProcess::MasterProcess(int worker_num, char** argv, WorkerFunc func)
+  : argv_(argv)
+  , func_(std::move(func))
+  , stats_table_(worker_num)
+  , workers_(worker_num)
+{
+  sigemptyset(&old_mask_);
+}
+
+MasterProcess::~MasterProcess() noexcept
+{
+}
+
+void MasterProcess::Run()
+{
+  // The default action of SIGCHLD is ignore,
+  // install a handler to make sure it is pending
+  struct sigaction act;
+  ::memset(&act, 0, sizeof act);
+  act.sa_handler = &OnChild;
+  ::sigaction(SIGCHLD, &act, NULL);
+
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGQUIT);
+  sigaddset(&set, SIGUSR1);
+  sigaddset(&set, SIGUSR2);
+  ::sigprocmask(SIG_BLOCK, &set, &old_mask_);
+
+  for (int i = 0; i < stats_table_.GetSize(); ++i) {
+    SpawnWorker(i);
+  }
+
+  LOG_INFO << "Master " << ::getpid() << " started " << stats_table_.GetSize() << " workers";
+
+  while (!stopping_ || GetAliveWorkerNum() > 0) {
+    const int signo = WaitSignal(set);
+
+    RespawnDelayedWorkers();
+
+    switch (signo) {
+      case SIGCHLD:
+        ReapWorkers();
+        break;
+      case SIGTERM:
+      case SIGINT:
+        LOG_INFO << "Master is terminating the workers";
+        stopping_ = true;
+        SignalWorkers(SIGTERM);
+        break;
+      case SIGQUIT:
+        LOG_INFO << "Master is draining the workers";
+        stopping_ = true;
+        SignalWorkers(SIGQUIT);
+        break;
+      case SIGUSR1:
+        LogStats();
+        break;
+      case SIGUSR2:
+        Upgrade();
+        break;
+    }
+  }
+
+  ::sigprocmask(SIG_SETMASK, &old_mask_, NULL);
+  LOG_INFO << "Master " << ::getpid() << " exited";
+}
+
+int MasterProcess::WaitSignal(sigset_t const& set)
+{
+  bool has_respawn = false;
+  auto deadline = Clock::time_point::max();
+
+  for (auto const& worker : workers_) {
+    if (worker.respawn_pending) {
+      has_respawn = true;
+      deadline = std::min(deadline, worker.respawn_time);
+    }
+  }
+
+  if (!has_respawn) {
+    return ::sigwaitinfo(&set, NULL);
+  }
+
+  const auto timeout_ns = std::max<int64_t>(0,
+    std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count());
+
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ns / 1000000000;
+  timeout.tv_nsec = timeout_ns % 1000000000;
+
+  // -1(EAGAIN) if timeout
+  return ::sigtimedwait(&set, NULL, &timeout);
+}
+
+void MasterProcess::RespawnDelayedWorkers()
+{
+  const auto now = Clock::now();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    auto& worker = workers_[i];
+
+    if (!worker.respawn_pending) continue;
+
+    if (stopping_) {
+      worker.respawn_pending = false;
+    } else if (worker.respawn_time <= now) {
+      worker.respawn_pending = false;
+      SpawnWorker(static_cast<int>(i));
+    }
+  }
+}
+
+void MasterProcess::SpawnWorker(int index)
+{
+  // The gauges of the dead worker are meaningless
+  stats_table_[index].ResetGauges();
+
+  unix::Process process;
+
+  const bool success = process.Fork(
+    []() {},
+    [this, index]() {
+      ::signal(SIGCHLD, SIG_DFL);
+      ::sigprocmask(SIG_SETMASK, &old_mask_, NULL);
+
+      func_(index, stats_table_[index], stats_table_);
+      ::_exit(0);
+    });
+
+  if (!success) {
+    LOG_SYSERROR << "Failed to fork the worker " << index;
+    return;
+  }
+
+  workers_[index].pid = process.GetPid();
+  workers_[index].start_time = Clock::now();
+  LOG_INFO << "Worker " << index << " is spawned, pid = " << process.GetPid();
+}
+
+void MasterProcess::ReapWorkers()
+{
+  pid_t pid;
+  int status;
+
+  while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+    int index = -1;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (workers_[i].pid == pid) {
+        index = static_cast<int>(i);
+        break;
+      }
+    }
+
+    if (index < 0) {
+      // e.g. the new master forked by Upgrade()
+      LOG_INFO << "Child " << pid << " exited";
+      continue;
+    }
+
+    auto& worker = workers_[index];
+    worker.pid = -1;
+
+    if (WIFSIGNALED(status)) {
+      LOG_ERROR << "Worker " << index << "(pid = " << pid << ") is killed by signal " << WTERMSIG(status);
+    } else {
+      LOG_INFO << "Worker " << index << "(pid = " << pid << ") exited with " << WEXITSTATUS(status);
+    }
+
+    if (stopping_) {
+      continue;
+    }
+
+    const auto lifetime = std::chrono::duration_cast<std::chrono::seconds>(
+      Clock::now() - worker.start_time).count();
+
+    // The signals are still handled meanwhile
+    if (lifetime < kMinWorkerLifetime) {
+      LOG_WARN << "Worker " << index << " exited too quickly, delay the respawn";
+      worker.respawn_pending = true;
+      worker.respawn_time = Clock::now() + std::chrono::seconds(kMinWorkerLifetime);
+      continue;
+    }
+
+    SpawnWorker(index);
+  }
+}
+
+void MasterProcess::SignalWorkers(int signo)
+{
+  for (auto const& worker : workers_) {
+    if (worker.pid > 0) {
+      ::kill(worker.pid, signo);
+    }
+  }
+}
+
+void MasterProcess::Upgrade()
+{
+  // The old workers close their listening sockets when drained,
+  // the connections queued on them are reset without the migration
+  if (!unix::EnableListenerMigration()) {
+    LOG_ERROR << "The binary upgrade is refused since net.ipv4.tcp_migrate_req "
+                 "can't be enabled(Linux 5.14+ and CAP_NET_ADMIN are required), "
+                 "the connections queued on the old workers would be reset";
+    return;
+  }
+
+  LOG_INFO << "Master is upgrading the binary: " << argv_[0];
+
+  unix::Process process;
+
+  // The listening sockets are SO_REUSEPORT, the new master can listen
+  // on the same port, then the old one can be drained by SIGQUIT.
+  const bool success = process.Fork(
+    []() {},
+    [this]() {
+      ::signal(SIGCHLD, SIG_DFL);
+      ::sigprocmask(SIG_SETMASK, &old_mask_, NULL);
+
+      // Search PATH if started without a path. /proc/self/exe is not
+      // used since it refers to the binary being replaced.
+      ::execvp(argv_[0], argv_);
+      ::perror("execvp() error occurred");
+      ::_exit(1);
+    });
+
+  if (!success) {
+    LOG_SYSERROR << "Failed to fork the new master";
+  } else {
+    LOG_INFO << "The new master is started, pid = " << process.GetPid()
+             << ", send SIGQUIT to " << ::getpid() << " to drain the old one";
+  }
+}
+
+void MasterProcess::LogStats()
+{
+  std::string out;
+  stats_table_.Render(out);
+
+  LOG_INFO << "The counters of workers:\n" << out;
+}
+
+int MasterProcess::GetAliveWorkerNum() const noexcept
+{
+  int num = 0;
+  for (auto const& worker : workers_) {
+    if (worker.pid > 0) {
+      ++num;
+    }
+  }
+
+  return num;
+}
+
+void MasterProcess::WatchGracefulShutdown(EventLoop* loop, ServerStats const& stats, int port)
+{
+  ::signal(SIGQUIT, &OnQuit);
+
+  static constexpr double kCheckInterval = 0.5;
+  double drain_time = 0;
+
+  loop->RunEvery([loop, &stats, port, drain_time]() mutable {
+    if (!g_quit) return;
+
+    // Stop accepting first, the new connections go to the other
+    // workers(e.g. of the new master) instead of this draining one
+    if (drain_time == 0) {
+      const int closed = unix::CloseListeningSockets(port);
+
+      if (closed < 0) {
+        LOG_SYSERROR << "Failed to close the listening sockets of worker " << ::getpid();
+      } else {
+        LOG_INFO << "Worker " << ::getpid() << " stops accepting(" << closed << " sockets)";
+      }
+    }
+
+    drain_time += kCheckInterval;
+
+    if (stats.active_connections.load(std::memory_order_relaxed) <= 0 ||
+        drain_time >= kDrainTimeout) {
+      LOG_INFO << "Worker " << ::getpid() << " is drained";
+      loop->Quit();
+    }
+  }, kCheckInterval);
+}
+
+} // namespace http
@@ -0,0 +1,98 @@
+#ifndef KANON_HTTP_MASTER_PROCESS_H
+#define KANON_HTTP_MASTER_PROCESS_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <kanon/net/user_server.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/server_stats.h"
+
+namespace http {
+
+/**
+ * Pre-fork master/worker mode.
+ *
+ * The master forks N worker processes, each one runs its own
+ * event loop and listens on the same port by SO_REUSEPORT.
+ * A plugin crashing or leaking only takes one worker down,
+ * and the master respawns it.
+ *
+ * Signals handled by master:
+ * - SIGTERM/SIGINT: Terminate workers and exit
+ * - SIGQUIT: Workers stop accepting and exit after the connections are closed(at most 10s)
+ * - SIGUSR1: Log the sum of counters of all workers
+ * - SIGUSR2: Binary upgrade. Execute the binary with same arguments, the new
+ *            master listens on the same port with the old one. Then send SIGQUIT
+ *            to the old master to drain it. The connections queued on the old
+ *            listening sockets are migrated to the new ones by the kernel, the
+ *            upgrade is refused if net.ipv4.tcp_migrate_req can't be enabled.
+ *
+ * MaxConnections is divided among the workers, each one admits its share.
+ */
+class MasterProcess : kanon::noncopyable {
+ public:
+  /**
+   * Called in the worker process, return when the worker should exit.
+   * \param index The index of worker in [0, worker number)
+   * \param stats The counters of the worker in shared memory
+   * \param table The counters of all workers
+   */
+  using WorkerFunc = std::function<void(int index, ServerStats& stats, SharedStatsTable const& table)>;
+
+  MasterProcess(int worker_num, char** argv, WorkerFunc func);
+  ~MasterProcess() noexcept;
+
+  /**
+   * Spawn the workers and supervise them until all of them exit.
+   */
+  void Run();
+
+  /**
+   * When receiving SIGQUIT, close the listening sockets of \p port, then
+   * quit the \p loop of the worker when the connections are all closed
+   * or the drain timeout expires.
+   * Must be called in the worker process.
+   */
+  static void WatchGracefulShutdown(EventLoop* loop, ServerStats const& stats, int port);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Worker {
+    pid_t pid = -1;
+    Clock::time_point start_time;
+    /** Respawn the worker exited too quickly at that time */
+    bool respawn_pending = false;
+    Clock::time_point respawn_time;
+  };
+
+  /** Wait for the signals in \p set until the next delayed respawn */
+  int WaitSignal(sigset_t const& set);
+
+  void SpawnWorker(int index);
+  void ReapWorkers();
+  void RespawnDelayedWorkers();
+  void SignalWorkers(int signo);
+  void Upgrade();
+  void LogStats();
+  int GetAliveWorkerNum() const noexcept;
+
+  char** argv_;
+  WorkerFunc func_;
+  SharedStatsTable stats_table_;
+  std::vector<Worker> workers_;
+  bool stopping_ = false;
+
+  /** The signal mask before blocking, restored in the child process */
+  sigset_t old_mask_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_MASTER_PROCESS_H
@@ -0,0 +1,70 @@
+#include "http2/plugin_instance_pool.h"
+
+#include <kanon/log/logger.h>
+
+using namespace kanon;
+
+namespace http {
+
+PluginInstancePool& PluginInstancePool::GetLocal()
+{
+  static thread_local PluginInstancePool pool;
+  return pool;
+}
+
+PluginInstancePool::~PluginInstancePool() noexcept
+{
+}
+
+auto PluginInstancePool::Acquire(PluginPtr const& plugin, EventLoop* loop) -> InstancePtr
+{
+  auto& entry = entries_[plugin->path];
+
+  if (entry.plugin != plugin) {
+    if (entry.plugin) {
+      LOG_DEBUG << "The plugin " << plugin->path << " is reloaded, drop "
+                << entry.instances.size() << " instances of old version";
+    }
+
+    entry.instances.clear();
+    entry.context = PluginContext();
+    entry.context.loop = loop;
+    entry.plugin = plugin;
+  }
+
+  if (!entry.instances.empty()) {
+    auto instance = entry.instances.back().release();
+    entry.instances.pop_back();
+    return InstancePtr(instance, Releaser{plugin.get()});
+  }
+
+  InstancePtr instance(plugin->create_func(), Releaser{plugin.get()});
+
+  if (instance->IsReusable()) {
+    instance->Init(entry.context);
+  }
+
+  return instance;
+}
+
+void PluginInstancePool::Release(Plugin const* plugin, Interface* instance) noexcept
+{
+  // Don't keep the connection alive
+  instance->SetConnection(TcpConnectionPtr());
+
+  if (instance->IsReusable()) {
+    auto iter = entries_.find(plugin->path);
+
+    // Not reloaded since acquired
+    if (iter != entries_.end() && iter->second.plugin.get() == plugin &&
+        iter->second.instances.size() < kMaxCached) {
+      instance->Reset();
+      iter->second.instances.emplace_back(instance);
+      return;
+    }
+  }
+
+  delete instance;
+}
+
+} // namespace http
@@ -0,0 +1,72 @@
+#ifndef KANON_HTTP_PLUGIN_INSTANCE_POOL_H
+#define KANON_HTTP_PLUGIN_INSTANCE_POOL_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <kanon/net/event_loop.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/plugin_registry.h"
+
+namespace http {
+
+/**
+ * The instances of reusable plugins owned by an IO loop.
+ *
+ * Since each IO loop is run in its own thread, the pool is thread
+ * local and no lock is needed. The instances which are not reusable
+ * are created and destroyed per request as before.
+ *
+ * When the plugin is reloaded, the instances and context of old
+ * version are dropped at the next acquisition of the plugin.
+ */
+class PluginInstancePool : kanon::noncopyable {
+  using Interface = PluginRegistry::Interface;
+  using PluginPtr = PluginRegistry::PluginPtr;
+  using Plugin = PluginRegistry::Plugin;
+
+  struct Releaser {
+    void operator()(Interface* instance) const noexcept
+    { PluginInstancePool::GetLocal().Release(plugin, instance); }
+
+    Plugin const* plugin;
+  };
+
+ public:
+  using InstancePtr = std::unique_ptr<Interface, Releaser>;
+
+  /** The pool of the calling thread */
+  static PluginInstancePool& GetLocal();
+
+  ~PluginInstancePool() noexcept;
+
+  /**
+   * Get a instance of \p plugin.
+   * \note \p plugin must be alive until the instance is released
+   */
+  InstancePtr Acquire(PluginPtr const& plugin, kanon::EventLoop* loop);
+
+ private:
+  PluginInstancePool() = default;
+
+  void Release(Plugin const* plugin, Interface* instance) noexcept;
+
+  struct Entry {
+    // Must be declared first, the instances are destroyed before unloaded
+    PluginPtr plugin;
+    PluginContext context;
+    std::vector<std::unique_ptr<Interface>> instances;
+  };
+
+  // Avoid caching too many instances after a burst
+  static constexpr size_t kMaxCached = 16;
+
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_PLUGIN_INSTANCE_POOL_H
@@ -0,0 +1,373 @@
+#include "http2/plugin_registry.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <kanon/log/logger.h>
+
+#include "config/http_config.h"
+#include "plugin/static_plugin.h"
+#include "unix/fd_wrapper.h"
+
+using namespace kanon;
+
+namespace http {
+
+/**
+ * Copy the shared object to a private file.
+ *
+ * dlopen() returns the handle already loaded if the path is same,
+ * so the new version must be loaded from a unique path. The copy
+ * also protects the mapped code from being overwritten in place,
+ * which crashes the process.
+ *
+ * The copy is created next to the plugin, where the code can be mapped
+ * since the plugin itself is(/tmp may be mounted noexec), or in the
+ * $XDG_RUNTIME_DIR if the directory of plugin is not writable.
+ */
+static bool CopyToPrivateFile(std::string const& path, std::string& copy, std::string& error)
+{
+  unix::FDWrapper in(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+
+  if (in.GetFd() < 0) {
+    error = "Failed to open " + path;
+    return false;
+  }
+
+  const auto slash_pos = path.rfind('/');
+  copy = slash_pos == std::string::npos ? std::string(".") : path.substr(0, slash_pos);
+  copy += "/.kanon_httpd_plugin_XXXXXX";
+  int out_fd = ::mkostemp(&copy[0], O_CLOEXEC);
+
+  if (out_fd < 0) {
+    auto runtime_dir = ::getenv("XDG_RUNTIME_DIR");
+
+    if (runtime_dir && runtime_dir[0] != '\0') {
+      copy = runtime_dir;
+      copy += "/kanon_httpd_plugin_XXXXXX";
+      out_fd = ::mkostemp(&copy[0], O_CLOEXEC);
+    }
+  }
+
+  unix::FDWrapper out(out_fd);
+
+  if (out.GetFd() < 0) {
+    error = "Failed to create the private copy of " + path +
+            " in its directory or $XDG_RUNTIME_DIR";
+    return false;
+  }
+
+  char buf[1 << 16];
+  ssize_t readn;
+
+  while ((readn = ::read(in.GetFd(), buf, sizeof buf)) > 0) {
+    if (::write(out.GetFd(), buf, readn) != readn) {
+      readn = -1;
+      break;
+    }
+  }
+
+  if (readn < 0) {
+    ::unlink(copy.c_str());
+    error = "Failed to copy " + path;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Find the linked plugin which \p path refers to.
+ *
+ * The linked plugins stand for the shared objects generated to
+ * ${RootPath}/contents(see plugin/src/CMakeLists.txt), so a file of the
+ * same name in other directory is still loaded, e.g. /opt/plugins/adder.
+ */
+static StaticPluginTable::Entry const* FindStaticPlugin(std::string const& path)
+{
+  static constexpr char kContentsDir[] = "/contents";
+  static constexpr size_t kContentsDirLen = sizeof(kContentsDir) - 1;
+
+  const auto slash_pos = path.rfind('/');
+
+  if (slash_pos == std::string::npos || slash_pos < kContentsDirLen ||
+      path.compare(slash_pos - kContentsDirLen, kContentsDirLen, kContentsDir) != 0) {
+    return nullptr;
+  }
+
+  // The RootPath may end with slash, e.g. /var/www//contents/adder
+  auto root_len = slash_pos - kContentsDirLen;
+  while (root_len > 0 && path[root_len-1] == '/') --root_len;
+
+  auto const& root = g_config.root_path;
+  auto config_root_len = root.size();
+  while (config_root_len > 0 && root[config_root_len-1] == '/') --config_root_len;
+
+  if (root_len != config_root_len || path.compare(0, root_len, root, 0, root_len) != 0) {
+    return nullptr;
+  }
+
+  return StaticPluginTable::Find(path.substr(slash_pos+1));
+}
+
+PluginRegistry::PluginRegistry()
+{
+}
+
+PluginRegistry::~PluginRegistry() noexcept
+{
+  if (inotify_channel_) {
+    inotify_channel_->DisableAll();
+    inotify_channel_->Remove();
+  }
+
+  if (inotify_fd_ >= 0) {
+    ::close(inotify_fd_);
+  }
+}
+
+auto PluginRegistry::Get(std::string const& path, std::string& error) -> PluginPtr
+{
+  {
+    RLockGuard guard(lock_);
+    auto iter = plugins_.find(path);
+
+    if (iter != plugins_.end()) {
+      return iter->second;
+    }
+  }
+
+  // Load it out of the lock, the copy and dlopen() don't block
+  // the requests of the loaded plugins
+  auto plugin = Load(path, 0, error);
+
+  if (!plugin) {
+    return nullptr;
+  }
+
+  WLockGuard guard(lock_);
+
+  // Other thread may load it meanwhile, use the first one and
+  // this one is unloaded when released
+  auto& entry = plugins_[path];
+
+  if (!entry) {
+    entry = std::move(plugin);
+
+    if (inotify_fd_ >= 0 && !entry->is_static) {
+      Watch(path);
+    }
+  }
+
+  return entry;
+}
+
+auto PluginRegistry::Load(std::string const& path, uint64_t version, std::string& error) -> PluginPtr
+{
+  auto plugin = std::make_shared<Plugin>();
+  plugin->path = path;
+  plugin->version = version;
+
+  // The linked plugin is called directly, the shared object is not needed
+  if (!StaticPluginTable::IsEmpty()) {
+    auto entry = FindStaticPlugin(path);
+
+    if (entry) {
+      plugin->create_func = entry->create_func;
+      plugin->abi_version = entry->abi_version;
+      plugin->is_static = true;
+      LOG_INFO << "The plugin " << path << "(static, ABI " << plugin->abi_version << ") is loaded";
+      return plugin;
+    }
+  }
+
+  kanon::optional<std::string> open_error;
+
+  if (inotify_fd_ >= 0) {
+    std::string copy;
+
+    if (!CopyToPrivateFile(path, copy, error)) {
+      return nullptr;
+    }
+
+    open_error = plugin->loader.Open(copy);
+
+    // The mapping is kept after unlinking
+    ::unlink(copy.c_str());
+  } else {
+    open_error = plugin->loader.Open(path);
+  }
+
+  if (open_error) {
+    error = std::move(*open_error);
+    return nullptr;
+  }
+
+  plugin->create_func = plugin->loader.GetCreateFunc();
+
+  if (!plugin->create_func) {
+    error = "The CreateObject() is not found";
+    return nullptr;
+  }
+
+  auto abi_version = static_cast<int const*>(plugin->loader.GetSymbol("kanon_plugin_abi_version"));
+
+  // The version may be found in the dependencies of plugin, e.g. a library
+  // built against this header, it must be defined with the CreateObject()
+  if (abi_version) {
+    Dl_info version_info;
+    Dl_info create_info;
+
+    if (!::dladdr(abi_version, &version_info) ||
+        !::dladdr(reinterpret_cast<void*>(plugin->create_func), &create_info) ||
+        version_info.dli_fbase != create_info.dli_fbase) {
+      abi_version = nullptr;
+    }
+  }
+
+  // Built against the interface before versioning, whose vtable and
+  // ArgsMap differ from the current ones, calling it is undefined
+  if (!abi_version) {
+    error = "The kanon_plugin_abi_version is not exported, the plugin is built "
+            "against the interface before versioning, rebuild it";
+    return nullptr;
+  }
+
+  plugin->abi_version = *abi_version;
+
+  if (plugin->abi_version < KANON_PLUGIN_MIN_ABI_VERSION ||
+      plugin->abi_version > KANON_PLUGIN_ABI_VERSION) {
+    error = "The ABI version " + std::to_string(plugin->abi_version) + " is not supported";
+    return nullptr;
+  }
+
+  LOG_INFO << "The plugin " << path << "(version " << version << ", ABI "
+           << plugin->abi_version << ") is loaded";
+  return plugin;
+}
+
+size_t PluginRegistry::GetSize() const
+{
+  RLockGuard guard(lock_);
+  return plugins_.size();
+}
+
+void PluginRegistry::EnableHotReload(EventLoop* loop)
+{
+  inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (inotify_fd_ < 0) {
+    LOG_SYSERROR << "Failed to create inotify instance, plugin hot reload is disabled";
+    return;
+  }
+
+  inotify_channel_.reset(new Channel(loop, inotify_fd_));
+  inotify_channel_->SetReadCallback([this](TimeStamp) {
+    OnInotify();
+  });
+  inotify_channel_->EnableReading();
+}
+
+void PluginRegistry::Watch(std::string const& path)
+{
+  const auto slash_pos = path.rfind('/');
+  auto dir = slash_pos == std::string::npos ? std::string(".") : path.substr(0, slash_pos);
+
+  // The shared object may be replaced by write or rename
+  const int wd = ::inotify_add_watch(inotify_fd_, dir.c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO);
+
+  if (wd < 0) {
+    LOG_SYSERROR << "Failed to watch " << dir << ", the plugins in it are not reloaded";
+    return;
+  }
+
+  // Same directory has same watch descriptor
+  watched_dirs_[wd] = std::move(dir);
+}
+
+void PluginRegistry::OnInotify()
+{
+  alignas(struct inotify_event) char buf[4096];
+
+  for (;;) {
+    const auto readn = ::read(inotify_fd_, buf, sizeof buf);
+
+    if (readn <= 0) {
+      if (readn < 0 && errno != EAGAIN) {
+        LOG_SYSERROR << "Failed to read the inotify events";
+      }
+
+      break;
+    }
+
+    for (char* p = buf; p < buf + readn; ) {
+      auto event = reinterpret_cast<struct inotify_event const*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->len == 0) continue;
+
+      std::string path;
+      bool loaded = false;
+
+      {
+        RLockGuard guard(lock_);
+
+        auto iter = watched_dirs_.find(event->wd);
+        if (iter == watched_dirs_.end()) continue;
+
+        path = iter->second;
+        path += '/';
+        path += event->name;
+
+        // Ignore the files which are not used
+        loaded = plugins_.find(path) != plugins_.end();
+      }
+
+      if (loaded) {
+        Reload(path);
+      }
+    }
+  }
+}
+
+void PluginRegistry::Reload(std::string const& path)
+{
+  uint64_t version = 0;
+
+  {
+    RLockGuard guard(lock_);
+    auto iter = plugins_.find(path);
+
+    if (iter == plugins_.end()) return;
+    version = iter->second->version + 1;
+  }
+
+  // Load it out of the lock, the requests still use the old version
+  std::string error;
+  auto plugin = Load(path, version, error);
+
+  if (!plugin) {
+    LOG_ERROR << "Failed to reload the plugin " << path << ": " << error
+              << ", the old version is kept";
+    return;
+  }
+
+  PluginPtr old;
+
+  {
+    WLockGuard guard(lock_);
+    auto& entry = plugins_[path];
+    old = std::move(entry);
+    entry = std::move(plugin);
+  }
+
+  LOG_INFO << "The plugin " << path << " is switched to version " << version
+           << ", the old version is unloaded after "
+           << (old ? old.use_count() - 1 : 0) << " references released";
+}
+
+} // namespace http
@@ -0,0 +1,94 @@
+#ifndef KANON_HTTP_PLUGIN_REGISTRY_H
+#define KANON_HTTP_PLUGIN_REGISTRY_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <kanon/net/channel.h>
+#include <kanon/net/event_loop.h>
+#include <kanon/thread/rw_lock.h>
+#include <kanon/util/noncopyable.h>
+
+#include "plugin/plugin_loader.h"
+#include "plugin/http_dynamic_response_interface.h"
+
+namespace http {
+
+/**
+ * Cache the loaded plugins(shared objects).
+ *
+ * Each plugin is loaded once and its handle is kept resident,
+ * the CreateObject symbol is resolved when loaded. Then serving
+ * a dynamic request only costs a hash lookup under the read lock,
+ * instead of dlopen()/dlsym()/dlclose() per request.
+ *
+ * If hot reload is enabled, the directories of loaded plugins are
+ * watched by inotify. When a shared object is replaced, the new
+ * version is loaded side by side and the entry is switched to it,
+ * the old version is unloaded after the requests using it finish.
+ *
+ * The plugins linked into the server are found by the path
+ * ${RootPath}/contents/<name> before dlopen(), they are never reloaded.
+ */
+class PluginRegistry : kanon::noncopyable {
+ public:
+  using Interface = HttpDynamicResponseInterface;
+  using CreateFunc = Interface*(*)();
+
+  struct Plugin : kanon::noncopyable {
+    std::string path;
+    plugin::PluginLoader<Interface> loader;
+    CreateFunc create_func = nullptr;
+    /** The exported kanon_plugin_abi_version */
+    int abi_version = KANON_PLUGIN_ABI_VERSION;
+    /** Linked into the server, see StaticPluginTable */
+    bool is_static = false;
+    /** Increased when reloaded, for logging */
+    uint64_t version = 0;
+  };
+
+  /**
+   * The plugin is unloaded when the last reference is released,
+   * so the request in progress can hold it safely.
+   */
+  using PluginPtr = std::shared_ptr<Plugin const>;
+
+  PluginRegistry();
+  ~PluginRegistry() noexcept;
+
+  /**
+   * Get the plugin of \p path, load it if it is not loaded.
+   * \param error Set the error message if failed
+   * \return nullptr if failed
+   */
+  PluginPtr Get(std::string const& path, std::string& error);
+
+  size_t GetSize() const;
+
+  /**
+   * Watch the loaded plugins and handle the changes in \p loop.
+   * \note Must be called before serving
+   */
+  void EnableHotReload(kanon::EventLoop* loop);
+
+ private:
+  PluginPtr Load(std::string const& path, uint64_t version, std::string& error);
+
+  void Watch(std::string const& path);
+  void OnInotify();
+  void Reload(std::string const& path);
+
+  mutable kanon::RWLock lock_;
+  std::unordered_map<std::string, PluginPtr> plugins_;
+
+  /** Hot reload */
+  int inotify_fd_ = -1;
+  std::unique_ptr<kanon::Channel> inotify_channel_;
+  // watch descriptor -> directory, guarded by lock_
+  std::unordered_map<int, std::string> watched_dirs_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_PLUGIN_REGISTRY_H
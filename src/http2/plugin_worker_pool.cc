@@ -0,0 +1,88 @@
+#include "http2/plugin_worker_pool.h"
+
+#include <exception>
+
+#include <kanon/log/logger.h>
+
+namespace http {
+
+PluginWorkerPool::PluginWorkerPool(int thread_num, size_t max_queue_size, ServerStats& stats)
+  : max_queue_size_(max_queue_size)
+  , stats_(&stats)
+{
+  threads_.reserve(thread_num);
+
+  for (int i = 0; i < thread_num; ++i) {
+    threads_.emplace_back(&PluginWorkerPool::ThreadFunc, this);
+  }
+
+  LOG_INFO << "The plugin worker pool is started with " << thread_num
+           << " threads(queue size = " << max_queue_size << ")";
+}
+
+PluginWorkerPool::~PluginWorkerPool() noexcept
+{
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    quit_ = true;
+  }
+
+  cond_.notify_all();
+
+  for (auto& thr : threads_) {
+    thr.join();
+  }
+}
+
+bool PluginWorkerPool::TrySubmit(Task task)
+{
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    if (tasks_.size() >= max_queue_size_) {
+      Increment(stats_->blocking_rejected);
+      return false;
+    }
+
+    tasks_.push_back(PendingTask{std::move(task), Clock::now()});
+  }
+
+  stats_->blocking_queue_length.fetch_add(1, std::memory_order_relaxed);
+  cond_.notify_one();
+  return true;
+}
+
+void PluginWorkerPool::ThreadFunc()
+{
+  for (;;) {
+    PendingTask pending;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return quit_ || !tasks_.empty(); });
+
+      // Drain the queue before quit
+      if (tasks_.empty()) return;
+
+      pending = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    const auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - pending.submit_time).count();
+
+    stats_->blocking_queue_length.fetch_sub(1, std::memory_order_relaxed);
+    stats_->blocking_queue_wait_us.fetch_add(wait_us, std::memory_order_relaxed);
+    Increment(stats_->blocking_tasks);
+
+    try {
+      pending.task();
+    } catch (std::exception const& ex) {
+      LOG_ERROR << "Exception is thrown by the blocking plugin: " << ex.what();
+    } catch (...) {
+      LOG_ERROR << "Unknown exception is thrown by the blocking plugin";
+    }
+  }
+}
+
+} // namespace http
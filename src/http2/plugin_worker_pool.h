@@ -0,0 +1,71 @@
+#ifndef KANON_HTTP_PLUGIN_WORKER_POOL_H
+#define KANON_HTTP_PLUGIN_WORKER_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <kanon/util/noncopyable.h>
+
+#include "http2/server_stats.h"
+
+namespace http {
+
+/**
+ * Run the blocking plugins(disk or CPU-bound) out of the IO loops,
+ * then a slow plugin doesn't stall the other connections of the loop.
+ *
+ * The queue is bounded, the task is rejected instead of waiting
+ * when it is full, and the caller responds 503.
+ */
+class PluginWorkerPool : kanon::noncopyable {
+ public:
+  using Task = std::function<void()>;
+
+  /**
+   * \param thread_num The number of worker threads
+   * \param max_queue_size The maximum number of pending tasks
+   */
+  PluginWorkerPool(int thread_num, size_t max_queue_size, ServerStats& stats);
+
+  /**
+   * Run the pending tasks and join the workers
+   */
+  ~PluginWorkerPool() noexcept;
+
+  void SetStats(ServerStats& stats) noexcept { stats_ = &stats; }
+
+  /**
+   * Push the task to the queue.
+   * \return false if the queue is full
+   */
+  bool TrySubmit(Task task);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct PendingTask {
+    Task task;
+    Clock::time_point submit_time;
+  };
+
+  void ThreadFunc();
+
+  size_t max_queue_size_;
+  ServerStats* stats_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<PendingTask> tasks_;
+  bool quit_ = false;
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_PLUGIN_WORKER_POOL_H
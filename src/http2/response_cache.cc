@@ -0,0 +1,179 @@
+#include "http2/response_cache.h"
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+ResponseCache::ResponseCache(size_t capacity)
+  : capacity_(capacity)
+{
+}
+
+ResponseCache::~ResponseCache() noexcept = default;
+
+auto ResponseCache::Lookup(std::string const& key, int64_t now_us,
+                           EntryPtr& entry, Waiter&& waiter) -> Result
+{
+  MutexGuard guard(mutex_);
+
+  auto iter = entries_.find(key);
+
+  if (iter != entries_.end()) {
+    auto node = iter->second;
+    auto const& cached = node->entry;
+
+    if (now_us < cached->stale_us) {
+      lru_.splice(lru_.begin(), lru_, node);
+      entry = cached;
+
+      if (now_us < cached->expire_us || pendings_.count(key)) {
+        return kHit;
+      }
+
+      pendings_.emplace(key, std::vector<Waiter>());
+      return kRevalidate;
+    }
+
+    Erase(node);
+  }
+
+  auto pending = pendings_.find(key);
+
+  if (pending != pendings_.end()) {
+    pending->second.push_back(std::move(waiter));
+    return kPending;
+  }
+
+  pendings_.emplace(key, std::vector<Waiter>());
+  return kMiss;
+}
+
+void ResponseCache::Fill(std::string const& key, std::string response,
+                         int64_t expire_us, int64_t stale_us)
+{
+  auto entry = std::make_shared<Entry>();
+  entry->response = std::move(response);
+  entry->expire_us = expire_us;
+  entry->stale_us = std::max(stale_us, expire_us);
+
+  std::vector<Waiter> waiters;
+
+  {
+    MutexGuard guard(mutex_);
+
+    auto pending = pendings_.find(key);
+
+    if (pending != pendings_.end()) {
+      waiters = std::move(pending->second);
+      pendings_.erase(pending);
+    }
+
+    auto iter = entries_.find(key);
+
+    if (iter != entries_.end()) {
+      Erase(iter->second);
+    }
+
+    const size_t size = key.size() + entry->response.size();
+
+    if (size <= capacity_) {
+      while (size_ + size > capacity_) {
+        Erase(std::prev(lru_.end()));
+      }
+
+      lru_.push_front(Node{key, entry});
+      entries_.emplace(key, lru_.begin());
+      size_ += size;
+    }
+  }
+
+  // Don't call them under the lock, they may look up again
+  for (auto const& waiter : waiters) {
+    waiter(entry);
+  }
+}
+
+void ResponseCache::Abort(std::string const& key)
+{
+  std::vector<Waiter> waiters;
+
+  {
+    MutexGuard guard(mutex_);
+
+    auto pending = pendings_.find(key);
+
+    if (pending == pendings_.end()) {
+      return;
+    }
+
+    waiters = std::move(pending->second);
+    pendings_.erase(pending);
+  }
+
+  for (auto const& waiter : waiters) {
+    waiter(nullptr);
+  }
+}
+
+void ResponseCache::Erase(NodeList::iterator node)
+{
+  size_ -= node->key.size() + node->entry->response.size();
+  entries_.erase(node->key);
+  lru_.erase(node);
+}
+
+size_t ResponseCache::GetSize() const
+{
+  MutexGuard guard(mutex_);
+  return size_;
+}
+
+size_t ResponseCache::GetEntryNum() const
+{
+  MutexGuard guard(mutex_);
+  return entries_.size();
+}
+
+void ResponseCache::MakeKey(HttpMethod method, StringView path,
+                            StringView query, std::string& key)
+{
+  // Most queries have a few arguments
+  std::vector<StringView> args;
+  args.reserve(8);
+
+  while (!query.empty()) {
+    auto and_pos = query.find('&');
+    auto arg = query.substr(0, and_pos);
+
+    if (!arg.empty()) {
+      args.push_back(arg);
+    }
+
+    if (and_pos == StringView::npos) break;
+
+    query.remove_prefix(and_pos+1);
+  }
+
+  // Sorted by the name only, the values of a repeated name keep their
+  // order since a=1&a=2 and a=2&a=1 may mean different lists
+  std::stable_sort(args.begin(), args.end(), [](StringView x, StringView y) {
+    return x.substr(0, x.find('=')) < y.substr(0, y.find('='));
+  });
+
+  key.clear();
+  key += GetMethodString(method);
+  key += ' ';
+  key.append(path.data(), path.size());
+
+  char sep = '?';
+
+  for (auto arg : args) {
+    key += sep;
+    key.append(arg.data(), arg.size());
+    sep = '&';
+  }
+}
+
+} // namespace http
@@ -0,0 +1,114 @@
+#ifndef KANON_HTTP_RESPONSE_CACHE_H
+#define KANON_HTTP_RESPONSE_CACHE_H
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+#include <kanon/thread/mutex_lock.h>
+#include <kanon/util/noncopyable.h>
+
+#include "common/http_constant.h"
+
+namespace http {
+
+/**
+ * Cache the responses of plugins, shared by all IO threads.
+ *
+ * An entry is fresh in its TTL. After that, it is still served in
+ * the stale window while one request refreshes it in background
+ * (stale-while-revalidate), then it is dropped.
+ *
+ * The concurrent misses of the same key are coalesced: the first
+ * one runs the plugin and fills the entry, the others wait for it.
+ *
+ * The entries are evicted in LRU order if the total size of keys
+ * and responses exceeds the capacity.
+ */
+class ResponseCache : kanon::noncopyable {
+ public:
+  struct Entry {
+    /** The response without the status line and Connection */
+    std::string response;
+    int64_t expire_us = 0;
+    /** Served as stale before it */
+    int64_t stale_us = 0;
+  };
+
+  /** The entry is immutable, so it can be sent after evicted */
+  using EntryPtr = std::shared_ptr<Entry const>;
+
+  /**
+   * Called with the entry when the miss is filled, or nullptr if
+   * it is aborted. Maybe called in any thread.
+   */
+  using Waiter = std::function<void(EntryPtr const&)>;
+
+  enum Result {
+    kHit = 0, /** Fresh, or stale but being refreshed by other */
+    kRevalidate, /** Stale, serve it and the caller must refresh it */
+    kMiss, /** The caller must fill or abort it */
+    kPending, /** The waiter is queued */
+  };
+
+  explicit ResponseCache(size_t capacity);
+  ~ResponseCache() noexcept;
+
+  /**
+   * \param entry Set if the result is kHit or kRevalidate
+   * \param waiter Queued if the result is kPending
+   */
+  Result Lookup(std::string const& key, int64_t now_us, EntryPtr& entry, Waiter&& waiter);
+
+  /**
+   * Store the response of the miss or revalidation, then call its waiters.
+   * The response larger than the capacity is not stored, but the
+   * waiters still get it.
+   */
+  void Fill(std::string const& key, std::string response, int64_t expire_us, int64_t stale_us);
+
+  /** The plugin failed, call the waiters with nullptr */
+  void Abort(std::string const& key);
+
+  size_t GetSize() const;
+  size_t GetEntryNum() const;
+
+  /**
+   * The key consists of the method, path and normalized query.
+   * The arguments are sorted by name, so a=1&b=2 and b=2&a=1 share the
+   * entry, the order of the repeated names is kept.
+   */
+  static void MakeKey(HttpMethod method, kanon::StringView path,
+                      kanon::StringView query, std::string& key);
+
+ private:
+  struct Node {
+    std::string key;
+    EntryPtr entry;
+  };
+
+  using NodeList = std::list<Node>;
+
+  void Erase(NodeList::iterator node);
+
+  size_t capacity_;
+  size_t size_ = 0;
+
+  mutable kanon::MutexLock mutex_;
+
+  /** The front is the most recently used */
+  NodeList lru_;
+  std::unordered_map<std::string, NodeList::iterator> entries_;
+
+  /** The keys being filled */
+  std::unordered_map<std::string, std::vector<Waiter>> pendings_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_RESPONSE_CACHE_H
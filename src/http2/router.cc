@@ -0,0 +1,270 @@
+#include "http2/router.h"
+
+#include <stdint.h>
+
+using namespace kanon;
+
+namespace http {
+
+static void SplitFields(StringView line, std::vector<StringView>& fields)
+{
+  StringView::size_type i = 0;
+  const auto n = line.size();
+
+  while (i < n) {
+    while (i < n && (line[i] == ' ' || line[i] == '\t')) ++i;
+
+    auto begin = i;
+    while (i < n && line[i] != ' ' && line[i] != '\t') ++i;
+
+    if (i > begin) {
+      fields.push_back(line.substr_range(begin, i));
+    }
+  }
+}
+
+static bool ParseMethods(StringView methods, unsigned& mask)
+{
+  mask = 0;
+
+  if (methods == "*") {
+    for (int m = static_cast<int>(HttpMethod::kGet); m < static_cast<int>(HttpMethod::kNum); ++m) {
+      mask |= 1u << m;
+    }
+    return true;
+  }
+
+  while (!methods.empty()) {
+    auto comma_pos = methods.find(',');
+    auto method = methods.substr(0, comma_pos);
+    bool found = false;
+
+    for (int m = static_cast<int>(HttpMethod::kGet); m < static_cast<int>(HttpMethod::kNum); ++m) {
+      if (method == GetMethodString(static_cast<HttpMethod>(m))) {
+        mask |= 1u << m;
+        found = true;
+        break;
+      }
+    }
+
+    if (!found) return false;
+    if (comma_pos == StringView::npos) break;
+
+    methods.remove_prefix(comma_pos+1);
+  }
+
+  return mask != 0;
+}
+
+size_t Router::SegmentHash::operator()(StringView segment) const noexcept
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (auto c : segment) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+
+  return static_cast<size_t>(hash);
+}
+
+Router::Router() = default;
+Router::~Router() noexcept = default;
+
+Route* Router::AddRoute(StringView line, std::string& error)
+{
+  std::vector<StringView> fields;
+  SplitFields(line, fields);
+
+  if (fields.size() != 4) {
+    error = "The route must be <methods> <pattern> <plugin|static|fastcgi|proxy> <target>";
+    return nullptr;
+  }
+
+  std::unique_ptr<Route> route(new Route());
+
+  if (!ParseMethods(fields[0], route->methods)) {
+    error = "Invalid methods: " + fields[0].ToString();
+    return nullptr;
+  }
+
+  if (fields[2] == "plugin") {
+    route->kind = Route::kPlugin;
+  }
+  else if (fields[2] == "static") {
+    route->kind = Route::kStatic;
+  }
+  else if (fields[2] == "fastcgi") {
+    route->kind = Route::kFastCgi;
+  }
+  else if (fields[2] == "proxy") {
+    route->kind = Route::kProxy;
+  }
+  else {
+    error = "The handler must be plugin, static, fastcgi or proxy: " + fields[2].ToString();
+    return nullptr;
+  }
+
+  route->target = fields[3].ToString();
+
+  auto pattern = fields[1];
+  route->pattern = pattern.ToString();
+
+  if (pattern.empty() || pattern[0] != '/') {
+    error = "The pattern must start with /: " + route->pattern;
+    return nullptr;
+  }
+
+  Node* node = &root_;
+  bool is_prefix = false;
+
+  while (!pattern.empty()) {
+    auto slash_pos = pattern.find('/');
+    auto segment = pattern.substr(0, slash_pos);
+    pattern.remove_prefix(slash_pos == StringView::npos ? pattern.size() : slash_pos+1);
+
+    // Ignore the redundant slashes
+    if (segment.empty()) continue;
+
+    if (segment == "*") {
+      if (!pattern.empty()) {
+        error = "The * must be the last segment: " + route->pattern;
+        return nullptr;
+      }
+
+      is_prefix = true;
+      break;
+    }
+
+    if (segment[0] == ':') {
+      segment.remove_prefix(1);
+
+      if (segment.empty()) {
+        error = "The parameter name is empty: " + route->pattern;
+        return nullptr;
+      }
+
+      if (!node->param_child) {
+        node->param_child.reset(new Node());
+        node->param_child->param_name = segment.ToString();
+      }
+      else if (node->param_child->param_name != segment) {
+        error = "The parameter :" + segment.ToString() + " conflicts with :" +
+                node->param_child->param_name + ": " + route->pattern;
+        return nullptr;
+      }
+
+      node = node->param_child.get();
+      continue;
+    }
+
+    auto iter = node->children.find(segment);
+
+    if (iter == node->children.end()) {
+      std::unique_ptr<Node> child(new Node());
+      child->segment = segment.ToString();
+
+      // The key refers to the segment owned by child
+      StringView key(child->segment);
+      iter = node->children.emplace(key, std::move(child)).first;
+    }
+
+    node = iter->second.get();
+  }
+
+  auto& routes = is_prefix ? node->prefix_routes : node->exact_routes;
+
+  for (auto other : routes) {
+    if (other->methods & route->methods) {
+      error = "The pattern " + route->pattern + " conflicts with " + other->pattern;
+      return nullptr;
+    }
+  }
+
+  routes.push_back(route.get());
+  routes_.push_back(std::move(route));
+  return routes_.back().get();
+}
+
+Route* Router::Find(std::vector<Route*> const& routes, HttpMethod method) noexcept
+{
+  for (auto route : routes) {
+    if (route->Accept(method)) {
+      return route;
+    }
+  }
+
+  return nullptr;
+}
+
+bool Router::Match(HttpMethod method, StringView path, RouteMatch& match) const
+{
+  match.Reset();
+
+  if (path.empty() || path[0] != '/') {
+    return false;
+  }
+
+  Node const* node = &root_;
+  const auto n = path.size();
+  StringView::size_type i = 0;
+
+  // The longest prefix route on the way
+  Route* prefix_route = nullptr;
+  StringView prefix_rest;
+  size_t prefix_params = 0;
+
+  for (;;) {
+    auto route = Find(node->prefix_routes, method);
+
+    if (route) {
+      prefix_route = route;
+      prefix_rest = path.substr(i);
+      prefix_params = match.params.size();
+    }
+
+    while (i < n && path[i] == '/') ++i;
+    if (i == n) break;
+
+    auto end = path.find('/', i);
+    if (end == StringView::npos) end = n;
+
+    auto segment = path.substr_range(i, end);
+    auto iter = node->children.find(segment);
+
+    if (iter != node->children.end()) {
+      node = iter->second.get();
+    }
+    else if (node->param_child) {
+      node = node->param_child.get();
+      match.params.emplace_back(StringView(node->param_name), segment);
+    }
+    else {
+      node = nullptr;
+      break;
+    }
+
+    i = end;
+  }
+
+  if (node) {
+    match.route = Find(node->exact_routes, method);
+
+    if (match.route) {
+      return true;
+    }
+  }
+
+  if (prefix_route) {
+    match.route = prefix_route;
+    match.rest = prefix_rest;
+    match.params.erase(match.params.begin() + prefix_params, match.params.end());
+    return true;
+  }
+
+  match.params.clear();
+  return false;
+}
+
+} // namespace http
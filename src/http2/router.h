@@ -0,0 +1,156 @@
+#ifndef KANON_HTTP_ROUTER_H
+#define KANON_HTTP_ROUTER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <kanon/string/string_view.h>
+#include <kanon/util/noncopyable.h>
+
+#include "common/http_constant.h"
+#include "http2/plugin_registry.h"
+
+namespace http {
+
+/**
+ * The handler of the URLs matched by a route pattern.
+ */
+struct Route {
+  enum Kind {
+    kPlugin = 0,
+    kStatic,
+    kFastCgi,
+    kProxy,
+  };
+
+  Kind kind = kPlugin;
+
+  /** Bit (1 << HttpMethod) is set if the method is accepted */
+  unsigned methods = 0;
+
+  /** The pattern in the config, for logging */
+  std::string pattern;
+
+  /**
+   * The path of plugin(shared object) or static root, the address
+   * of FastCGI application(ip:port) or the upstream servers of proxy
+   * (ip:port[,ip:port...]).
+   * The static root of prefix route is a directory, the matched
+   * URL without the prefix is appended to it.
+   */
+  std::string target;
+
+  /** Resolved by the server at startup, kept resident */
+  PluginRegistry::PluginPtr plugin;
+
+  bool Accept(HttpMethod method) const noexcept
+  { return methods & (1u << static_cast<unsigned>(method)); }
+};
+
+/**
+ * The result of Router::Match().
+ * The views refer to the path passed to Match().
+ */
+struct RouteMatch {
+  using Param = std::pair<kanon::StringView, kanon::StringView>;
+
+  Route* route = nullptr;
+
+  /** The part of path matched by the trailing * of prefix route */
+  kanon::StringView rest;
+
+  /** The values of :name segments */
+  std::vector<Param> params;
+
+  void Reset() noexcept
+  {
+    route = nullptr;
+    rest = kanon::StringView();
+    params.clear();
+  }
+};
+
+/**
+ * Map the method and path to the handler.
+ *
+ * The routes are compiled to a trie of path segments at startup,
+ * the following patterns are supported:
+ * 1. Exact: /api/status
+ * 2. Prefix: the last segment is *, e.g. the prefix /assets matches
+ *    itself and all paths under it
+ * 3. Parameter: /api/users/:id, the segment is captured as id
+ *
+ * The static segment takes precedence over the parameter, and the
+ * exact route over the prefix route. Match() doesn't backtrack, so
+ * it costs O(length of path) without filesystem access.
+ *
+ * The router is built before serving and read-only afterwards,
+ * so it can be shared by the IO threads without locking.
+ */
+class Router : kanon::noncopyable {
+ public:
+  Router();
+  ~Router() noexcept;
+
+  /**
+   * Add the route described by \p line:
+   *   <methods> <pattern> <plugin|static|fastcgi|proxy> <target>
+   * e.g.
+   *   GET,POST /api/users/:id plugin contents/user
+   *   GET /favicon.ico static /var/www/favicon.ico
+   *   POST /app.php fastcgi 127.0.0.1:9000
+   *   GET /api/orders proxy 127.0.0.1:8080,127.0.0.1:8081
+   * The methods is a comma-separated list, * means all methods.
+   *
+   * \param error Set the error message if failed
+   * \return The added route, nullptr if \p line is invalid or
+   *         the pattern conflicts with other route
+   */
+  Route* AddRoute(kanon::StringView line, std::string& error);
+
+  /**
+   * Match the \p path(without query string)
+   * \return false if no route accepts it
+   */
+  bool Match(HttpMethod method, kanon::StringView path, RouteMatch& match) const;
+
+  bool IsEmpty() const noexcept { return routes_.empty(); }
+  size_t GetSize() const noexcept { return routes_.size(); }
+
+  std::vector<std::unique_ptr<Route>> const& GetRoutes() const noexcept
+  { return routes_; }
+
+ private:
+  struct SegmentHash {
+    size_t operator()(kanon::StringView segment) const noexcept;
+  };
+
+  struct Node {
+    /** The static segment, the key of children of parent refers to it */
+    std::string segment;
+
+    /** Look up by the view of path, avoid constructing std::string */
+    std::unordered_map<kanon::StringView, std::unique_ptr<Node>, SegmentHash> children;
+
+    /** The :name segment */
+    std::unique_ptr<Node> param_child;
+    std::string param_name;
+
+    /** Routes end with this node, at most one per method */
+    std::vector<Route*> exact_routes;
+    /** Routes end with * after this node */
+    std::vector<Route*> prefix_routes;
+  };
+
+  static Route* Find(std::vector<Route*> const& routes, HttpMethod method) noexcept;
+
+  Node root_;
+  std::vector<std::unique_ptr<Route>> routes_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_ROUTER_H
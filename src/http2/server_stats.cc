@@ -0,0 +1,144 @@
+#include "http2/server_stats.h"
+
+#include <new>
+#include <stdio.h>
+#include <sys/mman.h>
+
+namespace http {
+
+template<typename T>
+static void RenderLine(std::string& out, char const* name, std::atomic<T> const& val)
+{
+  char buf[128];
+  ::snprintf(buf, sizeof buf, "%s %lld\n", name,
+             static_cast<long long>(val.load(std::memory_order_relaxed)));
+  out += buf;
+}
+
+void ServerStats::Render(std::string& out) const
+{
+  RenderLine(out, "kanon_httpd_accepted_connections", accepted_connections);
+  RenderLine(out, "kanon_httpd_active_connections", active_connections);
+  RenderLine(out, "kanon_httpd_shed_global_cap", shed_global_cap);
+  RenderLine(out, "kanon_httpd_shed_loop_cap", shed_loop_cap);
+  RenderLine(out, "kanon_httpd_shed_overload", shed_overload);
+  RenderLine(out, "kanon_httpd_closed_over_limit", closed_over_limit);
+  RenderLine(out, "kanon_httpd_buffers_trimmed", buffers_trimmed);
+  RenderLine(out, "kanon_httpd_requests", requests);
+  RenderLine(out, "kanon_httpd_blocking_tasks", blocking_tasks);
+  RenderLine(out, "kanon_httpd_blocking_rejected", blocking_rejected);
+  RenderLine(out, "kanon_httpd_blocking_queue_wait_us", blocking_queue_wait_us);
+  RenderLine(out, "kanon_httpd_blocking_queue_length", blocking_queue_length);
+  RenderLine(out, "kanon_httpd_plugin_cache_hits", plugin_cache_hits);
+  RenderLine(out, "kanon_httpd_plugin_cache_stale", plugin_cache_stale);
+  RenderLine(out, "kanon_httpd_plugin_cache_misses", plugin_cache_misses);
+  RenderLine(out, "kanon_httpd_plugin_cache_coalesced", plugin_cache_coalesced);
+  RenderLine(out, "kanon_httpd_fastcgi_requests", fastcgi_requests);
+  RenderLine(out, "kanon_httpd_fastcgi_failures", fastcgi_failures);
+  RenderLine(out, "kanon_httpd_proxy_requests", proxy_requests);
+  RenderLine(out, "kanon_httpd_proxy_reused", proxy_reused);
+  RenderLine(out, "kanon_httpd_proxy_failures", proxy_failures);
+  RenderLine(out, "kanon_httpd_proxy_closed_over_limit", proxy_closed_over_limit);
+  RenderLine(out, "kanon_httpd_http2_connections", http2_connections);
+  RenderLine(out, "kanon_httpd_http2_streams", http2_streams);
+  RenderLine(out, "kanon_httpd_http2_streams_reset", http2_streams_reset);
+  RenderLine(out, "kanon_httpd_tls_handshakes", tls_handshakes);
+  RenderLine(out, "kanon_httpd_tls_resumed", tls_resumed);
+  RenderLine(out, "kanon_httpd_tls_kernel_offload", tls_kernel_offload);
+  RenderLine(out, "kanon_httpd_tls_failures", tls_failures);
+  RenderLine(out, "kanon_httpd_websocket_connections", websocket_connections);
+  RenderLine(out, "kanon_httpd_websocket_messages", websocket_messages);
+  RenderLine(out, "kanon_httpd_websocket_closed_slow", websocket_closed_slow);
+}
+
+template<typename T>
+static void AddTo(std::atomic<T>& dst, std::atomic<T> const& src) noexcept
+{
+  dst.fetch_add(src.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void ServerStats::Accumulate(ServerStats const& other) noexcept
+{
+  AddTo(accepted_connections, other.accepted_connections);
+  AddTo(active_connections, other.active_connections);
+  AddTo(shed_global_cap, other.shed_global_cap);
+  AddTo(shed_loop_cap, other.shed_loop_cap);
+  AddTo(shed_overload, other.shed_overload);
+  AddTo(closed_over_limit, other.closed_over_limit);
+  AddTo(buffers_trimmed, other.buffers_trimmed);
+  AddTo(requests, other.requests);
+  AddTo(blocking_tasks, other.blocking_tasks);
+  AddTo(blocking_rejected, other.blocking_rejected);
+  AddTo(blocking_queue_wait_us, other.blocking_queue_wait_us);
+  AddTo(blocking_queue_length, other.blocking_queue_length);
+  AddTo(plugin_cache_hits, other.plugin_cache_hits);
+  AddTo(plugin_cache_stale, other.plugin_cache_stale);
+  AddTo(plugin_cache_misses, other.plugin_cache_misses);
+  AddTo(plugin_cache_coalesced, other.plugin_cache_coalesced);
+  AddTo(fastcgi_requests, other.fastcgi_requests);
+  AddTo(fastcgi_failures, other.fastcgi_failures);
+  AddTo(proxy_requests, other.proxy_requests);
+  AddTo(proxy_reused, other.proxy_reused);
+  AddTo(proxy_failures, other.proxy_failures);
+  AddTo(proxy_closed_over_limit, other.proxy_closed_over_limit);
+  AddTo(http2_connections, other.http2_connections);
+  AddTo(http2_streams, other.http2_streams);
+  AddTo(http2_streams_reset, other.http2_streams_reset);
+  AddTo(tls_handshakes, other.tls_handshakes);
+  AddTo(tls_resumed, other.tls_resumed);
+  AddTo(tls_kernel_offload, other.tls_kernel_offload);
+  AddTo(tls_failures, other.tls_failures);
+  AddTo(websocket_connections, other.websocket_connections);
+  AddTo(websocket_messages, other.websocket_messages);
+  AddTo(websocket_closed_slow, other.websocket_closed_slow);
+}
+
+void ServerStats::ResetGauges() noexcept
+{
+  active_connections.store(0, std::memory_order_relaxed);
+  blocking_queue_length.store(0, std::memory_order_relaxed);
+}
+
+SharedStatsTable::SharedStatsTable(int n)
+  : stats_(nullptr)
+  , n_(n)
+{
+  void* addr = ::mmap(NULL, sizeof(ServerStats) * n, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (addr == MAP_FAILED) {
+    throw SharedStatsException("Failed to map the shared memory of stats");
+  }
+
+  // The atomics are lock-free, so they work across processes
+  stats_ = static_cast<ServerStats*>(addr);
+  for (int i = 0; i < n_; ++i) {
+    new (stats_ + i) ServerStats();
+  }
+}
+
+SharedStatsTable::~SharedStatsTable() noexcept
+{
+  for (int i = 0; i < n_; ++i) {
+    stats_[i].~ServerStats();
+  }
+
+  ::munmap(stats_, sizeof(ServerStats) * n_);
+}
+
+void SharedStatsTable::Render(std::string& out) const
+{
+  ServerStats total;
+
+  for (int i = 0; i < n_; ++i) {
+    total.Accumulate(stats_[i]);
+  }
+
+  total.Render(out);
+
+  char buf[64];
+  ::snprintf(buf, sizeof buf, "kanon_httpd_workers %d\n", n_);
+  out += buf;
+}
+
+} // namespace http
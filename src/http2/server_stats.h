@@ -0,0 +1,139 @@
+#ifndef KANON_HTTP_SERVER_STATS_H
+#define KANON_HTTP_SERVER_STATS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include <kanon/util/noncopyable.h>
+
+#include "util/exception_macro.h"
+
+namespace http {
+
+/**
+ * Counters maintained by the server.
+ * All fields are lock-free atomics and only updated with relaxed
+ * ordering, the values are used for monitoring only.
+ */
+struct ServerStats {
+  using Counter = std::atomic<uint64_t>;
+  using Gauge = std::atomic<int64_t>;
+
+  Counter accepted_connections{0};
+  Gauge active_connections{0};
+
+  /** Connections rejected with 503 since the global cap is reached */
+  Counter shed_global_cap{0};
+  /** Connections rejected with 503 since the cap of the IO loop is reached */
+  Counter shed_loop_cap{0};
+  /** Connections rejected with 503 since the IO loop is overloaded */
+  Counter shed_overload{0};
+
+  /** Connections closed since the buffered bytes exceed the limit */
+  Counter closed_over_limit{0};
+
+  /** Buffers of idle connections shrunk to IdleBufferSize */
+  Counter buffers_trimmed{0};
+
+  Counter requests{0};
+
+  /** Requests of blocking plugins run by the worker pool */
+  Counter blocking_tasks{0};
+  /** Requests of blocking plugins rejected with 503 since the queue is full */
+  Counter blocking_rejected{0};
+  /** Sum of the time spent in the queue, divide it by blocking_tasks */
+  Counter blocking_queue_wait_us{0};
+  Gauge blocking_queue_length{0};
+
+  /** Responses of plugins served from the cache */
+  Counter plugin_cache_hits{0};
+  /** Stale responses served while refreshed in background */
+  Counter plugin_cache_stale{0};
+  Counter plugin_cache_misses{0};
+  /** Misses waiting for the identical one instead of running the plugin */
+  Counter plugin_cache_coalesced{0};
+
+  /** Requests proxied to the FastCGI applications */
+  Counter fastcgi_requests{0};
+  /** Requests failed with 502/503 since the application is down or busy */
+  Counter fastcgi_failures{0};
+
+  /** Requests forwarded to the upstream servers of proxy routes */
+  Counter proxy_requests{0};
+  /** Requests served by the idle keep-alive upstream connections */
+  Counter proxy_reused{0};
+  /** Requests failed with 502 since the upstream is down or fails */
+  Counter proxy_failures{0};
+  /** Requests aborted since the client can't keep up with the upstream */
+  Counter proxy_closed_over_limit{0};
+
+  /** Connections switched to HTTP/2 */
+  Counter http2_connections{0};
+  /** Streams(requests) of HTTP/2, also counted in requests */
+  Counter http2_streams{0};
+  /** Streams reset by the server, e.g. refused or the route needs HTTP/1.1 */
+  Counter http2_streams_reset{0};
+
+  /** TLS handshakes completed, including the resumed ones */
+  Counter tls_handshakes{0};
+  /** Handshakes resumed by the session tickets */
+  Counter tls_resumed{0};
+  /** Connections whose sending side is encrypted by the kernel */
+  Counter tls_kernel_offload{0};
+  /** Connections closed since the handshake or record is invalid */
+  Counter tls_failures{0};
+
+  /** Connections upgraded to WebSocket */
+  Counter websocket_connections{0};
+  /** Messages received by WebSocket, the fragments are counted once */
+  Counter websocket_messages{0};
+  /** WebSocket connections closed since the buffered frames exceed the limit */
+  Counter websocket_closed_slow{0};
+
+  /**
+   * Render the counters in the "name value" line format,
+   * which is also accepted by the Prometheus text collector.
+   */
+  void Render(std::string& out) const;
+
+  /** Add the values of \p other to this */
+  void Accumulate(ServerStats const& other) noexcept;
+
+  /**
+   * Reset the gauges, e.g. the process which updates them is dead
+   */
+  void ResetGauges() noexcept;
+};
+
+DEFINE_EXCEPTION_FROM_OTHER(SharedStatsException, std::runtime_error);
+
+/**
+ * The counters of the worker processes.
+ * Stored in the anonymous shared memory which is mapped before
+ * fork(), then the master and workers can access them.
+ */
+class SharedStatsTable : kanon::noncopyable {
+ public:
+  explicit SharedStatsTable(int n);
+  ~SharedStatsTable() noexcept;
+
+  ServerStats& operator[](int i) noexcept { return stats_[i]; }
+  ServerStats const& operator[](int i) const noexcept { return stats_[i]; }
+
+  int GetSize() const noexcept { return n_; }
+
+  /** Render the sum of the counters of all workers */
+  void Render(std::string& out) const;
+
+ private:
+  ServerStats* stats_;
+  int n_;
+};
+
+inline void Increment(ServerStats::Counter& counter) noexcept
+{ counter.fetch_add(1, std::memory_order_relaxed); }
+
+} // namespace http
+
+#endif // KANON_HTTP_SERVER_STATS_H
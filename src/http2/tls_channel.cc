@@ -0,0 +1,307 @@
+#include "http2/tls_channel.h"
+
+#ifdef KANON_HTTP_TLS
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <kanon/log/logger.h>
+
+using namespace kanon;
+
+namespace http {
+
+#ifdef KANON_HTTP_KTLS
+// The ctrls setting up kTLS are internal to OpenSSL(include/internal/bio.h),
+// they are forwarded to the socket BIO which calls setsockopt().
+// Only enabled for the verified releases, see KANON_HTTP_KTLS.
+static constexpr int kCtrlSetKtls = 72;
+static constexpr int kCtrlSetKtlsSendCtrlMsg = 74;
+static constexpr int kCtrlClearKtlsCtrlMsg = 75;
+#endif
+
+BIO_METHOD* TlsChannel::GetBioMethod()
+{
+  static BIO_METHOD* const method = []() {
+    auto m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "kanon connection");
+    BIO_meth_set_create(m, &TlsChannel::BioCreate);
+    BIO_meth_set_write(m, &TlsChannel::BioWrite);
+    BIO_meth_set_read(m, &TlsChannel::BioRead);
+    BIO_meth_set_ctrl(m, &TlsChannel::BioCtrl);
+    return m;
+  }();
+
+  return method;
+}
+
+TlsChannel::TlsChannel(TlsContext const& context, int fd, OutputCallback output)
+  : ssl_(SSL_new(context.GetContext()))
+  , output_(std::move(output))
+{
+  auto bio = BIO_new(GetBioMethod());
+  BIO_set_data(bio, this);
+  SSL_set_bio(ssl_, bio, bio);
+  SSL_set_accept_state(ssl_);
+
+#ifdef KANON_HTTP_KTLS
+  if (fd >= 0 && (SSL_get_options(ssl_) & SSL_OP_ENABLE_KTLS)) {
+    socket_bio_ = BIO_new_socket(fd, BIO_NOCLOSE);
+  }
+#else
+  (void)fd;
+#endif
+}
+
+TlsChannel::~TlsChannel() noexcept
+{
+  SSL_free(ssl_);
+  BIO_free(socket_bio_);
+}
+
+void TlsChannel::Shutdown()
+{
+  if (loop_ && !loop_->IsLoopInThread()) {
+    auto self = shared_from_this();
+
+    loop_->QueueToLoop([self]() {
+      self->Shutdown();
+    });
+    return;
+  }
+
+  if (!handshake_done_ || (SSL_get_shutdown(ssl_) & SSL_SENT_SHUTDOWN)) {
+    return;
+  }
+
+  // Don't wait for the close_notify of peer, the FIN follows
+  if (SSL_shutdown(ssl_) < 0) {
+    LogTlsError("Failed to send the close_notify");
+  }
+}
+
+bool TlsChannel::OnMessage(Buffer& input)
+{
+  records_ = input.ToStringView();
+  const size_t size = records_.size();
+
+  bool ok = handshake_done_ || DoHandshake();
+
+  // The request may follow the Finished
+  if (ok && handshake_done_) {
+    ok = ReadRecords();
+  }
+
+  input.AdvanceRead(size - records_.size());
+  records_ = StringView();
+  return ok;
+}
+
+bool TlsChannel::DoHandshake()
+{
+  const int ret = SSL_do_handshake(ssl_);
+
+  if (ret == 1) {
+    handshake_done_ = true;
+
+    if (!early_output_.empty()) {
+      std::string output;
+      output.swap(early_output_);
+      Send(output);
+    }
+
+    return true;
+  }
+
+  switch (SSL_get_error(ssl_, ret)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      return true;
+    default:
+      LogTlsError("TLS handshake failed");
+      return false;
+  }
+}
+
+bool TlsChannel::ReadRecords()
+{
+  char buf[16 << 10];
+
+  for (;;) {
+    const int n = SSL_read(ssl_, buf, sizeof buf);
+
+    if (n > 0) {
+      input_.Append(buf, n);
+      continue;
+    }
+
+    switch (SSL_get_error(ssl_, n)) {
+      case SSL_ERROR_WANT_READ:
+      case SSL_ERROR_WANT_WRITE:
+      // close_notify, the FIN follows
+      case SSL_ERROR_ZERO_RETURN:
+        return true;
+      default:
+        LogTlsError("Failed to read the TLS record");
+        return false;
+    }
+  }
+}
+
+void TlsChannel::Send(StringView data)
+{
+  // The SSL can't be used by multiple threads,
+  // e.g. the response of blocking plugin
+  if (loop_ && !loop_->IsLoopInThread()) {
+    auto self = shared_from_this();
+    std::string copy(data.data(), data.size());
+
+    loop_->QueueToLoop([self, copy]() {
+      self->Send(copy);
+    });
+    return;
+  }
+
+  if (!handshake_done_) {
+    early_output_.append(data.data(), data.size());
+    return;
+  }
+
+  if (IsKernelOffload()) {
+    output_pending_ = !output_(data);
+    return;
+  }
+
+  // The BIO never blocks, all bytes are written
+  while (!data.empty()) {
+    const int n = SSL_write(ssl_, data.data(), std::min<size_t>(data.size(), INT_MAX));
+
+    if (n <= 0) {
+      LogTlsError("Failed to write the TLS record");
+      return;
+    }
+
+    data.remove_prefix(n);
+  }
+}
+
+void TlsChannel::OnOutputDrained() noexcept
+{
+  output_pending_ = false;
+}
+
+bool TlsChannel::IsKernelOffload() const noexcept
+{
+#ifdef KANON_HTTP_KTLS
+  return socket_bio_ && BIO_get_ktls_send(socket_bio_);
+#else
+  return false;
+#endif
+}
+
+bool TlsChannel::IsSessionReused() const noexcept
+{
+  return SSL_session_reused(ssl_) == 1;
+}
+
+StringView TlsChannel::GetAlpn() const noexcept
+{
+  unsigned char const* data = nullptr;
+  unsigned len = 0;
+  SSL_get0_alpn_selected(ssl_, &data, &len);
+
+  return StringView(reinterpret_cast<char const*>(data), len);
+}
+
+int TlsChannel::BioCreate(BIO* bio)
+{
+  BIO_set_init(bio, 1);
+  return 1;
+}
+
+int TlsChannel::BioWrite(BIO* bio, char const* data, int len)
+{
+  auto channel = static_cast<TlsChannel*>(BIO_get_data(bio));
+  BIO_clear_retry_flags(bio);
+
+  // After the kernel offload is set up, the records other than the
+  // application data(e.g. the session ticket and alert) are passed
+  // with the record type by the socket BIO
+  if (channel->IsKernelOffload()) {
+    // The record would be sent ahead of the data buffered by the connection,
+    // e.g. close_notify before the end of response. Fail the connection instead.
+    if (channel->output_pending_) {
+      LOG_WARN << "The TLS control record can't be sent before the buffered data";
+      return -1;
+    }
+
+    const int n = BIO_write(channel->socket_bio_, data, len);
+
+    if (n <= 0 && BIO_should_retry(channel->socket_bio_)) {
+      BIO_set_retry_write(bio);
+    }
+
+    return n;
+  }
+
+  channel->output_pending_ = !channel->output_(StringView(data, len));
+  return len;
+}
+
+int TlsChannel::BioRead(BIO* bio, char* buf, int len)
+{
+  auto channel = static_cast<TlsChannel*>(BIO_get_data(bio));
+  auto& records = channel->records_;
+  BIO_clear_retry_flags(bio);
+
+  if (records.empty()) {
+    BIO_set_retry_read(bio);
+    return -1;
+  }
+
+  const size_t n = std::min<size_t>(len, records.size());
+  ::memcpy(buf, records.data(), n);
+  records.remove_prefix(n);
+  return n;
+}
+
+long TlsChannel::BioCtrl(BIO* bio, int cmd, long num, void* ptr)
+{
+  auto channel = static_cast<TlsChannel*>(BIO_get_data(bio));
+
+  switch (cmd) {
+    case BIO_CTRL_FLUSH:
+    case BIO_CTRL_DUP:
+      return 1;
+    case BIO_CTRL_PENDING:
+      return channel->records_.size();
+    case BIO_CTRL_WPENDING:
+      return 0;
+
+#ifdef KANON_HTTP_KTLS
+    case kCtrlSetKtls:
+      // The receiving side isn't offloaded, see the class comment.
+      // If the records are buffered by the connection, they would be
+      // encrypted again by the kernel, OpenSSL keeps building the records then
+      if (num == 0 || !channel->socket_bio_ || channel->output_pending_) return 0;
+      return BIO_ctrl(channel->socket_bio_, cmd, num, ptr);
+
+    case BIO_CTRL_GET_KTLS_SEND:
+    case kCtrlSetKtlsSendCtrlMsg:
+    case kCtrlClearKtlsCtrlMsg:
+      return channel->socket_bio_ ? BIO_ctrl(channel->socket_bio_, cmd, num, ptr) : 0;
+#endif
+
+    default:
+      return 0;
+  }
+}
+
+} // namespace http
+
+#endif // KANON_HTTP_TLS
@@ -0,0 +1,123 @@
+#ifndef KANON_HTTP_TLS_CHANNEL_H
+#define KANON_HTTP_TLS_CHANNEL_H
+
+#include <functional>
+#include <memory>
+
+#include <kanon/net/buffer.h>
+#include <kanon/net/event_loop.h>
+#include <kanon/string/string_view.h>
+#include <kanon/util/noncopyable.h>
+
+#include "http2/tls_context.h"
+
+typedef struct ssl_st SSL;
+typedef struct bio_st BIO;
+typedef struct bio_method_st BIO_METHOD;
+
+namespace http {
+
+/**
+ * The TLS of a connection, the records are read from the input buffer
+ * and written to the connection by a BIO, so the event loop owns the
+ * socket as the plaintext connections.
+ *
+ * The decrypted data is appended to GetInputBuffer(), which is parsed
+ * instead of the input buffer of connection.
+ *
+ * If the kernel offload is enabled and supported, the sending side is
+ * handed to the kernel(kTLS) after the handshake: Send() writes the
+ * plaintext to the socket and the kernel builds the records, so the
+ * file contents are not copied to the user space for the encryption.
+ * The receiving side is always decrypted by OpenSSL, the requests are
+ * small and the records read before the switch can't be handed over.
+ */
+class TlsChannel : public std::enable_shared_from_this<TlsChannel>
+                 , kanon::noncopyable {
+ public:
+  /**
+   * Send the bytes to the peer
+   * \return true if all bytes are written to the socket, i.e. nothing is buffered
+   */
+  using OutputCallback = std::function<bool(kanon::StringView data)>;
+
+  /**
+   * \param fd The socket, the kernel offload is set up on it. -1 to disable it
+   * \param output Write the records, or the plaintext if the kernel encrypts it
+   */
+  TlsChannel(TlsContext const& context, int fd, OutputCallback output);
+  ~TlsChannel() noexcept;
+
+  /** Send() called in the other threads is queued to \p loop */
+  void SetLoop(kanon::EventLoop* loop) noexcept { loop_ = loop; }
+
+  /**
+   * Handle the records in \p input, all bytes are consumed and
+   * the incomplete record is kept by OpenSSL.
+   * The decrypted data is appended to GetInputBuffer().
+   * \return false if the handshake failed or the record is invalid,
+   *         the connection must be closed
+   */
+  bool OnMessage(kanon::Buffer& input);
+
+  kanon::Buffer& GetInputBuffer() noexcept { return input_; }
+
+  /** Encrypt \p data and send it, or queued until the handshake is done */
+  void Send(kanon::StringView data);
+
+  /**
+   * Send the close_notify, the connection can be shut down then.
+   * Nothing is sent if the handshake is not done.
+   */
+  void Shutdown();
+
+  bool IsHandshakeDone() const noexcept { return handshake_done_; }
+
+  /** The output buffer of connection is drained, called in the loop */
+  void OnOutputDrained() noexcept;
+
+  /** The sending side is encrypted by the kernel */
+  bool IsKernelOffload() const noexcept;
+  bool IsSessionReused() const noexcept;
+
+  /** The protocol selected by ALPN, empty if not negotiated */
+  kanon::StringView GetAlpn() const noexcept;
+
+ private:
+  static BIO_METHOD* GetBioMethod();
+  static int BioCreate(BIO* bio);
+  static int BioWrite(BIO* bio, char const* data, int len);
+  static int BioRead(BIO* bio, char* buf, int len);
+  static long BioCtrl(BIO* bio, int cmd, long num, void* ptr);
+
+  /** \return false if failed */
+  bool DoHandshake();
+  bool ReadRecords();
+
+  SSL* ssl_;
+  /** Write to the socket directly after the kernel offload is set up */
+  BIO* socket_bio_ = nullptr;
+
+  OutputCallback output_;
+  /** Some bytes are buffered by the connection */
+  bool output_pending_ = false;
+
+  kanon::EventLoop* loop_ = nullptr;
+
+  /** The records unread in the input buffer of connection */
+  kanon::StringView records_;
+
+  /** The decrypted data */
+  kanon::Buffer input_;
+
+  /** The data sent before the handshake is done */
+  std::string early_output_;
+
+  bool handshake_done_ = false;
+};
+
+using TlsChannelPtr = std::shared_ptr<TlsChannel>;
+
+} // namespace http
+
+#endif // KANON_HTTP_TLS_CHANNEL_H
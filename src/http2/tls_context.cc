@@ -0,0 +1,114 @@
+#include "http2/tls_context.h"
+
+#ifdef KANON_HTTP_TLS
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <kanon/log/logger.h>
+
+#include "config/http_config.h"
+
+namespace http {
+
+/**
+ * The protocols in the order of preference(length-prefixed),
+ * the first one offered by the client is selected
+ */
+static int SelectAlpn(SSL* ssl, unsigned char const** out, unsigned char* outlen,
+                      unsigned char const* in, unsigned int inlen, void* arg)
+{
+  static unsigned char const kHttp2[] = "\x02h2\x08http/1.1";
+  static unsigned char const kHttp11[] = "\x08http/1.1";
+
+  auto protos = g_config.enable_http2 ? kHttp2 : kHttp11;
+  const unsigned protos_len = g_config.enable_http2 ? sizeof(kHttp2) - 1 : sizeof(kHttp11) - 1;
+
+  unsigned char* selected = nullptr;
+  unsigned char selected_len = 0;
+
+  if (SSL_select_next_proto(&selected, &selected_len, protos, protos_len, in, inlen) !=
+      OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  *out = selected;
+  *outlen = selected_len;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+void LogTlsError(char const* what)
+{
+  char buf[256];
+  unsigned long error;
+
+  while ((error = ERR_get_error()) != 0) {
+    ERR_error_string_n(error, buf, sizeof buf);
+    LOG_ERROR << what << ": " << buf;
+  }
+}
+
+TlsContext::TlsContext()
+{
+}
+
+TlsContext::~TlsContext() noexcept
+{
+  SSL_CTX_free(ctx_);
+}
+
+bool TlsContext::Load(std::string const& certificate, std::string const& private_key,
+                      int session_timeout, bool kernel_offload)
+{
+  ctx_ = SSL_CTX_new(TLS_server_method());
+
+  if (!ctx_) {
+    LogTlsError("Failed to create the SSL_CTX");
+    return false;
+  }
+
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+
+  uint64_t options = SSL_OP_NO_RENEGOTIATION | SSL_OP_NO_COMPRESSION |
+                     SSL_OP_CIPHER_SERVER_PREFERENCE;
+
+  if (kernel_offload) {
+#ifdef KANON_HTTP_KTLS
+    options |= SSL_OP_ENABLE_KTLS;
+#else
+    LOG_WARN << "kTLS is not supported with this OpenSSL(" << OPENSSL_VERSION_TEXT
+             << "), the records are built by it";
+#endif
+  }
+
+  SSL_CTX_set_options(ctx_, options);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx_, certificate.c_str()) != 1) {
+    LogTlsError("Failed to load the certificate");
+    return false;
+  }
+
+  if (SSL_CTX_use_PrivateKey_file(ctx_, private_key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    LogTlsError("Failed to load the private key");
+    return false;
+  }
+
+  // The session state is kept in the tickets, no cache is shared
+  // between the IO loops and workers
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_OFF);
+  SSL_CTX_set_timeout(ctx_, session_timeout);
+  SSL_CTX_set_num_tickets(ctx_, 1);
+
+  SSL_CTX_set_alpn_select_cb(ctx_, &SelectAlpn, nullptr);
+
+  // The buffers of idle connections are freed
+  SSL_CTX_set_mode(ctx_, SSL_MODE_RELEASE_BUFFERS);
+
+  LOG_INFO << "TLS is enabled, certificate: " << certificate;
+  return true;
+}
+
+} // namespace http
+
+#endif // KANON_HTTP_TLS
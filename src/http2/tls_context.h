@@ -0,0 +1,60 @@
+#ifndef KANON_HTTP_TLS_CONTEXT_H
+#define KANON_HTTP_TLS_CONTEXT_H
+
+#include <string>
+
+#include <kanon/util/noncopyable.h>
+
+#ifdef KANON_HTTP_TLS
+#include <openssl/opensslconf.h>
+#include <openssl/opensslv.h>
+
+// The kernel offload passes the ctrls internal to OpenSSL(include/internal/bio.h)
+// to the socket BIO, their values are only verified for the releases below
+#if !defined(OPENSSL_NO_KTLS) && \
+    OPENSSL_VERSION_NUMBER >= 0x30000000L && OPENSSL_VERSION_NUMBER < 0x30600000L
+#define KANON_HTTP_KTLS 1
+#endif
+#endif // KANON_HTTP_TLS
+
+typedef struct ssl_ctx_st SSL_CTX;
+
+namespace http {
+
+/**
+ * The certificate, ciphers and session tickets shared by the TLS
+ * connections of the process.
+ *
+ * The sessions are resumed by the stateless tickets instead of the
+ * session cache, the ticket keys are generated when created. So it is
+ * created before forking the workers, then a ticket issued by a worker
+ * is accepted by the others.
+ *
+ * The ALPN selects h2 if EnableHttp2 and the client offers it,
+ * otherwise http/1.1.
+ */
+class TlsContext : kanon::noncopyable {
+ public:
+  TlsContext();
+  ~TlsContext() noexcept;
+
+  /**
+   * Load the certificate chain and private key(PEM)
+   * \param kernel_offload Enable kTLS if the kernel supports it
+   * \return false if failed, the error is logged
+   */
+  bool Load(std::string const& certificate, std::string const& private_key,
+            int session_timeout, bool kernel_offload);
+
+  SSL_CTX* GetContext() const noexcept { return ctx_; }
+
+ private:
+  SSL_CTX* ctx_ = nullptr;
+};
+
+/** Log the errors in the error queue of OpenSSL and clear it */
+void LogTlsError(char const* what);
+
+} // namespace http
+
+#endif // KANON_HTTP_TLS_CONTEXT_H
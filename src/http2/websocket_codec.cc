@@ -0,0 +1,362 @@
+#include "http2/websocket_codec.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using namespace kanon;
+
+namespace http {
+
+constexpr size_t WebSocketCodec::kMaxControlPayload;
+
+static constexpr char kGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+WebSocketCodec::Result WebSocketCodec::Parse(StringView data, size_t max_payload,
+                                             Frame& frame, size_t& consumed) noexcept
+{
+  if (data.size() < 2) return kShort;
+
+  auto bytes = reinterpret_cast<unsigned char const*>(data.data());
+
+  // No extension, the RSV bits must be 0
+  if (bytes[0] & 0x70) return kBad;
+
+  frame.fin = (bytes[0] & 0x80) != 0;
+  frame.opcode = bytes[0] & 0x0f;
+  frame.masked = (bytes[1] & 0x80) != 0;
+
+  switch (frame.opcode) {
+    case kContinuation:
+    case kText:
+    case kBinary:
+    case kClose:
+    case kPing:
+    case kPong:
+      break;
+    default:
+      return kBad;
+  }
+
+  uint64_t length = bytes[1] & 0x7f;
+  size_t header_size = 2;
+
+  if (length == 126) {
+    header_size += 2;
+    if (data.size() < header_size) return kShort;
+    length = (bytes[2] << 8) | bytes[3];
+  } else if (length == 127) {
+    header_size += 8;
+    if (data.size() < header_size) return kShort;
+
+    length = 0;
+    for (int i = 2; i < 10; ++i) {
+      length = (length << 8) | bytes[i];
+    }
+
+    // The most significant bit must be 0
+    if (length >> 63) return kBad;
+  }
+
+  if (IsControl(frame.opcode) && (!frame.fin || length > kMaxControlPayload)) {
+    return kBad;
+  }
+
+  if (length > max_payload) return kTooBig;
+
+  if (frame.masked) {
+    if (data.size() < header_size + 4) return kShort;
+    ::memcpy(frame.mask, data.data() + header_size, 4);
+    header_size += 4;
+  }
+
+  if (data.size() - header_size < length) return kShort;
+
+  frame.payload = StringView(data.data() + header_size, length);
+  consumed = header_size + length;
+  return kGood;
+}
+
+void WebSocketCodec::AppendPayload(Frame const& frame, std::string& out)
+{
+  auto const& payload = frame.payload;
+
+  if (!frame.masked) {
+    out.append(payload.data(), payload.size());
+    return;
+  }
+
+  const size_t offset = out.size();
+  out.resize(offset + payload.size());
+  char* dst = &out[offset];
+
+  // XOR 8 bytes at a time, the key is repeated in the word
+  uint64_t mask8;
+  ::memcpy(&mask8, frame.mask, 4);
+  ::memcpy(reinterpret_cast<char*>(&mask8) + 4, frame.mask, 4);
+
+  size_t i = 0;
+  for (; i + 8 <= payload.size(); i += 8) {
+    uint64_t word;
+    ::memcpy(&word, payload.data() + i, 8);
+    word ^= mask8;
+    ::memcpy(dst + i, &word, 8);
+  }
+
+  for (; i < payload.size(); ++i) {
+    dst[i] = payload[i] ^ frame.mask[i & 3];
+  }
+}
+
+void WebSocketCodec::AppendFrame(std::string& out, uint8_t opcode, StringView payload,
+                                 bool fin, char const* mask)
+{
+  char header[14];
+  size_t n = 0;
+  const size_t length = payload.size();
+  const char mask_bit = mask ? 0x80 : 0;
+
+  header[n++] = static_cast<char>((fin ? 0x80 : 0) | opcode);
+
+  if (length < 126) {
+    header[n++] = static_cast<char>(mask_bit | length);
+  } else if (length <= 0xffff) {
+    header[n++] = static_cast<char>(mask_bit | 126);
+    header[n++] = static_cast<char>(length >> 8);
+    header[n++] = static_cast<char>(length);
+  } else {
+    header[n++] = static_cast<char>(mask_bit | 127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      header[n++] = static_cast<char>(static_cast<uint64_t>(length) >> shift);
+    }
+  }
+
+  if (!mask) {
+    out.reserve(out.size() + n + length);
+    out.append(header, n);
+    out.append(payload.data(), length);
+    return;
+  }
+
+  ::memcpy(header + n, mask, 4);
+  n += 4;
+  out.append(header, n);
+
+  Frame frame;
+  frame.masked = true;
+  ::memcpy(frame.mask, mask, 4);
+  frame.payload = payload;
+  AppendPayload(frame, out);
+}
+
+void WebSocketCodec::AppendClose(std::string& out, uint16_t code, StringView reason)
+{
+  char payload[kMaxControlPayload];
+  payload[0] = static_cast<char>(code >> 8);
+  payload[1] = static_cast<char>(code);
+
+  const size_t reason_size = std::min(reason.size(), kMaxControlPayload - 2);
+  ::memcpy(payload + 2, reason.data(), reason_size);
+
+  AppendFrame(out, kClose, StringView(payload, 2 + reason_size));
+}
+
+bool WebSocketCodec::ParseClose(StringView payload, uint16_t& code, StringView& reason) noexcept
+{
+  if (payload.empty()) {
+    code = kNoStatus;
+    reason = StringView();
+    return true;
+  }
+
+  if (payload.size() < 2) return false;
+
+  auto bytes = reinterpret_cast<unsigned char const*>(payload.data());
+  code = (bytes[0] << 8) | bytes[1];
+  reason = payload.substr(2);
+
+  // 1004~1006 and 1015 are reserved, 3000~4999 are for applications
+  const bool valid = (code >= 1000 && code <= 1003) ||
+                     (code >= 1007 && code <= 1014) ||
+                     (code >= 3000 && code <= 4999);
+
+  return valid && IsValidUtf8(reason);
+}
+
+bool WebSocketCodec::IsValidUtf8(StringView data) noexcept
+{
+  auto p = reinterpret_cast<unsigned char const*>(data.data());
+  auto end = p + data.size();
+
+  while (p != end) {
+    // ASCII is the common case, skip 8 bytes at a time
+    if (end - p >= 8) {
+      uint64_t word;
+      ::memcpy(&word, p, 8);
+
+      if ((word & 0x8080808080808080ULL) == 0) {
+        p += 8;
+        continue;
+      }
+    }
+
+    const unsigned char c = *p;
+
+    if (c < 0x80) {
+      ++p;
+      continue;
+    }
+
+    int n;
+    // The range of the second byte excludes the overlong forms,
+    // the surrogates and the code points larger than U+10FFFF
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 2;
+      if (c == 0xe0) low = 0xa0;
+      if (c == 0xed) high = 0x9f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 3;
+      if (c == 0xf0) low = 0x90;
+      if (c == 0xf4) high = 0x8f;
+    } else {
+      return false;
+    }
+
+    if (end - p <= n) return false;
+    if (p[1] < low || p[1] > high) return false;
+
+    for (int i = 2; i <= n; ++i) {
+      if ((p[i] & 0xc0) != 0x80) return false;
+    }
+
+    p += n + 1;
+  }
+
+  return true;
+}
+
+static inline uint32_t RotateLeft(uint32_t x, int n) noexcept
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/** SHA-1(RFC 3174), only used by the handshake */
+static void Sha1(StringView data, unsigned char digest[20])
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+  // Padded to a multiple of 64 bytes, the bit length is appended
+  std::string message(data.data(), data.size());
+  message += '\x80';
+  while (message.size() % 64 != 56) {
+    message += '\0';
+  }
+
+  const uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    message += static_cast<char>(bits >> shift);
+  }
+
+  auto bytes = reinterpret_cast<unsigned char const*>(message.data());
+
+  for (size_t offset = 0; offset < message.size(); offset += 64) {
+    uint32_t w[80];
+
+    for (int i = 0; i < 16; ++i) {
+      auto b = bytes + offset + i * 4;
+      w[i] = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+    }
+
+    for (int i = 16; i < 80; ++i) {
+      w[i] = RotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+
+      const uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = RotateLeft(b, 30);
+      b = a;
+      a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    digest[i*4] = h[i] >> 24;
+    digest[i*4 + 1] = h[i] >> 16;
+    digest[i*4 + 2] = h[i] >> 8;
+    digest[i*4 + 3] = h[i];
+  }
+}
+
+static void Base64Encode(unsigned char const* data, size_t len, std::string& out)
+{
+  static char const kTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    const uint32_t v = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+    out += kTable[v >> 18];
+    out += kTable[(v >> 12) & 0x3f];
+    out += kTable[(v >> 6) & 0x3f];
+    out += kTable[v & 0x3f];
+  }
+
+  if (i + 1 == len) {
+    const uint32_t v = data[i] << 16;
+    out += kTable[v >> 18];
+    out += kTable[(v >> 12) & 0x3f];
+    out += "==";
+  } else if (i + 2 == len) {
+    const uint32_t v = (data[i] << 16) | (data[i+1] << 8);
+    out += kTable[v >> 18];
+    out += kTable[(v >> 12) & 0x3f];
+    out += kTable[(v >> 6) & 0x3f];
+    out += '=';
+  }
+}
+
+std::string WebSocketCodec::GetAcceptKey(StringView key)
+{
+  std::string input(key.data(), key.size());
+  input += kGuid;
+
+  unsigned char digest[20];
+  Sha1(input, digest);
+
+  std::string accept;
+  Base64Encode(digest, sizeof digest, accept);
+  return accept;
+}
+
+} // namespace http
@@ -0,0 +1,100 @@
+#ifndef KANON_HTTP_WEBSOCKET_CODEC_H
+#define KANON_HTTP_WEBSOCKET_CODEC_H
+
+#include <stdint.h>
+#include <string>
+
+#include <kanon/string/string_view.h>
+
+namespace http {
+
+/**
+ * The frames of WebSocket(RFC 6455).
+ *
+ * | FIN RSV(3) opcode(4) | MASK(1 bit) length(7 bits) | extended length(0/2/8) |
+ * | masking key(0/4) | payload |
+ *
+ * The frames of client are masked, the ones of server are not, so a
+ * frame encoded by the server can be sent to many clients as is.
+ * A message is a data frame followed by the continuation frames until
+ * FIN, the control frames(close, ping, pong) can be interleaved.
+ * No extension is negotiated, the RSV bits must be 0.
+ */
+class WebSocketCodec {
+ public:
+  enum Opcode : uint8_t {
+    kContinuation = 0x0,
+    kText = 0x1,
+    kBinary = 0x2,
+    kClose = 0x8,
+    kPing = 0x9,
+    kPong = 0xA,
+  };
+
+  enum CloseCode : uint16_t {
+    kNormalClosure = 1000,
+    kGoingAway = 1001,
+    kProtocolError = 1002,
+    kNoStatus = 1005, /** Never sent, the close frame has no code */
+    kAbnormalClosure = 1006, /** Never sent, closed without close frame */
+    kInvalidPayload = 1007,
+    kMessageTooBig = 1009,
+  };
+
+  enum Result {
+    kGood = 0,
+    kShort, /** Need more data */
+    kBad, /** Protocol error */
+    kTooBig, /** The payload exceeds the limit */
+  };
+
+  struct Frame {
+    bool fin;
+    uint8_t opcode;
+    bool masked;
+    char mask[4];
+    /** Masked if masked, see AppendPayload() */
+    kanon::StringView payload;
+  };
+
+  /** The payload of control frame is at most 125 bytes */
+  static constexpr size_t kMaxControlPayload = 125;
+
+  /**
+   * Parse a frame at the beginning of \p data
+   * \param consumed The size of the frame if kGood
+   * \return kBad if the RSV bits, opcode or control frame is invalid
+   */
+  static Result Parse(kanon::StringView data, size_t max_payload,
+                      Frame& frame, size_t& consumed) noexcept;
+
+  /** Append the payload of \p frame unmasked */
+  static void AppendPayload(Frame const& frame, std::string& out);
+
+  /**
+   * \param mask The masking key(4 bytes) of client frame, nullptr if server
+   */
+  static void AppendFrame(std::string& out, uint8_t opcode, kanon::StringView payload,
+                          bool fin = true, char const* mask = nullptr);
+
+  /** The reason is truncated to fit the control frame */
+  static void AppendClose(std::string& out, uint16_t code, kanon::StringView reason);
+
+  /**
+   * \return false if the payload is 1 byte, the code is not allowed
+   *         to be sent or the reason is not UTF-8
+   */
+  static bool ParseClose(kanon::StringView payload, uint16_t& code,
+                         kanon::StringView& reason) noexcept;
+
+  static bool IsControl(uint8_t opcode) noexcept { return (opcode & 0x8) != 0; }
+
+  static bool IsValidUtf8(kanon::StringView data) noexcept;
+
+  /** The Sec-WebSocket-Accept of \p key: base64(SHA-1(key + GUID)) */
+  static std::string GetAcceptKey(kanon::StringView key);
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_WEBSOCKET_CODEC_H
@@ -0,0 +1,328 @@
+#include "http2/websocket_connection.h"
+
+#include <kanon/log/logger.h>
+#include <kanon/net/tcp_connection.h>
+
+#include "config/http_config.h"
+
+using namespace kanon;
+
+namespace http {
+
+constexpr int WebSocketConnection::kCloseTimeout_;
+
+WebSocketConnection::WebSocketConnection(TcpConnectionPtr const& conn, TlsChannelPtr tls,
+                                         ServerStats& stats)
+  : loop_(conn->GetLoop())
+  , conn_(conn)
+  , tls_(std::move(tls))
+  , stats_(&stats)
+{
+}
+
+WebSocketConnection::~WebSocketConnection() noexcept
+{
+  LOG_DEBUG << "WebSocketConnection is destroyed";
+}
+
+void WebSocketConnection::Open()
+{
+  if (!pending_.empty()) {
+    Send(pending_);
+    std::string().swap(pending_);
+  }
+
+  // Close() may be called by the plugin before opened
+  State expected = State::kConnecting;
+  state_.compare_exchange_strong(expected, State::kOpen);
+}
+
+void WebSocketConnection::OnMessage(Buffer& buffer)
+{
+  const size_t max_payload = g_config.websocket_max_message_size;
+
+  while (state_ == State::kOpen || state_ == State::kClosing) {
+    WebSocketCodec::Frame frame;
+    size_t consumed = 0;
+
+    switch (WebSocketCodec::Parse(buffer.ToStringView(), max_payload, frame, consumed)) {
+      case WebSocketCodec::kShort:
+        return;
+      case WebSocketCodec::kBad:
+        Fail(WebSocketCodec::kProtocolError, "Invalid frame");
+        return;
+      case WebSocketCodec::kTooBig:
+        Fail(WebSocketCodec::kMessageTooBig, "The frame is too large");
+        return;
+      case WebSocketCodec::kGood:
+        break;
+    }
+
+    if (!frame.masked) {
+      Fail(WebSocketCodec::kProtocolError, "The frame of client is not masked");
+      return;
+    }
+
+    // The payload is copied(unmasked) before consumed
+    const bool ok = HandleFrame(frame);
+    buffer.AdvanceRead(consumed);
+
+    if (!ok) return;
+  }
+}
+
+bool WebSocketConnection::HandleFrame(WebSocketCodec::Frame const& frame)
+{
+  switch (frame.opcode) {
+    case WebSocketCodec::kPing:
+      if (state_ == State::kOpen) {
+        std::string payload;
+        WebSocketCodec::AppendPayload(frame, payload);
+
+        control_.clear();
+        WebSocketCodec::AppendFrame(control_, WebSocketCodec::kPong, payload);
+        Send(control_);
+      }
+      return true;
+
+    case WebSocketCodec::kPong:
+      return true;
+
+    case WebSocketCodec::kClose:
+      return HandleClose(frame);
+
+    default:
+      break;
+  }
+
+  // The messages are dropped after the close frame is sent
+  if (state_ != State::kOpen) return true;
+
+  if ((frame.opcode == WebSocketCodec::kContinuation) != (message_opcode_ != 0)) {
+    Fail(WebSocketCodec::kProtocolError, "Unexpected continuation frame");
+    return false;
+  }
+
+  if (message_.size() + frame.payload.size() >
+      static_cast<size_t>(g_config.websocket_max_message_size)) {
+    Fail(WebSocketCodec::kMessageTooBig, "The message is too large");
+    return false;
+  }
+
+  if (frame.opcode != WebSocketCodec::kContinuation) {
+    message_opcode_ = frame.opcode;
+  }
+
+  WebSocketCodec::AppendPayload(frame, message_);
+
+  if (!frame.fin) return true;
+
+  const bool binary = message_opcode_ == WebSocketCodec::kBinary;
+  message_opcode_ = 0;
+
+  if (!binary && !WebSocketCodec::IsValidUtf8(message_)) {
+    Fail(WebSocketCodec::kInvalidPayload, "The text is not UTF-8");
+    return false;
+  }
+
+  Increment(stats_->websocket_messages);
+
+  if (message_callback_) {
+    message_callback_(message_, binary);
+  }
+
+  // Don't keep the memory of a large message for the idle socket
+  if (message_.capacity() > 64 * 1024) {
+    std::string().swap(message_);
+  } else {
+    message_.clear();
+  }
+
+  return true;
+}
+
+bool WebSocketConnection::HandleClose(WebSocketCodec::Frame const& frame)
+{
+  std::string payload;
+  WebSocketCodec::AppendPayload(frame, payload);
+
+  uint16_t code;
+  StringView reason;
+
+  if (!WebSocketCodec::ParseClose(payload, code, reason)) {
+    Fail(WebSocketCodec::kProtocolError, "Invalid close frame");
+    return false;
+  }
+
+  close_code_ = code;
+
+  // Echo it if the server didn't start the closing handshake
+  if (state_ == State::kOpen) {
+    control_.clear();
+
+    if (code == WebSocketCodec::kNoStatus) {
+      WebSocketCodec::AppendFrame(control_, WebSocketCodec::kClose, StringView());
+    } else {
+      WebSocketCodec::AppendClose(control_, code, StringView());
+    }
+
+    Send(control_);
+  }
+
+  state_ = State::kClosing;
+  conn_->ShutdownWrite();
+  return false;
+}
+
+void WebSocketConnection::Fail(uint16_t code, char const* reason)
+{
+  LOG_WARN << conn_->GetPeerAddr().ToIp() << " WebSocket error: " << reason;
+
+  if (state_ == State::kOpen) {
+    control_.clear();
+    WebSocketCodec::AppendClose(control_, code, reason);
+    Send(control_);
+  }
+
+  state_ = State::kClosing;
+  conn_->ShutdownWrite();
+}
+
+void WebSocketConnection::OnClose()
+{
+  state_ = State::kClosed;
+
+  auto close_callback = std::move(close_callback_);
+
+  // The callbacks may hold the socket
+  message_callback_ = MessageCallback();
+  close_callback_ = CloseCallback();
+
+  conn_.reset();
+  tls_.reset();
+
+  if (close_callback) {
+    close_callback(close_code_);
+  }
+}
+
+WebSocket::Frame WebSocketConnection::EncodeText(StringView text) const
+{
+  auto frame = std::make_shared<std::string>();
+  WebSocketCodec::AppendFrame(*frame, WebSocketCodec::kText, text);
+  return frame;
+}
+
+WebSocket::Frame WebSocketConnection::EncodeBinary(StringView data) const
+{
+  auto frame = std::make_shared<std::string>();
+  WebSocketCodec::AppendFrame(*frame, WebSocketCodec::kBinary, data);
+  return frame;
+}
+
+bool WebSocketConnection::SendFrame(Frame const& frame)
+{
+  const auto state = state_.load();
+
+  if (!frame || (state != State::kConnecting && state != State::kOpen)) {
+    return false;
+  }
+
+  if (!loop_->IsLoopInThread()) {
+    // Only the reference is queued, the frame is shared
+    auto self = shared_from_this();
+
+    loop_->QueueToLoop([self, frame]() {
+      self->SendFrameInLoop(*frame);
+    });
+
+    return true;
+  }
+
+  SendFrameInLoop(*frame);
+  return true;
+}
+
+void WebSocketConnection::SendFrameInLoop(std::string const& frame)
+{
+  if (state_ == State::kConnecting) {
+    pending_ += frame;
+    return;
+  }
+
+  if (state_ != State::kOpen) return;
+
+  Send(frame);
+
+  // The client can't keep up with the messages, e.g. the broadcast.
+  // Close it instead of buffering without limit.
+  auto output = conn_->GetOutputBuffer();
+
+  if (g_config.max_connection_buffer > 0 &&
+      output->GetReadableSize() > static_cast<size_t>(g_config.max_connection_buffer)) {
+    LOG_WARN << conn_->GetPeerAddr().ToIp() << " The WebSocket client is too slow("
+             << output->GetReadableSize() << " bytes buffered), close it";
+    Increment(stats_->websocket_closed_slow);
+    conn_->ForceClose();
+  }
+}
+
+void WebSocketConnection::Close(uint16_t code, StringView reason)
+{
+  if (!loop_->IsLoopInThread()) {
+    auto self = shared_from_this();
+    std::string copy(reason.data(), reason.size());
+
+    loop_->QueueToLoop([self, code, copy]() {
+      self->CloseInLoop(code, copy);
+    });
+
+    return;
+  }
+
+  CloseInLoop(code, std::string(reason.data(), reason.size()));
+}
+
+void WebSocketConnection::CloseInLoop(uint16_t code, std::string const& reason)
+{
+  const auto state = state_.load();
+
+  if (state != State::kConnecting && state != State::kOpen) return;
+
+  control_.clear();
+  WebSocketCodec::AppendClose(control_, code, reason);
+
+  if (state == State::kConnecting) {
+    pending_ += control_;
+  } else {
+    Send(control_);
+  }
+
+  state_ = State::kClosing;
+
+  // The close frame of peer is expected
+  std::weak_ptr<WebSocketConnection> wp(shared_from_this());
+
+  loop_->RunAfter([wp]() {
+    auto self = wp.lock();
+
+    if (self && self->state_ == State::kClosing && self->conn_) {
+      LOG_DEBUG << "The close frame of WebSocket peer is timeout";
+      self->conn_->ForceClose();
+    }
+  }, kCloseTimeout_);
+}
+
+void WebSocketConnection::Send(StringView data)
+{
+#ifdef KANON_HTTP_TLS
+  if (tls_) {
+    tls_->Send(data);
+    return;
+  }
+#endif
+
+  conn_->Send(data);
+}
+
+} // namespace http
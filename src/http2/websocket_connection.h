@@ -0,0 +1,110 @@
+#ifndef KANON_HTTP_WEBSOCKET_CONNECTION_H
+#define KANON_HTTP_WEBSOCKET_CONNECTION_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <kanon/net/buffer.h>
+#include <kanon/net/callback.h>
+#include <kanon/util/noncopyable.h>
+
+#include "plugin/websocket.h"
+#include "http2/server_stats.h"
+#include "http2/tls_channel.h"
+#include "http2/websocket_codec.h"
+
+namespace http {
+
+/**
+ * The WebSocket of a session after the handshake.
+ *
+ * The session passes the input to it and it calls the callbacks set
+ * by the plugin. The frames sent before Open()(i.e. in the call of
+ * AcceptWebSocket()) are sent after the 101 response.
+ *
+ * The closing handshake: the close frame of peer is echoed and the
+ * writing side is shut down. If the server closes it, the connection
+ * is closed when the close frame of peer is received or timeout.
+ */
+class WebSocketConnection : public WebSocket
+                          , public std::enable_shared_from_this<WebSocketConnection>
+                          , kanon::noncopyable {
+ public:
+  WebSocketConnection(kanon::TcpConnectionPtr const& conn, TlsChannelPtr tls,
+                      ServerStats& stats);
+  ~WebSocketConnection() noexcept override;
+
+  /** The 101 response has been sent */
+  void Open();
+
+  /** Handle the frames in \p buffer, the incomplete frame is left */
+  void OnMessage(kanon::Buffer& buffer);
+
+  /**
+   * The connection is closed, call the close callback and release
+   * the connection and callbacks
+   */
+  void OnClose();
+
+  void SetMessageCallback(MessageCallback cb) override { message_callback_ = std::move(cb); }
+  void SetCloseCallback(CloseCallback cb) override { close_callback_ = std::move(cb); }
+
+  Frame EncodeText(kanon::StringView text) const override;
+  Frame EncodeBinary(kanon::StringView data) const override;
+
+  bool SendFrame(Frame const& frame) override;
+  void Close(uint16_t code, kanon::StringView reason) override;
+
+  bool IsOpen() const override { return state_ == State::kOpen; }
+  kanon::EventLoop* GetLoop() const override { return loop_; }
+
+ private:
+  enum class State {
+    kConnecting = 0,
+    kOpen,
+    kClosing, /** The close frame is sent or received */
+    kClosed,
+  };
+
+  /** \return false if stop handling the frames */
+  bool HandleFrame(WebSocketCodec::Frame const& frame);
+  bool HandleClose(WebSocketCodec::Frame const& frame);
+
+  /** Send the close frame of \p code and shut down */
+  void Fail(uint16_t code, char const* reason);
+
+  void SendFrameInLoop(std::string const& frame);
+  void CloseInLoop(uint16_t code, std::string const& reason);
+  void Send(kanon::StringView data);
+
+  /** The seconds waiting for the close frame of peer */
+  static constexpr int kCloseTimeout_ = 5;
+
+  kanon::EventLoop* loop_;
+  kanon::TcpConnectionPtr conn_;
+  TlsChannelPtr tls_;
+  ServerStats* stats_;
+
+  // Read by the other threads in SendFrame() and IsOpen()
+  std::atomic<State> state_{State::kConnecting};
+
+  /** The frames sent before Open() */
+  std::string pending_;
+
+  /** The fragments of message, 0 if no message is in progress */
+  std::string message_;
+  uint8_t message_opcode_ = 0;
+
+  /** Reused to encode the control frames */
+  std::string control_;
+
+  uint16_t close_code_ = WebSocketCodec::kAbnormalClosure;
+
+  MessageCallback message_callback_;
+  CloseCallback close_callback_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_WEBSOCKET_CONNECTION_H
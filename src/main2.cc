@@ -1,9 +1,12 @@
 #include "http2/http_server2.h"
+#include "http2/http_server_group.h"
+#include "http2/master_process.h"
 
 #include "kanon/log/async_log.h"
 #include "config/http_config.h"
 
 #include "takina/takina.h"
+#include "unix/affinity.h"
 
 using namespace http;
 using namespace kanon;
@@ -14,8 +17,118 @@ struct Options {
   std::string config_name = "./.kanon_httpd.conf";
   int port = 80;
   int thread_num = 0;
+  bool reuseport = false;
+  bool pin_cpu = false;
+  std::vector<int> cpus;
+  int acceptor_cpu = -1;
+  int worker_num = 0;
 };
 
+/**
+ * The command line options override the configuration file.
+ * -a without CPU list pins the threads to all CPUs in order.
+ */
+static std::vector<int> GetIoCpus(Options const& options)
+{
+  if (!options.cpus.empty()) return options.cpus;
+  if (!g_config.cpu_affinity.empty()) return g_config.cpu_affinity;
+
+  std::vector<int> cpus;
+  if (options.pin_cpu) {
+    for (int i = 0; i < unix::GetCpuNum(); ++i) {
+      cpus.push_back(i);
+    }
+  }
+
+  return cpus;
+}
+
+static void SetupLog(Options const& options, std::string const& basename)
+{
+  if (options.log_file) {
+    LOG_INFO << "The log files are stored in the " << options.log_dir << " directory";
+
+    SetupAsyncLog(basename.c_str(), 2 * 1024 * 1024, options.log_dir);
+  }
+}
+
+/**
+ * Load the certificate before forking the workers,
+ * then the session tickets are shared by them.
+ * \return nullptr if TLS is not configured or failed
+ */
+static TlsContext const* LoadTlsContext()
+{
+  if (g_config.tls_certificate.empty()) return nullptr;
+
+#ifdef KANON_HTTP_TLS
+  static TlsContext context;
+
+  if (!context.Load(g_config.tls_certificate, g_config.tls_private_key,
+                     g_config.tls_session_timeout, g_config.tls_kernel_offload)) {
+    LOG_ERROR << "TLS is disabled since the certificate can't be loaded";
+    return nullptr;
+  }
+
+  return &context;
+#else
+  LOG_ERROR << "TlsCertificate is set but the server is built without ENABLE_TLS";
+  return nullptr;
+#endif
+}
+
+/**
+ * \param tls Terminate TLS if not null
+ * \param stats The counters of worker, null if not in the worker process
+ */
+static void RunServer(Options const& options, TlsContext const* tls,
+                      ServerStats* stats = nullptr, SharedStatsTable const* table = nullptr)
+{
+  if (!options.reuseport) {
+    const int acceptor_cpu = options.acceptor_cpu >= 0 ? options.acceptor_cpu : g_config.acceptor_cpu;
+
+    if (acceptor_cpu >= 0) {
+      if (unix::PinThread(acceptor_cpu)) {
+        LOG_INFO << "The acceptor is pinned to CPU " << acceptor_cpu;
+      } else {
+        LOG_SYSERROR << "Failed to pin the acceptor to CPU " << acceptor_cpu;
+      }
+    }
+  }
+
+  EventLoop loop;
+
+  InetAddr addr(options.port);
+
+  if (options.reuseport) {
+    HttpServerGroup group(&loop, addr, options.thread_num);
+    group.SetCpuAffinity(GetIoCpus(options));
+    group.GetMainServer().SetTlsContext(tls);
+    if (stats) {
+      group.GetMainServer().SetStats(*stats, table);
+      MasterProcess::WatchGracefulShutdown(&loop, *stats, options.port);
+    }
+    group.StartRun();
+
+    loop.SetEdgeTriggerMode();
+    loop.StartLoop();
+  } else {
+    // The workers listen on the same port
+    HttpServer server(&loop, addr, stats != nullptr);
+    server.SetLoopNum(options.thread_num);
+    server.SetCpuAffinity(GetIoCpus(options));
+    server.SetTlsContext(tls);
+    if (stats) {
+      server.SetStats(*stats, table);
+      MasterProcess::WatchGracefulShutdown(&loop, *stats, options.port);
+    }
+    server.StartRun();
+
+    loop.SetEdgeTriggerMode();
+    loop.StartLoop();
+  }
+}
+
 int main(int argc, char* argv[])
 {
   Options options;
@@ -31,6 +144,23 @@ int main(int argc, char* argv[])
   takina::AddOption({"t", "thread_num", 
                     "Threads number of IO thread. Main thread just accept new connection and other threads handle IO events,(default: 0)",
                     "THREAD_NUMBER"}, &options.thread_num);
+  takina::AddOption({"r", "reuseport",
+                    "Multi-acceptor mode. Each IO thread owns a SO_REUSEPORT listening socket and accepts connections directly, "
+                    "the main thread also accepts connections"}, &options.reuseport);
+  takina::AddSection("CPU affinity");
+  takina::AddOption({"a", "pin_cpu", "Pin the IO threads to all CPUs in order if CPU list is not specified"}, &options.pin_cpu);
+  takina::AddOption({"", "cpus",
+                    "The CPUs which the IO threads are pinned to in round-robin, "
+                    "in multi-acceptor mode the main thread is the first one(default: CpuAffinity in config)",
+                    "CPU..."}, &options.cpus);
+  takina::AddOption({"", "acceptor_cpu",
+                    "The CPU which the acceptor(main thread) is pinned to, not used in multi-acceptor mode"
+                    "(default: AcceptorCpu in config)",
+                    "CPU"}, &options.acceptor_cpu);
+  takina::AddOption({"w", "worker_num",
+                    "Pre-fork mode. The master process forks such worker processes and respawns them if crashed, "
+                    "each worker runs the server in the specified mode(default: 0, i.e. single process)",
+                    "WORKER_NUMBER"}, &options.worker_num);
   takina::AddOption({"c", "config", "Configuration file path(default: ./.kanon_httpd.conf)", "CONFIG_NAME"}, &options.config_name);
   takina::AddSection("Log setting");
   takina::AddOption({"f", "log_file", "Log to file in asynchronously(default: log to terminal)"}, &options.log_file);
@@ -40,23 +170,28 @@ int main(int argc, char* argv[])
   if (takina::Parse(argc, argv, &err_msg)) {
     takina::Teardown();
     SetConfigParameters(options.config_name);
+    auto tls = LoadTlsContext();
 
-    if (options.log_file) {
-      LOG_INFO << "The log files are stored in the " << options.log_dir << " directory";
-
-      SetupAsyncLog("httpd_kanon", 2 * 1024 * 1024, options.log_dir);
-    }
-
-    EventLoop loop;
+    if (options.worker_num > 0) {
+      // The connections are counted per worker, each one admits its share
+      if (g_config.max_connections > 0) {
+        g_config.max_connections = (g_config.max_connections + options.worker_num - 1) / options.worker_num;
+        LOG_INFO << "MaxConnections of each worker: " << g_config.max_connections;
+      }
 
-    InetAddr addr(options.port);
+      // The log thread must be created after fork(),
+      // the master just logs to terminal
+      MasterProcess master(options.worker_num, argv,
+        [&options, tls](int index, ServerStats& stats, SharedStatsTable const& table) {
+          SetupLog(options, "httpd_kanon_worker" + std::to_string(index));
+          RunServer(options, tls, &stats, &table);
+        });
 
-    HttpServer server(&loop, addr);
-    server.SetLoopNum(options.thread_num);
-    server.StartRun();
-
-    loop.SetEdgeTriggerMode();
-    loop.StartLoop();
+      master.Run();
+    } else {
+      SetupLog(options, "httpd_kanon");
+      RunServer(options, tls);
+    }
   } else {
     ::printf("Command line parse error: %s\n", err_msg.c_str());    
     ::fflush(stdout);
@@ -1,26 +1,177 @@
 #ifndef HTTP_DYNAMIC_REPONSE_INTERFACE_H
 #define HTTP_DYNAMIC_REPONSE_INTERFACE_H
 
+#include <memory>
+
+#include <kanon/util/macro.h>
 #include <kanon/util/noncopyable.h>
+#include <kanon/net/event_loop.h>
 #include <kanon/net/tcp_connection.h>
 
 #include "common/types.h"
 #include "common/http_response.h"
+#include "plugin/request_view.h"
+#include "plugin/response_writer.h"
+#include "plugin/websocket.h"
+
+/**
+ * The version of the plugin interface.
+ * It is exported by every plugin built against this header(see below),
+ * including the one only defines extern "C" CreateObject(). The plugin
+ * without it is built against the interface before versioning, whose
+ * vtable and ArgsMap are not compatible, so it is refused to load until
+ * rebuilt.
+ *
+ * Version 2: GenResponse() and StreamResponse() receive RequestView
+ * Version 3: AcceptWebSocket()
+ * Version 4: The response filled by GenResponse() is sent by the server,
+ *            conn_ is renamed to plaintext_conn_ which is null over TLS
+ */
+#define KANON_PLUGIN_ABI_VERSION 4
+/** The virtual functions are appended, the plugin of older version is compatible */
+#define KANON_PLUGIN_MIN_ABI_VERSION 2
+
+/**
+ * Weak, so each translation unit including this header defines it and
+ * the linker keeps one. The server also defines it, but dlsym() on the
+ * plugin handle doesn't search the executable.
+ */
+extern "C" {
+  __attribute__((weak)) extern int const kanon_plugin_abi_version = KANON_PLUGIN_ABI_VERSION;
+}
+
+/** The version is exported by the header, kept for the existing plugins */
+#define KANON_PLUGIN_EXPORT_ABI_VERSION()
 
 namespace http {
 
+/**
+ * Shared by the reusable instances of a plugin in the same IO loop.
+ * The plugin can keep its warm state in it, e.g. parsed templates,
+ * prepared lookup tables. No lock is needed since it is only used
+ * in the loop thread.
+ */
+struct PluginContext {
+  kanon::EventLoop* loop = nullptr;
+  std::shared_ptr<void> data;
+};
+
+/**
+ * The response of GET is cached if ttl_ms > 0.
+ * It is served as stale in stale_ms after expired,
+ * while it is refreshed in background.
+ */
+struct CachePolicy {
+  int ttl_ms = 0;
+  int stale_ms = 0;
+};
+
 class HttpDynamicResponseInterface {
 public:
   HttpDynamicResponseInterface() = default;  
   virtual ~HttpDynamicResponseInterface() = default;
-  virtual void GenResponseForGet(ArgsMap const& args, HttpResponse& response) = 0;
-  virtual void GenResponseForPost(std::string const& body, HttpResponse& response) = 0;
+
+  /**
+   * The entry points of method, called by the default GenResponse().
+   * The plugin can override GenResponse() instead.
+   */
+  virtual void GenResponseForGet(ArgsMap const& args, HttpResponse& response)
+  { KANON_UNUSED(args); KANON_UNUSED(response); }
+  virtual void GenResponseForPost(std::string const& body, HttpResponse& response)
+  { KANON_UNUSED(body); KANON_UNUSED(response); }
+
+  /**
+   * Optional lifecycle.
+   * If the instance is reusable, it is pooled per IO loop instead
+   * of being destroyed after the request:
+   * CreateObject() -> Init(context) -> (request -> Reset())...
+   */
+  virtual bool IsReusable() const { return false; }
+  /** Called once after created, \p context lives longer than the instance */
+  virtual void Init(PluginContext& context) { KANON_UNUSED(context); }
+  /** Called after each request, clear the per-request state */
+  virtual void Reset() {}
+
+  /**
+   * If the plugin is blocking(e.g. disk or CPU-bound), it runs in
+   * the worker pool instead of the IO loop.
+   */
+  virtual bool IsBlocking() const { return false; }
+
+  /**
+   * If the plugin is streaming, StreamResponseForGet/Post() are
+   * called instead of GenResponseForGet/Post().
+   * The response may be written later in the drain callback,
+   * the request is complete when ResponseWriter::End() is called.
+   * The args and body must be copied if they are used later.
+   */
+  virtual bool IsStreaming() const { return false; }
+  virtual void StreamResponseForGet(ArgsMap const& args, ResponseWriter& writer)
+  { KANON_UNUSED(args); writer.End(); }
+  virtual void StreamResponseForPost(std::string const& body, ResponseWriter& writer)
+  { KANON_UNUSED(body); writer.End(); }
+
+  /**
+   * Opt in the response cache(PluginCacheSize).
+   * The cacheable plugin only fills the response and returns, the
+   * server sends it. Since the response may be generated for other
+   * clients or in background, plaintext_conn_ must not be used.
+   * Only the responses of GET are cached, the plugin must not be
+   * streaming. The key is the method, path and query, so the request
+   * passed to the cacheable plugin has no headers and peer.
+   */
+  virtual CachePolicy GetCachePolicy() const { return CachePolicy{}; }
+
+  /**
+   * Version 2 entry points, called by the server.
+   * The default implementations dispatch to the entry points of
+   * method, so the plugin can override either.
+   */
+  virtual void GenResponse(RequestView const& request, HttpResponse& response)
+  {
+    if (request.GetMethod() == HttpMethod::kPost) {
+      GenResponseForPost(request.GetBodyString(), response);
+    }
+    else {
+      GenResponseForGet(request.GetArgs(), response);
+    }
+  }
+
+  virtual void StreamResponse(RequestView const& request, ResponseWriter& writer)
+  {
+    if (request.GetMethod() == HttpMethod::kPost) {
+      StreamResponseForPost(request.GetBodyString(), writer);
+    }
+    else {
+      StreamResponseForGet(request.GetArgs(), writer);
+    }
+  }
+
+  /**
+   * Version 3 entry point, called in the IO loop for the request of
+   * Upgrade: websocket whose handshake is valid.
+   * Set the callbacks of \p socket and keep it to send messages later,
+   * e.g. in a WebSocketGroup. The instance is kept until the socket
+   * is closed.
+   * \return false if not accepted, the request is served as a normal one
+   */
+  virtual bool AcceptWebSocket(RequestView const& request, WebSocketPtr const& socket)
+  { KANON_UNUSED(request); KANON_UNUSED(socket); return false; }
 
   void SetVersion(HttpVersion ver) noexcept { version_ = ver; }
-  void SetConnection(kanon::TcpConnectionPtr const& conn) { conn_ = conn; }
+  void SetConnection(kanon::TcpConnectionPtr const& conn) { plaintext_conn_ = conn; }
 
 protected:
-  kanon::TcpConnectionPtr conn_;
+  /**
+   * The connection of request, null over TLS since the bytes sent by
+   * it are not encrypted. Fill the response and return instead, the
+   * server sends it. The plugin before version 4 sending by it is
+   * refused over TLS unless it is cacheable or streaming.
+   * It was conn_, renamed so the plugin assuming it is never null fails
+   * to compile instead of crashing on the first HTTPS request. The
+   * layout is unchanged for the plugins built before.
+   */
+  kanon::TcpConnectionPtr plaintext_conn_;
   HttpVersion version_; 
   DISABLE_EVIL_COPYABLE(HttpDynamicResponseInterface)
 };
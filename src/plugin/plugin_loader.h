@@ -19,6 +19,9 @@ public:
 
   kanon::optional<std::string> Open(std::string const& plugin_name);
   CreateFunc GetCreateFunc();
+
+  /** \return nullptr if \p name is not exported */
+  void* GetSymbol(char const* name);
 private:
   void* handle_;
 
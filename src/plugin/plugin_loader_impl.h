@@ -64,4 +64,10 @@ auto PluginLoader<T>::GetCreateFunc() -> CreateFunc
   return reinterpret_cast<CreateFunc>(create_func);
 }
 
+template<typename T>
+void* PluginLoader<T>::GetSymbol(char const* name)
+{
+  return ::dlsym(handle_, name);
+}
+
 } // namespace plugin
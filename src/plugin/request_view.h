@@ -0,0 +1,114 @@
+#ifndef KANON_HTTP_REQUEST_VIEW_H
+#define KANON_HTTP_REQUEST_VIEW_H
+
+#include <string>
+#include <strings.h>
+
+#include <kanon/net/inet_addr.h>
+#include <kanon/string/string_view.h>
+
+#include "common/http_constant.h"
+#include "common/types.h"
+
+namespace http {
+
+/**
+ * The read-only view of the request passed to plugins(ABI v2).
+ *
+ * It refers to the request owned by the server, nothing is copied.
+ * The views are only valid in the call of the plugin, they must be
+ * copied if used later, e.g. in the drain callback.
+ *
+ * The accessors are inline, so plugins don't link to the server.
+ * The layout is part of the ABI, a change of it must increase
+ * KANON_PLUGIN_ABI_VERSION.
+ */
+class RequestView {
+ public:
+  RequestView() = default;
+
+  HttpMethod GetMethod() const noexcept { return method_; }
+  HttpVersion GetVersion() const noexcept { return version_; }
+
+  /** The decoded path without query string, e.g. /contents/adder */
+  kanon::StringView GetPath() const noexcept { return path_; }
+
+  /** The query string which is not decoded */
+  kanon::StringView GetQuery() const noexcept { return query_; }
+
+  /**
+   * The decoded arguments of query(GET) or form body(POST), and
+   * the parameters of route.
+   */
+  ArgsMap const& GetArgs() const noexcept { return *args_; }
+
+  kanon::StringView GetBody() const noexcept { return *body_; }
+  std::string const& GetBodyString() const noexcept { return *body_; }
+
+  /**
+   * \param name Case-insensitive
+   * \return The value of the first field of \p name, empty if not found
+   */
+  kanon::StringView GetHeader(kanon::StringView name) const noexcept
+  {
+    if (!headers_) return kanon::StringView();
+
+    // Only a few fields, scan them instead of hashing
+    for (auto const& header : *headers_) {
+      if (header.first.size() == name.size() &&
+          ::strncasecmp(header.first.data(), name.data(), name.size()) == 0) {
+        return ToStringView(header.second);
+      }
+    }
+
+    return kanon::StringView();
+  }
+
+  /** Empty if the response is generated in background, e.g. refreshing the cache */
+  ArenaHeaderMap const* GetHeaders() const noexcept { return headers_; }
+
+  /** nullptr if the response is generated in background */
+  kanon::InetAddr const* GetPeerAddr() const noexcept { return peer_; }
+
+  bool IsKeepAlive() const noexcept { return keep_alive_; }
+
+  /*
+   * Set by the server
+   */
+  void SetMethod(HttpMethod method) noexcept { method_ = method; }
+  void SetVersion(HttpVersion version) noexcept { version_ = version; }
+  void SetPath(kanon::StringView path) noexcept { path_ = path; }
+  void SetQuery(kanon::StringView query) noexcept { query_ = query; }
+  void SetArgs(ArgsMap const& args) noexcept { args_ = &args; }
+  void SetBody(std::string const& body) noexcept { body_ = &body; }
+  void SetHeaders(ArenaHeaderMap const* headers) noexcept { headers_ = headers; }
+  void SetPeerAddr(kanon::InetAddr const* peer) noexcept { peer_ = peer; }
+  void SetKeepAlive(bool keep_alive) noexcept { keep_alive_ = keep_alive; }
+
+ private:
+  static std::string const& GetEmptyString() noexcept
+  {
+    static std::string const empty;
+    return empty;
+  }
+
+  static ArgsMap const& GetEmptyArgs() noexcept
+  {
+    static ArgsMap const empty;
+    return empty;
+  }
+
+  HttpMethod method_ = HttpMethod::kNotSupport;
+  HttpVersion version_ = HttpVersion::kNotSupport;
+  kanon::StringView path_;
+  kanon::StringView query_;
+  ArgsMap const* args_ = &GetEmptyArgs();
+  std::string const* body_ = &GetEmptyString();
+  ArenaHeaderMap const* headers_ = nullptr;
+  kanon::InetAddr const* peer_ = nullptr;
+  bool keep_alive_ = false;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_REQUEST_VIEW_H
@@ -0,0 +1,63 @@
+#ifndef KANON_HTTP_RESPONSE_WRITER_H
+#define KANON_HTTP_RESPONSE_WRITER_H
+
+#include <functional>
+#include <stdint.h>
+
+#include <kanon/string/string_view.h>
+
+#include "common/http_constant.h"
+
+namespace http {
+
+/**
+ * Stream the response of plugin.
+ *
+ * The body is sent when it is written instead of being buffered,
+ * then a large response costs constant memory and the client get
+ * the first byte early. If the length is unknown, the body is
+ * chunked for HTTP/1.1, and the connection is closed at the end
+ * for HTTP/1.0.
+ *
+ * The methods are pure virtual, so plugins don't link to the server.
+ */
+class ResponseWriter {
+ public:
+  using DrainCallback = std::function<void()>;
+
+  virtual ~ResponseWriter() = default;
+
+  /** Add a header field, must be called before WriteHead() */
+  virtual void AddHeader(kanon::StringView field, kanon::StringView value) = 0;
+
+  /**
+   * Send the status line and header fields.
+   * Called by the first Write() with 200 if not called.
+   * \param content_length -1 means unknown
+   */
+  virtual void WriteHead(HttpStatusCode code, int64_t content_length = -1) = 0;
+
+  /**
+   * Send a piece of body.
+   * \return false if the output buffer reaches the high-water mark,
+   *         stop writing and continue in the drain callback.
+   *         The blocking plugins(run in the worker) are blocked
+   *         until drained instead, and true is returned.
+   *         false is also returned if the connection is closed.
+   */
+  virtual bool Write(kanon::StringView data) = 0;
+
+  /** Complete the response, the writer can't be used after it */
+  virtual void End() = 0;
+
+  /**
+   * Called in the IO loop when the output buffer is drained.
+   * Only continue writing in the callback after Write() returns
+   * false, the callback is not called after the connection closed.
+   */
+  virtual void SetDrainCallback(DrainCallback cb) = 0;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_RESPONSE_WRITER_H
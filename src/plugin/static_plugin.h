@@ -0,0 +1,96 @@
+#ifndef KANON_HTTP_STATIC_PLUGIN_H
+#define KANON_HTTP_STATIC_PLUGIN_H
+
+#include <string>
+#include <unordered_map>
+
+#include "plugin/http_dynamic_response_interface.h"
+
+namespace http {
+
+/**
+ * The plugins linked into the server(KANON_STATIC_PLUGINS).
+ *
+ * They are registered by KANON_PLUGIN() before main() and looked up
+ * by the registry before dlopen(), so a static build serves them
+ * without loading any shared object. The table is only written
+ * during the static initialization, no lock is needed.
+ */
+class StaticPluginTable {
+ public:
+  using CreateFunc = HttpDynamicResponseInterface*(*)();
+
+  struct Entry {
+    CreateFunc create_func = nullptr;
+    int abi_version = KANON_PLUGIN_ABI_VERSION;
+  };
+
+  /**
+   * \param name The file name of plugin, e.g. adder which stands for
+   *             ${RootPath}/contents/adder
+   */
+  static void Register(char const* name, CreateFunc create_func, int abi_version)
+  {
+    auto& entry = GetTable()[name];
+    entry.create_func = create_func;
+    entry.abi_version = abi_version;
+  }
+
+  /** \return nullptr if \p name is not linked */
+  static Entry const* Find(std::string const& name)
+  {
+    auto const& table = GetTable();
+    auto iter = table.find(name);
+    return iter != table.end() ? &iter->second : nullptr;
+  }
+
+  static bool IsEmpty() { return GetTable().empty(); }
+
+ private:
+  // Constructed on first use, the registrars in other
+  // translation units may run before this one
+  static std::unordered_map<std::string, Entry>& GetTable()
+  {
+    static std::unordered_map<std::string, Entry> table;
+    return table;
+  }
+};
+
+struct StaticPluginRegistrar {
+  StaticPluginRegistrar(char const* name, StaticPluginTable::CreateFunc create_func,
+                        int abi_version)
+  {
+    StaticPluginTable::Register(name, create_func, abi_version);
+  }
+};
+
+} // namespace http
+
+/**
+ * Define the entry of plugin \p name whose class is \p cls.
+ * By default, it exports CreateObject() and the ABI version for
+ * dlopen(). If KANON_STATIC_PLUGINS is defined, the plugin is
+ * registered to StaticPluginTable instead, so the plugins can be
+ * linked into one binary without the conflicted CreateObject().
+ */
+#ifdef KANON_STATIC_PLUGINS
+
+#define KANON_PLUGIN(name, cls) \
+  namespace { \
+  ::http::HttpDynamicResponseInterface* kanon_create_##name() \
+  { return new cls(); } \
+  ::http::StaticPluginRegistrar const kanon_static_plugin_##name( \
+    #name, &kanon_create_##name, KANON_PLUGIN_ABI_VERSION); \
+  }
+
+#else
+
+#define KANON_PLUGIN(name, cls) \
+  extern "C" { \
+    ::http::HttpDynamicResponseInterface* CreateObject() \
+    { return new cls(); } \
+  }
+
+#endif // KANON_STATIC_PLUGINS
+
+#endif // KANON_HTTP_STATIC_PLUGIN_H
@@ -0,0 +1,156 @@
+#ifndef KANON_HTTP_WEBSOCKET_H
+#define KANON_HTTP_WEBSOCKET_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <kanon/net/event_loop.h>
+#include <kanon/string/string_view.h>
+
+namespace http {
+
+/**
+ * A WebSocket accepted by the plugin(ABI v3), see
+ * HttpDynamicResponseInterface::AcceptWebSocket().
+ *
+ * The callbacks are called in the IO loop of the connection, so the
+ * state only used by them needs no lock. The other methods can be
+ * called in any thread, the frames are queued to the loop if not in it.
+ *
+ * To broadcast, encode the message once and pass the frame to
+ * SendFrame() of each socket(see WebSocketGroup). The frames of
+ * server are not masked, so the sockets share the encoded bytes
+ * instead of copying and encoding them per socket.
+ *
+ * The methods are pure virtual, so plugins don't link to the server.
+ */
+class WebSocket {
+ public:
+  /** The encoded frame, immutable and shared by the sockets */
+  using Frame = std::shared_ptr<std::string const>;
+
+  /** A complete message, the fragments are joined */
+  using MessageCallback = std::function<void(kanon::StringView message, bool binary)>;
+
+  /**
+   * Called once when the connection is closed.
+   * \param code The status code of the close frame of peer,
+   *             1006 if closed without it
+   */
+  using CloseCallback = std::function<void(uint16_t code)>;
+
+  virtual ~WebSocket() = default;
+
+  virtual void SetMessageCallback(MessageCallback cb) = 0;
+  virtual void SetCloseCallback(CloseCallback cb) = 0;
+
+  virtual Frame EncodeText(kanon::StringView text) const = 0;
+  virtual Frame EncodeBinary(kanon::StringView data) const = 0;
+
+  /**
+   * \return false if the socket is closed or closing, the frame is dropped.
+   *         If the client can't keep up with the frames(the buffered bytes
+   *         exceed MaxConnectionBuffer), the connection is closed.
+   */
+  virtual bool SendFrame(Frame const& frame) = 0;
+
+  bool SendText(kanon::StringView text) { return SendFrame(EncodeText(text)); }
+  bool SendBinary(kanon::StringView data) { return SendFrame(EncodeBinary(data)); }
+
+  /** Start the closing handshake, the messages received later are dropped */
+  virtual void Close(uint16_t code = 1000, kanon::StringView reason = kanon::StringView()) = 0;
+
+  virtual bool IsOpen() const = 0;
+
+  virtual kanon::EventLoop* GetLoop() const = 0;
+};
+
+using WebSocketPtr = std::shared_ptr<WebSocket>;
+
+/**
+ * The sockets receiving the same messages, e.g. the subscribers of
+ * a topic. The sockets may belong to different IO loops.
+ *
+ * The sockets are not owned, the closed ones are removed when
+ * broadcasting. Thread-safe and inline, so plugins don't link to
+ * the server.
+ */
+class WebSocketGroup {
+ public:
+  void Add(WebSocketPtr const& socket)
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sockets_.emplace_back(socket);
+  }
+
+  /**
+   * Send \p frame to the open sockets
+   * \return The number of the sockets sent to
+   */
+  size_t Broadcast(WebSocket::Frame const& frame)
+  {
+    std::vector<WebSocketPtr> sockets;
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      sockets.reserve(sockets_.size());
+
+      auto last = sockets_.begin();
+
+      for (auto& wp : sockets_) {
+        auto socket = wp.lock();
+
+        if (socket && socket->IsOpen()) {
+          sockets.push_back(std::move(socket));
+          *last++ = std::move(wp);
+        }
+      }
+
+      sockets_.erase(last, sockets_.end());
+    }
+
+    // Sent out of the lock, the frame may be queued to the other loops
+    size_t n = 0;
+    for (auto const& socket : sockets) {
+      n += socket->SendFrame(frame);
+    }
+
+    return n;
+  }
+
+  /** Encode \p message once and send it to the open sockets */
+  size_t Broadcast(kanon::StringView message, bool binary = false)
+  {
+    WebSocketPtr encoder;
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+
+      for (auto const& wp : sockets_) {
+        if ((encoder = wp.lock())) break;
+      }
+    }
+
+    if (!encoder) return 0;
+
+    return Broadcast(binary ? encoder->EncodeBinary(message) : encoder->EncodeText(message));
+  }
+
+  size_t GetSize() const
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return sockets_.size();
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::weak_ptr<WebSocket>> sockets_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_WEBSOCKET_H
@@ -0,0 +1,92 @@
+#include "unix/affinity.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// From <linux/mempolicy.h>
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+
+namespace unix {
+
+bool SetThreadAffinity(int cpu) noexcept
+{
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+
+  const int err = ::pthread_setaffinity_np(::pthread_self(), sizeof cpu_set, &cpu_set);
+
+  if (err != 0) {
+    errno = err;
+    return false;
+  }
+
+  return true;
+}
+
+bool SetThreadLocalMemoryPolicy() noexcept
+{
+#ifdef SYS_set_mempolicy
+  return ::syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) == 0;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+bool PinThread(int cpu) noexcept
+{
+  if (!SetThreadAffinity(cpu)) {
+    return false;
+  }
+
+  // Failure is not fatal, e.g. the kernel is not built with NUMA
+  SetThreadLocalMemoryPolicy();
+  return true;
+}
+
+bool ParseCpuList(char const* str, std::vector<int>& cpus)
+{
+  char* end = nullptr;
+
+  while (*str) {
+    const long first = ::strtol(str, &end, 10);
+    if (end == str || first < 0) return false;
+
+    long last = first;
+    str = end;
+
+    if (*str == '-') {
+      ++str;
+      last = ::strtol(str, &end, 10);
+      if (end == str || last < first) return false;
+      str = end;
+    }
+
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+
+    if (*str == ',') {
+      ++str;
+    } else if (*str != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int GetCpuNum() noexcept
+{
+  const long num = ::sysconf(_SC_NPROCESSORS_ONLN);
+  return num > 0 ? static_cast<int>(num) : 1;
+}
+
+} // namespace unix
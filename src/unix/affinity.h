@@ -0,0 +1,41 @@
+#ifndef KANON_UNIX_AFFINITY_H
+#define KANON_UNIX_AFFINITY_H
+
+#include <vector>
+
+namespace unix {
+
+/**
+ * Pin the calling thread to the \p cpu
+ * \return false if failed to set the affinity, errno is set
+ */
+bool SetThreadAffinity(int cpu) noexcept;
+
+/**
+ * Set the memory policy of the calling thread to local allocation,
+ * i.e. the memory touched first by this thread is allocated on the
+ * NUMA node of the CPU it is running on. This overrides the process
+ * policy such as `numactl --interleave`.
+ * \return false if not supported or failed
+ */
+bool SetThreadLocalMemoryPolicy() noexcept;
+
+/**
+ * Pin the calling thread to the \p cpu and allocate the memory
+ * of it on the local NUMA node.
+ * \return false if failed to set the affinity
+ */
+bool PinThread(int cpu) noexcept;
+
+/**
+ * Parse CPU list such as "0,2,4-7"
+ * \return false if the format is invalid
+ */
+bool ParseCpuList(char const* str, std::vector<int>& cpus);
+
+/** The number of online CPUs */
+int GetCpuNum() noexcept;
+
+} // namespace unix
+
+#endif // KANON_UNIX_AFFINITY_H
@@ -20,6 +20,8 @@ public:
   {
     ::close(fd_);
   }
+
+  int GetFd() const noexcept { return fd_; }
 private:
   int fd_;
   DISABLE_EVIL_COPYABLE(FDWrapper)
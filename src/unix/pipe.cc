@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "pipe.h"
@@ -11,6 +12,13 @@ Pipe::Pipe()
   }
 }
 
+Pipe::Pipe(int flags)
+{
+  if (::pipe2(fd_, flags) < 0) {
+    throw PipeException("Call pipe2() error occurred");
+  }
+}
+
 ssize_t Pipe::Read(void* buf, size_t n)
 {
   // readn
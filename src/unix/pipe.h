@@ -16,6 +16,12 @@ class Pipe : kanon::noncopyable {
 public:
   Pipe();
 
+  /**
+   * \param flags Passed to pipe2(), e.g. O_CLOEXEC, then the ends are
+   *              not leaked to the spawned process unless redirected
+   */
+  explicit Pipe(int flags);
+
   template<size_t N>
   ssize_t Read(char(&buf)[N])
   { return Read(buf, N); }
@@ -32,10 +38,10 @@ public:
 
   void RedirectReadEnd(int fd);
   void RedirectWriteEnd(int fd);
-private:
+
   int GetReadEnd() const noexcept { return fd_[0]; }
   int GetWriteEnd() const noexcept { return fd_[1]; }
-
+private:
   int fd_[2];
 };
 
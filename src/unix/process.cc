@@ -1,7 +1,50 @@
 #include "process.h"
 
+#include <errno.h>
+#include <signal.h>
+
+#include "pipe.h"
+
+extern char** environ;
+
 namespace unix {
 
+FileActions::FileActions()
+{
+  if (::posix_spawn_file_actions_init(&actions_) != 0) {
+    throw ProcessException("Call posix_spawn_file_actions_init() error occurred");
+  }
+}
+
+FileActions::~FileActions() noexcept
+{
+  ::posix_spawn_file_actions_destroy(&actions_);
+}
+
+void FileActions::Dup2(int fd, int target)
+{
+  if (::posix_spawn_file_actions_adddup2(&actions_, fd, target) != 0) {
+    throw ProcessException("Call posix_spawn_file_actions_adddup2() error occurred");
+  }
+}
+
+void FileActions::Close(int fd)
+{
+  if (::posix_spawn_file_actions_addclose(&actions_, fd) != 0) {
+    throw ProcessException("Call posix_spawn_file_actions_addclose() error occurred");
+  }
+}
+
+void FileActions::RedirectReadEnd(Pipe& pipe, int target)
+{
+  Dup2(pipe.GetReadEnd(), target);
+}
+
+void FileActions::RedirectWriteEnd(Pipe& pipe, int target)
+{
+  Dup2(pipe.GetWriteEnd(), target);
+}
+
 bool Process::Fork(ParentCallback p, ChildCallback c)
 {
   pid_ = ::fork();
@@ -22,5 +65,53 @@ bool Process::Fork(ParentCallback p, ChildCallback c)
   return true;
 }
 
+bool Process::Spawn(char const* path,
+                    char* const* argv,
+                    char* const* envp,
+                    FileActions const* actions)
+{
+  posix_spawnattr_t attr;
+
+  int ret = ::posix_spawnattr_init(&attr);
+  if (ret != 0) {
+    errno = ret;
+    return false;
+  }
+
+  sigset_t mask;
+  sigset_t defaults;
+  ::sigemptyset(&mask);
+  ::sigemptyset(&defaults);
+  ::sigaddset(&defaults, SIGPIPE);
+  ::sigaddset(&defaults, SIGCHLD);
+
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+  // glibc >= 2.24 always uses clone(CLONE_VM | CLONE_VFORK), the flag
+  // only matters for the older ones
+  flags |= POSIX_SPAWN_USEVFORK;
+#endif
+
+  ::posix_spawnattr_setflags(&attr, flags);
+  ::posix_spawnattr_setsigmask(&attr, &mask);
+  ::posix_spawnattr_setsigdefault(&attr, &defaults);
+
+  pid_t pid = -1;
+  ret = ::posix_spawn(&pid, path,
+                      actions ? actions->Get() : nullptr,
+                      &attr,
+                      argv,
+                      envp ? envp : environ);
+
+  ::posix_spawnattr_destroy(&attr);
+
+  if (ret != 0) {
+    errno = ret;
+    return false;
+  }
+
+  pid_ = pid;
+  return true;
+}
 
-} // namespace process
\ No newline at end of file
+} // namespace process
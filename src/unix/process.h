@@ -3,6 +3,7 @@
 
 #include <stdexcept>
 #include <unistd.h>
+#include <spawn.h>
 #include <functional>
 
 #include "kanon/util/noncopyable.h"
@@ -12,6 +13,29 @@ namespace unix {
 
 DEFINE_EXCEPTION_FROM_OTHER(ProcessException, std::runtime_error);
 
+class Pipe;
+
+/**
+ * The descriptor operations performed in the child before exec,
+ * in the order they are added.
+ */
+class FileActions : kanon::noncopyable {
+public:
+  FileActions();
+  ~FileActions() noexcept;
+
+  /** \p fd is duplicated to \p target, and \p target is not close-on-exec */
+  void Dup2(int fd, int target);
+  void Close(int fd);
+
+  void RedirectReadEnd(Pipe& pipe, int target);
+  void RedirectWriteEnd(Pipe& pipe, int target);
+
+  posix_spawn_file_actions_t const* Get() const noexcept { return &actions_; }
+private:
+  posix_spawn_file_actions_t actions_;
+};
+
 class Process : kanon::noncopyable {
 public:
   using ParentCallback = std::function<void ()>;
@@ -24,6 +48,26 @@ public:
 
   bool Fork(ParentCallback p, ChildCallback c);
 
+  /**
+   * Execute \p path in a new process by posix_spawn().
+   *
+   * Unlike Fork(), the page tables of the server are not copied(the
+   * child shares the memory until exec, i.e. vfork), so the latency
+   * doesn't grow with the heap and mmap cache.
+   *
+   * The signal mask of child is empty and the SIGPIPE and SIGCHLD
+   * are default since the server ignores them.
+   *
+   * \param argv terminated by NULL, argv[0] is the program name
+   * \param envp terminated by NULL, the environment of the server if NULL
+   * \param actions The redirections of descriptors, can be NULL
+   * \return false if failed, the errno is set
+   */
+  bool Spawn(char const* path,
+             char* const* argv,
+             char* const* envp = nullptr,
+             FileActions const* actions = nullptr);
+
   pid_t GetPid() const noexcept { return pid_; }
 private:
   pid_t pid_;
@@ -31,4 +75,4 @@ private:
 
 }
 
-#endif // KANON_HTTP_PROCESS_H
\ No newline at end of file
+#endif // KANON_HTTP_PROCESS_H
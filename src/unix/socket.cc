@@ -0,0 +1,103 @@
+#include "unix/socket.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace unix {
+
+static int GetPort(sockaddr_storage const& addr) noexcept
+{
+  switch (addr.ss_family) {
+    case AF_INET:
+      return ntohs(reinterpret_cast<sockaddr_in const&>(addr).sin_port);
+    case AF_INET6:
+      return ntohs(reinterpret_cast<sockaddr_in6 const&>(addr).sin6_port);
+    default:
+      return -1;
+  }
+}
+
+int CloseListeningSockets(int port) noexcept
+{
+  DIR* dir = ::opendir("/proc/self/fd");
+
+  if (!dir) return -1;
+
+  std::vector<int> fds;
+
+  while (auto entry = ::readdir(dir)) {
+    char* end = nullptr;
+    const long fd = ::strtol(entry->d_name, &end, 10);
+
+    if (end != entry->d_name && *end == '\0' && fd != ::dirfd(dir)) {
+      fds.push_back(static_cast<int>(fd));
+    }
+  }
+
+  ::closedir(dir);
+
+  int closed = 0;
+
+  for (auto fd : fds) {
+    int listening = 0;
+    socklen_t len = sizeof listening;
+
+    if (::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) != 0 || !listening) {
+      continue;
+    }
+
+    sockaddr_storage addr;
+    socklen_t addr_len = sizeof addr;
+
+    if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0 ||
+        GetPort(addr) != port) {
+      continue;
+    }
+
+    // Closing the last reference also removes the socket from epoll
+    const int placeholder = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (placeholder < 0) continue;
+
+    if (::dup3(placeholder, fd, O_CLOEXEC) == fd) {
+      ++closed;
+    }
+
+    ::close(placeholder);
+  }
+
+  return closed;
+}
+
+bool EnableListenerMigration() noexcept
+{
+  static char const kPath[] = "/proc/sys/net/ipv4/tcp_migrate_req";
+
+  // Not supported if missing
+  int fd = ::open(kPath, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) return false;
+
+  char value = '0';
+  const bool enabled = ::read(fd, &value, 1) == 1 && value == '1';
+  ::close(fd);
+
+  if (enabled) return true;
+
+  // Enabling it requires the privilege, reading doesn't
+  fd = ::open(kPath, O_WRONLY | O_CLOEXEC);
+
+  if (fd < 0) return false;
+
+  const bool written = ::write(fd, "1", 1) == 1;
+  ::close(fd);
+  return written;
+}
+
+} // namespace unix
@@ -0,0 +1,29 @@
+#ifndef KANON_UNIX_SOCKET_H
+#define KANON_UNIX_SOCKET_H
+
+namespace unix {
+
+/**
+ * Close the listening sockets of this process bound to \p port, so the
+ * kernel dispatches the new connections to the other sockets of the
+ * SO_REUSEPORT group only.
+ *
+ * The server owning the sockets is not notified, so each one is replaced
+ * by an unbound socket of the same fd, which is closed by the server
+ * later. The connections queued on the closed socket are reset unless
+ * net.ipv4.tcp_migrate_req is enabled(see EnableListenerMigration()).
+ * \return The number of sockets closed, -1 if failed to list the fds
+ */
+int CloseListeningSockets(int port) noexcept;
+
+/**
+ * Enable net.ipv4.tcp_migrate_req(Linux 5.14+, IPv6 also), then the
+ * connections queued on a closed listening socket are migrated to
+ * another socket of its SO_REUSEPORT group instead of reset.
+ * \return false if not supported or can't be enabled(CAP_NET_ADMIN is required)
+ */
+bool EnableListenerMigration() noexcept;
+
+} // namespace unix
+
+#endif // KANON_UNIX_SOCKET_H
@@ -0,0 +1,106 @@
+#include "util/arena.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+namespace http {
+
+constexpr size_t Arena::kDefaultBlockSize;
+constexpr size_t Arena::kMaxKeptSize;
+
+static inline char* AlignUp(char* p, size_t align) noexcept
+{
+  const auto addr = reinterpret_cast<uintptr_t>(p);
+  return reinterpret_cast<char*>((addr + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+Arena::Arena(size_t block_size) noexcept
+  : block_size_(block_size)
+{
+}
+
+Arena::~Arena() noexcept
+{
+  FreeBlocks(head_);
+}
+
+void* Arena::Allocate(size_t size, size_t align)
+{
+  assert((align & (align - 1)) == 0);
+
+  char* p = AlignUp(cur_, align);
+
+  if (cur_ && p + size <= end_) {
+    cur_ = p + size;
+    used_ += size;
+    return p;
+  }
+
+  return AllocateSlow(size, align);
+}
+
+void* Arena::AllocateSlow(size_t size, size_t align)
+{
+  // The large allocation also occupies a new block,
+  // the rest of the current block is wasted
+  NewBlock(size + align > block_size_ ? size + align : block_size_);
+
+  char* p = AlignUp(cur_, align);
+  cur_ = p + size;
+  used_ += size;
+  return p;
+}
+
+void Arena::NewBlock(size_t size)
+{
+  auto block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+  block->next = head_;
+  block->size = size;
+  head_ = block;
+  allocated_ += size;
+
+  cur_ = block->GetData();
+  end_ = cur_ + size;
+}
+
+void Arena::FreeBlocks(Block* block) noexcept
+{
+  while (block) {
+    auto next = block->next;
+    ::operator delete(block);
+    block = next;
+  }
+}
+
+void Arena::Reset() noexcept
+{
+  used_ = 0;
+
+  if (!head_) return;
+
+  if (head_->next || head_->size > kMaxKeptSize) {
+    // Multiple blocks are used, merge them to one block of the
+    // peak size, then the next request fits in it.
+    // The too large block is not kept.
+    const auto peak = allocated_;
+    FreeBlocks(head_);
+    head_ = nullptr;
+    allocated_ = 0;
+    cur_ = end_ = nullptr;
+
+    if (peak <= kMaxKeptSize) {
+      try {
+        NewBlock(peak);
+      } catch (std::bad_alloc const&) {
+        // Allocate it later
+      }
+    }
+
+    return;
+  }
+
+  cur_ = head_->GetData();
+  end_ = cur_ + head_->size;
+}
+
+} // namespace http
@@ -0,0 +1,136 @@
+#ifndef KANON_HTTP_UTIL_ARENA_H
+#define KANON_HTTP_UTIL_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+/**
+ * A bump allocator for the objects whose lifetime is a request.
+ *
+ * Allocation just advances a pointer in the current block,
+ * deallocation is a no-op and Reset() frees all at once.
+ * The arena is owned by a session, so it is only used in one
+ * IO thread and no lock is needed.
+ *
+ * Reset() keeps one block whose size is the peak usage(at most
+ * kMaxKeptSize), then the steady state doesn't allocate from the
+ * global allocator.
+ */
+class Arena : kanon::noncopyable {
+ public:
+  explicit Arena(size_t block_size = kDefaultBlockSize) noexcept;
+  ~Arena() noexcept;
+
+  void* Allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  /** Construct a object in the arena, its destructor must be called manually */
+  template<typename T, typename... Args>
+  T* New(Args&&... args)
+  {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  /**
+   * Free all the allocated memory.
+   * The objects allocated from the arena must not be used after it.
+   */
+  void Reset() noexcept;
+
+  /** The bytes allocated since the last Reset() */
+  size_t GetUsed() const noexcept { return used_; }
+
+  static constexpr size_t kDefaultBlockSize = 4096;
+  static constexpr size_t kMaxKeptSize = 1 << 20;
+
+ private:
+  struct Block {
+    Block* next;
+    size_t size;
+
+    char* GetData() noexcept { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  void* AllocateSlow(size_t size, size_t align);
+  void NewBlock(size_t size);
+  void FreeBlocks(Block* block) noexcept;
+
+  Block* head_ = nullptr;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+
+  size_t block_size_;
+  size_t used_ = 0;
+  size_t allocated_ = 0;
+};
+
+/**
+ * Allocator satisfies the Allocator requirements.
+ * If the arena is null, fallback to the global allocator, then the
+ * arena-aware containers can be also used as the usual ones,
+ * e.g. the ArgsMap constructed by plugins.
+ */
+template<typename T>
+class ArenaAllocator {
+  template<typename U> friend class ArenaAllocator;
+ public:
+  using value_type = T;
+
+  // The allocator is moved with the container
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator(Arena* arena = nullptr) noexcept
+    : arena_(arena)
+  {
+  }
+
+  template<typename U>
+  ArenaAllocator(ArenaAllocator<U> const& other) noexcept
+    : arena_(other.arena_)
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    if (arena_) {
+      return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept
+  {
+    (void)n;
+    if (!arena_) {
+      ::operator delete(p);
+    }
+  }
+
+  Arena* GetArena() const noexcept { return arena_; }
+
+  template<typename U>
+  struct rebind {
+    using other = ArenaAllocator<U>;
+  };
+
+ private:
+  Arena* arena_;
+};
+
+template<typename T, typename U>
+inline bool operator==(ArenaAllocator<T> const& x, ArenaAllocator<U> const& y) noexcept
+{ return x.GetArena() == y.GetArena(); }
+
+template<typename T, typename U>
+inline bool operator!=(ArenaAllocator<T> const& x, ArenaAllocator<U> const& y) noexcept
+{ return !(x == y); }
+
+} // namespace http
+
+#endif // KANON_HTTP_UTIL_ARENA_H
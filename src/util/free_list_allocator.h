@@ -0,0 +1,141 @@
+#ifndef KANON_HTTP_UTIL_FREE_LIST_ALLOCATOR_H
+#define KANON_HTTP_UTIL_FREE_LIST_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+namespace detail {
+
+/**
+ * A free list of fixed-size blocks owned by the calling thread.
+ * The blocks are not shared between threads, so no lock is needed.
+ * Since each IO loop is run in its own thread, it is also a
+ * per-loop free list.
+ */
+template<size_t Size>
+class FreeList : kanon::noncopyable {
+  struct Node {
+    Node* next;
+  };
+
+ public:
+  static constexpr size_t kBlockSize = Size < sizeof(Node) ? sizeof(Node) : Size;
+
+  /** The free list of the calling thread */
+  static FreeList& GetLocal()
+  {
+    static thread_local FreeList list;
+    return list;
+  }
+
+  ~FreeList() noexcept
+  {
+    while (head_) {
+      auto next = head_->next;
+      ::operator delete(head_);
+      head_ = next;
+    }
+  }
+
+  void* Allocate()
+  {
+    if (head_) {
+      auto block = head_;
+      head_ = head_->next;
+      --num_;
+      return block;
+    }
+
+    return ::operator new(kBlockSize);
+  }
+
+  /**
+   * The block may be allocated by other thread, e.g. the last
+   * reference is released there, it is just cached in this thread.
+   */
+  void Deallocate(void* p) noexcept
+  {
+    if (num_ >= kMaxCached) {
+      ::operator delete(p);
+      return;
+    }
+
+    auto node = static_cast<Node*>(p);
+    node->next = head_;
+    head_ = node;
+    ++num_;
+  }
+
+ private:
+  FreeList() = default;
+
+  // Avoid caching too many blocks after a burst
+  static constexpr size_t kMaxCached = 1024;
+
+  Node* head_ = nullptr;
+  size_t num_ = 0;
+};
+
+} // namespace detail
+
+/**
+ * Allocator satisfies the Allocator requirements.
+ * The single-object allocation is served by the free list of the
+ * calling thread, e.g. the control block of std::shared_ptr,
+ * the node of std::list.
+ */
+template<typename T>
+class FreeListAllocator {
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "Over-aligned type is not supported");
+
+  using FreeList = detail::FreeList<sizeof(T)>;
+ public:
+  using value_type = T;
+
+  FreeListAllocator() = default;
+
+  template<typename U>
+  FreeListAllocator(FreeListAllocator<U> const&) noexcept
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    if (n == 1) {
+      return static_cast<T*>(FreeList::GetLocal().Allocate());
+    }
+
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept
+  {
+    if (n == 1) {
+      FreeList::GetLocal().Deallocate(p);
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  template<typename U>
+  struct rebind {
+    using other = FreeListAllocator<U>;
+  };
+};
+
+template<typename T, typename U>
+inline bool operator==(FreeListAllocator<T> const&, FreeListAllocator<U> const&) noexcept
+{ return true; }
+
+template<typename T, typename U>
+inline bool operator!=(FreeListAllocator<T> const&, FreeListAllocator<U> const&) noexcept
+{ return false; }
+
+} // namespace http
+
+#endif // KANON_HTTP_UTIL_FREE_LIST_ALLOCATOR_H
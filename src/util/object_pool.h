@@ -0,0 +1,92 @@
+#ifndef KANON_HTTP_UTIL_OBJECT_POOL_H
+#define KANON_HTTP_UTIL_OBJECT_POOL_H
+
+#include <memory>
+#include <vector>
+
+#include <kanon/util/noncopyable.h>
+
+namespace http {
+
+/**
+ * A pool of constructed objects owned by the calling thread.
+ *
+ * The released objects are reset by T::Reset() and cached instead
+ * of destroyed, the capacity of their members(e.g. std::string,
+ * kanon::Buffer) is also kept, then the next Acquire() don't
+ * touch the global allocator.
+ *
+ * Since each IO loop is run in its own thread, the pool is
+ * also a per-loop pool and no lock is needed.
+ *
+ * \tparam T must be default constructible and provide Reset()
+ */
+template<typename T>
+class ObjectPool : kanon::noncopyable {
+ public:
+  /**
+   * Return the object to the pool of the calling thread
+   */
+  struct Releaser {
+    void operator()(T* p) const noexcept
+    { ObjectPool::GetLocal().Release(p); }
+  };
+
+  using Ptr = std::unique_ptr<T, Releaser>;
+
+  /** The pool of the calling thread */
+  static ObjectPool& GetLocal()
+  {
+    static thread_local ObjectPool pool;
+    return pool;
+  }
+
+  ~ObjectPool() noexcept
+  {
+    for (auto obj : objs_) {
+      delete obj;
+    }
+  }
+
+  Ptr Acquire() { return Ptr(AcquireRaw()); }
+
+  T* AcquireRaw()
+  {
+    if (objs_.empty()) {
+      return new T();
+    }
+
+    auto obj = objs_.back();
+    objs_.pop_back();
+    return obj;
+  }
+
+  void Release(T* obj) noexcept
+  {
+    obj->Reset();
+
+    if (objs_.size() >= kMaxCached) {
+      delete obj;
+    } else {
+      objs_.push_back(obj);
+    }
+  }
+
+  size_t GetCachedNum() const noexcept { return objs_.size(); }
+
+ private:
+  ObjectPool()
+  {
+    // push_back() never reallocates
+    objs_.reserve(kMaxCached);
+  }
+
+  // Avoid caching too many objects after a burst
+  static constexpr size_t kMaxCached = 256;
+
+  std::vector<T*> objs_;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_UTIL_OBJECT_POOL_H
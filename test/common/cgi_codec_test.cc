@@ -0,0 +1,90 @@
+#include "common/cgi_codec.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+TEST(cgi_codec_test, record) {
+  std::string records;
+  CgiCodec::Append(records, CgiCodec::kStdin, "body");
+  CgiCodec::Append(records, CgiCodec::kEnd, StringView());
+
+  EXPECT_EQ(records.size(), 2 * CgiCodec::kHeaderSize + 4);
+
+  CgiCodec::RecordType type;
+  StringView content;
+  size_t consumed = 0;
+  StringView data(records);
+
+  ASSERT_EQ(CgiCodec::Parse(data, type, content, consumed), CgiCodec::kGood);
+  EXPECT_EQ(type, CgiCodec::kStdin);
+  EXPECT_EQ(content, "body");
+  data.remove_prefix(consumed);
+
+  ASSERT_EQ(CgiCodec::Parse(data, type, content, consumed), CgiCodec::kGood);
+  EXPECT_EQ(type, CgiCodec::kEnd);
+  EXPECT_TRUE(content.empty());
+  EXPECT_EQ(consumed, data.size());
+}
+
+TEST(cgi_codec_test, short_and_bad) {
+  std::string records;
+  CgiCodec::Append(records, CgiCodec::kStdout, "hello");
+
+  CgiCodec::RecordType type;
+  StringView content;
+  size_t consumed = 0;
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(CgiCodec::Parse(StringView(records.data(), i), type, content, consumed),
+              CgiCodec::kShort);
+  }
+
+  records[0] = 2;
+  EXPECT_EQ(CgiCodec::Parse(records, type, content, consumed), CgiCodec::kBad);
+}
+
+TEST(cgi_codec_test, split) {
+  std::string input(CgiCodec::kMaxContentSize + 10, 'x');
+  std::string records;
+  CgiCodec::Append(records, CgiCodec::kStdin, input);
+
+  CgiCodec::RecordType type;
+  StringView content;
+  size_t consumed = 0;
+  StringView data(records);
+  std::string output;
+
+  while (!data.empty()) {
+    ASSERT_EQ(CgiCodec::Parse(data, type, content, consumed), CgiCodec::kGood);
+    output.append(content.data(), content.size());
+    data.remove_prefix(consumed);
+  }
+
+  EXPECT_EQ(output, input);
+}
+
+TEST(cgi_codec_test, params) {
+  std::string params;
+  CgiCodec::AppendParam(params, "REQUEST_METHOD", "GET");
+  CgiCodec::AppendParam(params, "QUERY_STRING", "?num1=1&num2=2");
+  CgiCodec::AppendParam(params, "CONTENT_LENGTH", "");
+
+  StringView value;
+  ASSERT_TRUE(CgiCodec::GetParam(params, "QUERY_STRING", value));
+  EXPECT_EQ(value, "?num1=1&num2=2");
+  ASSERT_TRUE(CgiCodec::GetParam(params, "CONTENT_LENGTH", value));
+  EXPECT_TRUE(value.empty());
+
+  // The prefix of name is not matched
+  EXPECT_FALSE(CgiCodec::GetParam(params, "REQUEST", value));
+  EXPECT_FALSE(CgiCodec::GetParam(params, "PATH_INFO", value));
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
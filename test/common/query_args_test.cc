@@ -0,0 +1,92 @@
+#include "common/parse_args.h"
+#include "common/query_args.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+TEST(query_args_test, parse) {
+  auto args = ParseArgs("a=100&b=hello+world%21&flag&&c=&=x");
+
+  ASSERT_EQ(args.size(), 5);
+  EXPECT_EQ(args.Get("a"), "100");
+  EXPECT_EQ(args.Get("b"), "hello world!");
+  EXPECT_EQ(args.Get("c"), "");
+  EXPECT_EQ(args.Get(""), "x");
+  EXPECT_NE(args.find("flag"), args.end());
+  EXPECT_EQ(args.find("flag")->second, "");
+  EXPECT_EQ(args.find("none"), args.end());
+  EXPECT_EQ(args.Get("none", ArgView("default", 7)), "default");
+
+  // NUL-terminated
+  EXPECT_EQ(::atoi(args.find("a")->second.c_str()), 100);
+  EXPECT_EQ(::strlen(args.Get("b").c_str()), 12);
+}
+
+TEST(query_args_test, decode) {
+  // The encoded separators are not split
+  auto args = ParseArgs("k%3D1=v%26w&%E4%BD%A0=%e5%A5%BD");
+
+  ASSERT_EQ(args.size(), 2);
+  EXPECT_EQ(args.Get("k=1"), "v&w");
+  EXPECT_EQ(args.Get("\xE4\xBD\xA0"), "\xE5\xA5\xBD");
+
+  // The invalid encoding is kept
+  args = ParseArgs("a=%zz%4&b=%");
+  EXPECT_EQ(args.Get("a"), "%zz%4");
+  EXPECT_EQ(args.Get("b"), "%");
+}
+
+TEST(query_args_test, form_body) {
+  std::string body = "name=kanon+httpd&lang=C%2B%2B&lang=C";
+  auto args = ParseArgs(body);
+
+  EXPECT_EQ(args.Get("name"), "kanon httpd");
+  // The first one is found
+  EXPECT_EQ(args.Get("lang"), "C++");
+  EXPECT_EQ(args.size(), 3);
+
+  // The source is not modified
+  EXPECT_EQ(body, "name=kanon+httpd&lang=C%2B%2B&lang=C");
+}
+
+TEST(query_args_test, set) {
+  Arena arena;
+  QueryArgs args(&arena);
+
+  args.Parse("id=1&x=2");
+  args.Set("id", "42");
+  args.Set("name", "a+b");
+
+  EXPECT_EQ(args.size(), 3);
+  EXPECT_EQ(args.Get("id"), "42");
+  // Not decoded
+  EXPECT_EQ(args.Get("name"), "a+b");
+  EXPECT_EQ(::strcmp(args.Get("name").c_str(), "a+b"), 0);
+}
+
+TEST(query_args_test, arena) {
+  Arena arena;
+
+  auto args = ParseArgs("a=1&b=2", &arena);
+  EXPECT_EQ(args.GetArena(), &arena);
+
+  const auto used = arena.GetUsed();
+  EXPECT_GT(used, 0);
+
+  // No allocation when looked up
+  EXPECT_EQ(args.Get("b"), "2");
+  EXPECT_EQ(arena.GetUsed(), used);
+
+  EXPECT_TRUE(ParseArgs("", &arena).empty());
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
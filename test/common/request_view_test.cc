@@ -0,0 +1,56 @@
+#include "plugin/request_view.h"
+#include "common/parse_args.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+TEST(request_view_test, default) {
+  RequestView view;
+
+  EXPECT_EQ(view.GetMethod(), HttpMethod::kNotSupport);
+  EXPECT_TRUE(view.GetArgs().empty());
+  EXPECT_TRUE(view.GetBody().empty());
+  EXPECT_TRUE(view.GetHeader("Host").empty());
+  EXPECT_EQ(view.GetHeaders(), nullptr);
+  EXPECT_EQ(view.GetPeerAddr(), nullptr);
+}
+
+TEST(request_view_test, header) {
+  ArenaHeaderMap headers;
+  headers.emplace("Content-Type", "text/plain");
+  headers.emplace("x-token", "abc");
+
+  RequestView view;
+  view.SetHeaders(&headers);
+
+  // Case-insensitive
+  EXPECT_EQ(view.GetHeader("content-type"), "text/plain");
+  EXPECT_EQ(view.GetHeader("X-Token"), "abc");
+  EXPECT_TRUE(view.GetHeader("X-Tok").empty());
+}
+
+TEST(request_view_test, request) {
+  std::string body = "a=1";
+  auto args = ParseArgs("b=2");
+
+  RequestView view;
+  view.SetMethod(HttpMethod::kPost);
+  view.SetPath("/contents/adder");
+  view.SetQuery("b=2");
+  view.SetArgs(args);
+  view.SetBody(body);
+
+  EXPECT_EQ(view.GetPath(), "/contents/adder");
+  EXPECT_EQ(view.GetQuery(), "b=2");
+  EXPECT_EQ(view.GetArgs().Get("b"), "2");
+  EXPECT_EQ(view.GetBody(), "a=1");
+  EXPECT_EQ(&view.GetBodyString(), &body);
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,208 @@
+#include "http2/fcgi_codec.h"
+#include "fcgi_responder.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+TEST(fcgi_codec_test, record) {
+  std::string records;
+  FcgiCodec::AppendBeginRequest(records, 1, true);
+  FcgiCodec::AppendStream(records, FcgiCodec::kStdin, 1, "hello");
+  FcgiCodec::AppendStream(records, FcgiCodec::kStdin, 1, StringView());
+
+  // The content is padded to 8 bytes
+  EXPECT_EQ(records.size(), 16 + 16 + 8);
+
+  StringView data(records);
+  FcgiCodec::Record record;
+  size_t consumed = 0;
+
+  ASSERT_EQ(FcgiCodec::Parse(data, record, consumed), FcgiCodec::kGood);
+  EXPECT_EQ(record.type, FcgiCodec::kBeginRequest);
+  EXPECT_EQ(record.request_id, 1);
+
+  uint16_t role = 0;
+  bool keep_conn = false;
+  EXPECT_TRUE(FcgiCodec::ParseBeginRequest(record.content, role, keep_conn));
+  EXPECT_EQ(role, FcgiCodec::kResponder);
+  EXPECT_TRUE(keep_conn);
+  data.remove_prefix(consumed);
+
+  ASSERT_EQ(FcgiCodec::Parse(data, record, consumed), FcgiCodec::kGood);
+  EXPECT_EQ(record.type, FcgiCodec::kStdin);
+  EXPECT_EQ(record.content, "hello");
+  EXPECT_EQ(consumed, 16);
+  data.remove_prefix(consumed);
+
+  ASSERT_EQ(FcgiCodec::Parse(data, record, consumed), FcgiCodec::kGood);
+  EXPECT_TRUE(record.content.empty());
+  EXPECT_EQ(consumed, data.size());
+}
+
+TEST(fcgi_codec_test, short_and_bad) {
+  std::string records;
+  FcgiCodec::AppendStream(records, FcgiCodec::kStdout, 3, "hello");
+
+  FcgiCodec::Record record;
+  size_t consumed = 0;
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(FcgiCodec::Parse(StringView(records.data(), i), record, consumed),
+              FcgiCodec::kShort);
+  }
+
+  records[0] = 2;
+  EXPECT_EQ(FcgiCodec::Parse(records, record, consumed), FcgiCodec::kBad);
+}
+
+TEST(fcgi_codec_test, large_stream) {
+  std::string body(FcgiCodec::kMaxContentSize + 100, 'x');
+  std::string records;
+  FcgiCodec::AppendStream(records, FcgiCodec::kStdin, 1, body);
+
+  StringView data(records);
+  FcgiCodec::Record record;
+  size_t consumed = 0;
+  std::string received;
+  int n = 0;
+
+  while (FcgiCodec::Parse(data, record, consumed) == FcgiCodec::kGood) {
+    received.append(record.content.data(), record.content.size());
+    data.remove_prefix(consumed);
+    ++n;
+  }
+
+  EXPECT_EQ(n, 2);
+  EXPECT_TRUE(data.empty());
+  EXPECT_EQ(received, body);
+}
+
+TEST(fcgi_codec_test, params) {
+  std::string long_value(200, 'v');
+  std::string params;
+  FcgiCodec::AppendParam(params, "REQUEST_METHOD", "GET");
+  FcgiCodec::AppendParam(params, "QUERY_STRING", "");
+  FcgiCodec::AppendParam(params, "HTTP_COOKIE", long_value);
+
+  std::vector<FcgiCodec::Pair> pairs;
+  ASSERT_TRUE(FcgiCodec::ParseParams(params, pairs));
+  ASSERT_EQ(pairs.size(), 3);
+  EXPECT_EQ(pairs[0].first, "REQUEST_METHOD");
+  EXPECT_EQ(pairs[0].second, "GET");
+  EXPECT_TRUE(pairs[1].second.empty());
+  EXPECT_EQ(pairs[2].second, long_value);
+
+  pairs.clear();
+  EXPECT_FALSE(FcgiCodec::ParseParams(StringView(params.data(), params.size() - 1), pairs));
+}
+
+TEST(fcgi_codec_test, response_head) {
+  int status = 0;
+  StringView reason;
+  std::vector<FcgiCodec::Pair> headers;
+  size_t consumed = 0;
+
+  StringView head = "Status: 404 Not Found\r\nContent-Type: text/html\r\n\r\nbody";
+  ASSERT_EQ(FcgiCodec::ParseResponseHead(head, status, reason, headers, consumed),
+            FcgiCodec::kGood);
+  EXPECT_EQ(status, 404);
+  EXPECT_EQ(reason, "Not Found");
+  ASSERT_EQ(headers.size(), 1);
+  EXPECT_EQ(headers[0].first, "Content-Type");
+  EXPECT_EQ(headers[0].second, "text/html");
+  EXPECT_EQ(head.substr(consumed), "body");
+
+  head = "Location: /index.html\n\n";
+  ASSERT_EQ(FcgiCodec::ParseResponseHead(head, status, reason, headers, consumed),
+            FcgiCodec::kGood);
+  EXPECT_EQ(status, 302);
+  EXPECT_EQ(consumed, head.size());
+
+  head = "Content-Type: text/plain\r\n";
+  EXPECT_EQ(FcgiCodec::ParseResponseHead(head, status, reason, headers, consumed),
+            FcgiCodec::kShort);
+
+  head = "Content-Type\r\n\r\n";
+  EXPECT_EQ(FcgiCodec::ParseResponseHead(head, status, reason, headers, consumed),
+            FcgiCodec::kBad);
+}
+
+static std::string Echo(DummyFcgiResponder::Params const& params, std::string const& input)
+{
+  return "Content-Type: text/plain\r\n\r\n" + params.at("REQUEST_METHOD") + " " + input;
+}
+
+TEST(fcgi_codec_test, multiplexed_requests) {
+  DummyFcgiResponder responder(&Echo);
+
+  std::string params;
+  FcgiCodec::AppendParam(params, "REQUEST_METHOD", "POST");
+
+  // The records of two requests are interleaved
+  std::string input;
+  FcgiCodec::AppendBeginRequest(input, 1, true);
+  FcgiCodec::AppendBeginRequest(input, 2, true);
+  FcgiCodec::AppendStream(input, FcgiCodec::kParams, 2, params);
+  FcgiCodec::AppendStream(input, FcgiCodec::kParams, 1, params);
+  FcgiCodec::AppendStream(input, FcgiCodec::kParams, 1, StringView());
+  FcgiCodec::AppendStream(input, FcgiCodec::kParams, 2, StringView());
+  FcgiCodec::AppendStream(input, FcgiCodec::kStdin, 2, "second");
+  FcgiCodec::AppendStream(input, FcgiCodec::kStdin, 1, "first");
+  FcgiCodec::AppendStream(input, FcgiCodec::kStdin, 2, StringView());
+
+  // Fed byte by byte as received from the network
+  std::string received;
+  std::string output;
+
+  for (auto c : input) {
+    received += c;
+    ASSERT_TRUE(responder.Feed(received, output));
+  }
+
+  EXPECT_TRUE(received.empty());
+  EXPECT_EQ(responder.GetRequestNum(), 1);
+
+  StringView data(output);
+  FcgiCodec::Record record;
+  size_t consumed = 0;
+  std::string stdout_content;
+  bool ended = false;
+
+  while (FcgiCodec::Parse(data, record, consumed) == FcgiCodec::kGood) {
+    EXPECT_EQ(record.request_id, 2);
+
+    if (record.type == FcgiCodec::kStdout) {
+      stdout_content.append(record.content.data(), record.content.size());
+    }
+    else if (record.type == FcgiCodec::kEndRequest) {
+      uint32_t app_status = 1;
+      FcgiCodec::ProtocolStatus status;
+      ASSERT_TRUE(FcgiCodec::ParseEndRequest(record.content, app_status, status));
+      EXPECT_EQ(app_status, 0);
+      EXPECT_EQ(status, FcgiCodec::kRequestComplete);
+      ended = true;
+    }
+
+    data.remove_prefix(consumed);
+  }
+
+  EXPECT_TRUE(ended);
+  EXPECT_EQ(stdout_content, "Content-Type: text/plain\r\n\r\nPOST second");
+
+  // The rest one is aborted
+  output.clear();
+  FcgiCodec::AppendAbortRequest(received, 1);
+  ASSERT_TRUE(responder.Feed(received, output));
+  EXPECT_EQ(responder.GetRequestNum(), 0);
+  EXPECT_EQ(responder.GetAbortNum(), 1);
+  ASSERT_EQ(FcgiCodec::Parse(output, record, consumed), FcgiCodec::kGood);
+  EXPECT_EQ(record.type, FcgiCodec::kEndRequest);
+  EXPECT_EQ(record.request_id, 1);
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
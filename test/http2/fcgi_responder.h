@@ -0,0 +1,190 @@
+#ifndef KANON_HTTP_TEST_FCGI_RESPONDER_H
+#define KANON_HTTP_TEST_FCGI_RESPONDER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <kanon/net/user_server.h>
+#include <kanon/util/any.h>
+
+#include "http2/fcgi_codec.h"
+
+namespace http {
+
+/**
+ * The dummy FastCGI responder used by the tests.
+ *
+ * The records of requests are fed and the responses are appended
+ * to the output once the FCGI_STDIN of request ends. The requests
+ * can be interleaved as the multiplexed ones.
+ */
+class DummyFcgiResponder {
+ public:
+  using Params = std::map<std::string, std::string>;
+
+  /** \return The content of FCGI_STDOUT, i.e. CGI header and body */
+  using Handler = std::function<std::string(Params const& params, std::string const& input)>;
+
+  explicit DummyFcgiResponder(Handler handler)
+    : handler_(std::move(handler))
+  {
+  }
+
+  /**
+   * \param input The bytes received, the complete records are removed
+   * \return false if the records are invalid
+   */
+  bool Feed(std::string& input, std::string& output)
+  {
+    kanon::StringView data(input);
+    FcgiCodec::Record record;
+    size_t consumed = 0;
+    FcgiCodec::Result result;
+
+    while ((result = FcgiCodec::Parse(data, record, consumed)) == FcgiCodec::kGood) {
+      if (!OnRecord(record, output)) return false;
+      data.remove_prefix(consumed);
+    }
+
+    input.erase(0, input.size() - data.size());
+    return result != FcgiCodec::kBad;
+  }
+
+  /** The requests not ended */
+  size_t GetRequestNum() const noexcept { return requests_.size(); }
+
+  /** The number of FCGI_ABORT_REQUEST received */
+  int GetAbortNum() const noexcept { return aborts_; }
+
+ private:
+  struct Request {
+    std::string params;
+    std::string input;
+  };
+
+  bool OnRecord(FcgiCodec::Record const& record, std::string& output)
+  {
+    const auto id = record.request_id;
+
+    switch (record.type) {
+      case FcgiCodec::kBeginRequest: {
+        uint16_t role = 0;
+        bool keep_conn = false;
+
+        if (!FcgiCodec::ParseBeginRequest(record.content, role, keep_conn) ||
+            role != FcgiCodec::kResponder || requests_.count(id)) {
+          return false;
+        }
+
+        requests_[id];
+      }
+        break;
+      case FcgiCodec::kParams:
+        if (!requests_.count(id)) return false;
+        requests_[id].params.append(record.content.data(), record.content.size());
+        break;
+      case FcgiCodec::kStdin: {
+        auto iter = requests_.find(id);
+        if (iter == requests_.end()) return false;
+
+        if (!record.content.empty()) {
+          iter->second.input.append(record.content.data(), record.content.size());
+          break;
+        }
+
+        std::vector<FcgiCodec::Pair> pairs;
+        if (!FcgiCodec::ParseParams(iter->second.params, pairs)) return false;
+
+        Params params;
+        for (auto const& pair : pairs) {
+          params[pair.first.ToString()] = pair.second.ToString();
+        }
+
+        FcgiCodec::AppendStream(output, FcgiCodec::kStdout, id,
+                                handler_(params, iter->second.input));
+        FcgiCodec::AppendStream(output, FcgiCodec::kStdout, id, kanon::StringView());
+        FcgiCodec::AppendEndRequest(output, id, 0, FcgiCodec::kRequestComplete);
+        requests_.erase(iter);
+      }
+        break;
+      case FcgiCodec::kAbortRequest:
+        ++aborts_;
+
+        if (requests_.erase(id)) {
+          FcgiCodec::AppendEndRequest(output, id, 0, FcgiCodec::kRequestComplete);
+        }
+        break;
+      default:
+        return false;
+    }
+
+    return true;
+  }
+
+  Handler handler_;
+  std::map<uint16_t, Request> requests_;
+  int aborts_ = 0;
+};
+
+/**
+ * Serve the DummyFcgiResponder over TCP in the loop
+ */
+class DummyFcgiServer {
+ public:
+  DummyFcgiServer(kanon::EventLoop* loop, kanon::InetAddr const& addr,
+                  DummyFcgiResponder::Handler handler)
+    : server_(loop, addr, "DummyFcgiServer")
+    , handler_(std::move(handler))
+  {
+    server_.SetConnectionCallback([this](kanon::TcpConnectionPtr const& conn) {
+      if (conn->IsConnected()) {
+        ++connections_;
+        conn->SetContext(std::make_shared<Session>(handler_));
+      }
+    });
+
+    server_.SetMessageCallback([](kanon::TcpConnectionPtr const& conn, kanon::Buffer& buffer,
+                                  kanon::TimeStamp) {
+      auto session = *kanon::AnyCast<std::shared_ptr<Session>>(conn->GetContext());
+
+      session->input.append(buffer.ToStringView().data(), buffer.GetReadableSize());
+      buffer.AdvanceAll();
+
+      std::string output;
+
+      if (!session->responder.Feed(session->input, output)) {
+        conn->ForceClose();
+        return;
+      }
+
+      if (!output.empty()) conn->Send(output);
+    });
+  }
+
+  void StartRun() { server_.StartRun(); }
+
+  /** The number of connections accepted */
+  int GetConnectionNum() const noexcept { return connections_; }
+
+ private:
+  struct Session {
+    explicit Session(DummyFcgiResponder::Handler handler)
+      : responder(std::move(handler))
+    {
+    }
+
+    DummyFcgiResponder responder;
+    std::string input;
+  };
+
+  kanon::TcpServer server_;
+  DummyFcgiResponder::Handler handler_;
+  int connections_ = 0;
+};
+
+} // namespace http
+
+#endif // KANON_HTTP_TEST_FCGI_RESPONDER_H
@@ -0,0 +1,183 @@
+#include "http2/fcgi_upstream.h"
+#include "fcgi_responder.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+static constexpr uint16_t kPort = 9876;
+
+static std::string Echo(DummyFcgiResponder::Params const& params, std::string const& input)
+{
+  return "Status: 201 Created\r\nContent-Type: text/plain\r\n\r\n" +
+         params.at("REQUEST_METHOD") + " " + input;
+}
+
+struct Response {
+  int status = 0;
+  std::string reason;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  bool ended = false;
+  bool ok = false;
+};
+
+static FcgiUpstream::Callbacks Collect(Response& response, std::function<void()> on_end)
+{
+  FcgiUpstream::Callbacks callbacks;
+
+  callbacks.on_head = [&response](int status, StringView reason,
+                                  std::vector<FcgiUpstream::Pair> const& headers) {
+    response.status = status;
+    response.reason = reason.ToString();
+
+    for (auto const& header : headers) {
+      response.headers.emplace_back(header.first.ToString(), header.second.ToString());
+    }
+  };
+
+  callbacks.on_body = [&response](StringView data) {
+    response.body.append(data.data(), data.size());
+  };
+
+  callbacks.on_end = [&response, on_end](bool ok) {
+    response.ended = true;
+    response.ok = ok;
+    on_end();
+  };
+
+  return callbacks;
+}
+
+static std::string MethodParam(StringView method)
+{
+  std::string params;
+  FcgiCodec::AppendParam(params, "REQUEST_METHOD", method);
+  return params;
+}
+
+TEST(fcgi_upstream_test, multiplexed) {
+  EventLoop loop;
+  DummyFcgiServer server(&loop, InetAddr(kPort), &Echo);
+  server.StartRun();
+
+  FcgiUpstream upstream(&loop, InetAddr("127.0.0.1", kPort), 1, 4, 16);
+
+  // The body is split into multiple records
+  std::string body(100000, 'b');
+  Response responses[3];
+  int ended = 0;
+
+  auto on_end = [&ended, &loop]() {
+    if (++ended == 3) loop.Quit();
+  };
+
+  EXPECT_NE(upstream.Submit(MethodParam("GET"), StringView(), Collect(responses[0], on_end)), 0);
+  EXPECT_NE(upstream.Submit(MethodParam("POST"), "hello", Collect(responses[1], on_end)), 0);
+  EXPECT_NE(upstream.Submit(MethodParam("POST"), body, Collect(responses[2], on_end)), 0);
+
+  loop.StartLoop();
+
+  EXPECT_EQ(server.GetConnectionNum(), 1);
+  EXPECT_EQ(upstream.GetConnectionNum(), 1);
+
+  for (auto const& response : responses) {
+    EXPECT_TRUE(response.ok);
+    EXPECT_EQ(response.status, 201);
+    EXPECT_EQ(response.reason, "Created");
+    ASSERT_EQ(response.headers.size(), 1);
+    EXPECT_EQ(response.headers[0].first, "Content-Type");
+  }
+
+  EXPECT_EQ(responses[0].body, "GET ");
+  EXPECT_EQ(responses[1].body, "POST hello");
+  EXPECT_EQ(responses[2].body, "POST " + body);
+}
+
+TEST(fcgi_upstream_test, queued_and_reused) {
+  EventLoop loop;
+  DummyFcgiServer server(&loop, InetAddr(kPort + 1), &Echo);
+  server.StartRun();
+
+  // One request per connection(e.g. php-fpm), the others wait in the queue
+  FcgiUpstream upstream(&loop, InetAddr("127.0.0.1", kPort + 1), 1, 1, 1);
+
+  Response responses[2];
+  Response rejected;
+  int ended = 0;
+
+  auto on_end = [&ended, &loop]() {
+    if (++ended == 2) loop.Quit();
+  };
+
+  EXPECT_NE(upstream.Submit(MethodParam("GET"), "1", Collect(responses[0], on_end)), 0);
+  EXPECT_NE(upstream.Submit(MethodParam("GET"), "2", Collect(responses[1], on_end)), 0);
+  EXPECT_EQ(upstream.GetPendingNum(), 1);
+  EXPECT_EQ(upstream.Submit(MethodParam("GET"), "3", Collect(rejected, on_end)), 0);
+
+  loop.StartLoop();
+
+  // The connection is kept for the queued request
+  EXPECT_EQ(server.GetConnectionNum(), 1);
+  EXPECT_EQ(upstream.GetPendingNum(), 0);
+  EXPECT_EQ(responses[0].body, "GET 1");
+  EXPECT_EQ(responses[1].body, "GET 2");
+  EXPECT_FALSE(rejected.ended);
+}
+
+TEST(fcgi_upstream_test, aborted) {
+  EventLoop loop;
+  DummyFcgiServer server(&loop, InetAddr(kPort + 2), &Echo);
+  server.StartRun();
+
+  FcgiUpstream upstream(&loop, InetAddr("127.0.0.1", kPort + 2), 1, 2, 16);
+
+  Response aborted;
+  Response response;
+
+  auto id = upstream.Submit(MethodParam("GET"), StringView(), Collect(aborted, []() {}));
+  upstream.Submit(MethodParam("GET"), StringView(), Collect(response, [&loop]() { loop.Quit(); }));
+  upstream.Abort(id);
+
+  loop.StartLoop();
+
+  EXPECT_FALSE(aborted.ended);
+  EXPECT_TRUE(response.ok);
+}
+
+TEST(fcgi_upstream_test, unavailable) {
+  EventLoop loop;
+
+  // Nothing listens on it
+  FcgiUpstream upstream(&loop, InetAddr("127.0.0.1", kPort + 3), 1, 1, 16);
+
+  Response response;
+  upstream.Submit(MethodParam("GET"), StringView(), Collect(response, [&loop]() { loop.Quit(); }));
+
+  loop.StartLoop();
+
+  EXPECT_TRUE(response.ended);
+  EXPECT_FALSE(response.ok);
+  EXPECT_EQ(response.status, 0);
+  EXPECT_EQ(upstream.GetConnectionNum(), 0);
+}
+
+TEST(fcgi_upstream_test, parse_address) {
+  std::string ip;
+  uint16_t port = 0;
+  std::string error;
+
+  EXPECT_TRUE(FcgiUpstream::ParseAddress("127.0.0.1:9000", ip, port, error));
+  EXPECT_EQ(ip, "127.0.0.1");
+  EXPECT_EQ(port, 9000);
+
+  EXPECT_FALSE(FcgiUpstream::ParseAddress("127.0.0.1", ip, port, error));
+  EXPECT_FALSE(FcgiUpstream::ParseAddress("127.0.0.1:0", ip, port, error));
+  EXPECT_FALSE(FcgiUpstream::ParseAddress("unix:/run/php-fpm.sock", ip, port, error));
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
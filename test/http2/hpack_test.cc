@@ -0,0 +1,192 @@
+#include "http2/hpack.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+// e.g. "8286" -> "\x82\x86"
+static std::string FromHex(char const* hex)
+{
+  std::string bytes;
+
+  for (; hex[0] && hex[1]; hex += 2) {
+    bytes += static_cast<char>(std::stoi(std::string(hex, 2), nullptr, 16));
+  }
+
+  return bytes;
+}
+
+using Headers = std::vector<Hpack::Header>;
+
+TEST(hpack_test, integer) {
+  // RFC 7541 C.1
+  std::string out;
+  Hpack::AppendInteger(out, 10, 5, 0);
+  EXPECT_EQ(out, FromHex("0a"));
+
+  out.clear();
+  Hpack::AppendInteger(out, 1337, 5, 0);
+  EXPECT_EQ(out, FromHex("1f9a0a"));
+
+  out.clear();
+  Hpack::AppendInteger(out, 42, 8, 0);
+  EXPECT_EQ(out, FromHex("2a"));
+
+  for (uint64_t value : { 0, 30, 31, 127, 128, 1337, 1 << 20 }) {
+    out.clear();
+    Hpack::AppendInteger(out, value, 5, 0xe0);
+
+    StringView data(out);
+    uint64_t decoded = 0;
+    ASSERT_TRUE(Hpack::ParseInteger(data, 5, decoded));
+    EXPECT_EQ(decoded, value);
+    EXPECT_TRUE(data.empty());
+  }
+
+  // Incomplete
+  std::string incomplete = FromHex("1f9a");
+  StringView data(incomplete);
+  uint64_t value = 0;
+  EXPECT_FALSE(Hpack::ParseInteger(data, 5, value));
+}
+
+TEST(hpack_test, huffman) {
+  std::string out;
+  Hpack::HuffmanEncode(out, "www.example.com");
+  EXPECT_EQ(out, FromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+  EXPECT_EQ(Hpack::GetHuffmanLength("www.example.com"), out.size());
+
+  std::string decoded;
+  ASSERT_TRUE(Hpack::HuffmanDecode(decoded, out));
+  EXPECT_EQ(decoded, "www.example.com");
+
+  // All symbols
+  std::string all;
+  for (int i = 0; i < 256; ++i) all += static_cast<char>(i);
+
+  out.clear();
+  decoded.clear();
+  Hpack::HuffmanEncode(out, all);
+  ASSERT_TRUE(Hpack::HuffmanDecode(decoded, out));
+  EXPECT_EQ(decoded, all);
+
+  // The padding is longer than 7 bits
+  decoded.clear();
+  EXPECT_FALSE(Hpack::HuffmanDecode(decoded, FromHex("f1e3c2e5f23a6ba0ab90f4ffff")));
+
+  // The padding is not the prefix of EOS
+  decoded.clear();
+  EXPECT_FALSE(Hpack::HuffmanDecode(decoded, FromHex("f1e3c2e5f23a6ba0ab90f4fe")));
+}
+
+TEST(hpack_test, decode_requests) {
+  // RFC 7541 C.3, without Huffman
+  HpackDecoder decoder;
+  Headers headers;
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828684410f7777772e6578616d706c652e636f6d"), headers));
+  EXPECT_EQ(headers, Headers({ { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                               { ":authority", "www.example.com" } }));
+  EXPECT_EQ(decoder.GetTableSize(), 57);
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828684be58086e6f2d6361636865"), headers));
+  EXPECT_EQ(headers, Headers({ { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                               { ":authority", "www.example.com" },
+                               { "cache-control", "no-cache" } }));
+  EXPECT_EQ(decoder.GetTableSize(), 110);
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565"),
+                             headers));
+  EXPECT_EQ(headers, Headers({ { ":method", "GET" }, { ":scheme", "https" },
+                               { ":path", "/index.html" }, { ":authority", "www.example.com" },
+                               { "custom-key", "custom-value" } }));
+  EXPECT_EQ(decoder.GetTableSize(), 164);
+  EXPECT_EQ(decoder.GetEntryNum(), 3);
+}
+
+TEST(hpack_test, decode_requests_huffman) {
+  // RFC 7541 C.4
+  HpackDecoder decoder;
+  Headers headers;
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), headers));
+  EXPECT_EQ(headers[3], Hpack::Header(":authority", "www.example.com"));
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828684be5886a8eb10649cbf"), headers));
+  EXPECT_EQ(headers[4], Hpack::Header("cache-control", "no-cache"));
+
+  ASSERT_TRUE(decoder.Decode(FromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), headers));
+  EXPECT_EQ(headers[4], Hpack::Header("custom-key", "custom-value"));
+  EXPECT_EQ(decoder.GetTableSize(), 164);
+}
+
+TEST(hpack_test, eviction) {
+  // RFC 7541 C.5, the table size is 256
+  HpackDecoder decoder;
+  Headers headers;
+
+  ASSERT_TRUE(decoder.Decode(FromHex("3fe101"), headers));
+  EXPECT_TRUE(headers.empty());
+
+  ASSERT_TRUE(decoder.Decode(FromHex(
+    "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d54"
+    "6e1768747470733a2f2f7777772e6578616d706c652e636f6d"), headers));
+  EXPECT_EQ(decoder.GetTableSize(), 222);
+
+  ASSERT_TRUE(decoder.Decode(FromHex("4803333037c1c0bf"), headers));
+  EXPECT_EQ(headers[0], Hpack::Header(":status", "307"));
+  EXPECT_EQ(headers[3], Hpack::Header("location", "https://www.example.com"));
+  EXPECT_EQ(decoder.GetTableSize(), 222);
+  EXPECT_EQ(decoder.GetEntryNum(), 4);
+
+  // The size update can't exceed the SETTINGS_HEADER_TABLE_SIZE
+  decoder.SetMaxTableSize(100);
+  EXPECT_FALSE(decoder.Decode(FromHex("3fe101"), headers));
+}
+
+TEST(hpack_test, decode_bad) {
+  HpackDecoder decoder;
+  Headers headers;
+
+  // Index 0 and out of the table
+  EXPECT_FALSE(decoder.Decode(FromHex("80"), headers));
+  EXPECT_FALSE(decoder.Decode(FromHex("be"), headers));
+
+  // The string is truncated
+  EXPECT_FALSE(decoder.Decode(FromHex("410f7777"), headers));
+
+  // The size update after a field
+  EXPECT_FALSE(decoder.Decode(FromHex("8220"), headers));
+
+  decoder.SetMaxHeaderListSize(64);
+  EXPECT_FALSE(decoder.Decode(FromHex("828684410f7777772e6578616d706c652e636f6d"), headers));
+}
+
+TEST(hpack_test, encode) {
+  HpackEncoder encoder;
+  HpackDecoder decoder;
+  Headers headers;
+
+  for (int i = 0; i < 2; ++i) {
+    std::string block;
+    encoder.Append(block, ":status", "200");
+    encoder.Append(block, ":status", "201");
+    encoder.Append(block, "content-type", "text/html");
+    encoder.Append(block, "x-kanon", "value");
+
+    // The size update to 0 is only in the first block
+    EXPECT_EQ(block[0] == 0x20, i == 0);
+    EXPECT_EQ(block[i == 0 ? 1 : 0], '\x88');
+
+    ASSERT_TRUE(decoder.Decode(block, headers));
+    EXPECT_EQ(headers, Headers({ { ":status", "200" }, { ":status", "201" },
+                                 { "content-type", "text/html" }, { "x-kanon", "value" } }));
+    EXPECT_EQ(decoder.GetEntryNum(), 0);
+  }
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
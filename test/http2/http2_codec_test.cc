@@ -0,0 +1,123 @@
+#include "http2/http2_codec.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+TEST(http2_codec_test, preface) {
+  std::string preface(Http2Codec::kPreface);
+
+  EXPECT_EQ(Http2Codec::MatchPreface(preface), 1);
+  EXPECT_EQ(Http2Codec::MatchPreface(preface + "extra"), 1);
+  EXPECT_EQ(Http2Codec::MatchPreface(preface.substr(0, 10)), 0);
+  EXPECT_EQ(Http2Codec::MatchPreface("GET / HTTP/1.1\r\n"), -1);
+}
+
+TEST(http2_codec_test, frame) {
+  std::string out;
+  Http2Codec::AppendPing(out, "12345678", false);
+  Http2Codec::AppendWindowUpdate(out, 3, 1000);
+
+  Http2Codec::Frame frame;
+  size_t consumed = 0;
+
+  // Incomplete
+  EXPECT_EQ(Http2Codec::Parse(StringView(out.data(), 12), 16384, frame, consumed),
+            Http2Codec::kShort);
+
+  ASSERT_EQ(Http2Codec::Parse(out, 16384, frame, consumed), Http2Codec::kGood);
+  EXPECT_EQ(frame.type, Http2Codec::kPing);
+  EXPECT_EQ(frame.flags, 0);
+  EXPECT_EQ(frame.stream_id, 0);
+  EXPECT_EQ(frame.payload, "12345678");
+  EXPECT_EQ(consumed, 17);
+
+  StringView rest(out);
+  rest.remove_prefix(consumed);
+  ASSERT_EQ(Http2Codec::Parse(rest, 16384, frame, consumed), Http2Codec::kGood);
+  EXPECT_EQ(frame.type, Http2Codec::kWindowUpdate);
+  EXPECT_EQ(frame.stream_id, 3);
+  EXPECT_EQ(Http2Codec::ReadUint32(frame.payload), 1000);
+
+  // Larger than the max frame size
+  EXPECT_EQ(Http2Codec::Parse(out, 4, frame, consumed), Http2Codec::kBad);
+}
+
+TEST(http2_codec_test, headers) {
+  std::string block(40000, 'x');
+  std::string out;
+  Http2Codec::AppendHeaders(out, 1, block, true, 16384);
+
+  Http2Codec::Frame frame;
+  size_t consumed = 0;
+  StringView data(out);
+  std::string received;
+  int n = 0;
+
+  while (!data.empty()) {
+    ASSERT_EQ(Http2Codec::Parse(data, 16384, frame, consumed), Http2Codec::kGood);
+    data.remove_prefix(consumed);
+
+    // END_STREAM is only in HEADERS, END_HEADERS is in the last one
+    EXPECT_EQ(frame.type, n == 0 ? Http2Codec::kHeaders : Http2Codec::kContinuation);
+    EXPECT_EQ((frame.flags & Http2Codec::kEndStream) != 0, n == 0);
+    EXPECT_EQ((frame.flags & Http2Codec::kEndHeaders) != 0, data.empty());
+    received.append(frame.payload.data(), frame.payload.size());
+    ++n;
+  }
+
+  EXPECT_EQ(n, 3);
+  EXPECT_EQ(received, block);
+}
+
+TEST(http2_codec_test, headers_payload) {
+  // Padded(2) and priority: exclusive, depends on 3, weight 256
+  static char const kPayload[] = "\x02\x80\x00\x00\x03\xff" "block" "\x00\x00";
+  std::string payload(kPayload, sizeof(kPayload) - 1);
+
+  Http2Codec::Frame frame;
+  frame.type = Http2Codec::kHeaders;
+  frame.flags = Http2Codec::kPadded | Http2Codec::kPriorityFlag;
+  frame.stream_id = 5;
+  frame.payload = StringView(payload.data(), payload.size());
+
+  Http2Codec::Priority priority;
+  bool has_priority = false;
+  ASSERT_TRUE(Http2Codec::ParseHeadersPayload(frame, priority, has_priority));
+  EXPECT_TRUE(has_priority);
+  EXPECT_TRUE(priority.exclusive);
+  EXPECT_EQ(priority.dependency, 3);
+  EXPECT_EQ(priority.weight, 256);
+  EXPECT_EQ(frame.payload, "block");
+
+  // The padding is longer than the payload
+  std::string bad = "\x09" "abc";
+  frame.flags = Http2Codec::kPadded;
+  frame.payload = StringView(bad.data(), bad.size());
+  EXPECT_FALSE(Http2Codec::RemovePadding(frame));
+}
+
+TEST(http2_codec_test, settings) {
+  std::string out;
+  Http2Codec::AppendSettings(out, { { Http2Codec::kSettingInitialWindowSize, 1 << 20 },
+                                    { Http2Codec::kSettingMaxFrameSize, 32768 } });
+
+  Http2Codec::Frame frame;
+  size_t consumed = 0;
+  ASSERT_EQ(Http2Codec::Parse(out, 16384, frame, consumed), Http2Codec::kGood);
+  EXPECT_EQ(frame.type, Http2Codec::kSettings);
+
+  std::vector<Http2Codec::Setting> settings;
+  ASSERT_TRUE(Http2Codec::ParseSettings(frame.payload, settings));
+  ASSERT_EQ(settings.size(), 2);
+  EXPECT_EQ(settings[0], Http2Codec::Setting(Http2Codec::kSettingInitialWindowSize, 1 << 20));
+  EXPECT_EQ(settings[1], Http2Codec::Setting(Http2Codec::kSettingMaxFrameSize, 32768));
+
+  EXPECT_FALSE(Http2Codec::ParseSettings("12345", settings));
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
@@ -46,7 +46,8 @@ TEST(http_parser, header_line) {
   EXPECT_EQ(request3.method, HttpMethod::kHead);
   EXPECT_EQ(request3.version, HttpVersion::kHttp11);
   EXPECT_EQ(request3.url, "/kanon_http/contents/ ");
-  EXPECT_EQ(request3.query, "a=100&b=102");
+  // The query is decoded by ParseArgs()
+  EXPECT_EQ(request3.query, "a=%31%30%30&b=%31%30%32");
 }
 
 TEST(http_parser, error_handling_of_header_line) {
@@ -82,6 +83,56 @@ TEST(http_parser, error_handling_of_header_line) {
   LOG_DEBUG << "The error message for not supported http version code";
 }
 
+TEST(http_parser, url_normalization) {
+  HttpParser parser;
+
+  auto parse = [&parser](char const* line, HttpRequest& request) {
+    return parser.ParseHeaderLine(line, &request);
+  };
+
+  // Scenario:
+  // The encoded dots and slashes can't escape the root
+  HttpRequest request;
+  EXPECT_EQ(parse("GET /%2e%2e%2f%2e%2e%2f/etc/passwd HTTP/1.1", request), HttpParser::kGood);
+  EXPECT_EQ(request.url, "/etc/passwd");
+
+  HttpRequest request2;
+  EXPECT_EQ(parse("GET /a/%2E./%2e%2E/b HTTP/1.1", request2), HttpParser::kGood);
+  EXPECT_EQ(request2.url, "/b");
+
+  HttpRequest request3;
+  EXPECT_EQ(parse("GET /a/b/.. HTTP/1.1", request3), HttpParser::kGood);
+  EXPECT_EQ(request3.url, "/a/");
+
+  HttpRequest request4;
+  EXPECT_EQ(parse("GET /%2e%2e HTTP/1.1", request4), HttpParser::kGood);
+  EXPECT_EQ(request4.url, "/");
+
+  HttpRequest request5;
+  EXPECT_EQ(parse("GET /a%2fb//./c HTTP/1.1", request5), HttpParser::kGood);
+  EXPECT_EQ(request5.url, "/a/b/c");
+
+  // Scenario:
+  // The names starting with dot are kept
+  HttpRequest request6;
+  EXPECT_EQ(parse("GET /a/.hidden/..b%20 HTTP/1.1", request6), HttpParser::kGood);
+  EXPECT_EQ(request6.url, "/a/.hidden/..b ");
+}
+
+TEST(http_parser, url_invalid_encoding) {
+  HttpParser parser;
+
+  for (auto line : { "GET /a%0d%0aHost:%20x HTTP/1.1",
+                     "GET /a%00.html HTTP/1.1",
+                     "GET /%7f HTTP/1.1",
+                     "GET /a/%1 HTTP/1.1",
+                     "GET /a/%zz HTTP/1.1", }) {
+    HttpRequest request;
+    EXPECT_EQ(parser.ParseHeaderLine(line, &request), HttpParser::kError) << line;
+    EXPECT_EQ(parser.error_.code, HttpStatusCode::k400BadRequest);
+  }
+}
+
 TEST(http_parser, header_fields) {
   // Scenario:
   // Single header field
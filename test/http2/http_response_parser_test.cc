@@ -0,0 +1,165 @@
+#include "http2/http_response_parser.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+// Decode the whole body, the data is fed byte by byte if \p split
+static HttpResponseParser::Result DecodeBody(HttpResponseParser& parser, StringView data,
+                                             std::string& body, bool split = false)
+{
+  std::string received;
+  size_t fed = 0;
+
+  while (!parser.IsComplete()) {
+    if (split && fed < data.size()) {
+      received += data[fed++];
+    }
+    else if (!split) {
+      received.assign(data.data(), data.size());
+      fed = data.size();
+    }
+
+    StringView piece;
+    size_t consumed = 0;
+    auto result = parser.ParseBody(received, piece, consumed);
+
+    if (result == HttpResponseParser::kBad) return result;
+
+    if (result == HttpResponseParser::kShort) {
+      if (fed == data.size()) return result;
+      continue;
+    }
+
+    body.append(piece.data(), piece.size());
+    received.erase(0, consumed);
+
+    if (!split) data.remove_prefix(consumed);
+  }
+
+  return HttpResponseParser::kGood;
+}
+
+TEST(http_response_parser_test, content_length) {
+  HttpResponseParser parser;
+  parser.Reset();
+
+  StringView response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                        "Content-Length: 5\r\n\r\nhello";
+  size_t consumed = 0;
+
+  for (size_t i = 0; i < 40; ++i) {
+    EXPECT_EQ(parser.ParseHead(response.substr(0, i), consumed), HttpResponseParser::kShort);
+  }
+
+  ASSERT_EQ(parser.ParseHead(response, consumed), HttpResponseParser::kGood);
+  EXPECT_EQ(parser.GetStatus(), 200);
+  EXPECT_EQ(parser.GetReason(), "OK");
+  EXPECT_EQ(parser.GetContentLength(), 5);
+  EXPECT_TRUE(parser.IsKeepAlive());
+  ASSERT_EQ(parser.GetHeaders().size(), 2);
+  EXPECT_EQ(parser.GetHeaders()[0].first, "Content-Type");
+  EXPECT_EQ(parser.GetHeaders()[0].second, "text/plain");
+
+  std::string body;
+  EXPECT_EQ(DecodeBody(parser, response.substr(consumed), body), HttpResponseParser::kGood);
+  EXPECT_EQ(body, "hello");
+}
+
+TEST(http_response_parser_test, chunked) {
+  StringView head = "HTTP/1.1 404 Not Found\r\nTransfer-Encoding: chunked\r\n"
+                    "Content-Length: 100\r\n\r\n";
+  StringView chunks = "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+
+  for (bool split : {false, true}) {
+    HttpResponseParser parser;
+    parser.Reset();
+
+    size_t consumed = 0;
+    ASSERT_EQ(parser.ParseHead(head, consumed), HttpResponseParser::kGood);
+    EXPECT_EQ(parser.GetStatus(), 404);
+    EXPECT_EQ(parser.GetReason(), "Not Found");
+    EXPECT_EQ(parser.GetContentLength(), -1);
+
+    std::string body;
+    EXPECT_EQ(DecodeBody(parser, chunks, body, split), HttpResponseParser::kGood);
+    EXPECT_EQ(body, "hello world");
+    EXPECT_TRUE(parser.IsComplete());
+  }
+}
+
+TEST(http_response_parser_test, no_body) {
+  HttpResponseParser parser;
+  size_t consumed = 0;
+
+  parser.Reset();
+  ASSERT_EQ(parser.ParseHead("HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\n\r\n", consumed),
+            HttpResponseParser::kGood);
+  EXPECT_TRUE(parser.IsComplete());
+  EXPECT_EQ(parser.GetContentLength(), 0);
+
+  // The length of HEAD response is kept
+  parser.Reset(true);
+  ASSERT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n", consumed),
+            HttpResponseParser::kGood);
+  EXPECT_TRUE(parser.IsComplete());
+  EXPECT_EQ(parser.GetContentLength(), 10);
+}
+
+TEST(http_response_parser_test, until_close) {
+  HttpResponseParser parser;
+  parser.Reset();
+
+  size_t consumed = 0;
+  ASSERT_EQ(parser.ParseHead("HTTP/1.0 200 OK\r\nConnection: keep-alive\r\n\r\n", consumed),
+            HttpResponseParser::kGood);
+  EXPECT_TRUE(parser.IsUntilClose());
+  EXPECT_FALSE(parser.IsKeepAlive());
+
+  StringView piece;
+  EXPECT_EQ(parser.ParseBody("data", piece, consumed), HttpResponseParser::kGood);
+  EXPECT_EQ(piece, "data");
+  EXPECT_EQ(parser.ParseBody(StringView(), piece, consumed), HttpResponseParser::kShort);
+  EXPECT_FALSE(parser.IsComplete());
+}
+
+TEST(http_response_parser_test, keep_alive) {
+  HttpResponseParser parser;
+  size_t consumed = 0;
+
+  parser.Reset();
+  ASSERT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n",
+                             consumed), HttpResponseParser::kGood);
+  EXPECT_FALSE(parser.IsKeepAlive());
+  EXPECT_TRUE(parser.IsComplete());
+
+  parser.Reset();
+  ASSERT_EQ(parser.ParseHead("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n",
+                             consumed), HttpResponseParser::kGood);
+  EXPECT_TRUE(parser.IsKeepAlive());
+}
+
+TEST(http_response_parser_test, bad) {
+  HttpResponseParser parser;
+  size_t consumed = 0;
+
+  parser.Reset();
+  EXPECT_EQ(parser.ParseHead("HTTP/2 200 OK\r\n\r\n", consumed), HttpResponseParser::kBad);
+  EXPECT_EQ(parser.ParseHead("HTTP/1.1 abc OK\r\n\r\n", consumed), HttpResponseParser::kBad);
+  EXPECT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nNoColon\r\n\r\n", consumed),
+            HttpResponseParser::kBad);
+  EXPECT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n", consumed),
+            HttpResponseParser::kBad);
+
+  ASSERT_EQ(parser.ParseHead("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n", consumed),
+            HttpResponseParser::kGood);
+
+  std::string body;
+  EXPECT_EQ(DecodeBody(parser, "zz\r\n", body), HttpResponseParser::kBad);
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,241 @@
+#include "http2/http_upstream.h"
+#include "http2/http_response_parser.h"
+
+#include <kanon/net/user_server.h>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+static constexpr uint16_t kPort = 9886;
+
+/**
+ * Reply its name to each request, the connection is kept alive
+ */
+class DummyHttpServer {
+ public:
+  DummyHttpServer(EventLoop* loop, uint16_t port, std::string name)
+    : server_(loop, InetAddr(port), "DummyHttpServer")
+    , name_(std::move(name))
+  {
+    server_.SetConnectionCallback([this](TcpConnectionPtr const& conn) {
+      if (conn->IsConnected()) ++connections_;
+    });
+
+    server_.SetMessageCallback([this](TcpConnectionPtr const& conn, Buffer& buffer, TimeStamp) {
+      auto data = buffer.ToStringView();
+      auto end_pos = data.find("\r\n\r\n");
+
+      while (end_pos != StringView::npos) {
+        buffer.AdvanceRead(end_pos + 4);
+        ++requests_;
+
+        conn->Send("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(name_.size()) +
+                   "\r\n\r\n" + name_);
+
+        data = buffer.ToStringView();
+        end_pos = data.find("\r\n\r\n");
+      }
+    });
+
+    server_.StartRun();
+  }
+
+  int GetConnectionNum() const noexcept { return connections_; }
+  int GetRequestNum() const noexcept { return requests_; }
+
+ private:
+  TcpServer server_;
+  std::string name_;
+  int connections_ = 0;
+  int requests_ = 0;
+};
+
+/**
+ * Send a request on the acquired connection and collect the body
+ */
+static void Request(HttpUpstream& upstream, std::function<void(std::string const& body,
+                                                                bool reused)> done)
+{
+  upstream.Acquire([&upstream, done](HttpUpstream::ConnectionPtr const& c) {
+    if (!c) {
+      done(std::string(), false);
+      return;
+    }
+
+    auto parser = std::make_shared<HttpResponseParser>();
+    auto body = std::make_shared<std::string>();
+    parser->Reset();
+
+    c->SetMessageCallback([&upstream, c, parser, body, done](Buffer& buffer) {
+      if (!parser->IsHeadDone()) {
+        size_t consumed = 0;
+        if (parser->ParseHead(buffer.ToStringView(), consumed) != HttpResponseParser::kGood) return;
+        buffer.AdvanceRead(consumed);
+      }
+
+      StringView piece;
+      size_t consumed = 0;
+
+      while (parser->ParseBody(buffer.ToStringView(), piece, consumed) == HttpResponseParser::kGood) {
+        body->append(piece.data(), piece.size());
+        buffer.AdvanceRead(consumed);
+      }
+
+      if (parser->IsComplete()) {
+        const bool reused = c->IsReused();
+        upstream.Release(c, parser->IsKeepAlive());
+        done(*body, reused);
+      }
+    });
+
+    c->GetConnection()->Send("GET / HTTP/1.1\r\nHost: test\r\n\r\n");
+  });
+}
+
+TEST(http_upstream_test, keep_alive) {
+  EventLoop loop;
+  DummyHttpServer server(&loop, kPort, "a");
+
+  HttpUpstream upstream(&loop, { InetAddr("127.0.0.1", kPort) }, HttpUpstream::Options());
+
+  std::vector<std::pair<std::string, bool>> results;
+
+  // The second request reuses the connection of the first one
+  Request(upstream, [&](std::string const& body, bool reused) {
+    results.emplace_back(body, reused);
+
+    Request(upstream, [&](std::string const& body, bool reused) {
+      results.emplace_back(body, reused);
+      loop.Quit();
+    });
+  });
+
+  loop.StartLoop();
+
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_EQ(results[0].first, "a");
+  EXPECT_FALSE(results[0].second);
+  EXPECT_EQ(results[1].first, "a");
+  EXPECT_TRUE(results[1].second);
+
+  EXPECT_EQ(server.GetConnectionNum(), 1);
+  EXPECT_EQ(server.GetRequestNum(), 2);
+  EXPECT_EQ(upstream.GetIdleNum(0), 1);
+  EXPECT_EQ(upstream.GetActiveNum(0), 0);
+}
+
+TEST(http_upstream_test, round_robin) {
+  EventLoop loop;
+  DummyHttpServer a(&loop, kPort + 1, "a");
+  DummyHttpServer b(&loop, kPort + 2, "b");
+
+  HttpUpstream upstream(&loop, { InetAddr("127.0.0.1", kPort + 1),
+                                 InetAddr("127.0.0.1", kPort + 2) },
+                        HttpUpstream::Options());
+
+  std::vector<std::string> bodies;
+
+  for (int i = 0; i < 4; ++i) {
+    Request(upstream, [&](std::string const& body, bool) {
+      bodies.push_back(body);
+      if (bodies.size() == 4) loop.Quit();
+    });
+  }
+
+  loop.StartLoop();
+
+  std::sort(bodies.begin(), bodies.end());
+  EXPECT_EQ(bodies, std::vector<std::string>({ "a", "a", "b", "b" }));
+  EXPECT_EQ(a.GetRequestNum(), 2);
+  EXPECT_EQ(b.GetRequestNum(), 2);
+}
+
+TEST(http_upstream_test, least_conn) {
+  EventLoop loop;
+  DummyHttpServer a(&loop, kPort + 3, "a");
+  DummyHttpServer b(&loop, kPort + 4, "b");
+
+  HttpUpstream::Options options;
+  options.balance = HttpUpstream::kLeastConn;
+
+  HttpUpstream upstream(&loop, { InetAddr("127.0.0.1", kPort + 3),
+                                 InetAddr("127.0.0.1", kPort + 4) },
+                        options);
+
+  // The connection of a is held, then the others go to b
+  HttpUpstream::ConnectionPtr held;
+  upstream.Acquire([&](HttpUpstream::ConnectionPtr const& c) {
+    held = c;
+
+    Request(upstream, [&](std::string const& body, bool) {
+      EXPECT_EQ(body, "b");
+
+      Request(upstream, [&](std::string const& body, bool) {
+        EXPECT_EQ(body, "b");
+        loop.Quit();
+      });
+    });
+  });
+
+  loop.StartLoop();
+
+  ASSERT_TRUE(held);
+  EXPECT_EQ(upstream.GetActiveNum(0), 1);
+  EXPECT_EQ(b.GetConnectionNum(), 1);
+  upstream.Release(held, true);
+}
+
+TEST(http_upstream_test, failover) {
+  EventLoop loop;
+
+  // Nothing listens on the first one
+  DummyHttpServer b(&loop, kPort + 6, "b");
+
+  HttpUpstream::Options options;
+  options.max_fails = 1;
+  options.fail_timeout = 60;
+
+  HttpUpstream upstream(&loop, { InetAddr("127.0.0.1", kPort + 5),
+                                 InetAddr("127.0.0.1", kPort + 6) },
+                        options);
+
+  std::vector<std::string> bodies;
+
+  Request(upstream, [&](std::string const& body, bool) {
+    bodies.push_back(body);
+
+    // The failed one is out of rotation
+    Request(upstream, [&](std::string const& body, bool) {
+      bodies.push_back(body);
+      loop.Quit();
+    });
+  });
+
+  loop.StartLoop();
+
+  EXPECT_EQ(bodies, std::vector<std::string>({ "b", "b" }));
+  EXPECT_FALSE(upstream.IsPeerUp(0));
+  EXPECT_TRUE(upstream.IsPeerUp(1));
+}
+
+TEST(http_upstream_test, parse_addresses) {
+  std::vector<std::pair<std::string, uint16_t>> addrs;
+  std::string error;
+
+  EXPECT_TRUE(HttpUpstream::ParseAddresses("127.0.0.1:8080,10.0.0.2:80", addrs, error));
+  ASSERT_EQ(addrs.size(), 2);
+  EXPECT_EQ(addrs[0].first, "127.0.0.1");
+  EXPECT_EQ(addrs[0].second, 8080);
+  EXPECT_EQ(addrs[1].first, "10.0.0.2");
+
+  EXPECT_FALSE(HttpUpstream::ParseAddresses("127.0.0.1", addrs, error));
+  EXPECT_FALSE(HttpUpstream::ParseAddresses("127.0.0.1:8080,:80", addrs, error));
+  EXPECT_FALSE(HttpUpstream::ParseAddresses("", addrs, error));
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
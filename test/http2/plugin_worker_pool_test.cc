@@ -0,0 +1,72 @@
+#include "http2/plugin_worker_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+TEST(plugin_worker_pool_test, run) {
+  ServerStats stats;
+  std::atomic<int> count{0};
+
+  {
+    PluginWorkerPool pool(4, 1024, stats);
+
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(pool.TrySubmit([&count]() { count++; }));
+    }
+  }
+
+  // The pending tasks are run before destroyed
+  EXPECT_EQ(count, 1000);
+  EXPECT_EQ(stats.blocking_tasks, 1000);
+  EXPECT_EQ(stats.blocking_rejected, 0);
+  EXPECT_EQ(stats.blocking_queue_length, 0);
+}
+
+TEST(plugin_worker_pool_test, queue_full) {
+  ServerStats stats;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool blocked = false;
+  bool released = false;
+
+  PluginWorkerPool pool(1, 2, stats);
+
+  // Block the only worker
+  pool.TrySubmit([&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    blocked = true;
+    cond.notify_all();
+    cond.wait(lock, [&]() { return released; });
+  });
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return blocked; });
+  }
+
+  EXPECT_TRUE(pool.TrySubmit([]() {}));
+  EXPECT_TRUE(pool.TrySubmit([]() {}));
+  EXPECT_FALSE(pool.TrySubmit([]() {}));
+  EXPECT_EQ(stats.blocking_rejected, 1);
+  EXPECT_EQ(stats.blocking_queue_length, 2);
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    released = true;
+  }
+
+  cond.notify_all();
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
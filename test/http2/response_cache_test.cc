@@ -0,0 +1,135 @@
+#include "http2/response_cache.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+using EntryPtr = ResponseCache::EntryPtr;
+
+static constexpr int64_t kSecond = 1000000;
+
+static ResponseCache::Waiter NoWaiter()
+{
+  return [](EntryPtr const&) { FAIL() << "No waiter is expected"; };
+}
+
+TEST(response_cache_test, key) {
+  std::string key1;
+  std::string key2;
+
+  ResponseCache::MakeKey(HttpMethod::kGet, "/contents/adder", "b=2&a=1", key1);
+  ResponseCache::MakeKey(HttpMethod::kGet, "/contents/adder", "a=1&&b=2&", key2);
+  EXPECT_EQ(key1, "GET /contents/adder?a=1&b=2");
+  EXPECT_EQ(key1, key2);
+
+  ResponseCache::MakeKey(HttpMethod::kPost, "/contents/adder", "a=1&b=2", key2);
+  EXPECT_NE(key1, key2);
+
+  ResponseCache::MakeKey(HttpMethod::kGet, "/contents/adder", "", key2);
+  EXPECT_EQ(key2, "GET /contents/adder");
+
+  // The order of repeated names is kept
+  ResponseCache::MakeKey(HttpMethod::kGet, "/contents/adder", "b=1&a=2&a=1", key1);
+  ResponseCache::MakeKey(HttpMethod::kGet, "/contents/adder", "a=1&b=1&a=2", key2);
+  EXPECT_EQ(key1, "GET /contents/adder?a=2&a=1&b=1");
+  EXPECT_EQ(key2, "GET /contents/adder?a=1&a=2&b=1");
+}
+
+TEST(response_cache_test, hit_and_expire) {
+  ResponseCache cache(1 << 20);
+  EntryPtr entry;
+
+  EXPECT_EQ(cache.Lookup("k", 0, entry, NoWaiter()), ResponseCache::kMiss);
+  cache.Fill("k", "response", 10 * kSecond, 10 * kSecond);
+
+  EXPECT_EQ(cache.Lookup("k", 5 * kSecond, entry, NoWaiter()), ResponseCache::kHit);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry->response, "response");
+
+  // Expired without stale window
+  EXPECT_EQ(cache.Lookup("k", 10 * kSecond, entry, NoWaiter()), ResponseCache::kMiss);
+  EXPECT_EQ(cache.GetEntryNum(), 0);
+}
+
+TEST(response_cache_test, stale_while_revalidate) {
+  ResponseCache cache(1 << 20);
+  EntryPtr entry;
+
+  EXPECT_EQ(cache.Lookup("k", 0, entry, NoWaiter()), ResponseCache::kMiss);
+  cache.Fill("k", "v1", 10 * kSecond, 20 * kSecond);
+
+  // The first stale lookup refreshes it, the others are served the stale one
+  EXPECT_EQ(cache.Lookup("k", 15 * kSecond, entry, NoWaiter()), ResponseCache::kRevalidate);
+  EXPECT_EQ(entry->response, "v1");
+  EXPECT_EQ(cache.Lookup("k", 16 * kSecond, entry, NoWaiter()), ResponseCache::kHit);
+  EXPECT_EQ(entry->response, "v1");
+
+  cache.Fill("k", "v2", 30 * kSecond, 40 * kSecond);
+  EXPECT_EQ(cache.Lookup("k", 17 * kSecond, entry, NoWaiter()), ResponseCache::kHit);
+  EXPECT_EQ(entry->response, "v2");
+}
+
+TEST(response_cache_test, coalesce) {
+  ResponseCache cache(1 << 20);
+  EntryPtr entry;
+  std::vector<std::string> responses;
+
+  auto waiter = [&responses](EntryPtr const& entry) {
+    responses.push_back(entry ? entry->response : "aborted");
+  };
+
+  EXPECT_EQ(cache.Lookup("k", 0, entry, NoWaiter()), ResponseCache::kMiss);
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(cache.Lookup("k", 0, entry, waiter), ResponseCache::kPending);
+  }
+
+  cache.Fill("k", "response", kSecond, kSecond);
+  ASSERT_EQ(responses.size(), 3);
+  EXPECT_EQ(responses[2], "response");
+
+  // Abort
+  responses.clear();
+  EXPECT_EQ(cache.Lookup("other", 0, entry, NoWaiter()), ResponseCache::kMiss);
+  EXPECT_EQ(cache.Lookup("other", 0, entry, waiter), ResponseCache::kPending);
+  cache.Abort("other");
+  ASSERT_EQ(responses.size(), 1);
+  EXPECT_EQ(responses[0], "aborted");
+
+  // The next one retries
+  EXPECT_EQ(cache.Lookup("other", 0, entry, NoWaiter()), ResponseCache::kMiss);
+}
+
+TEST(response_cache_test, evict) {
+  // Each entry costs 1 + 9 bytes
+  ResponseCache cache(30);
+  EntryPtr entry;
+
+  for (char c = 'a'; c <= 'c'; ++c) {
+    std::string key(1, c);
+    cache.Lookup(key, 0, entry, NoWaiter());
+    cache.Fill(key, "123456789", kSecond, kSecond);
+  }
+
+  EXPECT_EQ(cache.GetSize(), 30);
+
+  // a is the most recently used, b is evicted
+  EXPECT_EQ(cache.Lookup("a", 0, entry, NoWaiter()), ResponseCache::kHit);
+  cache.Lookup("d", 0, entry, NoWaiter());
+  cache.Fill("d", "123456789", kSecond, kSecond);
+
+  EXPECT_EQ(cache.GetEntryNum(), 3);
+  EXPECT_EQ(cache.Lookup("a", 0, entry, NoWaiter()), ResponseCache::kHit);
+  EXPECT_EQ(cache.Lookup("b", 0, entry, NoWaiter()), ResponseCache::kMiss);
+
+  // Too large to store
+  cache.Fill("b", std::string(100, 'x'), kSecond, kSecond);
+  EXPECT_EQ(cache.GetEntryNum(), 3);
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
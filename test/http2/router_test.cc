@@ -0,0 +1,123 @@
+#include "http2/router.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+static Route* AddRoute(Router& router, StringView line)
+{
+  std::string error;
+  auto route = router.AddRoute(line, error);
+  EXPECT_TRUE(route) << error;
+  return route;
+}
+
+TEST(router_test, exact) {
+  Router router;
+  auto route = AddRoute(router, "GET,POST /api/add plugin contents/adder");
+
+  EXPECT_EQ(route->kind, Route::kPlugin);
+  EXPECT_EQ(route->target, "contents/adder");
+
+  RouteMatch match;
+  EXPECT_TRUE(router.Match(HttpMethod::kGet, "/api/add", match));
+  EXPECT_EQ(match.route, route);
+  EXPECT_TRUE(router.Match(HttpMethod::kPost, "/api//add/", match));
+  EXPECT_EQ(match.route, route);
+
+  EXPECT_FALSE(router.Match(HttpMethod::kPut, "/api/add", match));
+  EXPECT_FALSE(router.Match(HttpMethod::kGet, "/api", match));
+  EXPECT_FALSE(router.Match(HttpMethod::kGet, "/api/add/1", match));
+  EXPECT_FALSE(match.route);
+}
+
+TEST(router_test, param) {
+  Router router;
+  auto user = AddRoute(router, "GET /api/users/:id plugin contents/user");
+  auto book = AddRoute(router, "GET /api/users/:id/books/:book plugin contents/book");
+  auto me = AddRoute(router, "GET /api/users/me plugin contents/me");
+
+  RouteMatch match;
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/api/users/42", match));
+  EXPECT_EQ(match.route, user);
+  ASSERT_EQ(match.params.size(), 1);
+  EXPECT_EQ(match.params[0].first, "id");
+  EXPECT_EQ(match.params[0].second, "42");
+
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/api/users/42/books/7", match));
+  EXPECT_EQ(match.route, book);
+  ASSERT_EQ(match.params.size(), 2);
+  EXPECT_EQ(match.params[1].first, "book");
+  EXPECT_EQ(match.params[1].second, "7");
+
+  // The static segment takes precedence
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/api/users/me", match));
+  EXPECT_EQ(match.route, me);
+  EXPECT_TRUE(match.params.empty());
+}
+
+TEST(router_test, prefix) {
+  Router router;
+  auto assets = AddRoute(router, "GET /assets/* static /var/www/assets");
+  auto all = AddRoute(router, "* /* plugin contents/fallback");
+  auto logo = AddRoute(router, "GET /assets/logo.png static /var/www/logo.png");
+
+  EXPECT_EQ(assets->kind, Route::kStatic);
+
+  RouteMatch match;
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/assets/css/main.css", match));
+  EXPECT_EQ(match.route, assets);
+  EXPECT_EQ(match.rest, "/css/main.css");
+
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/assets", match));
+  EXPECT_EQ(match.route, assets);
+  EXPECT_TRUE(match.rest.empty());
+
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/assets/logo.png", match));
+  EXPECT_EQ(match.route, logo);
+
+  // Fallback to the shorter prefix
+  ASSERT_TRUE(router.Match(HttpMethod::kPost, "/assets/upload", match));
+  EXPECT_EQ(match.route, all);
+  EXPECT_EQ(match.rest, "/assets/upload");
+}
+
+TEST(router_test, prefix_drops_params) {
+  Router router;
+  auto files = AddRoute(router, "GET /users/:id/files/* static /var/www/files");
+  AddRoute(router, "GET /users/:id/avatar plugin contents/avatar");
+
+  RouteMatch match;
+  ASSERT_TRUE(router.Match(HttpMethod::kGet, "/users/1/files/a/b", match));
+  EXPECT_EQ(match.route, files);
+  EXPECT_EQ(match.rest, "/a/b");
+  ASSERT_EQ(match.params.size(), 1);
+  EXPECT_EQ(match.params[0].second, "1");
+}
+
+TEST(router_test, invalid) {
+  Router router;
+  std::string error;
+
+  EXPECT_FALSE(router.AddRoute("GET /a plugin", error));
+  EXPECT_FALSE(router.AddRoute("FETCH /a plugin contents/a", error));
+  EXPECT_FALSE(router.AddRoute("GET a plugin contents/a", error));
+  EXPECT_FALSE(router.AddRoute("GET /a cgi contents/a", error));
+  EXPECT_FALSE(router.AddRoute("GET /a/*/b static /var/www", error));
+  EXPECT_FALSE(router.AddRoute("GET /a/: plugin contents/a", error));
+
+  EXPECT_TRUE(router.AddRoute("GET /users/:id plugin contents/user", error));
+  EXPECT_FALSE(router.AddRoute("GET /users/:name/x plugin contents/x", error));
+  EXPECT_FALSE(router.AddRoute("GET,POST /users/:id plugin contents/other", error));
+  EXPECT_TRUE(router.AddRoute("POST /users/:id plugin contents/other", error));
+
+  EXPECT_EQ(router.GetSize(), 2);
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,331 @@
+#ifdef KANON_HTTP_TLS
+
+#include "http2/tls_channel.h"
+#include "http2/admission_control.h"
+#include "http2/plugin_worker_pool.h"
+#include "config/http_config.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+/**
+ * Self-signed certificate of localhost, the PEM files are
+ * removed after loaded
+ */
+static TlsContext const& GetContext()
+{
+  static TlsContext context;
+  static bool loaded = false;
+
+  if (loaded) return context;
+
+  EVP_PKEY* key = nullptr;
+  auto key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  EVP_PKEY_keygen_init(key_ctx);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(key_ctx, &key);
+  EVP_PKEY_CTX_free(key_ctx);
+
+  auto cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+
+  auto name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             reinterpret_cast<unsigned char const*>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  char cert_path[] = "/tmp/kanon_tls_cert_XXXXXX";
+  char key_path[] = "/tmp/kanon_tls_key_XXXXXX";
+  ::close(::mkstemp(cert_path));
+  ::close(::mkstemp(key_path));
+
+  auto fp = ::fopen(cert_path, "w");
+  PEM_write_X509(fp, cert);
+  ::fclose(fp);
+
+  fp = ::fopen(key_path, "w");
+  PEM_write_PrivateKey(fp, key, nullptr, nullptr, 0, nullptr, nullptr);
+  ::fclose(fp);
+
+  loaded = context.Load(cert_path, key_path, 300, false);
+
+  ::unlink(cert_path);
+  ::unlink(key_path);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+
+  EXPECT_TRUE(loaded);
+  return context;
+}
+
+/** The client talks to the channel over memory BIOs */
+struct TestClient {
+  explicit TestClient(SSL_SESSION* session = nullptr)
+  {
+    ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_alpn_protos(ctx, reinterpret_cast<unsigned char const*>("\x02h2\x08http/1.1"), 12);
+
+    ssl = SSL_new(ctx);
+    in = BIO_new(BIO_s_mem());
+    out = BIO_new(BIO_s_mem());
+    SSL_set_bio(ssl, in, out);
+    SSL_set_connect_state(ssl);
+
+    if (session) {
+      SSL_set_session(ssl, session);
+    }
+  }
+
+  ~TestClient()
+  {
+    // The session is not resumable if closed without close_notify
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+  }
+
+  /** Move the records sent by the client to the input buffer of server */
+  void Flush(Buffer& input)
+  {
+    char buf[4096];
+    int n;
+
+    while ((n = BIO_read(out, buf, sizeof buf)) > 0) {
+      input.Append(buf, n);
+    }
+  }
+
+  void Receive(std::string& records)
+  {
+    BIO_write(in, records.data(), records.size());
+    records.clear();
+  }
+
+  std::string Read()
+  {
+    std::string data;
+    char buf[4096];
+    int n;
+
+    while ((n = SSL_read(ssl, buf, sizeof buf)) > 0) {
+      data.append(buf, n);
+    }
+
+    return data;
+  }
+
+  SSL_CTX* ctx;
+  SSL* ssl;
+  BIO* in;
+  BIO* out;
+};
+
+struct TestServer {
+  TestServer()
+    : channel(std::make_shared<TlsChannel>(GetContext(), -1, [this](StringView data) {
+        output.append(data.data(), data.size());
+        return true;
+      }))
+  {
+  }
+
+  /** \return false if failed */
+  bool Handshake(TestClient& client)
+  {
+    for (int i = 0; i < 8; ++i) {
+      const int ret = SSL_do_handshake(client.ssl);
+      client.Flush(input);
+
+      if (!channel->OnMessage(input)) return false;
+
+      client.Receive(output);
+
+      if (ret == 1 && channel->IsHandshakeDone()) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  TlsChannelPtr channel;
+  Buffer input;
+  std::string output;
+};
+
+TEST(tls_channel_test, handshake) {
+  g_config.enable_http2 = true;
+
+  TestClient client;
+  TestServer server;
+  ASSERT_TRUE(server.Handshake(client));
+
+  EXPECT_FALSE(server.channel->IsSessionReused());
+  EXPECT_FALSE(server.channel->IsKernelOffload());
+  EXPECT_EQ(server.channel->GetAlpn(), "h2");
+
+  // The request
+  std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  ASSERT_EQ(SSL_write(client.ssl, request.data(), request.size()), (int)request.size());
+  client.Flush(server.input);
+
+  // The incomplete record is kept by the channel
+  Buffer partial;
+  partial.Append(server.input.ToStringView().substr(0, 10));
+  server.input.AdvanceRead(10);
+  EXPECT_TRUE(server.channel->OnMessage(partial));
+  EXPECT_FALSE(partial.HasReadable());
+  EXPECT_FALSE(server.channel->GetInputBuffer().HasReadable());
+
+  ASSERT_TRUE(server.channel->OnMessage(server.input));
+  EXPECT_FALSE(server.input.HasReadable());
+  EXPECT_EQ(server.channel->GetInputBuffer().ToStringView(), request);
+
+  // The response
+  std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  server.channel->Send(response);
+  EXPECT_EQ(server.output.find("HTTP/1.1"), std::string::npos);
+  client.Receive(server.output);
+  EXPECT_EQ(client.Read(), response);
+}
+
+TEST(tls_channel_test, alpn) {
+  g_config.enable_http2 = false;
+
+  TestClient client;
+  TestServer server;
+  ASSERT_TRUE(server.Handshake(client));
+  EXPECT_EQ(server.channel->GetAlpn(), "http/1.1");
+
+  g_config.enable_http2 = true;
+}
+
+TEST(tls_channel_test, early_output) {
+  TestClient client;
+  TestServer server;
+
+  // Queued until the handshake is done
+  server.channel->Send("early");
+  ASSERT_TRUE(server.Handshake(client));
+
+  client.Receive(server.output);
+  EXPECT_EQ(client.Read(), "early");
+}
+
+TEST(tls_channel_test, resumption) {
+  SSL_SESSION* session = nullptr;
+
+  {
+    TestClient client;
+    TestServer server;
+    ASSERT_TRUE(server.Handshake(client));
+
+    // Receive the session ticket
+    client.Read();
+    session = SSL_get1_session(client.ssl);
+    ASSERT_TRUE(session);
+    ASSERT_TRUE(SSL_SESSION_has_ticket(session));
+  }
+
+  // Resumed by the ticket in a new connection
+  TestClient client(session);
+  TestServer server;
+  ASSERT_TRUE(server.Handshake(client));
+  EXPECT_TRUE(server.channel->IsSessionReused());
+  EXPECT_TRUE(SSL_session_reused(client.ssl));
+
+  SSL_SESSION_free(session);
+}
+
+// The session answers the request of blocking plugin with 503 if the
+// queue of workers is full, it must be encrypted and closed by close_notify
+TEST(tls_channel_test, queue_full) {
+  TestClient client;
+  TestServer server;
+  ASSERT_TRUE(server.Handshake(client));
+
+  ServerStats stats;
+  AdmissionControl admission(stats);
+  PluginWorkerPool workers(1, 1, stats);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool blocked = false;
+  bool released = false;
+
+  // Block the only worker
+  ASSERT_TRUE(workers.TrySubmit([&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    blocked = true;
+    cond.notify_all();
+    cond.wait(lock, [&]() { return released; });
+  }));
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return blocked; });
+  }
+
+  ASSERT_TRUE(workers.TrySubmit([]() {}));
+  ASSERT_FALSE(workers.TrySubmit([]() {}));
+
+  // Same as HttpSession::ServeBlockingContent()
+  server.channel->Send(admission.GetUnavailableResponse());
+  server.channel->Shutdown();
+
+  EXPECT_EQ(server.output.find("HTTP/1.1 503"), std::string::npos);
+  client.Receive(server.output);
+
+  const auto response = client.Read();
+  EXPECT_EQ(response, admission.GetUnavailableResponse());
+  EXPECT_EQ(response.find("HTTP/1.1 503"), 0);
+  EXPECT_TRUE(SSL_get_shutdown(client.ssl) & SSL_RECEIVED_SHUTDOWN);
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    released = true;
+  }
+  cond.notify_all();
+}
+
+TEST(tls_channel_test, invalid_record) {
+  TestServer server;
+
+  // A handshake record of garbage
+  static char const kRecord[] = "\x16\x03\x01\x00\x05hello";
+  server.input.Append(kRecord, sizeof(kRecord) - 1);
+  EXPECT_FALSE(server.channel->OnMessage(server.input));
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
+
+#else
+
+int main() {
+  return 0;
+}
+
+#endif // KANON_HTTP_TLS
@@ -0,0 +1,167 @@
+#include "http2/websocket_codec.h"
+
+#include <gtest/gtest.h>
+
+using namespace http;
+using namespace kanon;
+
+TEST(websocket_codec_test, accept_key) {
+  // The example of RFC 6455
+  EXPECT_EQ(WebSocketCodec::GetAcceptKey("dGhlIHNhbXBsZSBub25jZQ=="),
+            "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+TEST(websocket_codec_test, masked) {
+  const char mask[4] = { 0x37, static_cast<char>(0xfa), 0x21, 0x3d };
+  std::string out;
+  WebSocketCodec::AppendFrame(out, WebSocketCodec::kText, "Hello, WebSocket!", true, mask);
+
+  WebSocketCodec::Frame frame;
+  size_t consumed = 0;
+
+  // Incomplete
+  for (size_t i = 0; i < out.size(); ++i) {
+    EXPECT_EQ(WebSocketCodec::Parse(StringView(out.data(), i), 1024, frame, consumed),
+              WebSocketCodec::kShort);
+  }
+
+  ASSERT_EQ(WebSocketCodec::Parse(out, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_TRUE(frame.fin);
+  EXPECT_TRUE(frame.masked);
+  EXPECT_EQ(frame.opcode, WebSocketCodec::kText);
+  EXPECT_EQ(consumed, out.size());
+  EXPECT_NE(frame.payload, "Hello, WebSocket!");
+
+  std::string payload;
+  WebSocketCodec::AppendPayload(frame, payload);
+  EXPECT_EQ(payload, "Hello, WebSocket!");
+}
+
+TEST(websocket_codec_test, length) {
+  WebSocketCodec::Frame frame;
+  size_t consumed = 0;
+
+  for (size_t size : { 125, 126, 65535, 65536, 100000 }) {
+    std::string data(size, 'a');
+    std::string out;
+    WebSocketCodec::AppendFrame(out, WebSocketCodec::kBinary, data);
+
+    const size_t header_size = size < 126 ? 2 : size <= 65535 ? 4 : 10;
+    EXPECT_EQ(out.size(), header_size + size);
+
+    ASSERT_EQ(WebSocketCodec::Parse(out, 1 << 20, frame, consumed), WebSocketCodec::kGood);
+    EXPECT_FALSE(frame.masked);
+    EXPECT_EQ(frame.payload.size(), size);
+    EXPECT_EQ(consumed, out.size());
+
+    EXPECT_EQ(WebSocketCodec::Parse(out, size - 1, frame, consumed), WebSocketCodec::kTooBig);
+  }
+
+  // The most significant bit of 64-bit length
+  std::string out("\x82\x7f\x80\0\0\0\0\0\0\0", 10);
+  EXPECT_EQ(WebSocketCodec::Parse(out, 1 << 20, frame, consumed), WebSocketCodec::kBad);
+}
+
+TEST(websocket_codec_test, invalid) {
+  WebSocketCodec::Frame frame;
+  size_t consumed = 0;
+
+  // RSV1
+  EXPECT_EQ(WebSocketCodec::Parse(StringView("\xc1\x00", 2), 1024, frame, consumed),
+            WebSocketCodec::kBad);
+  // Unknown opcode
+  EXPECT_EQ(WebSocketCodec::Parse(StringView("\x83\x00", 2), 1024, frame, consumed),
+            WebSocketCodec::kBad);
+  // Fragmented ping
+  EXPECT_EQ(WebSocketCodec::Parse(StringView("\x09\x00", 2), 1024, frame, consumed),
+            WebSocketCodec::kBad);
+  // Ping larger than 125 bytes
+  EXPECT_EQ(WebSocketCodec::Parse(StringView("\x89\x7e\x00\x7e", 4), 1024, frame, consumed),
+            WebSocketCodec::kBad);
+}
+
+TEST(websocket_codec_test, fragment) {
+  std::string out;
+  WebSocketCodec::AppendFrame(out, WebSocketCodec::kText, "Hel", false);
+  WebSocketCodec::AppendFrame(out, WebSocketCodec::kPing, "ping");
+  WebSocketCodec::AppendFrame(out, WebSocketCodec::kContinuation, "lo");
+
+  WebSocketCodec::Frame frame;
+  size_t consumed = 0;
+  StringView rest(out);
+
+  ASSERT_EQ(WebSocketCodec::Parse(rest, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_FALSE(frame.fin);
+  EXPECT_EQ(frame.opcode, WebSocketCodec::kText);
+  EXPECT_EQ(frame.payload, "Hel");
+  rest.remove_prefix(consumed);
+
+  ASSERT_EQ(WebSocketCodec::Parse(rest, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_TRUE(frame.fin);
+  EXPECT_EQ(frame.opcode, WebSocketCodec::kPing);
+  EXPECT_EQ(frame.payload, "ping");
+  rest.remove_prefix(consumed);
+
+  ASSERT_EQ(WebSocketCodec::Parse(rest, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_TRUE(frame.fin);
+  EXPECT_EQ(frame.opcode, WebSocketCodec::kContinuation);
+  EXPECT_EQ(frame.payload, "lo");
+  EXPECT_EQ(consumed, rest.size());
+}
+
+TEST(websocket_codec_test, close) {
+  std::string out;
+  WebSocketCodec::AppendClose(out, WebSocketCodec::kGoingAway, "bye");
+
+  WebSocketCodec::Frame frame;
+  size_t consumed = 0;
+  ASSERT_EQ(WebSocketCodec::Parse(out, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_EQ(frame.opcode, WebSocketCodec::kClose);
+
+  uint16_t code;
+  StringView reason;
+  ASSERT_TRUE(WebSocketCodec::ParseClose(frame.payload, code, reason));
+  EXPECT_EQ(code, WebSocketCodec::kGoingAway);
+  EXPECT_EQ(reason, "bye");
+
+  EXPECT_TRUE(WebSocketCodec::ParseClose(StringView(), code, reason));
+  EXPECT_EQ(code, WebSocketCodec::kNoStatus);
+
+  EXPECT_TRUE(WebSocketCodec::ParseClose(StringView("\x0f\xa0", 2), code, reason));
+  EXPECT_EQ(code, 4000);
+
+  EXPECT_FALSE(WebSocketCodec::ParseClose(StringView("\x03", 1), code, reason));
+  // 1005 and 999 are not allowed to be sent
+  EXPECT_FALSE(WebSocketCodec::ParseClose(StringView("\x03\xed", 2), code, reason));
+  EXPECT_FALSE(WebSocketCodec::ParseClose(StringView("\x03\xe7", 2), code, reason));
+  EXPECT_FALSE(WebSocketCodec::ParseClose(StringView("\x03\xe8\xff", 3), code, reason));
+
+  // The reason is truncated
+  out.clear();
+  WebSocketCodec::AppendClose(out, WebSocketCodec::kNormalClosure, std::string(200, 'a'));
+  ASSERT_EQ(WebSocketCodec::Parse(out, 1024, frame, consumed), WebSocketCodec::kGood);
+  EXPECT_EQ(frame.payload.size(), WebSocketCodec::kMaxControlPayload);
+}
+
+TEST(websocket_codec_test, utf8) {
+  EXPECT_TRUE(WebSocketCodec::IsValidUtf8(""));
+  EXPECT_TRUE(WebSocketCodec::IsValidUtf8("Hello, WebSocket!"));
+  EXPECT_TRUE(WebSocketCodec::IsValidUtf8("\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5"));
+  EXPECT_TRUE(WebSocketCodec::IsValidUtf8("\xf4\x8f\xbf\xbf"));
+
+  // Overlong
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("\xc0\xaf"));
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("\xe0\x80\xaf"));
+  // Surrogate
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("\xed\xa0\x80"));
+  // Larger than U+10FFFF
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("\xf4\x90\x80\x80"));
+  // Truncated
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("abcdefgh\xce"));
+  EXPECT_FALSE(WebSocketCodec::IsValidUtf8("\xe1\xbd"));
+}
+
+int main() {
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
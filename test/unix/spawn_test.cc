@@ -0,0 +1,67 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <gtest/gtest.h>
+
+#include "unix/pipe.h"
+#include "unix/process.h"
+
+using namespace unix;
+
+TEST(spawn_test, redirect) {
+  Pipe to_child(O_CLOEXEC);
+  Pipe from_child(O_CLOEXEC);
+
+  FileActions actions;
+  actions.RedirectReadEnd(to_child, STDIN_FILENO);
+  actions.RedirectWriteEnd(from_child, STDOUT_FILENO);
+
+  char* argv[] = { (char*)"cat", NULL };
+  char* envp[] = { NULL };
+
+  Process process{};
+  const bool spawned = process.Spawn("/bin/cat", argv, envp, &actions);
+  ASSERT_TRUE(spawned);
+  ASSERT_GT(process.GetPid(), 0);
+
+  to_child.CloseReadEnd();
+  from_child.CloseWriteEnd();
+
+  to_child.Write("parent send to child\n");
+  to_child.CloseWriteEnd();
+
+  // Both ends are close-on-exec, the cat gets EOF after
+  // the write end of parent is closed
+  char buf[4096];
+  memset(buf, 0, sizeof buf);
+  const auto readn = from_child.Read(buf);
+
+  // The terminator is also written
+  EXPECT_EQ(readn, sizeof("parent send to child\n"));
+  EXPECT_STREQ(buf, "parent send to child\n");
+
+  int status = 0;
+  const auto pid = ::waitpid(process.GetPid(), &status, 0);
+  ASSERT_EQ(pid, process.GetPid());
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST(spawn_test, not_found) {
+  char* argv[] = { (char*)"nonexistent", NULL };
+
+  Process bad{};
+  const bool spawned = bad.Spawn("/nonexistent", argv);
+  const int saved_errno = errno;
+
+  EXPECT_FALSE(spawned);
+  EXPECT_EQ(saved_errno, ENOENT);
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
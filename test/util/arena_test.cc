@@ -0,0 +1,101 @@
+#include "util/arena.h"
+#include "common/parse_args.h"
+#include "common/types.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+TEST(arena_test, align) {
+  Arena arena;
+
+  arena.Allocate(1, 1);
+  auto p = arena.Allocate(sizeof(uint64_t), alignof(uint64_t));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(uint64_t), 0);
+
+  arena.Allocate(3, 1);
+  p = arena.Allocate(16, 16);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 16, 0);
+}
+
+TEST(arena_test, reset) {
+  Arena arena(128);
+
+  auto first = arena.Allocate(64);
+  arena.Allocate(32);
+  EXPECT_EQ(arena.GetUsed(), 96);
+
+  arena.Reset();
+  EXPECT_EQ(arena.GetUsed(), 0);
+
+  // The block is reused
+  EXPECT_EQ(arena.Allocate(64), first);
+}
+
+TEST(arena_test, large) {
+  Arena arena(128);
+
+  // Allocate multiple blocks
+  for (int i = 0; i < 10; ++i) {
+    arena.Allocate(100);
+  }
+
+  auto large = static_cast<char*>(arena.Allocate(4096));
+  large[4095] = 'a';
+
+  arena.Reset();
+
+  // The blocks are merged to one block, so the same usage
+  // in the next round is served by it
+  auto first = static_cast<char*>(arena.Allocate(100));
+  for (int i = 0; i < 9; ++i) {
+    auto p = static_cast<char*>(arena.Allocate(100));
+    EXPECT_GT(p, first);
+    EXPECT_LT(p, first + 1000 + 4096 + 128 * 10);
+  }
+}
+
+TEST(arena_test, container) {
+  Arena arena;
+
+  {
+    std::vector<int, ArenaAllocator<int>> vec{ArenaAllocator<int>(&arena)};
+
+    for (int i = 0; i < 100; ++i) {
+      vec.push_back(i);
+    }
+
+    EXPECT_EQ(vec[99], 99);
+    EXPECT_GE(arena.GetUsed(), 100 * sizeof(int));
+  }
+
+  arena.Reset();
+
+  auto args = ParseArgs("a=100&b=102&name=a_long_value_exceeds_the_sso_buffer", &arena);
+  EXPECT_EQ(args.size(), 3);
+  EXPECT_EQ(args.find("a")->second, "100");
+  EXPECT_EQ(args.find("b")->second, "102");
+  EXPECT_EQ(args.find("name")->second, "a_long_value_exceeds_the_sso_buffer");
+  EXPECT_EQ(args.GetArena(), &arena);
+  EXPECT_GT(arena.GetUsed(), 0);
+}
+
+TEST(arena_test, null_arena) {
+  // Fallback to the own arena
+  auto args = ParseArgs("a=100&b=102");
+  EXPECT_NE(args.GetArena(), nullptr);
+  EXPECT_EQ(args.find("b")->second, "102");
+
+  ArgsMap moved = std::move(args);
+  EXPECT_EQ(moved.find("a")->second, "100");
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,157 @@
+#include "util/object_pool.h"
+#include "util/free_list_allocator.h"
+#include "http2/http_request.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <gtest/gtest.h>
+
+using namespace http;
+
+/**
+ * Count the allocations of the global allocator,
+ * then we can know if the pools bypass it.
+ */
+static std::atomic<size_t> g_alloc_count{0};
+
+void* operator new(size_t size)
+{
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  auto p = std::malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+static size_t GetAllocCount() noexcept
+{
+  return g_alloc_count.load(std::memory_order_relaxed);
+}
+
+// Mimic the session, the enable_shared_from_this must work
+// when the object is reused
+struct Session : std::enable_shared_from_this<Session> {
+  Arena arena;
+  HttpRequest request;
+  char payload[512];
+
+  Session() { request.Reset(&arena); }
+
+  void Reset() noexcept
+  {
+    request.Reset(&arena);
+    arena.Reset();
+  }
+};
+
+static std::shared_ptr<Session> CreateSession()
+{
+  using Pool = ObjectPool<Session>;
+
+  return std::shared_ptr<Session>(Pool::GetLocal().AcquireRaw(),
+                                  Pool::Releaser(),
+                                  FreeListAllocator<Session>());
+}
+
+static void FillRequest(HttpRequest& request)
+{
+  request.url = "/root/kanon/example/http/html/index.html";
+  request.query = "a=100&b=102&c=this_is_a_long_value_exceeds_sso";
+  request.body.assign(1024, 'x');
+  request.method = HttpMethod::kGet;
+  request.version = HttpVersion::kHttp11;
+}
+
+static constexpr int kRound = 100000;
+
+TEST(object_pool_test, reuse) {
+  auto& pool = ObjectPool<HttpRequest>::GetLocal();
+
+  auto first = pool.Acquire();
+  auto addr = first.get();
+  FillRequest(*first);
+  first.reset();
+
+  EXPECT_EQ(pool.GetCachedNum(), 1);
+
+  auto second = pool.Acquire();
+  EXPECT_EQ(second.get(), addr);
+  EXPECT_TRUE(second->url.empty());
+  EXPECT_TRUE(second->body.empty());
+  EXPECT_EQ(second->method, HttpMethod::kNotSupport);
+}
+
+TEST(object_pool_test, shared_from_this) {
+  std::weak_ptr<Session> old;
+
+  {
+    auto session = CreateSession();
+    old = session->shared_from_this();
+  }
+
+  // The old reference is expired even though the object is reused
+  auto session = CreateSession();
+  EXPECT_TRUE(old.expired());
+  EXPECT_EQ(session->shared_from_this(), session);
+}
+
+TEST(object_pool_test, no_alloc_after_warm_up) {
+  // Warm up
+  for (int i = 0; i < 2; ++i) {
+    auto session = CreateSession();
+    FillRequest(session->request);
+    std::weak_ptr<Session> wp(session);
+  }
+
+  const auto before = GetAllocCount();
+
+  for (int i = 0; i < kRound; ++i) {
+    auto session = CreateSession();
+    FillRequest(session->request);
+    std::weak_ptr<Session> wp(session);
+  }
+
+  EXPECT_EQ(GetAllocCount() - before, 0);
+}
+
+// Compare with std::make_shared + fresh request
+TEST(object_pool_test, fewer_allocs_than_make_shared) {
+  auto before = GetAllocCount();
+
+  for (int i = 0; i < kRound; ++i) {
+    auto session = std::make_shared<Session>();
+    FillRequest(session->request);
+  }
+
+  const auto make_shared_allocs = GetAllocCount() - before;
+
+  before = GetAllocCount();
+
+  for (int i = 0; i < kRound; ++i) {
+    auto session = CreateSession();
+    FillRequest(session->request);
+  }
+
+  const auto pool_allocs = GetAllocCount() - before;
+
+  EXPECT_LT(pool_allocs, make_shared_allocs);
+}
+
+int main()
+{
+  ::testing::InitGoogleTest();
+
+  return RUN_ALL_TESTS();
+}